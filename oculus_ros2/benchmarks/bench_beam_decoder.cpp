@@ -0,0 +1,32 @@
+#include <benchmark/benchmark.h>
+
+#include "beam_decoder.h"
+#include "bench_utils.h"
+#include "cpu_features.h"
+
+// Float gain compensated decoding of a whole ping, with the portable (avx2 0)
+// or the AVX2 kernel (avx2 1, when the CPU supports it).
+static void BM_BeamDecoder_Decode(benchmark::State& state)
+{
+    oculus::set_avx2_enabled(state.range(4));
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1),
+                                         state.range(2), state.range(3));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+
+    oculus::BeamDecoder decoder;
+    std::vector<float> output;
+    decoder.decode(metadata, data, output);
+
+    for(auto _ : state) {
+        decoder.decode(metadata, data, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["pings_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(state.iterations()*data.size());
+    oculus::set_avx2_enabled(true);
+}
+
+// nbeams, nranges, 16 bits, gain, avx2
+BENCHMARK(BM_BeamDecoder_Decode)->ArgsProduct({{256, 512}, {512, 1024, 2048}, {0, 1}, {0, 1}, {0, 1}});
+
+BENCHMARK_MAIN();
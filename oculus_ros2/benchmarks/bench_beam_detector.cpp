@@ -0,0 +1,36 @@
+#include <benchmark/benchmark.h>
+
+#include "beam_detector.h"
+#include "bench_utils.h"
+#include "cpu_features.h"
+
+// Per-beam detection of a whole ping, points included. Arguments : nbeams,
+// nranges, 16 bits, mode (1 first return, 2 peak, 3 both), threads, avx2
+// (0 for the portable kernel).
+static void BM_BeamDetector_Detect(benchmark::State& state)
+{
+    oculus::set_avx2_enabled(state.range(5));
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+
+    oculus::BeamDetector::Options options;
+    options.mode      = static_cast<oculus::BeamDetector::Mode>(state.range(3));
+    options.threshold = 0.3f;
+    options.threads   = state.range(4);
+    oculus::BeamDetector detector(options);
+    std::vector<oculus::BeamDetector::Point> points(detector.max_points(metadata.nBeams));
+
+    size_t count = 0;
+    for(auto _ : state) {
+        count = detector.detect(metadata, data, points.data());
+        benchmark::DoNotOptimize(points.data());
+    }
+    state.counters["pings_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.counters["points"] = count;
+    oculus::set_avx2_enabled(true);
+}
+
+BENCHMARK(BM_BeamDetector_Detect)->ArgsProduct({{256, 512}, {1024}, {0, 1}, {1, 3}, {1, 4}, {0, 1}})
+                                 ->UseRealTime();
+
+BENCHMARK_MAIN();
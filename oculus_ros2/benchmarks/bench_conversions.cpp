@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cstring>
+
+#include <benchmark/benchmark.h>
+
+#include "rclcpp/serialization.hpp"
+#include "rclcpp/serialized_message.hpp"
+#include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+
+#include "conversions.h"
+#include "bench_utils.h"
+
+// Conversion and serialization costs on the ping path. Runs headless : no
+// ROS context, no sonar and no network needed.
+
+using StampedPing = oculus_interfaces::msg::OculusStampedPing;
+
+static void BM_CopyToRos_Status(benchmark::State& state)
+{
+    OculusStatusMsg status;
+    std::memset(&status, 0, sizeof(status));
+    oculus_interfaces::msg::OculusStatus msg;
+    for(auto _ : state) {
+        oculus::copy_to_ros(msg, status);
+        benchmark::DoNotOptimize(msg);
+    }
+}
+
+static void BM_CopyToRos_FireConfig(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(256, 512, false);
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+    oculus_interfaces::msg::OculusFireConfig msg;
+    for(auto _ : state) {
+        oculus::copy_to_ros(msg, metadata.fireMessage);
+        benchmark::DoNotOptimize(msg);
+    }
+}
+
+static void BM_CopyToRos_PingMetadata(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(256, 512, false);
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+    oculus_interfaces::msg::OculusPing msg;
+    for(auto _ : state) {
+        oculus::copy_to_ros(msg, metadata);
+        benchmark::DoNotOptimize(msg);
+    }
+}
+
+// Metadata and data copy of publish_ping (fill_ping_message), the message
+// buffer being reused between pings as in the node.
+static void BM_CopyToRos_PingData(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2), state.range(3));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+    StampedPing msg;
+    for(auto _ : state) {
+        oculus::copy_to_ros(msg.ping, metadata, data);
+        benchmark::DoNotOptimize(msg.ping.data.data());
+    }
+    state.SetBytesProcessed(state.iterations()*data.size());
+}
+
+// Same, the slot buffer being swapped into the message (publish_ping when the
+// raw ping is the last output reading it).
+static void BM_MoveToRos_PingData(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2), state.range(3));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+    StampedPing msg;
+    for(auto _ : state) {
+        oculus::move_to_ros(msg.ping, metadata, data);
+        benchmark::DoNotOptimize(msg.ping.data.data());
+    }
+    state.SetBytesProcessed(state.iterations()*msg.ping.data.size());
+}
+
+static void BM_ToRosStamp(benchmark::State& state)
+{
+    auto stamp = std::chrono::system_clock::now();
+    for(auto _ : state) {
+        builtin_interfaces::msg::Time msg = oculus::to_ros_stamp(stamp);
+        benchmark::DoNotOptimize(msg);
+        stamp += std::chrono::microseconds(1);
+    }
+}
+
+// CDR serialization done by the middleware for inter-process subscribers.
+static void BM_Serialize_StampedPing(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2), state.range(3));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+    StampedPing msg;
+    oculus::copy_to_ros(msg.ping, metadata, data);
+
+    rclcpp::Serialization<StampedPing> serialization;
+    rclcpp::SerializedMessage serialized;
+    for(auto _ : state) {
+        serialization.serialize_message(&msg, &serialized);
+        benchmark::DoNotOptimize(serialized.get_rcl_serialized_message().buffer);
+    }
+    state.counters["serialized_bytes"] = serialized.size();
+    state.SetBytesProcessed(state.iterations()*data.size());
+}
+
+static void BM_Deserialize_StampedPing(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2), state.range(3));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+    StampedPing msg;
+    oculus::copy_to_ros(msg.ping, metadata, data);
+
+    rclcpp::Serialization<StampedPing> serialization;
+    rclcpp::SerializedMessage serialized;
+    serialization.serialize_message(&msg, &serialized);
+    StampedPing output;
+    for(auto _ : state) {
+        serialization.deserialize_message(&serialized, &output);
+        benchmark::DoNotOptimize(output.ping.data.data());
+    }
+    state.SetBytesProcessed(state.iterations()*data.size());
+}
+
+// nbeams, nranges (short to long range), 16 bits, gain
+#define PING_ARGS ArgsProduct({{256, 512}, {128, 256, 512, 1024, 2048}, {0, 1}, {0, 1}})
+
+BENCHMARK(BM_CopyToRos_Status);
+BENCHMARK(BM_CopyToRos_FireConfig);
+BENCHMARK(BM_CopyToRos_PingMetadata);
+BENCHMARK(BM_CopyToRos_PingData)->PING_ARGS;
+BENCHMARK(BM_MoveToRos_PingData)->PING_ARGS;
+BENCHMARK(BM_ToRosStamp);
+BENCHMARK(BM_Serialize_StampedPing)->PING_ARGS;
+BENCHMARK(BM_Deserialize_StampedPing)->PING_ARGS;
+
+BENCHMARK_MAIN();
@@ -0,0 +1,90 @@
+#include <cstdlib>
+#include <iostream>
+
+#include <benchmark/benchmark.h>
+
+#include "ping_codec.h"
+#include "log_reader.h"
+#include "bench_utils.h"
+
+// Pings compressed in the benchmarks. Taken from the .oculus log given in the
+// OCULUS_BENCH_LOG environment variable if set (compression ratios are only
+// meaningful on recorded data, synthetic pings are random noise).
+static const std::vector<std::vector<uint8_t>>& bench_pings(unsigned int nBeams, bool use16Bits)
+{
+    static std::vector<std::vector<uint8_t>> pings;
+    pings.clear();
+
+    const char* filename = std::getenv("OCULUS_BENCH_LOG");
+    if(filename) {
+        static oculus::LogReader reader(filename);
+        for(const auto& item : reader.items()) {
+            auto header = reinterpret_cast<const OculusMessageHeader*>(item.data);
+            if(item.size < sizeof(OculusSimplePingResult) || header->msgId != messageSimplePingResult)
+                continue;
+            pings.emplace_back(item.data, item.data + item.size);
+            if(pings.size() >= 256)
+                break;
+        }
+        if(!pings.empty())
+            return pings;
+        std::cerr << "No ping in '" << filename << "', using synthetic pings." << std::endl;
+    }
+    for(unsigned int i = 0; i < 16; i++) {
+        pings.push_back(oculus::bench::make_ping(nBeams, 1024, use16Bits, true, i));
+    }
+    return pings;
+}
+
+static void BM_PingCodec_Compress(benchmark::State& state)
+{
+    const auto& pings = bench_pings(state.range(0), state.range(1));
+    oculus::PingCodec::Options options;
+    options.level             = state.range(2);
+    options.quantization_bits = state.range(3);
+    oculus::PingCodec codec(options);
+
+    std::vector<uint8_t> output;
+    size_t index = 0, rawBytes = 0, compressedBytes = 0;
+    for(auto _ : state) {
+        const auto& data = pings[index++ % pings.size()];
+        codec.compress(*reinterpret_cast<const OculusSimplePingResult*>(data.data()), data, output);
+        rawBytes        += data.size();
+        compressedBytes += output.size();
+    }
+    state.counters["ratio"] = static_cast<double>(rawBytes) / compressedBytes;
+    state.counters["pings_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(rawBytes);
+}
+
+static void BM_PingCodec_Decompress(benchmark::State& state)
+{
+    const auto& pings = bench_pings(state.range(0), state.range(1));
+    oculus::PingCodec::Options options;
+    options.level             = state.range(2);
+    options.quantization_bits = state.range(3);
+    oculus::PingCodec codec(options);
+
+    std::vector<std::vector<uint8_t>> compressed(pings.size());
+    for(size_t i = 0; i < pings.size(); i++) {
+        codec.compress(*reinterpret_cast<const OculusSimplePingResult*>(pings[i].data()),
+                       pings[i], compressed[i]);
+    }
+
+    std::vector<uint8_t> output;
+    size_t index = 0, rawBytes = 0;
+    for(auto _ : state) {
+        const auto& data = compressed[index++ % compressed.size()];
+        codec.decompress(data.data(), data.size(), output);
+        rawBytes += output.size();
+    }
+    state.counters["pings_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(rawBytes);
+}
+
+// nbeams, 16 bits (synthetic pings only), zstd level, quantization bits
+BENCHMARK(BM_PingCodec_Compress)->ArgsProduct({{256, 512}, {0, 1}, {1, 3, 9}, {0}});
+BENCHMARK(BM_PingCodec_Compress)->ArgsProduct({{512}, {1}, {1}, {6, 8, 10}});
+BENCHMARK(BM_PingCodec_Decompress)->ArgsProduct({{256, 512}, {0, 1}, {1}, {0}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,178 @@
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include <benchmark/benchmark.h>
+
+#include "rclcpp/rclcpp.hpp"
+#include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+
+#include "conversions.h"
+#include "message_pool.h"
+#include "bench_utils.h"
+
+// Counts every heap allocation made by the process so the benchmarks can
+// report allocations per ping.
+static std::atomic<size_t> allocationCount(0);
+
+void* operator new(std::size_t size)
+{
+    allocationCount++;
+    if(void* ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+using StampedPing = oculus_interfaces::msg::OculusStampedPing;
+
+static void report(benchmark::State& state, size_t allocations, size_t bytesCopied)
+{
+    state.counters["allocs_per_ping"] = benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+    state.counters["bytes_copied_per_ping"] = benchmark::Counter(bytesCopied, benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(bytesCopied);
+}
+
+// Reproduces the former OculusSonarNode::publish_ping : function static
+// message filled one byte at a time then published by reference. With
+// intra-process enabled rclcpp copies the whole message again.
+static void BM_PublishPing_Legacy(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+
+    auto node = std::make_shared<rclcpp::Node>("bench_legacy",
+        rclcpp::NodeOptions().use_intra_process_comms(true));
+    auto publisher = node->create_publisher<StampedPing>("ping", 10);
+    auto subscription = node->create_subscription<StampedPing>("ping", 10,
+        [](StampedPing::ConstSharedPtr) {});
+
+    static StampedPing msg;
+    size_t allocations = 0, bytesCopied = 0;
+    for(auto _ : state) {
+        size_t start = allocationCount;
+        oculus::copy_to_ros(msg.ping, metadata);
+        msg.ping.data.resize(data.size());
+        for(unsigned int i = 0; i < msg.ping.data.size(); i++)
+            msg.ping.data[i] = data[i];
+        publisher->publish(msg);
+        allocations += allocationCount - start;
+        bytesCopied += 2*data.size(); // byte loop + intra-process copy
+    }
+    report(state, allocations, bytesCopied);
+}
+
+// Former unique_ptr path : one memcpy from the driver buffer, ownership is
+// moved to the intra-process subscribers, the message is allocated on the
+// ping path.
+static void BM_PublishPing_UniquePtr(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+
+    auto node = std::make_shared<rclcpp::Node>("bench_unique_ptr",
+        rclcpp::NodeOptions().use_intra_process_comms(true));
+    auto publisher = node->create_publisher<StampedPing>("ping", 10);
+    auto subscription = node->create_subscription<StampedPing>("ping", 10,
+        [](StampedPing::ConstSharedPtr) {});
+
+    size_t allocations = 0, bytesCopied = 0;
+    for(auto _ : state) {
+        size_t start = allocationCount;
+        auto msg = std::make_unique<StampedPing>();
+        msg->ping.data.reserve(data.size());
+        oculus::copy_to_ros(msg->ping, metadata, data);
+        publisher->publish(std::move(msg));
+        allocations += allocationCount - start;
+        bytesCopied += data.size();
+    }
+    report(state, allocations, bytesCopied);
+}
+
+// Current unique_ptr path : the queue slot buffer is swapped into a message
+// taken from an oculus::MessagePool (no copy), the next message is allocated
+// and reserved after publishing. allocs_per_ping counts the allocations on
+// the ping path (take, fill, publish), refill_allocs_per_ping those made
+// afterwards. The slot gets the reserved buffer back, so the driver thread
+// does not allocate either.
+static void BM_PublishPing_Pool(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+
+    auto node = std::make_shared<rclcpp::Node>("bench_pool",
+        rclcpp::NodeOptions().use_intra_process_comms(true));
+    auto publisher = node->create_publisher<StampedPing>("ping", 10);
+    auto subscription = node->create_subscription<StampedPing>("ping", 10,
+        [](StampedPing::ConstSharedPtr) {});
+
+    const size_t size = data.size();
+    oculus::MessagePool<StampedPing> pool(1, [size](StampedPing& msg) { msg.ping.data.reserve(size); });
+    pool.refill();
+    std::vector<uint8_t> slot = data;
+    size_t allocations = 0, refillAllocations = 0;
+    for(auto _ : state) {
+        size_t start = allocationCount;
+        auto msg = pool.take();
+        oculus::move_to_ros(msg->ping, metadata, slot);
+        publisher->publish(std::move(msg));
+        size_t published = allocationCount;
+        pool.refill();
+        allocations       += published - start;
+        refillAllocations += allocationCount - published;
+
+        state.PauseTiming();
+        // Driver callback filling the slot again (push_ping).
+        slot.assign(data.cbegin(), data.cend());
+        state.ResumeTiming();
+    }
+    report(state, allocations, 0);
+    state.counters["refill_allocs_per_ping"] = benchmark::Counter(refillAllocations, benchmark::Counter::kAvgIterations);
+}
+
+// Current inter-process path : the member message is reused for every ping
+// and serialized by the middleware during publish (no intra-process comms,
+// the subscription is matched through the middleware).
+static void BM_PublishPing_Reused(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+
+    auto node = std::make_shared<rclcpp::Node>("bench_reused",
+        rclcpp::NodeOptions().use_intra_process_comms(false));
+    auto publisher = node->create_publisher<StampedPing>("ping_reused", 10);
+    auto listener = std::make_shared<rclcpp::Node>("bench_reused_listener");
+    auto subscription = listener->create_subscription<StampedPing>("ping_reused", 10,
+        [](StampedPing::ConstSharedPtr) {});
+
+    StampedPing msg;
+    size_t allocations = 0, bytesCopied = 0;
+    for(auto _ : state) {
+        size_t start = allocationCount;
+        oculus::copy_to_ros(msg.ping, metadata, data);
+        publisher->publish(msg);
+        allocations += allocationCount - start;
+        bytesCopied += 2*data.size(); // copy_to_ros + serialization
+    }
+    report(state, allocations, bytesCopied);
+}
+
+// nbeams, nranges, 16 bits
+#define PING_ARGS ArgsProduct({{256, 512}, {256, 1024}, {0, 1}})
+
+BENCHMARK(BM_PublishPing_Legacy)->PING_ARGS;
+BENCHMARK(BM_PublishPing_UniquePtr)->PING_ARGS;
+BENCHMARK(BM_PublishPing_Pool)->PING_ARGS;
+BENCHMARK(BM_PublishPing_Reused)->PING_ARGS;
+
+int main(int argc, char** argv)
+{
+    rclcpp::init(argc, argv);
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    rclcpp::shutdown();
+    return 0;
+}
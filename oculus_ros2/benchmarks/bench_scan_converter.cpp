@@ -0,0 +1,44 @@
+#include <benchmark/benchmark.h>
+
+#include "scan_converter.h"
+#include "bench_utils.h"
+
+// Full fan image conversion (unpacking and remapping) of a ping, the remap
+// table being already built. 40Hz at 512 beams requires less than 25ms.
+static void BM_ScanConverter_Convert(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+
+    oculus::ScanConverter converter(state.range(3));
+    std::vector<uint8_t> output;
+    converter.convert(metadata, data, output);
+
+    for(auto _ : state) {
+        converter.convert(metadata, data, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["pings_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.counters["lut_builds"] = converter.lut_builds();
+    state.SetBytesProcessed(state.iterations()*data.size());
+}
+
+// Remap table construction, paid only on geometry changes.
+static void BM_ScanConverter_BuildLut(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+
+    oculus::ScanConverter converter(state.range(3));
+    std::vector<uint8_t> output;
+    for(auto _ : state) {
+        converter.invalidate();
+        converter.convert(metadata, data, output);
+    }
+}
+
+// nbeams, nranges, 16 bits, output width
+BENCHMARK(BM_ScanConverter_Convert)->ArgsProduct({{256, 512}, {512, 1024}, {0, 1}, {512, 1024}});
+BENCHMARK(BM_ScanConverter_BuildLut)->ArgsProduct({{512}, {1024}, {0}, {512, 1024}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,41 @@
+#include <cstring>
+
+#include <benchmark/benchmark.h>
+
+#include "sonar_mosaic.h"
+#include "bench_utils.h"
+
+// Projection of 512 beams x 1024 ranges pings with a 40m range along a survey
+// line (1.5m/s at 40Hz, dirty tiles taken every 10 pings, evicted tiles
+// dropped). Arguments : resolution (cm), threads. Pings at 40Hz leave 25ms
+// per ping.
+static void BM_SonarMosaic_Integrate(benchmark::State& state)
+{
+    auto data = oculus::bench::make_ping(512, 1024, false);
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, data.data(), sizeof(metadata));
+    metadata.rangeResolution = 40.0 / 1024;
+    std::memcpy(data.data(), &metadata, sizeof(metadata));
+
+    oculus::SonarMosaic::Options options;
+    options.resolution = 0.01f*state.range(0);
+    options.threads    = state.range(1);
+    options.max_tiles  = 64;
+    oculus::SonarMosaic mosaic(options);
+
+    unsigned int ping = 0;
+    for(auto _ : state) {
+        auto pose = oculus::SonarMosaic::Pose::from_quaternion(0.0375*ping, 0.0, 0.0,
+                                                               0.0, 0.0, 0.0, 1.0);
+        benchmark::DoNotOptimize(mosaic.integrate(metadata, data, pose, 0.025*ping));
+        if(++ping % 10 == 0)
+            mosaic.take_dirty([](const oculus::SonarMosaic::Tile&) {});
+    }
+    auto stats = mosaic.statistics();
+    state.counters["cells_per_ping"] = stats.last_cells;
+    state.counters["pings_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_SonarMosaic_Integrate)->ArgsProduct({{10, 5}, {1, 4}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
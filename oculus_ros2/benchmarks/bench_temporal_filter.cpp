@@ -0,0 +1,36 @@
+#include <benchmark/benchmark.h>
+
+#include "temporal_filter.h"
+#include "bench_utils.h"
+#include "cpu_features.h"
+
+// Filtering of a ping once the ring is full. Arguments : nbeams, nranges,
+// 16 bits, mode (0 ema, 1 median, 2 min), frames, avx2 (0 for the portable
+// kernels).
+static void BM_TemporalFilter_Filter(benchmark::State& state)
+{
+    oculus::set_avx2_enabled(state.range(5));
+    auto data = oculus::bench::make_ping(state.range(0), state.range(1), state.range(2));
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+
+    oculus::TemporalFilter::Options options;
+    options.mode   = static_cast<oculus::TemporalFilter::Mode>(state.range(3));
+    options.frames = state.range(4);
+    oculus::TemporalFilter filter(options);
+    std::vector<uint8_t> output;
+    for(unsigned int i = 0; i < options.frames; i++)
+        filter.filter(metadata, data, output);
+
+    for(auto _ : state) {
+        filter.filter(metadata, data, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.counters["pings_per_second"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(state.iterations()*data.size());
+    oculus::set_avx2_enabled(true);
+}
+
+BENCHMARK(BM_TemporalFilter_Filter)->ArgsProduct({{512}, {512, 1024}, {0, 1}, {0}, {1}, {0, 1}});
+BENCHMARK(BM_TemporalFilter_Filter)->ArgsProduct({{512}, {512, 1024}, {0, 1}, {1, 2}, {3, 5, 9}, {0, 1}});
+
+BENCHMARK_MAIN();
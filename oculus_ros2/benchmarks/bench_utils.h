@@ -0,0 +1,68 @@
+#ifndef _DEF_OCULUS_ROS_BENCH_UTILS_H_
+#define _DEF_OCULUS_ROS_BENCH_UTILS_H_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+namespace oculus { namespace bench {
+
+// Builds a full OculusSimplePingResult message (header, bearings and image)
+// as delivered by oculus::SonarDriver ping callbacks.
+inline std::vector<uint8_t> make_ping(unsigned int nBeams, unsigned int nRanges,
+                                      bool use16Bits, bool withGain = false,
+                                      uint32_t pingId = 0)
+{
+    const unsigned int sampleSize = use16Bits ? 2 : 1;
+    const unsigned int rowSize    = nBeams*sampleSize + (withGain ? 4 : 0);
+    const unsigned int imageOffset = sizeof(OculusSimplePingResult) + nBeams*sizeof(int16_t);
+
+    std::vector<uint8_t> data(imageOffset + nRanges*rowSize);
+
+    OculusSimplePingResult metadata;
+    std::memset(&metadata, 0, sizeof(metadata));
+    metadata.fireMessage.head.oculusId    = OCULUS_CHECK_ID;
+    metadata.fireMessage.head.msgId       = messageSimplePingResult;
+    metadata.fireMessage.head.payloadSize = data.size() - sizeof(OculusMessageHeader);
+    metadata.fireMessage.masterMode = 1;
+    metadata.fireMessage.flags      = 0x09 | (use16Bits ? 0x02 : 0) | (withGain ? 0x04 : 0)
+                                           | (nBeams > 256 ? 0x40 : 0);
+    metadata.fireMessage.range      = 0.01*nRanges;
+    metadata.pingId          = pingId;
+    metadata.frequency       = 1.2e6;
+    metadata.dataSize        = use16Bits ? dataSize16Bit : dataSize8Bit;
+    metadata.rangeResolution = 0.01;
+    metadata.nRanges         = nRanges;
+    metadata.nBeams          = nBeams;
+    metadata.imageOffset     = imageOffset;
+    metadata.imageSize       = nRanges*rowSize;
+    metadata.messageSize     = data.size();
+    std::memcpy(data.data(), &metadata, sizeof(metadata));
+
+    // 130° aperture, bearings in hundredths of degrees.
+    auto bearings = reinterpret_cast<int16_t*>(data.data() + sizeof(OculusSimplePingResult));
+    for(unsigned int b = 0; b < nBeams; b++) {
+        bearings[b] = static_cast<int16_t>(-6500 + (13000*b) / (nBeams - 1));
+    }
+
+    uint32_t seed = 0x2545f491 + pingId;
+    for(unsigned int r = 0; r < nRanges; r++) {
+        uint8_t* row = data.data() + imageOffset + r*rowSize;
+        if(withGain) {
+            uint32_t gain = 1 + r;
+            std::memcpy(row, &gain, sizeof(gain));
+            row += 4;
+        }
+        for(unsigned int i = 0; i < nBeams*sampleSize; i++) {
+            seed = 1664525*seed + 1013904223;
+            row[i] = seed >> 24;
+        }
+    }
+    return data;
+}
+
+}} //namespace oculus::bench
+
+#endif //_DEF_OCULUS_ROS_BENCH_UTILS_H_
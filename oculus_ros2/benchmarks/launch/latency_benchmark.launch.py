@@ -0,0 +1,78 @@
+from launch import LaunchDescription
+from launch.actions import DeclareLaunchArgument
+from launch.conditions import LaunchConfigurationEquals
+from launch_ros.actions import ComposableNodeContainer, Node
+from launch_ros.descriptions import ComposableNode
+from launch.substitutions import LaunchConfiguration
+
+
+# End-to-end ping latency, sonar driver to consumer.
+#   mode:=component  : sonar node and probe share a container, intra-process.
+#   mode:=standalone : sonar node and probe are separate processes, DDS.
+#   replay_file:=<log.oculus> replay_rate:=<factor> : replays a log instead
+#   of connecting to the sonar, so that runs can be compared without hardware.
+def generate_launch_description():
+
+    ld = LaunchDescription()
+
+    ld.add_action(DeclareLaunchArgument(
+        name='mode',
+        default_value='component',
+        description='component or standalone'))
+    ld.add_action(DeclareLaunchArgument(
+        name='replay_file',
+        default_value='',
+        description='.oculus log to replay instead of connecting to the sonar (empty: use the sonar).'))
+    ld.add_action(DeclareLaunchArgument(
+        name='replay_rate',
+        default_value='1.0',
+        description='Replay speed factor (1.0: real time, 0.0: as fast as possible).'))
+
+    remappings = [('ping', '/oculus_sonar/ping'),
+                  ('status', '/oculus_sonar/status')]
+    sonar_parameters = [{'replay.file': LaunchConfiguration('replay_file'),
+                         'replay.rate': LaunchConfiguration('replay_rate')}]
+
+    ld.add_action(ComposableNodeContainer(
+         name='oculus_benchmark_container',
+         namespace='',
+         package='rclcpp_components',
+         executable='component_container',
+         composable_node_descriptions=[
+             ComposableNode(
+                 package='oculus_ros2',
+                 plugin='OculusSonarNode',
+                 name='oculus_sonar',
+                 parameters=sonar_parameters,
+                 remappings=remappings,
+                 extra_arguments=[{'use_intra_process_comms': True}]),
+             ComposableNode(
+                 package='oculus_ros2',
+                 plugin='oculus::bench::PingLatencyProbe',
+                 name='ping_latency_probe',
+                 remappings=remappings,
+                 extra_arguments=[{'use_intra_process_comms': True}]),
+         ],
+         output='screen',
+         condition=LaunchConfigurationEquals('mode', 'component')
+      ))
+
+    ld.add_action(Node(
+         package='oculus_ros2',
+         executable='oculus_sonar_node',
+         name='oculus_sonar',
+         parameters=sonar_parameters,
+         remappings=remappings,
+         output='screen',
+         condition=LaunchConfigurationEquals('mode', 'standalone')
+      ))
+    ld.add_action(Node(
+         package='oculus_ros2',
+         executable='ping_latency_probe',
+         name='ping_latency_probe',
+         remappings=remappings,
+         output='screen',
+         condition=LaunchConfigurationEquals('mode', 'standalone')
+      ))
+
+    return ld
@@ -0,0 +1,149 @@
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+
+#include "mock_sonar.h"
+#include "oculus_sonar_node.hpp"
+
+// End to end load test : oculus::MockSonar on the local host -> socket ->
+// oculus::SonarDriver -> OculusSonarNode -> DDS -> subscriber in this
+// process. Sweeps the ping rate for each (nbeams, data depth) and reports the
+// highest rate sustained without any lost ping.
+//
+// Uses the sonar ports (52100 and 52102) : no other sonar node nor mock sonar
+// must run on the host.
+
+struct LoadPoint
+{
+    unsigned int nbeams;
+    bool         use16bits;
+    double       rate;
+    uint64_t     fired    = 0; // pings fired by the mock sonar
+    uint64_t     received = 0; // by the subscriber
+    uint64_t     gaps     = 0; // ping_id gaps seen by the subscriber
+    double       mbps     = 0.0;
+
+    bool sustained() const {
+        // A couple of pings may be in flight at the window boundaries.
+        return gaps == 0 && received + 2 >= fired;
+    }
+};
+
+static void run_point(LoadPoint& point, unsigned int nranges, double warmup, double duration)
+{
+    oculus::MockSonar::Options options;
+    options.rate          = point.rate;
+    options.nbeams        = point.nbeams;
+    options.nranges       = nranges;
+    options.use16bits     = point.use16bits;
+    options.status_period = 0.2;
+    oculus::MockSonar mock(options);
+    mock.start();
+
+    // The node sends its configuration on connection and the mock sonar
+    // applies it : it has to match the point.
+    rclcpp::NodeOptions nodeOptions;
+    nodeOptions.parameter_overrides({
+        {"diagnostics.period", 0.0},
+        {"standby_delay", -1.0},
+        {"nbeams", point.nbeams > 256 ? 1 : 0},
+        {"data_depth", point.use16bits ? 1 : 0},
+        {"range", options.range},
+    });
+    auto sonar = std::make_shared<OculusSonarNode>(nodeOptions);
+
+    std::atomic<uint64_t> received(0), gaps(0), bytes(0);
+    std::atomic<bool>     hasLast(false);
+    uint32_t lastPingId = 0;
+    auto listener = rclcpp::Node::make_shared("oculus_load_test");
+    auto subscription = listener->create_subscription<oculus_interfaces::msg::OculusStampedPing>(
+        "ping", 100,
+        [&](oculus_interfaces::msg::OculusStampedPing::ConstSharedPtr msg) {
+            if(hasLast && msg->ping.ping_id != lastPingId + 1)
+                gaps++;
+            lastPingId = msg->ping.ping_id;
+            hasLast    = true;
+            received++;
+            bytes += msg->ping.data.size();
+        });
+
+    rclcpp::executors::SingleThreadedExecutor executor;
+    executor.add_node(sonar);
+    executor.add_node(listener);
+    std::thread spinner([&]() { executor.spin(); });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(warmup));
+    auto start     = mock.statistics();
+    auto received0 = received.load();
+    gaps = 0;
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+    auto end = mock.statistics();
+
+    point.fired    = (end.pings_sent + end.pings_dropped) - (start.pings_sent + start.pings_dropped);
+    point.received = received - received0;
+    point.gaps     = gaps;
+    point.mbps     = 1.0e-6*(end.bytes_sent - start.bytes_sent) / duration;
+
+    executor.cancel();
+    spinner.join();
+    executor.remove_node(listener);
+    executor.remove_node(sonar);
+    subscription.reset();
+    sonar.reset();
+    mock.stop();
+}
+
+int main(int argc, char** argv)
+{
+    rclcpp::init(argc, argv);
+
+    std::vector<double> rates = {10.0, 15.0, 20.0, 30.0, 40.0, 60.0, 80.0, 120.0, 160.0, 240.0, 320.0};
+    std::vector<unsigned int> beams = {256, 512};
+    unsigned int nranges  = 1024;
+    double       warmup   = 1.0;
+    double       duration = 3.0;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if(arg == "--nranges")       nranges  = std::stoi(argv[i + 1]);
+        else if(arg == "--duration") duration = std::stod(argv[i + 1]);
+        else if(arg == "--warmup")   warmup   = std::stod(argv[i + 1]);
+    }
+
+    std::cout << "nbeams depth   rate    fired received gaps    MB/s\n";
+    std::vector<LoadPoint> maxima;
+    for(auto nbeams : beams) {
+        for(bool use16bits : {false, true}) {
+            LoadPoint best{nbeams, use16bits, 0.0};
+            for(auto rate : rates) {
+                LoadPoint point{nbeams, use16bits, rate};
+                run_point(point, nranges, warmup, duration);
+                std::cout << std::setw(6) << nbeams << std::setw(6) << (use16bits ? 16 : 8)
+                          << std::setw(7) << rate << std::setw(9) << point.fired
+                          << std::setw(9) << point.received << std::setw(5) << point.gaps
+                          << std::setw(8) << std::fixed << std::setprecision(1) << point.mbps
+                          << (point.sustained() ? "" : "  <- pings lost") << std::endl;
+                if(!point.sustained() || !rclcpp::ok())
+                    break;
+                best = point;
+            }
+            maxima.push_back(best);
+        }
+    }
+
+    std::cout << "\nMaximum sustained ping rate without loss (" << nranges << " ranges) :\n";
+    for(const auto& point : maxima) {
+        std::cout << "  " << point.nbeams << " beams, " << (point.use16bits ? 16 : 8) << " bits : "
+                  << point.rate << " Hz (" << point.mbps << " MB/s)\n";
+    }
+
+    rclcpp::shutdown();
+    return 0;
+}
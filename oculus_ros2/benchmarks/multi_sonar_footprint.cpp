@@ -0,0 +1,239 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rclcpp/rclcpp.hpp"
+#include "ament_index_cpp/get_package_prefix.hpp"
+#include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+
+#include "log_writer.h"
+#include "mock_sonar.h"
+
+extern char** environ;
+
+// CPU and memory used to publish the pings of N sonars, by a single
+// oculus_multi_sonar_node or by N oculus_sonar_node processes. Every sonar
+// replays (in a loop, in real time) the same synthetic log, so no sonar is
+// needed. The nodes run as separate processes started from the installed
+// package (the workspace has to be sourced), this process subscribes to all
+// the pings.
+//
+// CPU is the utime + stime of the node processes over the measurement, in
+// percent of one core. Memory is their proportional set size (PSS : pages
+// shared between processes, such as the ROS libraries, are split between
+// them), or their resident set size if PSS is not available.
+
+struct Footprint
+{
+    double cpu      = 0.0; // % of one core
+    double memory   = 0.0; // MB
+    double pingRate = 0.0; // received, all sonars
+};
+
+static std::string write_log(unsigned int nbeams, unsigned int nranges, double rate)
+{
+    oculus::LogWriter::Options options;
+    options.directory = "/tmp";
+    options.prefix    = "oculus_footprint";
+    oculus::LogWriter writer(options);
+
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09 | (nbeams > 256 ? 0x40 : 0);
+    config.range      = 20.0;
+    // The log is looped : 10s of pings, ping ids going on across loops are
+    // not needed.
+    const unsigned int count = static_cast<unsigned int>(10.0*rate);
+    const double start = std::chrono::duration<double>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    for(unsigned int i = 0; i < count; i++) {
+        auto ping = oculus::make_synthetic_ping(config, nbeams, nranges, i);
+        OculusSimplePingResult metadata;
+        std::memcpy(&metadata, ping.data(), sizeof(metadata));
+        metadata.pingId = i;
+        std::memcpy(ping.data(), &metadata, sizeof(metadata));
+        while(!writer.push(ping.data(), ping.size(), start + i / rate)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    writer.stop();
+    return writer.current_filename();
+}
+
+static pid_t spawn(const std::vector<std::string>& args)
+{
+    std::vector<char*> argv;
+    for(const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    pid_t pid;
+    if(posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+        throw std::runtime_error("Could not start " + args[0]);
+    }
+    return pid;
+}
+
+// utime + stime in seconds.
+static double cpu_time(pid_t pid)
+{
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    // Fields after the command name, which may contain spaces.
+    std::istringstream fields(stat.substr(stat.rfind(')') + 2));
+    std::string field;
+    unsigned long utime = 0, stime = 0;
+    for(int i = 3; fields >> field; i++) {
+        if(i == 14) utime = std::stoul(field);
+        if(i == 15) { stime = std::stoul(field); break; }
+    }
+    return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+// PSS (or RSS) in MB.
+static double memory(pid_t pid)
+{
+    for(const auto& source : {std::make_pair("/smaps_rollup", "Pss:"), std::make_pair("/status", "VmRSS:")}) {
+        std::ifstream file("/proc/" + std::to_string(pid) + source.first);
+        std::string line;
+        while(std::getline(file, line)) {
+            if(line.compare(0, std::strlen(source.second), source.second) == 0) {
+                return 1.0e-3*std::stod(line.substr(std::strlen(source.second)));
+            }
+        }
+    }
+    return 0.0;
+}
+
+static Footprint measure(const std::vector<std::vector<std::string>>& commands,
+                         const std::vector<std::string>& topics,
+                         double warmup, double duration)
+{
+    std::vector<pid_t> pids;
+    for(const auto& command : commands) {
+        pids.push_back(spawn(command));
+    }
+
+    std::atomic<uint64_t> received(0);
+    auto listener = rclcpp::Node::make_shared("oculus_footprint");
+    std::vector<rclcpp::Subscription<oculus_interfaces::msg::OculusStampedPing>::SharedPtr> subscriptions;
+    for(const auto& topic : topics) {
+        subscriptions.push_back(listener->create_subscription<oculus_interfaces::msg::OculusStampedPing>(
+            topic, 10, [&](oculus_interfaces::msg::OculusStampedPing::ConstSharedPtr) { received++; }));
+    }
+    rclcpp::executors::SingleThreadedExecutor executor;
+    executor.add_node(listener);
+    std::thread spinner([&]() { executor.spin(); });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(warmup));
+    double cpu0 = 0.0;
+    for(auto pid : pids) {
+        cpu0 += cpu_time(pid);
+    }
+    uint64_t received0 = received;
+    std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+
+    Footprint footprint;
+    for(auto pid : pids) {
+        footprint.cpu    += cpu_time(pid);
+        footprint.memory += memory(pid);
+    }
+    footprint.cpu      = 100.0*(footprint.cpu - cpu0) / duration;
+    footprint.pingRate = (received - received0) / duration;
+
+    executor.cancel();
+    spinner.join();
+    for(auto pid : pids) {
+        kill(pid, SIGINT);
+    }
+    for(auto pid : pids) {
+        waitpid(pid, nullptr, 0);
+    }
+    return footprint;
+}
+
+int main(int argc, char** argv)
+{
+    rclcpp::init(argc, argv);
+
+    std::vector<unsigned int> heads = {1, 2, 4, 6};
+    unsigned int nbeams   = 512;
+    unsigned int nranges  = 1024;
+    double       rate     = 10.0;
+    double       warmup   = 5.0;
+    double       duration = 10.0;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if(arg == "--nbeams")        nbeams   = std::stoi(argv[i + 1]);
+        else if(arg == "--nranges")  nranges  = std::stoi(argv[i + 1]);
+        else if(arg == "--rate")     rate     = std::stod(argv[i + 1]);
+        else if(arg == "--duration") duration = std::stod(argv[i + 1]);
+        else if(arg == "--warmup")   warmup   = std::stod(argv[i + 1]);
+    }
+
+    const std::string bin  = ament_index_cpp::get_package_prefix("oculus_ros2") + "/lib/oculus_ros2/";
+    const std::string log  = write_log(nbeams, nranges, rate);
+    std::cout << nbeams << " beams x " << nranges << " ranges pings at " << rate
+              << " Hz per sonar, replayed from '" << log << "'.\n\n"
+              << "sonars mode      processes   CPU (%)  PSS (MB)  pings/s\n";
+
+    auto print = [](unsigned int n, const char* mode, size_t processes, const Footprint& f) {
+        std::cout << std::setw(6) << n << " " << std::left << std::setw(9) << mode << std::right
+                  << std::setw(10) << processes << std::fixed << std::setprecision(1)
+                  << std::setw(10) << f.cpu << std::setw(10) << f.memory
+                  << std::setw(9) << f.pingRate << std::endl;
+    };
+    for(auto n : heads) {
+        if(!rclcpp::ok())
+            break;
+
+        // One multi sonar node, all the sonars replayed.
+        std::vector<std::string> command = {bin + "oculus_multi_sonar_node", "--ros-args",
+            "-r", "__ns:=/footprint_multi", "-p", "diagnostics.period:=0.0"};
+        std::string sonars = "sonars:=[";
+        std::vector<std::string> topics;
+        for(unsigned int i = 0; i < n; i++) {
+            const std::string name = "s" + std::to_string(i);
+            sonars += (i > 0 ? "," : "") + name;
+            for(const auto& param : {name + ".replay.file:=" + log, name + ".replay.loop:=true"}) {
+                command.push_back("-p");
+                command.push_back(param);
+            }
+            topics.push_back("/footprint_multi/" + name + "/ping");
+        }
+        command.push_back("-p");
+        command.push_back(sonars + "]");
+        print(n, "multi", 1, measure({command}, topics, warmup, duration));
+
+        // One oculus_sonar_node per sonar.
+        std::vector<std::vector<std::string>> commands;
+        topics.clear();
+        for(unsigned int i = 0; i < n; i++) {
+            const std::string ns = "/footprint_separate/s" + std::to_string(i);
+            commands.push_back({bin + "oculus_sonar_node", "--ros-args", "-r", "__ns:=" + ns,
+                "-p", "diagnostics.period:=0.0", "-p", "replay.file:=" + log, "-p", "replay.loop:=true"});
+            topics.push_back(ns + "/ping");
+        }
+        print(n, "separate", n, measure(commands, topics, warmup, duration));
+    }
+
+    std::remove(log.c_str());
+    rclcpp::shutdown();
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+
+#include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+
+namespace oculus { namespace bench {
+
+// Measures the delay between the ping header stamp (host time at which the
+// driver received the ping header) and the reception of the ping by this
+// node. Load it in the same container as OculusSonarNode to measure the
+// intra-process path, or run it standalone to measure the DDS path.
+class PingLatencyProbe : public rclcpp::Node
+{
+    public:
+
+    explicit PingLatencyProbe(const rclcpp::NodeOptions& options = rclcpp::NodeOptions()) :
+        Node("ping_latency_probe", options)
+    {
+        this->declare_parameter<double>("report_period", 5.0);
+        double period = this->get_parameter("report_period").as_double();
+
+        latencies_.reserve(4096);
+        subscription_ = this->create_subscription<oculus_interfaces::msg::OculusStampedPing>(
+            "ping", 100,
+            [this](oculus_interfaces::msg::OculusStampedPing::ConstSharedPtr msg) {
+                this->on_ping(*msg);
+            });
+        timer_ = this->create_wall_timer(std::chrono::duration<double>(period),
+                                         [this]() { this->report(); });
+        RCLCPP_INFO_STREAM(this->get_logger(), "Measuring ping latency ("
+            << (options.use_intra_process_comms() ? "intra-process" : "inter-process") << ").");
+    }
+
+    private:
+
+    rclcpp::Subscription<oculus_interfaces::msg::OculusStampedPing>::SharedPtr subscription_;
+    rclcpp::TimerBase::SharedPtr timer_;
+    std::vector<double> latencies_; // in micro-seconds
+    size_t bytes_ = 0;
+
+    void on_ping(const oculus_interfaces::msg::OculusStampedPing& msg)
+    {
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        auto stamp = rclcpp::Time(msg.header.stamp).nanoseconds();
+        latencies_.push_back(1.0e-3*(now - stamp));
+        bytes_ += msg.ping.data.size();
+    }
+
+    void report()
+    {
+        if(latencies_.empty()) {
+            RCLCPP_INFO(this->get_logger(), "No ping received.");
+            return;
+        }
+        std::sort(latencies_.begin(), latencies_.end());
+        double mean = 0.0;
+        for(auto l : latencies_)
+            mean += l;
+        mean /= latencies_.size();
+
+        auto percentile = [this](double p) {
+            return latencies_[std::min(latencies_.size() - 1,
+                                       static_cast<size_t>(p*latencies_.size()))];
+        };
+        RCLCPP_INFO(this->get_logger(),
+            "%zu pings (%.1f kB avg), latency us : min %.1f, mean %.1f, p50 %.1f, p99 %.1f, max %.1f",
+            latencies_.size(), 1.0e-3*bytes_ / latencies_.size(), latencies_.front(), mean,
+            percentile(0.5), percentile(0.99), latencies_.back());
+        latencies_.clear();
+        bytes_ = 0;
+    }
+};
+
+}} //namespace oculus::bench
+
+RCLCPP_COMPONENTS_REGISTER_NODE(oculus::bench::PingLatencyProbe)
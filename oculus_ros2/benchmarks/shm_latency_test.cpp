@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shm_ping_writer.h"
+#include "bench_utils.h"
+
+// Delivery latency of the shared memory ping ring to a reader process : the
+// writer (this process, as in oculus_sonar_node) pushes pings at a given
+// rate, a forked reader process measures the time between the end of each
+// push and the end of its copy on the reader side, or the start of its
+// processing in place with --zero-copy (CLOCK_MONOTONIC is shared by the
+// processes). Fails if the p99 latency is above --max-p99.
+
+static void usage()
+{
+    std::cout << "Usage : oculus_shm_latency_test [options]\n"
+        "  --pings <n>        pings to publish (2000)\n"
+        "  --rate <hz>        ping rate (200)\n"
+        "  --nbeams <n>       (512)\n"
+        "  --nranges <n>      (512)\n"
+        "  --16bits           16 bits samples\n"
+        "  --slots <n>        ring slots (8)\n"
+        "  --spin <us>        reader spin time before sleeping (50)\n"
+        "  --zero-copy        read the pings in place (PingRingReader::visit)\n"
+        "  --max-p99 <us>     failure threshold (100)\n";
+}
+
+static int run_reader(const std::string& name, unsigned int pings,
+                      std::chrono::microseconds spin, bool zeroCopy, double maxP99)
+{
+    oculus::shm::PingRingReader reader(name);
+    oculus::shm::Ping ping;
+    std::vector<double> latencies;
+    latencies.reserve(pings);
+    while(latencies.size() < pings) {
+        double latency = 0.0;
+        bool received;
+        if(zeroCopy) {
+            received = reader.visit([&](const oculus::shm::SlotHeader& slot, const uint8_t*) {
+                latency = 1.0e-3*(oculus::shm::monotonic_ns() - slot.publish_time);
+                ping.data.resize(slot.data_size);
+            }, std::chrono::seconds(2), spin);
+        }
+        else {
+            received = reader.read(ping, std::chrono::seconds(2), spin);
+            latency  = 1.0e-3*(oculus::shm::monotonic_ns() - ping.publish_time);
+        }
+        if(!received)
+            break;
+        latencies.push_back(latency);
+    }
+    if(latencies.empty()) {
+        std::cerr << "No ping received." << std::endl;
+        return 1;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min<size_t>(latencies.size() - 1, p*latencies.size())];
+    };
+    double p99 = percentile(0.99);
+    std::cout << std::fixed << std::setprecision(1)
+              << "received " << latencies.size() << "/" << pings << " pings of "
+              << ping.data.size() << " bytes, " << reader.missed() << " missed\n"
+              << "latency (us) : p50 " << percentile(0.5)
+              << ", p90 " << percentile(0.9)
+              << ", p99 " << p99
+              << ", max " << latencies.back() << std::endl;
+    if(latencies.size() < pings || p99 > maxP99) {
+        std::cout << "FAILED" << std::endl;
+        return 1;
+    }
+    std::cout << "PASSED" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int pings   = 2000;
+    double       rate    = 200.0;
+    unsigned int nbeams  = 512;
+    unsigned int nranges = 512;
+    bool         use16bits = false;
+    unsigned int spinUs  = 50;
+    double       maxP99  = 100.0;
+    bool         zeroCopy = false;
+    oculus::ShmPingWriter::Options options;
+    options.name = "/oculus_shm_latency_test_" + std::to_string(getpid());
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if(i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if     (arg == "--pings")   pings         = std::stoi(value());
+        else if(arg == "--rate")    rate          = std::stod(value());
+        else if(arg == "--nbeams")  nbeams        = std::stoi(value());
+        else if(arg == "--nranges") nranges       = std::stoi(value());
+        else if(arg == "--16bits")  use16bits     = true;
+        else if(arg == "--slots")   options.slots = std::stoi(value());
+        else if(arg == "--spin")    spinUs        = std::stoi(value());
+        else if(arg == "--zero-copy") zeroCopy    = true;
+        else if(arg == "--max-p99") maxP99        = std::stod(value());
+        else {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    auto data = oculus::bench::make_ping(nbeams, nranges, use16bits);
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(data.data());
+    options.slot_data_size = data.size();
+    oculus::ShmPingWriter writer(options);
+
+    pid_t reader = fork();
+    if(reader < 0) {
+        std::cerr << "fork failed" << std::endl;
+        return 1;
+    }
+    if(reader == 0) {
+        std::exit(run_reader(options.name, pings, std::chrono::microseconds(spinUs),
+                             zeroCopy, maxP99));
+    }
+
+    // Letting the reader open the ring before the first ping.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / rate));
+    auto next = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < pings; i++) {
+        next += period;
+        std::this_thread::sleep_until(next);
+        writer.push(metadata, data, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    int status = 0;
+    waitpid(reader, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,277 @@
+#ifndef _DEF_OCULUS_ROS_SHM_PING_RING_H_
+#define _DEF_OCULUS_ROS_SHM_PING_RING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <oculus_driver/Oculus.h>
+
+// Ping ring in POSIX shared memory, written by the oculus_sonar_node
+// (shm.enable parameter) and read by processes which do not use ROS.
+//
+// This header only depends on the oculus_driver headers and on the C library
+// (link with -lrt on glibc older than 2.34). Typical reader :
+//
+//     oculus::shm::PingRingReader reader("/oculus_sonar_pings");
+//     oculus::shm::Ping ping;
+//     while(running) {
+//         if(reader.read(ping, std::chrono::seconds(1)))
+//             process(ping.metadata, ping.data);
+//     }
+//
+// The ring is a fixed number of fixed size slots. The writer never waits for
+// the readers : each slot is protected by a sequence number (seqlock), odd
+// while the slot is being written, so that a reader detects a slot
+// overwritten during its copy and skips ahead. Readers never take a lock and
+// do not see each other.
+
+namespace oculus {
+namespace shm {
+
+constexpr uint32_t RingMagic   = 0x5253434f; // "OCSR"
+constexpr uint32_t RingVersion = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+// CLOCK_MONOTONIC is shared by all the processes of the host.
+inline int64_t monotonic_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+struct alignas(64) RingHeader
+{
+    std::atomic<uint32_t> magic;    // written last by the writer
+    uint32_t              version;
+    uint32_t              slot_count;
+    uint32_t              padding;
+    uint64_t              slot_size;     // bytes, SlotHeader included
+    uint64_t              data_capacity; // max ping data bytes in a slot
+    int32_t               writer_pid;
+
+    alignas(64) std::atomic<uint64_t> write_count; // pings published
+    std::atomic<uint32_t>             notify;      // futex word, bumped on each ping
+
+    // Written by the readers (CLOCK_MONOTONIC ns of their last poll), so that
+    // the node knows someone reads the ring.
+    alignas(64) std::atomic<int64_t> reader_heartbeat;
+};
+
+struct alignas(64) SlotHeader
+{
+    std::atomic<uint64_t>  sequence;     // odd while the slot is written
+    uint64_t               index;        // ping number since the ring creation
+    int64_t                stamp;        // ping stamp, ns since epoch (system clock)
+    int64_t                publish_time; // CLOCK_MONOTONIC ns, when the slot was complete
+    uint64_t               data_size;
+    OculusSimplePingResult metadata;
+    // Followed by data_size bytes of ping data (the whole sonar message, as
+    // delivered by oculus_driver, metadata included).
+};
+
+inline const uint8_t* slot_data(const SlotHeader* slot)
+{
+    return reinterpret_cast<const uint8_t*>(slot) + sizeof(SlotHeader);
+}
+inline uint8_t* slot_data(SlotHeader* slot)
+{
+    return reinterpret_cast<uint8_t*>(slot) + sizeof(SlotHeader);
+}
+
+inline size_t slot_size(size_t dataCapacity)
+{
+    return ((sizeof(SlotHeader) + dataCapacity + 63) / 64)*64;
+}
+inline size_t ring_size(unsigned int slotCount, size_t dataCapacity)
+{
+    return sizeof(RingHeader) + slotCount*slot_size(dataCapacity);
+}
+
+struct Ping
+{
+    uint64_t               index        = 0;
+    int64_t                stamp        = 0;
+    int64_t                publish_time = 0;
+    OculusSimplePingResult metadata;
+    std::vector<uint8_t>   data;
+};
+
+// Visitor copying a slot in a Ping.
+struct PingCopier
+{
+    Ping& ping;
+
+    void operator()(const SlotHeader& slot, const uint8_t* data) const
+    {
+        ping.index        = slot.index;
+        ping.stamp        = slot.stamp;
+        ping.publish_time = slot.publish_time;
+        std::memcpy(&ping.metadata, &slot.metadata, sizeof(ping.metadata));
+        ping.data.resize(slot.data_size);
+        std::memcpy(ping.data.data(), data, ping.data.size());
+    }
+};
+
+class PingRingReader
+{
+    public:
+
+    // Throws std::runtime_error if the ring does not exist (node not started
+    // or shm.enable not set) or is not valid. Only the pings published after
+    // the reader creation are read.
+    explicit PingRingReader(const std::string& name)
+    {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if(fd < 0) {
+            throw std::runtime_error("Could not open shared memory '" + name + "' : "
+                                     + std::strerror(errno));
+        }
+        struct stat info;
+        if(fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(RingHeader)) {
+            ::close(fd);
+            throw std::runtime_error("Invalid ping ring '" + name + "'");
+        }
+        size_ = info.st_size;
+        memory_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(memory_ == MAP_FAILED) {
+            throw std::runtime_error("Could not map shared memory '" + name + "' : "
+                                     + std::strerror(errno));
+        }
+        header_ = static_cast<RingHeader*>(memory_);
+        if(header_->magic.load(std::memory_order_acquire) != RingMagic
+           || header_->version != RingVersion
+           || ring_size(header_->slot_count, header_->data_capacity) > size_) {
+            munmap(memory_, size_);
+            throw std::runtime_error("Invalid ping ring '" + name + "'");
+        }
+        slots_ = static_cast<uint8_t*>(memory_) + sizeof(RingHeader);
+        next_  = header_->write_count.load(std::memory_order_acquire);
+    }
+
+    ~PingRingReader() { munmap(memory_, size_); }
+
+    PingRingReader(const PingRingReader&)            = delete;
+    PingRingReader& operator=(const PingRingReader&) = delete;
+
+    // Copies the next ping in ping and returns true, or returns false at once
+    // if no new ping was published. If the reader fell more than a ring
+    // behind, it skips to the oldest ping still available (see missed()).
+    bool try_read(Ping& ping)
+    {
+        return this->try_visit(PingCopier{ping});
+    }
+
+    // Zero copy version of try_read : calls visitor(const SlotHeader&, const
+    // uint8_t* data) directly on the shared memory. The slot may be
+    // overwritten while the visitor runs : the ping is then counted as missed
+    // and the visitor is called again on the next ping, so only the results
+    // of its last call are valid when try_visit returns true. The visitor
+    // should be short compared to slot_count ping periods.
+    template <class Visitor>
+    bool try_visit(Visitor&& visitor)
+    {
+        header_->reader_heartbeat.store(monotonic_ns(), std::memory_order_relaxed);
+        const uint64_t slotCount = header_->slot_count;
+        while(true) {
+            const uint64_t count = header_->write_count.load(std::memory_order_acquire);
+            if(next_ >= count)
+                return false;
+            // The slot of ping count may be being written.
+            if(count - next_ >= slotCount) {
+                missed_ += count - slotCount + 1 - next_;
+                next_    = count - slotCount + 1;
+            }
+
+            const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(
+                slots_ + (next_ % slotCount)*header_->slot_size);
+            const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            bool valid = !(sequence & 1) && slot->index == next_
+                      && slot->data_size <= header_->data_capacity;
+            if(valid) {
+                visitor(*slot, slot_data(slot));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                valid = slot->sequence.load(std::memory_order_relaxed) == sequence;
+            }
+            next_++;
+            if(valid)
+                return true;
+            // Overwritten : the writer went round the ring.
+            missed_++;
+        }
+    }
+
+    // Waits up to timeout for the next ping. Spins during spin first (lowest
+    // latency), then sleeps until the writer signals a new ping.
+    template <class Rep, class Period>
+    bool read(Ping& ping, std::chrono::duration<Rep,Period> timeout,
+              std::chrono::nanoseconds spin = std::chrono::microseconds(50))
+    {
+        return this->visit(PingCopier{ping}, timeout, spin);
+    }
+
+    // Waiting version of try_visit.
+    template <class Visitor, class Rep, class Period>
+    bool visit(Visitor&& visitor, std::chrono::duration<Rep,Period> timeout,
+               std::chrono::nanoseconds spin = std::chrono::microseconds(50))
+    {
+        const int64_t start    = monotonic_ns();
+        const int64_t deadline = start + std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+        const int64_t spinEnd  = start + spin.count();
+        while(true) {
+            uint32_t notify = header_->notify.load(std::memory_order_acquire);
+            if(this->try_visit(visitor))
+                return true;
+            int64_t now = monotonic_ns();
+            if(now >= deadline)
+                return false;
+            if(now < spinEnd)
+                continue;
+            // Waking up at least every 100ms to keep the heartbeat alive.
+            int64_t wait = std::min<int64_t>(deadline - now, 100000000);
+            timespec ts;
+            ts.tv_sec  = wait / 1000000000;
+            ts.tv_nsec = wait % 1000000000;
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header_->notify),
+                    FUTEX_WAIT, notify, &ts, nullptr, 0);
+        }
+    }
+
+    // Pings published but never read by this reader.
+    uint64_t missed() const { return missed_; }
+    unsigned int slot_count() const { return header_->slot_count; }
+    size_t data_capacity() const { return header_->data_capacity; }
+
+    private:
+
+    void*       memory_  = nullptr;
+    size_t      size_    = 0;
+    RingHeader* header_  = nullptr;
+    uint8_t*    slots_   = nullptr;
+    uint64_t    next_    = 0;
+    uint64_t    missed_  = 0;
+};
+
+} //namespace shm
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_SHM_PING_RING_H_
@@ -0,0 +1,48 @@
+import os
+
+from ament_index_python.packages import get_package_share_directory
+from launch.actions import DeclareLaunchArgument
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
+from launch.substitutions import LaunchConfiguration
+
+
+def generate_launch_description():
+
+    ld = LaunchDescription()
+
+    ld.add_action(DeclareLaunchArgument(
+        name='container_name',
+        default_value='oculus_container',
+        description='Name of the component container. Downstream components loaded in this container receive pings by pointer.'))
+
+    config = os.path.join(
+      get_package_share_directory('oculus_ros2'),
+      'cfg',
+      'default.yaml'
+      )
+
+    oculus_sonar_component = ComposableNode(
+         package='oculus_ros2',
+         plugin='OculusSonarNode',
+         name='oculus_sonar',
+        #  parameters=[config],
+         remappings=[
+                 ('ping', '/oculus_sonar/ping'), # Topic name where ping messages are published (cf Oculus.h).
+                 ('status', '/oculus_sonar/status') # Topic name where status messages are published (cf Oculus.h).
+             ],
+         extra_arguments=[{'use_intra_process_comms': True}]
+      )
+
+    container = ComposableNodeContainer(
+         name=LaunchConfiguration('container_name'),
+         namespace='',
+         package='rclcpp_components',
+         executable='component_container',
+         composable_node_descriptions=[oculus_sonar_component],
+         output='screen'
+      )
+    ld.add_action(container)
+
+    return ld
@@ -0,0 +1,59 @@
+import os
+
+from ament_index_python.packages import get_package_share_directory
+from launch.actions import DeclareLaunchArgument
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
+from launch.substitutions import LaunchConfiguration
+
+
+def generate_launch_description():
+
+    ld = LaunchDescription()
+
+    ld.add_action(DeclareLaunchArgument(
+        name='config',
+        default_value=os.path.join(get_package_share_directory('oculus_ros2'), 'cfg', 'mosaic.yaml'),
+        description='Parameter file of the mosaic (see cfg/mosaic.yaml).'))
+    ld.add_action(DeclareLaunchArgument(
+        name='replay_file',
+        default_value='',
+        description='.oculus log to replay instead of connecting to the sonar (empty: use the sonar).'))
+
+    oculus_sonar_component = ComposableNode(
+         package='oculus_ros2',
+         plugin='OculusSonarNode',
+         name='oculus_sonar',
+         parameters=[{'replay.file': LaunchConfiguration('replay_file')}],
+         remappings=[
+                 ('ping', '/oculus_sonar/ping'),
+                 ('status', '/oculus_sonar/status')
+             ],
+         extra_arguments=[{'use_intra_process_comms': True}]
+      )
+
+    # Pings are received by pointer, the sonar pose comes from TF.
+    oculus_mosaic_component = ComposableNode(
+         package='oculus_ros2',
+         plugin='OculusMosaicNode',
+         name='oculus_mosaic',
+         parameters=[LaunchConfiguration('config')],
+         remappings=[
+                 ('ping', '/oculus_sonar/ping'),
+                 ('mosaic_tiles', '/oculus_sonar/mosaic_tiles')
+             ],
+         extra_arguments=[{'use_intra_process_comms': True}]
+      )
+
+    container = ComposableNodeContainer(
+         name='oculus_mosaic_container',
+         namespace='',
+         package='rclcpp_components',
+         executable='component_container',
+         composable_node_descriptions=[oculus_sonar_component, oculus_mosaic_component],
+         output='screen'
+      )
+    ld.add_action(container)
+
+    return ld
@@ -0,0 +1,28 @@
+import os
+
+from ament_index_python.packages import get_package_share_directory
+from launch.actions import DeclareLaunchArgument
+from launch import LaunchDescription
+from launch_ros.actions import Node
+from launch.substitutions import LaunchConfiguration
+
+
+def generate_launch_description():
+
+    ld = LaunchDescription()
+
+    ld.add_action(DeclareLaunchArgument(
+        name='config',
+        default_value=os.path.join(get_package_share_directory('oculus_ros2'), 'cfg', 'multi_sonar.yaml'),
+        description='Parameter file listing the sonars (see cfg/multi_sonar.yaml).'))
+
+    oculus_sonars_node = Node(
+         package='oculus_ros2',
+         executable='oculus_multi_sonar_node',
+         name='oculus_sonars',
+         parameters=[LaunchConfiguration('config')],
+         output='screen'
+      )
+    ld.add_action(oculus_sonars_node)
+
+    return ld
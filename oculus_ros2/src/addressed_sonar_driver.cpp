@@ -0,0 +1,269 @@
+#include "addressed_sonar_driver.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+
+namespace oculus {
+
+namespace {
+
+// Larger messages mean the stream lost its synchronization.
+constexpr uint32_t MaxPayloadSize = 64*1024*1024;
+
+} //namespace
+
+AddressedSonarDriver::AddressedSonarDriver(const IoServicePtr& service, const Options& options) :
+    service_(service),
+    options_(options),
+    statusSocket_(*service),
+    socket_(*service),
+    checker_(*service)
+{
+    std::memset(&status_, 0, sizeof(status_));
+    std::memset(&header_, 0, sizeof(header_));
+    std::memset(&config_, 0, sizeof(config_));
+    if(!options_.address.empty()) {
+        boost::system::error_code err;
+        auto address = boost::asio::ip::make_address_v4(options_.address, err);
+        if(err || address.is_unspecified()) {
+            throw std::runtime_error("AddressedSonarDriver : invalid sonar address '"
+                                     + options_.address + "'");
+        }
+        sonarAddress_ = address.to_uint();
+    }
+}
+
+AddressedSonarDriver::~AddressedSonarDriver()
+{
+    boost::system::error_code err;
+    statusSocket_.close(err);
+    socket_.close(err);
+}
+
+std::string AddressedSonarDriver::sonar_address() const
+{
+    uint32_t address = sonarAddress_;
+    if(address == 0)
+        return "";
+    return boost::asio::ip::address_v4(address).to_string();
+}
+
+void AddressedSonarDriver::start()
+{
+    try {
+        statusSocket_.open(Udp::v4());
+        statusSocket_.set_option(Udp::socket::reuse_address(true));
+        statusSocket_.bind(Udp::endpoint(Udp::v4(), options_.status_port));
+    }
+    catch(const boost::system::system_error& e) {
+        throw std::runtime_error("AddressedSonarDriver : could not listen to the sonar status on port "
+                                 + std::to_string(options_.status_port) + " (" + e.what() + ")");
+    }
+    boost::asio::post(*service_, [this]() { this->receive_status(); });
+}
+
+void AddressedSonarDriver::receive_status()
+{
+    statusSocket_.async_receive_from(boost::asio::buffer(&status_, sizeof(status_)), statusSender_,
+        [this](const boost::system::error_code& err, size_t size) { this->on_status(err, size); });
+}
+
+void AddressedSonarDriver::on_status(const boost::system::error_code& err, size_t size)
+{
+    if(err == boost::asio::error::operation_aborted)
+        return;
+    if(!err && size >= sizeof(status_) && status_.hdr.oculusId == OCULUS_CHECK_ID) {
+        // ipAddr is in network byte order.
+        const uint32_t address = ntohl(status_.ipAddr);
+        if(sonarAddress_ == 0 && address != 0)
+            sonarAddress_ = address;
+        if(address == sonarAddress_) {
+            for(const auto& callback : statusCallbacks_) {
+                callback(status_);
+            }
+            if(!connected_ && !connecting_)
+                this->connect();
+        }
+    }
+    this->receive_status();
+}
+
+void AddressedSonarDriver::connect()
+{
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+    connecting_ = true;
+    const uint64_t generation = ++generation_;
+    Tcp::endpoint remote(boost::asio::ip::address_v4(sonarAddress_), options_.data_port);
+    socket_.async_connect(remote, [this, generation](const boost::system::error_code& err) {
+        if(generation != generation_)
+            return;
+        connecting_ = false;
+        if(err) {
+            // Tried again on the next status.
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+            return;
+        }
+        boost::system::error_code ignored;
+        socket_.set_option(Tcp::no_delay(true), ignored);
+        connected_    = true;
+        lastReceived_ = std::chrono::steady_clock::now();
+        this->check_reception(generation);
+        this->read_header(generation);
+    });
+}
+
+void AddressedSonarDriver::close_connection()
+{
+    // Handlers of the closed connection see a different generation.
+    generation_++;
+    connected_  = false;
+    connecting_ = false;
+    writes_.clear();
+    checker_.cancel();
+    boost::system::error_code ignored;
+    socket_.shutdown(Tcp::socket::shutdown_both, ignored);
+    socket_.close(ignored);
+}
+
+void AddressedSonarDriver::check_reception(uint64_t generation)
+{
+    const auto timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options_.timeout));
+    checker_.expires_after(timeout / 4);
+    checker_.async_wait([this, generation, timeout](const boost::system::error_code& err) {
+        if(err || generation != generation_)
+            return;
+        if(std::chrono::steady_clock::now() - lastReceived_ > timeout) {
+            // Half open connection (sonar power cycled...).
+            this->close_connection();
+            return;
+        }
+        this->check_reception(generation);
+    });
+}
+
+void AddressedSonarDriver::read_header(uint64_t generation)
+{
+    boost::asio::async_read(socket_, boost::asio::buffer(&header_, sizeof(header_)),
+        [this, generation](const boost::system::error_code& err, size_t) {
+            if(generation != generation_)
+                return;
+            if(err || header_.oculusId != OCULUS_CHECK_ID || header_.payloadSize > MaxPayloadSize) {
+                this->close_connection();
+                return;
+            }
+            stamp_        = TimeSource::now();
+            lastReceived_ = std::chrono::steady_clock::now();
+            sonarId_      = header_.srcDeviceId;
+            // Messages are handed over whole, header included, as with
+            // oculus::SonarDriver.
+            data_.resize(sizeof(header_) + header_.payloadSize);
+            std::memcpy(data_.data(), &header_, sizeof(header_));
+            if(header_.payloadSize == 0) {
+                this->dispatch();
+                this->read_header(generation);
+                return;
+            }
+            this->read_payload(generation);
+        });
+}
+
+void AddressedSonarDriver::read_payload(uint64_t generation)
+{
+    boost::asio::async_read(socket_,
+        boost::asio::buffer(data_.data() + sizeof(header_), header_.payloadSize),
+        [this, generation](const boost::system::error_code& err, size_t) {
+            if(generation != generation_)
+                return;
+            if(err) {
+                this->close_connection();
+                return;
+            }
+            lastReceived_ = std::chrono::steady_clock::now();
+            this->dispatch();
+            this->read_header(generation);
+        });
+}
+
+void AddressedSonarDriver::dispatch()
+{
+    switch(header_.msgId) {
+        case messageSimplePingResult:
+            if(data_.size() >= sizeof(OculusSimplePingResult)) {
+                OculusSimplePingResult metadata;
+                std::memcpy(&metadata, data_.data(), sizeof(metadata));
+                for(const auto& callback : pingCallbacks_) {
+                    callback(metadata, data_);
+                }
+            }
+            break;
+        case messageDummy:
+            for(const auto& callback : dummyCallbacks_) {
+                callback();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void AddressedSonarDriver::send_ping_config(const PingConfig& config)
+{
+    boost::asio::post(*service_, [this, config]() {
+        config_ = config;
+        this->write(config);
+    });
+}
+
+void AddressedSonarDriver::standby()
+{
+    boost::asio::post(*service_, [this]() {
+        PingConfig config = config_;
+        config.pingRate = pingRateStandby;
+        this->write(config);
+    });
+}
+
+void AddressedSonarDriver::resume()
+{
+    boost::asio::post(*service_, [this]() { this->write(config_); });
+}
+
+void AddressedSonarDriver::write(PingConfig config)
+{
+    if(!connected_)
+        return;
+    config.head.oculusId    = OCULUS_CHECK_ID;
+    config.head.srcDeviceId = 0;
+    config.head.dstDeviceId = sonarId_;
+    config.head.msgId       = messageSimpleFire;
+    config.head.payloadSize = sizeof(config) - sizeof(OculusMessageHeader);
+
+    const bool idle = writes_.empty();
+    const auto bytes = reinterpret_cast<const uint8_t*>(&config);
+    writes_.emplace_back(bytes, bytes + sizeof(config));
+    if(idle)
+        this->write_next(generation_);
+}
+
+void AddressedSonarDriver::write_next(uint64_t generation)
+{
+    boost::asio::async_write(socket_, boost::asio::buffer(writes_.front()),
+        [this, generation](const boost::system::error_code& err, size_t) {
+            if(generation != generation_)
+                return;
+            if(err) {
+                this->close_connection();
+                return;
+            }
+            writes_.pop_front();
+            if(!writes_.empty())
+                this->write_next(generation);
+        });
+}
+
+} //namespace oculus
@@ -0,0 +1,135 @@
+#ifndef _DEF_OCULUS_ROS_ADDRESSED_SONAR_DRIVER_H_
+#define _DEF_OCULUS_ROS_ADDRESSED_SONAR_DRIVER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <oculus_driver/Oculus.h>
+
+namespace oculus {
+
+// Client of the sonar at a given address, with the same callbacks and
+// commands as oculus::SonarDriver. oculus::SonarDriver connects to the first
+// sonar it hears of : with several sonars on the network, each
+// AddressedSonarDriver only listens to the status messages advertising its
+// own address and connects to that sonar only.
+//
+// The status socket is bound with SO_REUSEADDR, so several drivers of the
+// same host all receive the (broadcast) status messages. The data connection
+// is opened on the first status of the sonar, and opened again on the next
+// status once lost (closed on error, or when nothing was received during
+// timeout seconds).
+//
+// Callbacks are called from the io_service thread. Commands can be called
+// from any thread, they are run on the io_service thread. Commands sent while
+// not connected are dropped (the configuration is to be sent again on
+// connection). The io_service must not be running anymore when the driver is
+// destroyed.
+class AddressedSonarDriver
+{
+    public:
+
+    using IoService      = boost::asio::io_service;
+    using IoServicePtr   = std::shared_ptr<IoService>;
+    using PingConfig     = OculusSimpleFireMessage;
+    using TimeSource     = std::chrono::system_clock;
+    using TimePoint      = TimeSource::time_point;
+    using PingCallback   = std::function<void(const OculusSimplePingResult&, const std::vector<uint8_t>&)>;
+    using StatusCallback = std::function<void(const OculusStatusMsg&)>;
+    using DummyCallback  = std::function<void()>;
+
+    struct Options
+    {
+        std::string address;            // IPv4 of the sonar, empty for the first one heard of
+        uint16_t    status_port = 52102;
+        uint16_t    data_port   = 52100;
+        double      timeout     = 5.0;  // seconds without message before reconnecting
+    };
+
+    // Throws std::runtime_error if the address is invalid.
+    AddressedSonarDriver(const IoServicePtr& service, const Options& options);
+    ~AddressedSonarDriver();
+
+    AddressedSonarDriver(const AddressedSonarDriver&)            = delete;
+    AddressedSonarDriver& operator=(const AddressedSonarDriver&) = delete;
+
+    // To be registered before start().
+    void add_ping_callback(const PingCallback& callback)     { pingCallbacks_.push_back(callback);   }
+    void add_status_callback(const StatusCallback& callback) { statusCallbacks_.push_back(callback); }
+    void add_dummy_callback(const DummyCallback& callback)   { dummyCallbacks_.push_back(callback);  }
+
+    // Opens the status socket and waits for the sonar. Throws
+    // std::runtime_error if the socket cannot be opened.
+    void start();
+
+    void send_ping_config(const PingConfig& config);
+    // Last configuration sent, with a standby ping rate.
+    void standby();
+    // Last configuration sent again.
+    void resume();
+
+    bool connected() const { return connected_; }
+    // Address of the sonar, empty until a sonar is heard of if none was
+    // given.
+    std::string sonar_address() const;
+
+    // Reception time of the current message (to be called from the
+    // callbacks).
+    TimePoint last_header_stamp() const { return stamp_; }
+
+    protected:
+
+    using Udp = boost::asio::ip::udp;
+    using Tcp = boost::asio::ip::tcp;
+
+    IoServicePtr service_;
+    Options      options_;
+
+    std::vector<PingCallback>   pingCallbacks_;
+    std::vector<StatusCallback> statusCallbacks_;
+    std::vector<DummyCallback>  dummyCallbacks_;
+
+    // 0 until a sonar is selected, host byte order.
+    std::atomic<uint32_t> sonarAddress_{0};
+
+    // Only used by the io_service thread.
+    Udp::socket                      statusSocket_;
+    Udp::endpoint                    statusSender_;
+    OculusStatusMsg                  status_;
+    Tcp::socket                      socket_;
+    boost::asio::steady_timer        checker_;
+    uint64_t                         generation_ = 0; // of the data connection
+    bool                             connecting_ = false;
+    uint16_t                         sonarId_    = 0;
+    OculusMessageHeader              header_;
+    std::vector<uint8_t>             data_;
+    std::chrono::steady_clock::time_point lastReceived_;
+    TimePoint                        stamp_;
+    PingConfig                       config_;
+    std::deque<std::vector<uint8_t>> writes_;
+
+    std::atomic<bool> connected_{false};
+
+    void receive_status();
+    void on_status(const boost::system::error_code& err, size_t size);
+    void connect();
+    void close_connection();
+    void check_reception(uint64_t generation);
+    void read_header(uint64_t generation);
+    void read_payload(uint64_t generation);
+    void dispatch();
+    void write(PingConfig config);
+    void write_next(uint64_t generation);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_ADDRESSED_SONAR_DRIVER_H_
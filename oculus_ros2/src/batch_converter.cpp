@@ -0,0 +1,597 @@
+#include "batch_converter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace oculus {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool is_ping(const uint8_t* data, size_t size)
+{
+    if(size < sizeof(OculusSimplePingResult))
+        return false;
+    OculusMessageHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    return header.oculusId == OCULUS_CHECK_ID && header.msgId == messageSimplePingResult;
+}
+
+void append(std::vector<uint8_t>& output, const void* data, size_t size)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    output.insert(output.end(), bytes, bytes + size);
+}
+
+void append_item(std::vector<uint8_t>& output, double time, const uint8_t* data, size_t size,
+                 uint16_t compression = log::NoCompression, uint32_t rawSize = 0)
+{
+    auto header = log::make_item_header(time, size, compression, rawSize);
+    append(output, &header, sizeof(header));
+    append(output, data, size);
+}
+
+void write_all(int fd, const struct iovec* chunks, int count, const std::string& filename)
+{
+    std::vector<struct iovec> remaining(chunks, chunks + count);
+    size_t index = 0;
+    while(index < remaining.size()) {
+        ssize_t written = writev(fd, remaining.data() + index, remaining.size() - index);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            throw std::runtime_error("Could not write to '" + filename + "' : " + std::strerror(errno));
+        }
+        // Partial write, skipping what was written.
+        while(index < remaining.size() && static_cast<size_t>(written) >= remaining[index].iov_len) {
+            written -= remaining[index].iov_len;
+            index++;
+        }
+        if(index < remaining.size()) {
+            remaining[index].iov_base = static_cast<uint8_t*>(remaining[index].iov_base) + written;
+            remaining[index].iov_len -= written;
+        }
+    }
+}
+
+void write_all(int fd, const std::vector<uint8_t>& data, const std::string& filename)
+{
+    struct iovec chunk = {const_cast<uint8_t*>(data.data()), data.size()};
+    write_all(fd, &chunk, 1, filename);
+}
+
+} //namespace
+
+bool LogMessageSource::next(Message& message)
+{
+    LogStreamReader::Item item;
+    while(reader_.next(item)) {
+        if(item.header->messageType != log::RawSonarMessage)
+            continue;
+        message.time        = item.time;
+        message.compression = item.header->compression;
+        message.data        = item.data;
+        message.size        = item.size;
+        return true;
+    }
+    return false;
+}
+
+BatchConverter::BatchConverter(const Options& options) :
+    options_(options),
+    filesDone_(0),
+    filesFailed_(0),
+    messages_(0),
+    pings_(0),
+    bytesTotal_(0),
+    bytesRead_(0),
+    bytesWritten_(0),
+    started_(false)
+{
+    options_.every      = std::max(1u, options_.every);
+    options_.chunk_size = std::max<size_t>(1, options_.chunk_size);
+
+    pool_ = std::make_unique<WorkStealingPool>(options_.threads);
+    PingCodec::Options codecOptions;
+    codecOptions.level             = options_.compression_level;
+    codecOptions.quantization_bits = options_.quantization_bits;
+    for(unsigned int i = 0; i < pool_->size(); i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->codec = std::make_unique<PingCodec>(codecOptions);
+        worker->converter.set_width(options_.fan_width);
+        workers_.push_back(std::move(worker));
+    }
+    maxActiveJobs_   = pool_->size();
+    chunksAvailable_ = options_.max_chunks > 0 ? options_.max_chunks : 2*pool_->size();
+}
+
+BatchConverter::~BatchConverter()
+{
+    // The workers must be stopped before the jobs they may reference.
+    pool_.reset();
+}
+
+void BatchConverter::add_input(const std::string& name, const std::string& stem,
+                               const std::string& directory, uint64_t size,
+                               SourceFactory open)
+{
+    inputs_.push_back(Input{name, stem, directory, size, std::move(open)});
+    bytesTotal_ += size;
+}
+
+void BatchConverter::add_log(const std::string& filename)
+{
+    std::error_code error;
+    auto size = fs::file_size(filename, error);
+    if(error) {
+        throw std::runtime_error("Could not open '" + filename + "' : " + error.message());
+    }
+    fs::path path(filename);
+    this->add_input(filename, path.stem().string(), path.parent_path().string(), size,
+                    [filename]() { return std::make_unique<LogMessageSource>(filename); });
+}
+
+std::string BatchConverter::output_path(const Input& input) const
+{
+    fs::path directory = options_.output_directory.empty() ? input.directory
+                                                           : options_.output_directory;
+    switch(options_.format) {
+        case Archive:   return (directory / (input.stem + "_compressed.oculus")).string();
+        case FanImages: return (directory / (input.stem + "_fan")).string();
+        default:        return (directory / (input.stem + ".oculus")).string();
+    }
+}
+
+bool BatchConverter::run()
+{
+    if(started_.exchange(true))
+        throw std::logic_error("BatchConverter::run can only be called once.");
+    startTime_ = std::chrono::steady_clock::now();
+    this->start_jobs();
+    pool_->wait_idle();
+    return filesFailed_ == 0;
+}
+
+BatchConverter::Statistics BatchConverter::statistics() const
+{
+    Statistics stats;
+    stats.files_total   = inputs_.size();
+    stats.files_done    = filesDone_;
+    stats.files_failed  = filesFailed_;
+    stats.messages      = messages_;
+    stats.pings         = pings_;
+    stats.bytes_total   = bytesTotal_;
+    stats.bytes_read    = bytesRead_;
+    stats.bytes_written = bytesWritten_;
+    stats.steals        = pool_->steals();
+    if(started_) {
+        stats.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                                      - startTime_).count();
+    }
+    return stats;
+}
+
+std::vector<std::string> BatchConverter::errors() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return errors_;
+}
+
+void BatchConverter::add_error(const Job& job, const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    errors_.push_back(job.input.name + " : " + error);
+}
+
+void BatchConverter::start_jobs()
+{
+    // One recording per worker at most : they are read sequentially, more
+    // would only hold more buffers.
+    while(true) {
+        Job* job = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(nextInput_ >= inputs_.size() || activeJobs_ >= maxActiveJobs_)
+                return;
+            jobs_.push_back(std::make_unique<Job>());
+            job = jobs_.back().get();
+            job->input = inputs_[nextInput_++];
+            activeJobs_++;
+        }
+        pool_->submit([this, job]() { this->read_chunk(job, false); });
+    }
+}
+
+void BatchConverter::open_job(Job& job)
+{
+    job.source = job.input.open();
+    job.output = this->output_path(job.input);
+
+    std::error_code error;
+    if(fs::exists(job.output)) {
+        if(fs::equivalent(job.output, job.input.name, error)) {
+            throw std::runtime_error("the output '" + job.output + "' would overwrite the input.");
+        }
+        if(!options_.overwrite) {
+            throw std::runtime_error("'" + job.output + "' already exists.");
+        }
+    }
+
+    // Left over by an interrupted run.
+    job.partial = job.output + ".part";
+    fs::remove_all(job.partial, error);
+
+    std::string filename = job.partial;
+    if(options_.format == FanImages) {
+        fs::create_directories(job.partial, error);
+        filename = (fs::path(job.partial) / "index.csv").string();
+    }
+    else if(fs::path(job.partial).has_parent_path()) {
+        fs::create_directories(fs::path(job.partial).parent_path(), error);
+    }
+    job.fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(job.fd < 0) {
+        throw std::runtime_error("Could not open '" + filename + "' : " + std::strerror(errno));
+    }
+    posix_fadvise(job.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void BatchConverter::read_chunk(Job* job, bool reserved)
+{
+    std::shared_ptr<Chunk> chunk;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!reserved) {
+            if(chunksAvailable_ == 0) {
+                // Resumed by release_chunk().
+                parked_.push_back(job);
+                return;
+            }
+            chunksAvailable_--;
+        }
+        if(freeChunks_.empty()) {
+            chunk = std::make_shared<Chunk>();
+        }
+        else {
+            chunk = std::move(freeChunks_.back());
+            freeChunks_.pop_back();
+        }
+    }
+
+    bool eof;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        eof = job->failed;
+    }
+    if(!eof) {
+        try {
+            if(!job->source)
+                this->open_job(*job);
+
+            // Only this task touches the source, the next read is submitted
+            // when this one is done.
+            MessageSource::Message message;
+            while(chunk->input.size() < options_.chunk_size) {
+                if(!job->source->next(message)) {
+                    eof = true;
+                    break;
+                }
+                Entry entry;
+                entry.time        = message.time;
+                entry.compression = message.compression;
+                entry.offset      = chunk->input.size();
+                entry.size        = message.size;
+                entry.ping        = job->pings;
+                if(message.compression == log::PingCodecCompression || is_ping(message.data, message.size))
+                    job->pings++;
+                chunk->input.insert(chunk->input.end(), message.data, message.data + message.size);
+                chunk->entries.push_back(entry);
+            }
+            messages_ += chunk->entries.size();
+            auto position = std::min(job->source->position(), job->input.size);
+            if(position > job->position) {
+                bytesRead_   += position - job->position;
+                job->position = position;
+            }
+        }
+        catch(const std::exception& e) {
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->failed = true;
+            }
+            this->add_error(*job, e.what());
+            eof = true;
+        }
+    }
+
+    bool convert = false, readNext = false, finishNow = false;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if(eof)
+            job->eof = true;
+        if(!chunk->entries.empty() && !job->failed) {
+            chunk->sequence = job->nextSequence++;
+            job->inFlight++;
+            convert = true;
+        }
+        if(job->eof) {
+            job->reading = false;
+            finishNow = job->inFlight == 0 && !job->finished;
+            job->finished |= finishNow;
+        }
+        else {
+            readNext = true;
+        }
+    }
+
+    if(convert) {
+        pool_->submit([this, job, chunk]() { this->convert_chunk(job, chunk); });
+    }
+    else {
+        this->release_chunk(chunk);
+    }
+    // Submitted last : it is popped first by this worker (LIFO) while the
+    // conversion is stolen by the others.
+    if(readNext) {
+        pool_->submit([this, job]() { this->read_chunk(job, false); });
+    }
+    if(finishNow) {
+        this->finish(job);
+    }
+}
+
+void BatchConverter::convert_chunk(Job* job, std::shared_ptr<Chunk> chunk)
+{
+    auto& worker = *workers_[pool_->worker_index()];
+    chunk->output.clear();
+    chunk->pings = 0;
+
+    bool failed = false;
+    try {
+        if(chunk->sequence == 0) {
+            if(options_.format == FanImages) {
+                const char header[] = "image,time,ping_id\n";
+                append(chunk->output, header, sizeof(header) - 1);
+            }
+            else {
+                auto header = log::make_file_header(chunk->entries.front().time);
+                append(chunk->output, &header, sizeof(header));
+            }
+        }
+        for(const auto& entry : chunk->entries) {
+            this->convert_message(worker, entry, chunk->input.data() + entry.offset,
+                                  job->partial, *chunk);
+        }
+    }
+    catch(const std::exception& e) {
+        this->add_error(*job, e.what());
+        failed = true;
+    }
+    pings_ += chunk->pings;
+
+    // Chunks are written in the order they were read. The writes of a
+    // recording are serialized by its mutex, they are sequential and large.
+    std::vector<std::shared_ptr<Chunk>> written;
+    bool finishNow = false;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if(failed) {
+            job->failed = true;
+            job->eof    = true;
+        }
+        auto position = std::find_if(job->done.begin(), job->done.end(),
+            [&](const std::shared_ptr<Chunk>& other) { return other->sequence > chunk->sequence; });
+        job->done.insert(position, chunk);
+
+        while(!job->done.empty() && job->done.front()->sequence == job->nextWrite) {
+            auto next = std::move(job->done.front());
+            job->done.pop_front();
+            if(!job->failed && !next->output.empty()) {
+                try {
+                    write_all(job->fd, next->output, options_.format == FanImages
+                              ? (fs::path(job->partial) / "index.csv").string() : job->partial);
+                    bytesWritten_ += next->output.size();
+                }
+                catch(const std::exception& e) {
+                    job->failed = true;
+                    job->eof    = true;
+                    this->add_error(*job, e.what());
+                }
+            }
+            job->nextWrite++;
+            job->inFlight--;
+            written.push_back(std::move(next));
+        }
+        finishNow = job->eof && job->inFlight == 0 && !job->reading && !job->finished;
+        job->finished |= finishNow;
+    }
+
+    for(auto& done : written) {
+        this->release_chunk(std::move(done));
+    }
+    if(finishNow) {
+        this->finish(job);
+    }
+}
+
+void BatchConverter::convert_message(Worker& worker, const Entry& entry, const uint8_t* data,
+                                     const std::string& directory, Chunk& chunk)
+{
+    if(entry.compression != log::NoCompression && entry.compression != log::PingCodecCompression)
+        return; // unknown compression
+
+    if(options_.format == Archive) {
+        if(entry.compression == log::PingCodecCompression) {
+            chunk.pings++;
+            append_item(chunk.output, entry.time, data, entry.size, log::PingCodecCompression,
+                        PingCodec::raw_size(data, entry.size));
+        }
+        else if(is_ping(data, entry.size)) {
+            chunk.pings++;
+            // PingCodec works on the message as delivered by the driver.
+            worker.message.assign(data, data + entry.size);
+            OculusSimplePingResult metadata;
+            std::memcpy(&metadata, data, sizeof(metadata));
+            if(worker.codec->compress(metadata, worker.message, worker.buffer)) {
+                append_item(chunk.output, entry.time, worker.buffer.data(), worker.buffer.size(),
+                            log::PingCodecCompression, entry.size);
+            }
+            else {
+                append_item(chunk.output, entry.time, data, entry.size);
+            }
+        }
+        else {
+            append_item(chunk.output, entry.time, data, entry.size);
+        }
+        return;
+    }
+
+    const uint8_t* message = data;
+    size_t         size    = entry.size;
+    bool           inScratch = false;
+    if(entry.compression == log::PingCodecCompression) {
+        if(!worker.codec->decompress(data, entry.size, worker.message)) {
+            throw std::runtime_error("corrupted compressed ping in item "
+                                     + std::to_string(entry.ping) + ".");
+        }
+        message   = worker.message.data();
+        size      = worker.message.size();
+        inScratch = true;
+    }
+    const bool ping = is_ping(message, size);
+    chunk.pings += ping;
+
+    if(options_.format == OculusLog) {
+        append_item(chunk.output, entry.time, message, size);
+        return;
+    }
+
+    // FanImages
+    if(!ping || entry.ping % options_.every != 0)
+        return;
+    if(!inScratch)
+        worker.message.assign(message, message + size);
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, message, sizeof(metadata));
+    if(!worker.converter.convert(metadata, worker.message, worker.image))
+        return;
+
+    const unsigned int width  = worker.converter.width();
+    const unsigned int height = worker.converter.height();
+    const bool is16Bits = worker.image.size() >= 2*static_cast<size_t>(width)*height;
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "ping_%06" PRIu64 ".pgm", entry.ping);
+    char header[64];
+    int headerSize = std::snprintf(header, sizeof(header), "P5\n%u %u\n%u\n",
+                                   width, height, is16Bits ? 65535u : 255u);
+    // PGM samples are big endian.
+    const uint8_t* pixels = worker.image.data();
+    size_t pixelsSize     = static_cast<size_t>(width)*height*(is16Bits ? 2 : 1);
+    if(is16Bits) {
+        worker.buffer.resize(pixelsSize);
+        for(size_t i = 0; i < pixelsSize; i += 2) {
+            worker.buffer[i]     = pixels[i + 1];
+            worker.buffer[i + 1] = pixels[i];
+        }
+        pixels = worker.buffer.data();
+    }
+
+    const std::string filename = (fs::path(directory) / name).string();
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        throw std::runtime_error("Could not open '" + filename + "' : " + std::strerror(errno));
+    }
+    struct iovec chunks[2] = {
+        {header, static_cast<size_t>(headerSize)},
+        {const_cast<uint8_t*>(pixels), pixelsSize},
+    };
+    try {
+        write_all(fd, chunks, 2, filename);
+    }
+    catch(...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    bytesWritten_ += headerSize + pixelsSize;
+
+    char line[96];
+    int lineSize = std::snprintf(line, sizeof(line), "%s,%.6f,%u\n", name, entry.time, metadata.pingId);
+    append(chunk.output, line, lineSize);
+}
+
+void BatchConverter::release_chunk(std::shared_ptr<Chunk> chunk)
+{
+    // The buffers keep their capacity for the next read.
+    chunk->input.clear();
+    chunk->entries.clear();
+    chunk->output.clear();
+
+    Job* resume = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        freeChunks_.push_back(std::move(chunk));
+        if(parked_.empty()) {
+            chunksAvailable_++;
+        }
+        else {
+            // Handing the chunk over to a waiting read.
+            resume = parked_.front();
+            parked_.pop_front();
+        }
+    }
+    if(resume) {
+        pool_->submit([this, resume]() { this->read_chunk(resume, true); });
+    }
+}
+
+void BatchConverter::finish(Job* job)
+{
+    if(job->fd >= 0) {
+        ::close(job->fd);
+        job->fd = -1;
+    }
+    job->source.reset();
+    // Truncated recordings end early, accounting for the rest of the file.
+    bytesRead_ += job->input.size - job->position;
+    if(!job->partial.empty()) {
+        std::error_code error;
+        if(!job->failed) {
+            // --overwrite : a previous output is only replaced now (rename
+            // replaces files but not non-empty directories).
+            if(fs::is_directory(job->output, error))
+                fs::remove_all(job->output, error);
+            fs::rename(job->partial, job->output, error);
+            if(error) {
+                job->failed = true;
+                this->add_error(*job, "could not rename '" + job->partial + "' to '"
+                                      + job->output + "' : " + error.message());
+            }
+        }
+        if(job->failed)
+            fs::remove_all(job->partial, error);
+    }
+    if(job->failed)
+        filesFailed_++;
+    filesDone_++;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        activeJobs_--;
+        jobs_.remove_if([job](const std::unique_ptr<Job>& other) { return other.get() == job; });
+    }
+    this->start_jobs();
+}
+
+} //namespace oculus
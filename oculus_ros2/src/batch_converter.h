@@ -0,0 +1,253 @@
+#ifndef _DEF_OCULUS_ROS_BATCH_CONVERTER_H_
+#define _DEF_OCULUS_ROS_BATCH_CONVERTER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "log_stream_reader.h"
+#include "ping_codec.h"
+#include "scan_converter.h"
+#include "work_stealing_pool.h"
+
+namespace oculus {
+
+// Raw sonar messages read sequentially from a recording, for BatchConverter.
+class MessageSource
+{
+    public:
+
+    struct Message
+    {
+        double         time;        // reception time, seconds since epoch
+        uint16_t       compression; // log::NoCompression or log::PingCodecCompression
+        const uint8_t* data;        // valid until the next call to next()
+        size_t         size;
+    };
+
+    virtual ~MessageSource() = default;
+
+    // Returns false at the end of the recording, throws std::runtime_error on
+    // read errors.
+    virtual bool next(Message& message) = 0;
+    // Input bytes consumed so far (for progress reporting).
+    virtual uint64_t position() const = 0;
+};
+
+// .oculus logs, raw or compressed (see BatchConverter::Archive).
+class LogMessageSource : public MessageSource
+{
+    public:
+
+    explicit LogMessageSource(const std::string& filename) : reader_(filename) {}
+
+    bool next(Message& message) override;
+    uint64_t position() const override { return reader_.position(); }
+
+    protected:
+
+    LogStreamReader reader_;
+};
+
+// Converts recordings in parallel : each recording is read sequentially by
+// chunks of about chunk_size bytes, the chunks are converted by the workers
+// of a WorkStealingPool and written back in order. At most max_chunks chunks
+// are in memory at once, whatever the number and the size of the
+// recordings.
+//
+// Output formats :
+//  - OculusLog : <stem>.oculus, uncompressed .oculus log (compressed pings
+//    are restored).
+//  - Archive   : <stem>_compressed.oculus, .oculus log in which the pings are
+//    compressed with PingCodec (log::PingCodecCompression items, replayed
+//    as is by LogReplayer).
+//  - FanImages : <stem>_fan/ directory with one PGM fan image per ping
+//    (ScanConverter, 16 bits images for 16 bits pings) and an index.csv file
+//    giving the time and the ping_id of each image.
+//
+// Outputs are written under a temporary name (<output>.part) and renamed when
+// the conversion succeeded, a failed conversion leaves no partial output.
+class BatchConverter
+{
+    public:
+
+    enum Format { OculusLog, Archive, FanImages };
+
+    struct Options
+    {
+        Format       format            = OculusLog;
+        std::string  output_directory;          // empty : next to each input
+        bool         overwrite         = false;
+        unsigned int threads           = 0;     // 0 : all cores
+        size_t       chunk_size        = 4*1024*1024; // input bytes per task
+        unsigned int max_chunks        = 0;     // 0 : 2 per thread
+        // Archive
+        int          compression_level = 3;
+        unsigned int quantization_bits = 0;     // 0 : lossless
+        // FanImages
+        unsigned int fan_width         = 512;
+        unsigned int every             = 1;     // one image every n pings
+    };
+
+    struct Statistics
+    {
+        uint64_t files_total   = 0;
+        uint64_t files_done    = 0; // including the failed ones
+        uint64_t files_failed  = 0;
+        uint64_t messages      = 0;
+        uint64_t pings         = 0;
+        uint64_t bytes_total   = 0; // input size
+        uint64_t bytes_read    = 0;
+        uint64_t bytes_written = 0;
+        uint64_t steals        = 0;
+        double   elapsed       = 0.0;
+
+        double progress() const {
+            return bytes_total > 0 ? static_cast<double>(bytes_read) / bytes_total : 0.0;
+        }
+        double read_rate() const { // MB/s
+            return elapsed > 0.0 ? 1.0e-6*bytes_read / elapsed : 0.0;
+        }
+        double write_rate() const {
+            return elapsed > 0.0 ? 1.0e-6*bytes_written / elapsed : 0.0;
+        }
+        double ping_rate() const {
+            return elapsed > 0.0 ? pings / elapsed : 0.0;
+        }
+    };
+
+    using SourceFactory = std::function<std::unique_ptr<MessageSource>()>;
+
+    explicit BatchConverter(const Options& options);
+    ~BatchConverter();
+
+    BatchConverter(const BatchConverter&)            = delete;
+    BatchConverter& operator=(const BatchConverter&) = delete;
+
+    // stem names the outputs, size is the input size in bytes (progress). The
+    // source is only opened when the recording is converted.
+    void add_input(const std::string& name, const std::string& stem,
+                   const std::string& directory, uint64_t size,
+                   SourceFactory open);
+    // Adds a .oculus log. Throws std::runtime_error if it does not exist.
+    void add_log(const std::string& filename);
+
+    // Converts all the inputs, returns false if any of them failed (see
+    // errors()). Can only be called once.
+    bool run();
+
+    // Can be called from any thread while run() is converting.
+    Statistics statistics() const;
+    std::vector<std::string> errors() const;
+    const Options& options() const { return options_; }
+
+    protected:
+
+    struct Input
+    {
+        std::string   name;
+        std::string   stem;
+        std::string   directory;
+        uint64_t      size;
+        SourceFactory open;
+    };
+
+    struct Entry
+    {
+        double   time;
+        uint16_t compression;
+        size_t   offset; // in Chunk::input
+        size_t   size;
+        uint64_t ping;   // index of the ping in the recording (FanImages)
+    };
+
+    struct Chunk
+    {
+        size_t               sequence = 0;
+        std::vector<uint8_t> input;
+        std::vector<Entry>   entries;
+        std::vector<uint8_t> output; // written in sequence order
+        uint64_t             pings = 0;
+    };
+
+    struct Job
+    {
+        Input                         input;
+        std::unique_ptr<MessageSource> source;
+        std::string                   output;  // file (or directory for FanImages)
+        std::string                   partial; // output while converting
+        int                           fd = -1;
+        uint64_t                      position = 0; // source position already counted
+        uint64_t                      pings    = 0; // read so far
+
+        std::mutex                    mutex;
+        bool                          reading  = true;  // a read task is queued, running or parked
+        bool                          eof      = false;
+        bool                          failed   = false;
+        bool                          finished = false;
+        size_t                        nextSequence = 0;
+        size_t                        nextWrite    = 0;
+        size_t                        inFlight     = 0; // chunks read, not written yet
+        std::list<std::shared_ptr<Chunk>> done;      // converted, waiting for their turn
+    };
+
+    // Per worker scratch data (PingCodec and ScanConverter keep state between
+    // pings).
+    struct Worker
+    {
+        std::unique_ptr<PingCodec> codec;
+        ScanConverter              converter;
+        std::vector<uint8_t>       message;
+        std::vector<uint8_t>       image;
+        std::vector<uint8_t>       buffer;
+    };
+
+    Options                     options_;
+    std::vector<Input>          inputs_;
+    std::unique_ptr<WorkStealingPool> pool_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    mutable std::mutex          mutex_;
+    size_t                      nextInput_   = 0;
+    unsigned int                activeJobs_  = 0;
+    unsigned int                maxActiveJobs_ = 0;
+    std::list<std::unique_ptr<Job>> jobs_;
+    // Chunks are recycled (with their capacity) : chunksAvailable_ more can
+    // be handed out before the reads have to wait.
+    unsigned int                chunksAvailable_ = 0;
+    std::vector<std::shared_ptr<Chunk>> freeChunks_;
+    std::deque<Job*>            parked_;     // jobs waiting for a chunk to read
+    std::vector<std::string>    errors_;
+
+    std::atomic<uint64_t>       filesDone_;
+    std::atomic<uint64_t>       filesFailed_;
+    std::atomic<uint64_t>       messages_;
+    std::atomic<uint64_t>       pings_;
+    std::atomic<uint64_t>       bytesTotal_;
+    std::atomic<uint64_t>       bytesRead_;
+    std::atomic<uint64_t>       bytesWritten_;
+    std::chrono::steady_clock::time_point startTime_;
+    std::atomic<bool>           started_;
+
+    std::string output_path(const Input& input) const;
+    void start_jobs();
+    void open_job(Job& job);
+    void read_chunk(Job* job, bool reserved);
+    void convert_chunk(Job* job, std::shared_ptr<Chunk> chunk);
+    void convert_message(Worker& worker, const Entry& entry, const uint8_t* data,
+                         const std::string& directory, Chunk& chunk);
+    void release_chunk(std::shared_ptr<Chunk> chunk);
+    void add_error(const Job& job, const std::string& error);
+    void finish(Job* job);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_BATCH_CONVERTER_H_
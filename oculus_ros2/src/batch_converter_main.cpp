@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rclcpp/serialization.hpp"
+#include "rclcpp/serialized_message.hpp"
+#include "rosbag2_cpp/reader.hpp"
+#include "rosbag2_cpp/converter_options.hpp"
+#include "rosbag2_storage/storage_filter.hpp"
+#include "rosbag2_storage/storage_options.hpp"
+
+#include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+#include "oculus_interfaces/msg/oculus_compressed_ping.hpp"
+
+#include "batch_converter.h"
+
+// Offline conversion of recorded pings (rosbag2 bags and .oculus logs) to
+// .oculus logs, compressed archives or fan images, on all cores (see
+// oculus::BatchConverter).
+
+namespace fs = std::filesystem;
+
+static const std::string StampedPingType    = "oculus_interfaces/msg/OculusStampedPing";
+static const std::string CompressedPingType = "oculus_interfaces/msg/OculusCompressedPing";
+
+// Pings of a rosbag2 bag, read one message at a time. ping.data of the ROS
+// messages is the raw sonar message, compressed pings are handed over as
+// is.
+class BagMessageSource : public oculus::MessageSource
+{
+    public:
+
+    BagMessageSource(const std::string& uri, const std::string& topic)
+    {
+        rosbag2_storage::StorageOptions storage;
+        // storage_id left empty : rosbag2 infers it (sqlite3, mcap...) from
+        // the metadata or the file extension.
+        storage.uri = uri;
+        rosbag2_cpp::ConverterOptions converter;
+        converter.input_serialization_format  = "cdr";
+        converter.output_serialization_format = "cdr";
+        reader_.open(storage, converter);
+
+        std::vector<std::string> candidates;
+        for(const auto& metadata : reader_.get_all_topics_and_types()) {
+            if(!topic.empty() && metadata.name != topic)
+                continue;
+            if(metadata.type == StampedPingType || metadata.type == CompressedPingType) {
+                candidates.push_back(metadata.name);
+                compressed_ = metadata.type == CompressedPingType;
+            }
+            else if(!topic.empty()) {
+                throw std::runtime_error("topic '" + topic + "' is a " + metadata.type
+                                         + ", not an Oculus ping.");
+            }
+        }
+        if(candidates.empty()) {
+            throw std::runtime_error(topic.empty() ? "no " + StampedPingType + " nor "
+                                     + CompressedPingType + " topic."
+                                     : "no topic '" + topic + "'.");
+        }
+        if(candidates.size() > 1) {
+            std::string names;
+            for(const auto& name : candidates)
+                names += (names.empty() ? "" : ", ") + name;
+            throw std::runtime_error("several ping topics (" + names + "), select one with --topic.");
+        }
+        rosbag2_storage::StorageFilter filter;
+        filter.topics = candidates;
+        reader_.set_filter(filter);
+    }
+
+    bool next(Message& message) override
+    {
+        if(!reader_.has_next())
+            return false;
+        auto bagMessage = reader_.read_next();
+        position_ += bagMessage->serialized_data->buffer_length;
+
+        rclcpp::SerializedMessage serialized(*bagMessage->serialized_data);
+        message.time = 1.0e-9*bagMessage->time_stamp;
+        if(compressed_) {
+            compressedSerialization_.deserialize_message(&serialized, &compressedPing_);
+            message.compression = oculus::log::PingCodecCompression;
+            message.data        = compressedPing_.data.data();
+            message.size        = compressedPing_.data.size();
+        }
+        else {
+            pingSerialization_.deserialize_message(&serialized, &ping_);
+            message.compression = oculus::log::NoCompression;
+            message.data        = ping_.ping.data.data();
+            message.size        = ping_.ping.data.size();
+        }
+        return true;
+    }
+
+    uint64_t position() const override { return position_; }
+
+    protected:
+
+    rosbag2_cpp::Reader reader_;
+    bool                compressed_ = false;
+    uint64_t            position_   = 0;
+
+    // Deserializing in the same messages reuses their buffers.
+    rclcpp::Serialization<oculus_interfaces::msg::OculusStampedPing>    pingSerialization_;
+    rclcpp::Serialization<oculus_interfaces::msg::OculusCompressedPing> compressedSerialization_;
+    oculus_interfaces::msg::OculusStampedPing    ping_;
+    oculus_interfaces::msg::OculusCompressedPing compressedPing_;
+};
+
+static uint64_t disk_size(const fs::path& path)
+{
+    if(!fs::is_directory(path))
+        return fs::file_size(path);
+    uint64_t size = 0;
+    for(const auto& entry : fs::recursive_directory_iterator(path)) {
+        if(entry.is_regular_file())
+            size += entry.file_size();
+    }
+    return size;
+}
+
+static bool is_bag_directory(const fs::path& path)
+{
+    return fs::is_directory(path) && fs::exists(path / "metadata.yaml");
+}
+
+// Directories are searched recursively for .oculus logs and bags.
+static void add_inputs(oculus::BatchConverter& converter, fs::path path,
+                       const std::string& topic)
+{
+    if(!path.has_filename()) // trailing slash
+        path = path.parent_path();
+
+    auto add_bag = [&](const fs::path& bag) {
+        std::string uri = bag.string();
+        std::string stem = fs::is_directory(bag) ? bag.filename().string() : bag.stem().string();
+        converter.add_input(uri, stem, bag.parent_path().string(), disk_size(bag),
+            [uri, topic]() { return std::make_unique<BagMessageSource>(uri, topic); });
+    };
+
+    if(is_bag_directory(path) || path.extension() == ".db3" || path.extension() == ".mcap") {
+        add_bag(path);
+    }
+    else if(fs::is_directory(path)) {
+        std::vector<fs::path> entries;
+        for(const auto& entry : fs::directory_iterator(path))
+            entries.push_back(entry.path());
+        std::sort(entries.begin(), entries.end());
+        for(const auto& entry : entries) {
+            if(fs::is_directory(entry) || entry.extension() == ".oculus")
+                add_inputs(converter, entry, topic);
+        }
+    }
+    else if(fs::exists(path)) {
+        converter.add_log(path.string());
+    }
+    else {
+        throw std::runtime_error("'" + path.string() + "' does not exist.");
+    }
+}
+
+static void print_progress(std::ostream& os, const oculus::BatchConverter::Statistics& stats)
+{
+    double progress = stats.progress();
+    os << "[" << std::fixed << std::setprecision(1) << std::setw(5) << 100.0*progress << "%] "
+       << stats.files_done << "/" << stats.files_total << " files, "
+       << stats.pings << " pings (" << std::setprecision(0) << stats.ping_rate() << "/s), "
+       << std::setprecision(1) << stats.read_rate() << " MB/s in, "
+       << stats.write_rate() << " MB/s out";
+    if(progress > 0.0 && progress < 1.0) {
+        os << ", " << std::setprecision(0) << stats.elapsed*(1.0 - progress) / progress << "s left";
+    }
+}
+
+static void usage()
+{
+    std::cout << "Usage : oculus_batch_converter [options] <input>...\n"
+        "Inputs are rosbag2 bags (directory, .db3 or .mcap file) and .oculus logs (raw or\n"
+        "compressed), directories are searched recursively.\n"
+        "  -f, --format <format>   oculus : .oculus log (default)\n"
+        "                          archive : .oculus log with compressed pings\n"
+        "                          fan : PGM fan images\n"
+        "  -o, --output <dir>      output directory (next to each input)\n"
+        "  -t, --topic <name>      ping topic of the bags (the only OculusStampedPing\n"
+        "                          or OculusCompressedPing topic)\n"
+        "  -j, --threads <n>       worker threads (all cores)\n"
+        "  --chunk-size <MB>       input read per task (4)\n"
+        "  --max-chunks <n>        chunks in memory at once (2 per thread)\n"
+        "  --level <n>             zstd level of the archives (3)\n"
+        "  --quantization <bits>   bits kept per sample in archives (0 : lossless)\n"
+        "  --width <px>            fan image width (512)\n"
+        "  --every <n>             one fan image every n pings (1)\n"
+        "  --overwrite             overwrite existing outputs\n"
+        "  -q, --quiet             no progress report\n";
+}
+
+int main(int argc, char** argv)
+{
+    oculus::BatchConverter::Options options;
+    std::vector<std::string> inputs;
+    std::string topic;
+    bool quiet = false;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if(i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if(arg == "-f" || arg == "--format") {
+            std::string format = value();
+            if     (format == "oculus")  options.format = oculus::BatchConverter::OculusLog;
+            else if(format == "archive") options.format = oculus::BatchConverter::Archive;
+            else if(format == "fan")     options.format = oculus::BatchConverter::FanImages;
+            else {
+                std::cerr << "Unknown format '" << format << "'." << std::endl;
+                return 1;
+            }
+        }
+        else if(arg == "-o" || arg == "--output")  options.output_directory  = value();
+        else if(arg == "-t" || arg == "--topic")   topic                     = value();
+        else if(arg == "-j" || arg == "--threads") options.threads           = std::stoi(value());
+        else if(arg == "--chunk-size")    options.chunk_size        = std::stod(value())*1024*1024;
+        else if(arg == "--max-chunks")    options.max_chunks        = std::stoi(value());
+        else if(arg == "--level")         options.compression_level = std::stoi(value());
+        else if(arg == "--quantization")  options.quantization_bits = std::stoi(value());
+        else if(arg == "--width")         options.fan_width         = std::stoi(value());
+        else if(arg == "--every")         options.every             = std::stoi(value());
+        else if(arg == "--overwrite")     options.overwrite         = true;
+        else if(arg == "-q" || arg == "--quiet") quiet              = true;
+        else if(arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        }
+        else if(!arg.empty() && arg[0] == '-') {
+            usage();
+            return 1;
+        }
+        else {
+            inputs.push_back(arg);
+        }
+    }
+    if(inputs.empty()) {
+        usage();
+        return 1;
+    }
+
+    try {
+        oculus::BatchConverter converter(options);
+        for(const auto& input : inputs) {
+            add_inputs(converter, input, topic);
+        }
+        auto stats = converter.statistics();
+        if(stats.files_total == 0) {
+            std::cerr << "Nothing to convert." << std::endl;
+            return 1;
+        }
+        std::cout << "Converting " << stats.files_total << " recordings ("
+                  << std::fixed << std::setprecision(1) << 1.0e-6*stats.bytes_total << " MB) on "
+                  << (options.threads > 0 ? options.threads : std::thread::hardware_concurrency())
+                  << " threads." << std::endl;
+
+        std::mutex              mutex;
+        std::condition_variable condition;
+        bool                    done = false;
+        std::thread reporter([&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(!condition.wait_for(lock, std::chrono::seconds(1), [&]() { return done; })) {
+                if(!quiet) {
+                    print_progress(std::cout, converter.statistics());
+                    std::cout << std::endl;
+                }
+            }
+        });
+        bool success = converter.run();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        condition.notify_one();
+        reporter.join();
+
+        stats = converter.statistics();
+        print_progress(std::cout, stats);
+        std::cout << ", " << std::setprecision(1) << stats.elapsed << "s ("
+                  << stats.steals << " tasks stolen)." << std::endl;
+        for(const auto& error : converter.errors()) {
+            std::cerr << "Error : " << error << std::endl;
+        }
+        return success ? 0 : 1;
+    }
+    catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,134 @@
+#include "beam_decoder.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "cpu_features.h"
+
+#ifdef OCULUS_ROS2_AVX2
+#include <immintrin.h>
+#endif
+
+namespace oculus {
+
+namespace {
+
+template <bool Is16Bit>
+inline float sample_at(const uint8_t* row, unsigned int index)
+{
+    if(Is16Bit)
+        return row[2*index] | (row[2*index + 1] << 8);
+    return row[index];
+}
+
+#ifdef OCULUS_ROS2_AVX2
+// Decodes the samples of a row 16 at a time and returns the number of samples
+// decoded, the remainder is left to the portable loop.
+template <bool Is16Bit>
+OCULUS_AVX2_TARGET unsigned int decode_row_avx2(const uint8_t* src, float* dst,
+                                                unsigned int count, float scale)
+{
+    unsigned int i = 0;
+    const __m256 factor = _mm256_set1_ps(scale);
+    for(; i + 16 <= count; i += 16) {
+        __m256i low, high;
+        if(Is16Bit) {
+            low  = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2*i)));
+            high = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2*i + 16)));
+        }
+        else {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            low  = _mm256_cvtepu8_epi32(bytes);
+            high = _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8));
+        }
+        _mm256_storeu_ps(dst + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(low),  factor));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(high), factor));
+    }
+    return i;
+}
+#endif
+
+template <bool Is16Bit>
+inline void decode_row(const uint8_t* src, float* dst, unsigned int count, float scale,
+                       bool avx2)
+{
+    unsigned int i = 0;
+#ifdef OCULUS_ROS2_AVX2
+    if(avx2)
+        i = decode_row_avx2<Is16Bit>(src, dst, count, scale);
+#else
+    (void)avx2;
+#endif
+    for(; i < count; i++) {
+        dst[i] = scale*sample_at<Is16Bit>(src, i);
+    }
+}
+
+template <bool Is16Bit, bool HasGain>
+void decode_image(const PingLayout& layout, float* output, bool avx2)
+{
+    const float fullScale = 1.0f / (Is16Bit ? 65535.0f : 255.0f);
+    for(unsigned int r = 0; r < layout.n_ranges; r++) {
+        float scale = fullScale;
+        if(HasGain) {
+            uint32_t gain = layout.gain(r);
+            if(gain > 0)
+                scale /= std::sqrt(static_cast<float>(gain));
+        }
+        decode_row<Is16Bit>(layout.row(r), output + static_cast<size_t>(r)*layout.n_beams,
+                            layout.n_beams, scale, avx2);
+    }
+}
+
+using DecodeFunction = void(*)(const PingLayout&, float*, bool);
+
+// Indexed by is16Bit*2 + hasGain.
+const DecodeFunction decodeFunctions[4] = {
+    &decode_image<false, false>,
+    &decode_image<false, true>,
+    &decode_image<true,  false>,
+    &decode_image<true,  true>,
+};
+
+} //namespace
+
+bool BeamDecoder::decode(const OculusSimplePingResult& metadata,
+                         const std::vector<uint8_t>& data,
+                         std::vector<float>& output) const
+{
+    PingLayout layout(metadata, data);
+    if(!layout.is_valid())
+        return false;
+    output.resize(static_cast<size_t>(layout.n_ranges)*layout.n_beams);
+    decodeFunctions[2*layout.is_16bit() + layout.has_gain](layout, output.data(), has_avx2());
+    return true;
+}
+
+bool BeamDecoder::decode(const OculusSimplePingResult& metadata,
+                         const std::vector<uint8_t>& data,
+                         float* output) const
+{
+    PingLayout layout(metadata, data);
+    if(!layout.is_valid())
+        return false;
+    decodeFunctions[2*layout.is_16bit() + layout.has_gain](layout, output, has_avx2());
+    return true;
+}
+
+bool BeamDecoder::bearings(const OculusSimplePingResult& metadata,
+                           const std::vector<uint8_t>& data,
+                           std::vector<float>& output)
+{
+    PingLayout layout(metadata, data);
+    if(!layout.bearings)
+        return false;
+    output.resize(layout.n_beams);
+    for(unsigned int b = 0; b < layout.n_beams; b++) {
+        int16_t bearing;
+        std::memcpy(&bearing, layout.bearings + b, sizeof(bearing));
+        output[b] = bearing*(0.01f*M_PI / 180.0f);
+    }
+    return true;
+}
+
+} //namespace oculus
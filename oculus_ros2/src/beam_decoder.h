@@ -0,0 +1,44 @@
+#ifndef _DEF_OCULUS_ROS_BEAM_DECODER_H_
+#define _DEF_OCULUS_ROS_BEAM_DECODER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "ping_layout.h"
+
+namespace oculus {
+
+// Decodes the image of a ping into float intensities, range-major (nRanges
+// rows of nBeams values) :
+//  - samples are normalized to [0,1] (divided by 255 or 65535),
+//  - when the ping carries range gains (send_gain flag), each row is divided
+//    by the square root of its gain, which undoes the gain applied by the
+//    sonar.
+// The row kernel is specialized at compile time for each (8/16 bits, gain or
+// not) combination.
+class BeamDecoder
+{
+    public:
+
+    // output is resized to nRanges*nBeams. Returns false if the ping is
+    // malformed.
+    bool decode(const OculusSimplePingResult& metadata,
+                const std::vector<uint8_t>& data,
+                std::vector<float>& output) const;
+
+    // Same thing in a caller provided buffer of at least nRanges*nBeams floats.
+    bool decode(const OculusSimplePingResult& metadata,
+                const std::vector<uint8_t>& data,
+                float* output) const;
+
+    // Beam bearings in radians.
+    static bool bearings(const OculusSimplePingResult& metadata,
+                         const std::vector<uint8_t>& data,
+                         std::vector<float>& output);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_BEAM_DECODER_H_
@@ -0,0 +1,298 @@
+#include "beam_detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "cpu_features.h"
+
+#ifdef OCULUS_ROS2_AVX2
+#include <immintrin.h>
+#endif
+
+namespace oculus {
+
+namespace {
+
+// Beams scanned together : the state of a block stays in L1 while the rows
+// are walked, and each row access is a single cache line (8 bit data).
+constexpr unsigned int BlockSize = 64;
+
+template <bool Is16Bit>
+inline float sample_at(const uint8_t* row, unsigned int index)
+{
+    if(Is16Bit)
+        return row[2*index] | (row[2*index + 1] << 8);
+    return row[index];
+}
+
+struct BlockState
+{
+    alignas(32) float firstRow[BlockSize];
+    alignas(32) float firstValue[BlockSize];
+    alignas(32) float peakRow[BlockSize];
+    alignas(32) float peakValue[BlockSize];
+};
+
+#ifdef OCULUS_ROS2_AVX2
+// Scans the samples of row r 8 beams at a time and returns the number of
+// beams scanned, the remainder is left to the portable loop.
+template <bool Is16Bit>
+OCULUS_AVX2_TARGET unsigned int scan_row_avx2(const uint8_t* row, unsigned int r, float scale,
+                                              float threshold, bool wantPeak, unsigned int count,
+                                              BlockState& state, unsigned int& remaining)
+{
+    unsigned int i = 0;
+    const __m256 vScale     = _mm256_set1_ps(scale);
+    const __m256 vThreshold = _mm256_set1_ps(threshold);
+    const __m256 vRow       = _mm256_set1_ps(static_cast<float>(r));
+    const __m256 zero       = _mm256_setzero_ps();
+    for(; i + 8 <= count; i += 8) {
+        __m256i samples;
+        if(Is16Bit)
+            samples = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 2*i)));
+        else
+            samples = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + i)));
+        __m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(samples), vScale);
+
+        __m256 first    = _mm256_load_ps(state.firstRow + i);
+        __m256 newFirst = _mm256_and_ps(_mm256_cmp_ps(v, vThreshold, _CMP_GT_OQ),
+                                        _mm256_cmp_ps(first, zero, _CMP_LT_OQ));
+        int found = _mm256_movemask_ps(newFirst);
+        if(found) {
+            _mm256_store_ps(state.firstRow + i, _mm256_blendv_ps(first, vRow, newFirst));
+            _mm256_store_ps(state.firstValue + i,
+                _mm256_blendv_ps(_mm256_load_ps(state.firstValue + i), v, newFirst));
+            remaining -= __builtin_popcount(found);
+        }
+        if(wantPeak) {
+            __m256 peak    = _mm256_load_ps(state.peakValue + i);
+            __m256 newPeak = _mm256_cmp_ps(v, peak, _CMP_GT_OQ);
+            _mm256_store_ps(state.peakValue + i, _mm256_max_ps(v, peak));
+            _mm256_store_ps(state.peakRow + i,
+                _mm256_blendv_ps(_mm256_load_ps(state.peakRow + i), vRow, newPeak));
+        }
+    }
+    return i;
+}
+#endif
+
+// Scans count (<= BlockSize) beams starting at beam begin over the rows
+// [rowBegin, nRanges). firstRow is the first row above threshold, peakRow the
+// row of the maximum (only if above threshold), -1 if none.
+template <bool Is16Bit>
+void scan_block(const PingLayout& layout, const float* rowScales,
+                unsigned int rowBegin, float threshold, bool wantPeak, bool avx2,
+                unsigned int begin, unsigned int count, BlockState& state)
+{
+    std::fill(state.firstRow,   state.firstRow   + BlockSize, -1.0f);
+    std::fill(state.firstValue, state.firstValue + BlockSize, 0.0f);
+    std::fill(state.peakRow,    state.peakRow    + BlockSize, -1.0f);
+    std::fill(state.peakValue,  state.peakValue  + BlockSize, threshold);
+
+    unsigned int remaining = count; // beams without first return yet
+    for(unsigned int r = rowBegin; r < layout.n_ranges; r++) {
+        const uint8_t* row   = layout.row(r) + begin*layout.sample_size;
+        const float    scale = rowScales[r];
+        unsigned int i = 0;
+#ifdef OCULUS_ROS2_AVX2
+        if(avx2)
+            i = scan_row_avx2<Is16Bit>(row, r, scale, threshold, wantPeak, count, state, remaining);
+#else
+        (void)avx2;
+#endif
+        for(; i < count; i++) {
+            float v = scale*sample_at<Is16Bit>(row, i);
+            if(v > threshold && state.firstRow[i] < 0.0f) {
+                state.firstRow[i]   = r;
+                state.firstValue[i] = v;
+                remaining--;
+            }
+            if(wantPeak && v > state.peakValue[i]) {
+                state.peakValue[i] = v;
+                state.peakRow[i]   = r;
+            }
+        }
+        if(!wantPeak && remaining == 0)
+            break;
+    }
+}
+
+} //namespace
+
+BeamDetector::BeamDetector() :
+    BeamDetector(Options())
+{}
+
+BeamDetector::BeamDetector(const Options& options) :
+    options_(options)
+{
+    unsigned int threads = options_.threads;
+    if(threads == 0)
+        threads = std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+    for(unsigned int i = 1; i < threads; i++) {
+        workers_.emplace_back(&BeamDetector::run_worker, this, i);
+    }
+}
+
+BeamDetector::~BeamDetector()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wakeCondition_.notify_all();
+    for(auto& worker : workers_)
+        worker.join();
+}
+
+void BeamDetector::run_worker(unsigned int index)
+{
+    uint64_t generation = 0;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeCondition_.wait(lock, [&]() { return !running_ || generation_ != generation; });
+            if(!running_)
+                return;
+            generation = generation_;
+        }
+        this->scan_chunk(index);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_--;
+        }
+        doneCondition_.notify_one();
+    }
+}
+
+void BeamDetector::scan_chunk(unsigned int chunk)
+{
+    // Chunk boundaries on multiples of 8 beams (one AVX2 vector).
+    unsigned int nBeams = layout_.n_beams;
+    unsigned int begin  = ((nBeams*chunk / chunkCount_) / 8)*8;
+    unsigned int end    = chunk + 1 == chunkCount_ ? nBeams : ((nBeams*(chunk + 1) / chunkCount_) / 8)*8;
+    this->scan_beams(begin, end);
+}
+
+void BeamDetector::scan_beams(unsigned int begin, unsigned int end)
+{
+    const bool wantPeak = (options_.mode & Peak) != 0;
+    const bool avx2     = has_avx2();
+    BlockState state;
+    for(unsigned int b = begin; b < end; b += BlockSize) {
+        unsigned int count = std::min(BlockSize, end - b);
+        if(layout_.is_16bit())
+            scan_block<true>(layout_, rowScales_.data(), firstRow_, options_.threshold,
+                             wantPeak, avx2, b, count, state);
+        else
+            scan_block<false>(layout_, rowScales_.data(), firstRow_, options_.threshold,
+                              wantPeak, avx2, b, count, state);
+        for(unsigned int i = 0; i < count; i++) {
+            auto& result = results_[b + i];
+            result.firstRow   = state.firstRow[i];
+            result.firstValue = state.firstValue[i];
+            result.peakRow    = state.peakRow[i];
+            result.peakValue  = state.peakValue[i];
+        }
+    }
+}
+
+float BeamDetector::sample(unsigned int row, unsigned int beam) const
+{
+    if(layout_.is_16bit())
+        return rowScales_[row]*sample_at<true>(layout_.row(row), beam);
+    return rowScales_[row]*sample_at<false>(layout_.row(row), beam);
+}
+
+// Vertex of the parabola through the peak and its two neighbours.
+float BeamDetector::refine_peak(unsigned int row, unsigned int beam) const
+{
+    if(row == 0 || row + 1 >= layout_.n_ranges)
+        return row;
+    float before = this->sample(row - 1, beam);
+    float peak   = this->sample(row,     beam);
+    float after  = this->sample(row + 1, beam);
+    float curvature = before - 2.0f*peak + after;
+    if(curvature >= 0.0f)
+        return row;
+    return row + std::clamp(0.5f*(before - after) / curvature, -0.5f, 0.5f);
+}
+
+size_t BeamDetector::detect(const OculusSimplePingResult& metadata,
+                            const std::vector<uint8_t>& data,
+                            Point* output)
+{
+    layout_ = PingLayout(metadata, data);
+    if(!layout_.is_valid() || metadata.rangeResolution <= 0.0)
+        return 0;
+
+    const unsigned int nBeams  = layout_.n_beams;
+    const unsigned int nRanges = layout_.n_ranges;
+
+    const float fullScale = 1.0f / (layout_.is_16bit() ? 65535.0f : 255.0f);
+    rowScales_.resize(nRanges);
+    for(unsigned int r = 0; r < nRanges; r++) {
+        uint32_t gain = layout_.gain(r);
+        rowScales_[r] = gain > 0 ? fullScale / std::sqrt(static_cast<float>(gain)) : fullScale;
+    }
+    firstRow_ = std::min<unsigned int>(nRanges,
+        std::ceil(options_.min_range / metadata.rangeResolution));
+    results_.resize(nBeams);
+
+    chunkCount_ = (workers_.empty() || nBeams < options_.parallel_min_beams) ?
+                  1 : workers_.size() + 1;
+    if(chunkCount_ > 1) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = chunkCount_ - 1;
+            generation_++;
+        }
+        wakeCondition_.notify_all();
+    }
+    this->scan_chunk(0);
+    if(chunkCount_ > 1) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        doneCondition_.wait(lock, [&]() { return pending_ == 0; });
+    }
+
+    const float resolution = metadata.rangeResolution;
+    const float threshold  = options_.threshold;
+    size_t count = 0;
+    auto add_point = [&](unsigned int beam, float row, float intensity, PointType type) {
+        int16_t bearing;
+        std::memcpy(&bearing, layout_.bearings + beam, sizeof(bearing));
+        // Bearings are positive to starboard, y points to port.
+        float angle = bearing*(0.01f*M_PI / 180.0f);
+        float range = row*resolution;
+        Point& p    = output[count++];
+        p.x         = range*std::cos(angle);
+        p.y         = -range*std::sin(angle);
+        p.z         = 0.0f;
+        p.intensity = intensity;
+        p.beam      = beam;
+        p.type      = type;
+        p.padding   = 0;
+    };
+    for(unsigned int b = 0; b < nBeams; b++) {
+        const auto& result = results_[b];
+        if((options_.mode & FirstReturn) && result.firstRow >= 0.0f) {
+            float row = result.firstRow;
+            if(options_.refine && row > firstRow_) {
+                // Threshold crossing between the previous row and this one.
+                float before = this->sample(row - 1, b);
+                row -= (result.firstValue - threshold) / (result.firstValue - before);
+            }
+            add_point(b, row, result.firstValue, FirstReturnPoint);
+        }
+        if((options_.mode & Peak) && result.peakRow >= 0.0f) {
+            float row = result.peakRow;
+            if(options_.refine)
+                row = this->refine_peak(row, b);
+            add_point(b, row, result.peakValue, PeakPoint);
+        }
+    }
+    return count;
+}
+
+} //namespace oculus
@@ -0,0 +1,116 @@
+#ifndef _DEF_OCULUS_ROS_BEAM_DETECTOR_H_
+#define _DEF_OCULUS_ROS_BEAM_DETECTOR_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "ping_layout.h"
+
+namespace oculus {
+
+// Per-beam detection of the first return above a threshold and/or of the
+// strongest return, turned into 3D points in the sonar frame (x forward, y
+// left, z up, the sonar image plane being z = 0).
+//
+// Samples are compared after gain compensation (same scale as BeamDecoder,
+// [0,1] divided by sqrt(gain)) so that the threshold does not depend on the
+// send_gain setting. Each beam is scanned along range directly in the ping
+// data, 8 beams at a time with AVX2. The beams are split between worker
+// threads when a ping has at least parallel_min_beams beams.
+//
+// Bearings are read from the ping itself, so they always match the
+// frequency mode the ping was fired with.
+class BeamDetector
+{
+    public:
+
+    enum Mode { FirstReturn = 1, Peak = 2, Both = 3 };
+
+    enum PointType : uint8_t { FirstReturnPoint = 0, PeakPoint = 1 };
+
+    // Layout of the points written by detect() (PointCloud2 fields x, y, z,
+    // intensity, beam, type).
+    struct Point
+    {
+        float    x;
+        float    y;
+        float    z;
+        float    intensity;
+        uint16_t beam;
+        uint8_t  type;
+        uint8_t  padding;
+    };
+
+    struct Options
+    {
+        Mode         mode      = FirstReturn;
+        float        threshold = 0.2f; // gain compensated intensity
+        float        min_range = 0.0f; // meters, skips the near field
+        bool         refine    = true; // sub-sample range interpolation
+        unsigned int threads   = 0;    // 0 for the number of cores, up to 4
+        unsigned int parallel_min_beams = 512;
+    };
+
+    BeamDetector();
+    explicit BeamDetector(const Options& options);
+    ~BeamDetector();
+
+    BeamDetector(const BeamDetector&)            = delete;
+    BeamDetector& operator=(const BeamDetector&) = delete;
+
+    // Writes at most max_points(nBeams) points in output and returns their
+    // number (beams without detection give no point). Returns 0 if the ping
+    // is malformed.
+    size_t detect(const OculusSimplePingResult& metadata,
+                  const std::vector<uint8_t>& data,
+                  Point* output);
+
+    size_t max_points(unsigned int nBeams) const {
+        return options_.mode == Both ? 2*nBeams : nBeams;
+    }
+    const Options& options() const { return options_; }
+
+    protected:
+
+    // Per beam scan results. Row indexes are fractional when refined, negative
+    // when nothing was found.
+    struct BeamResult
+    {
+        float firstRow  = -1.0f;
+        float firstValue = 0.0f;
+        float peakRow   = -1.0f;
+        float peakValue = 0.0f;
+    };
+
+    Options                 options_;
+    PingLayout              layout_;
+    std::vector<float>      rowScales_;
+    unsigned int            firstRow_ = 0;
+    std::vector<BeamResult> results_;
+
+    // Worker pool. The calling thread processes the first beam chunk, the
+    // workers the other ones.
+    std::vector<std::thread> workers_;
+    std::mutex               mutex_;
+    std::condition_variable  wakeCondition_;
+    std::condition_variable  doneCondition_;
+    uint64_t                 generation_ = 0;
+    unsigned int             pending_    = 0;
+    unsigned int             chunkCount_ = 1;
+    bool                     running_    = true;
+
+    void run_worker(unsigned int index);
+    void scan_chunk(unsigned int chunk);
+    void scan_beams(unsigned int begin, unsigned int end);
+    float sample(unsigned int row, unsigned int beam) const;
+    float refine_peak(unsigned int row, unsigned int beam) const;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_BEAM_DETECTOR_H_
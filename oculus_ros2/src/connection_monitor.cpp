@@ -0,0 +1,133 @@
+#include "connection_monitor.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace oculus {
+
+const char* ConnectionMonitor::state_name(State state)
+{
+    switch(state) {
+        case Discovering:  return "discovering";
+        case Configuring:  return "configuring";
+        case Streaming:    return "streaming";
+        case Lost:         return "lost";
+        case Reconnecting: return "reconnecting";
+        default:           return "unknown";
+    }
+}
+
+ConnectionMonitor::ConnectionMonitor(const Options& options, Clock::time_point start) :
+    options_(options),
+    lastMessage_(0),
+    lastPing_(0),
+    state_(Discovering),
+    start_(start),
+    stateStart_(start),
+    expectedSince_(start)
+{}
+
+ConnectionMonitor::Clock::time_point ConnectionMonitor::last_activity(bool pingsExpected) const
+{
+    Clock::rep last = pingsExpected ? lastPing_.load(std::memory_order_relaxed)
+                                    : lastMessage_.load(std::memory_order_relaxed);
+    return Clock::time_point(Clock::duration(last));
+}
+
+void ConnectionMonitor::enter(State state, Clock::time_point now)
+{
+    state_      = state;
+    stateStart_ = now;
+}
+
+ConnectionMonitor::Action ConnectionMonitor::update(Clock::time_point now, bool pingsExpected)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The sonar takes some time to fire again after a standby.
+    if(pingsExpected && !pingsExpected_)
+        expectedSince_ = now;
+    pingsExpected_ = pingsExpected;
+
+    const auto timeout  = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options_.timeout));
+    const auto activity = this->last_activity(pingsExpected);
+    const auto lastPing = this->last_activity(true);
+
+    switch(state_) {
+        case Discovering:
+            if(lastMessage_.load(std::memory_order_relaxed) != 0) {
+                this->enter(Configuring, now);
+                return ApplyConfig;
+            }
+            break;
+        case Configuring:
+            if(activity > stateStart_) {
+                if(timeToFirstPing_ < 0.0 && lastPing > start_)
+                    timeToFirstPing_ = std::chrono::duration<double>(lastPing - start_).count();
+                this->enter(Streaming, now);
+            }
+            else if(now - std::max(stateStart_, expectedSince_) > timeout) {
+                this->enter(Lost, now);
+                lostActivity_ = std::max(activity, stateStart_);
+            }
+            break;
+        case Streaming:
+            if(now - std::max(activity, expectedSince_) > timeout) {
+                this->enter(Lost, now);
+                lostActivity_ = activity;
+            }
+            break;
+        case Lost:
+            // Stays visible for one update.
+            attempts_    = 0;
+            nextAttempt_ = now;
+            this->enter(Reconnecting, now);
+            return this->attempt(now);
+        case Reconnecting:
+            if(activity > stateStart_) {
+                lastReconnectDuration_ = std::chrono::duration<double>(activity - lostActivity_).count();
+                if(timeToFirstPing_ < 0.0 && lastPing > start_)
+                    timeToFirstPing_ = std::chrono::duration<double>(lastPing - start_).count();
+                reconnects_++;
+                attempts_ = 0;
+                this->enter(Streaming, now);
+            }
+            else if(now >= nextAttempt_) {
+                return this->attempt(now);
+            }
+            break;
+    }
+    return None;
+}
+
+ConnectionMonitor::Action ConnectionMonitor::attempt(Clock::time_point now)
+{
+    double backoff = std::min(options_.backoff_max,
+                              options_.backoff_initial*std::pow(2.0, attempts_));
+    attempts_++;
+    nextAttempt_ = now + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(backoff));
+    return ApplyConfig;
+}
+
+ConnectionMonitor::State ConnectionMonitor::state() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+}
+
+ConnectionMonitor::Statistics ConnectionMonitor::statistics(Clock::time_point now) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Statistics stats;
+    stats.state                   = state_;
+    stats.state_duration          = std::chrono::duration<double>(now - stateStart_).count();
+    stats.time_to_first_ping      = timeToFirstPing_;
+    stats.last_reconnect_duration = lastReconnectDuration_;
+    stats.reconnects              = reconnects_;
+    stats.attempts                = attempts_;
+    return stats;
+}
+
+} //namespace oculus
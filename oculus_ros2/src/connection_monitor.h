@@ -0,0 +1,114 @@
+#ifndef _DEF_OCULUS_ROS_CONNECTION_MONITOR_H_
+#define _DEF_OCULUS_ROS_CONNECTION_MONITOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace oculus {
+
+// Sonar connection state machine, driven by the messages received from the
+// sonar and by periodic calls to update() :
+//
+//   Discovering  : no message received from the sonar yet.
+//   Configuring  : the sonar is connected, its configuration was sent, waiting
+//                  for the first ping.
+//   Streaming    : pings are received (or dummy or status messages while the
+//                  sonar is expected to be in standby).
+//   Lost         : nothing received during timeout seconds.
+//   Reconnecting : the configuration is sent again (and the pings resumed)
+//                  with an exponential backoff until the sonar streams again.
+//
+// The socket itself is reconnected by oculus_driver, this class decides when
+// the cached configuration must be applied again and measures the time to
+// the first ping and the reconnection durations.
+//
+// on_message, on_status and on_ping are lock-free and meant to be called from
+// the driver callbacks, update() and statistics() from a (low rate) supervising thread.
+class ConnectionMonitor
+{
+    public:
+
+    using Clock = std::chrono::steady_clock;
+
+    enum State { Discovering, Configuring, Streaming, Lost, Reconnecting };
+    static const char* state_name(State state);
+
+    enum Action {
+        None,
+        ApplyConfig, // send the cached configuration (and resume the pings)
+    };
+
+    struct Options
+    {
+        double timeout         = 2.0;  // seconds without message before Lost
+        double backoff_initial = 0.5;  // seconds between the first attempts
+        double backoff_max     = 10.0;
+    };
+
+    struct Statistics
+    {
+        State    state                   = Discovering;
+        double   state_duration          = 0.0;  // seconds in the current state
+        double   time_to_first_ping      = -1.0; // seconds, from start (-1 if none yet)
+        double   last_reconnect_duration = -1.0; // seconds without data during the last reconnection
+        uint64_t reconnects              = 0;
+        uint64_t attempts                = 0;    // of the current reconnection
+    };
+
+    explicit ConnectionMonitor(const Options& options, Clock::time_point start = Clock::now());
+
+    // Any message received through the sonar data connection (ping, dummy).
+    void on_message(Clock::time_point time = Clock::now()) {
+        lastMessage_.store(time.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+    // Status broadcasts : the sonar keeps sending them in standby, where they
+    // may be the only messages received. They do not replace the pings when
+    // pings are expected (the data connection may be down).
+    void on_status(Clock::time_point time = Clock::now()) {
+        this->on_message(time);
+    }
+    void on_ping(Clock::time_point time = Clock::now()) {
+        lastPing_.store(time.time_since_epoch().count(), std::memory_order_relaxed);
+        this->on_message(time);
+    }
+
+    // pingsExpected is false while the sonar is (meant to be) in standby :
+    // dummy messages are then enough to keep the connection Streaming.
+    Action update(Clock::time_point now, bool pingsExpected);
+
+    State      state() const;
+    Statistics statistics(Clock::time_point now = Clock::now()) const;
+    const Options& options() const { return options_; }
+
+    protected:
+
+    Options options_;
+
+    // Clock::duration counts, 0 if nothing received.
+    std::atomic<Clock::rep> lastMessage_;
+    std::atomic<Clock::rep> lastPing_;
+
+    mutable std::mutex mutex_;
+    State              state_;
+    Clock::time_point  start_;
+    Clock::time_point  stateStart_;
+    Clock::time_point  expectedSince_; // pings expected since (standby exit)
+    bool               pingsExpected_ = true;
+    Clock::time_point  lostActivity_;  // last sign of life before Lost
+    Clock::time_point  nextAttempt_;
+    double             timeToFirstPing_       = -1.0;
+    double             lastReconnectDuration_ = -1.0;
+    uint64_t           reconnects_ = 0;
+    uint64_t           attempts_   = 0;
+
+    void enter(State state, Clock::time_point now);
+    Action attempt(Clock::time_point now);
+    // Last sign of life relevant to the current expectation.
+    Clock::time_point last_activity(bool pingsExpected) const;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_CONNECTION_MONITOR_H_
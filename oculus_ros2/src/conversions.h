@@ -1,7 +1,11 @@
 #ifndef _DEF_OCULUS_ROS_CONVERSIONS_H_
 #define _DEF_OCULUS_ROS_CONVERSIONS_H_
 
+#include <chrono>
+#include <vector>
+
 #include <oculus_driver/Oculus.h>
+#include "rclcpp/time.hpp"
 #include "oculus_interfaces/msg/oculus_header.hpp"
 #include "oculus_interfaces/msg/oculus_version_info.hpp"
 #include "oculus_interfaces/msg/oculus_status.hpp"
@@ -98,6 +102,33 @@ inline void copy_to_ros(oculus_interfaces::msg::OculusPing &msg, const OculusSim
     msg.message_size       = ping.messageSize;
 }
 
+inline void copy_to_ros(oculus_interfaces::msg::OculusPing &msg, const OculusSimplePingResult& ping,
+                        const std::vector<uint8_t>& data)
+{
+    copy_to_ros(msg, ping);
+    // assign reuses the capacity already held by msg.data and copies with a
+    // single memcpy (no per-byte loop, no zero-filling before the copy).
+    msg.data.assign(data.cbegin(), data.cend());
+}
+
+// Same without copy : data is swapped with msg.data (data gets the previous
+// buffer of the message, and its capacity).
+inline void move_to_ros(oculus_interfaces::msg::OculusPing &msg, const OculusSimplePingResult& ping,
+                        std::vector<uint8_t>& data)
+{
+    copy_to_ros(msg, ping);
+    msg.data.swap(data);
+}
+
+template <class Clock, class Duration>
+inline rclcpp::Time to_ros_stamp(const std::chrono::time_point<Clock,Duration>& stamp)
+{
+    size_t nano = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        stamp.time_since_epoch()).count();
+    size_t seconds = nano / 1000000000;
+    return rclcpp::Time(seconds, nano - 1000000000*seconds);
+}
+
 } //namespace oculus
 
 #endif //_DEF_OCULUS_ROS_CONVERSIONS_H_
@@ -0,0 +1,34 @@
+#include "cpu_features.h"
+
+#include <atomic>
+
+namespace oculus {
+
+namespace {
+
+bool cpu_supports_avx2()
+{
+#ifdef OCULUS_ROS2_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return false;
+#endif
+}
+
+std::atomic<bool> avx2Enabled(true);
+
+} //namespace
+
+bool has_avx2()
+{
+    static const bool supported = cpu_supports_avx2();
+    return supported && avx2Enabled.load(std::memory_order_relaxed);
+}
+
+void set_avx2_enabled(bool enabled)
+{
+    avx2Enabled = enabled;
+}
+
+} //namespace oculus
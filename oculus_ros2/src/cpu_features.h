@@ -0,0 +1,31 @@
+#ifndef _DEF_OCULUS_ROS_CPU_FEATURES_H_
+#define _DEF_OCULUS_ROS_CPU_FEATURES_H_
+
+// The ping processing kernels are built twice in the same binary : a portable
+// version, and an AVX2 version compiled with OCULUS_AVX2_TARGET (a function
+// level target attribute, no -mavx2 on the command line). The AVX2 version is
+// selected at run time with has_avx2(), so the binaries run on any x86-64 CPU
+// whatever the build machine.
+//
+// OCULUS_ROS2_AVX2 is defined by the build (OCULUS_ROS2_ENABLE_AVX2 option)
+// when the compiler supports the target attribute.
+#ifdef OCULUS_ROS2_AVX2
+#define OCULUS_AVX2_TARGET __attribute__((target("avx2,fma")))
+#else
+#define OCULUS_AVX2_TARGET
+#endif
+
+namespace oculus {
+
+// True if the AVX2 kernels are built, the CPU supports AVX2 and FMA, and they
+// were not disabled with set_avx2_enabled(false).
+bool has_avx2();
+
+// Forces the portable kernels (false) or restores the default (true), to
+// compare both versions in the tests and benchmarks. Kernels already running
+// are not affected.
+void set_avx2_enabled(bool enabled);
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_CPU_FEATURES_H_
@@ -0,0 +1,79 @@
+#ifndef _DEF_OCULUS_ROS_IO_SERVICE_POOL_H_
+#define _DEF_OCULUS_ROS_IO_SERVICE_POOL_H_
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace oculus {
+
+// A fixed number of io_service, each run by its own thread, shared by several
+// oculus::SonarDriver (oculus::AsyncService runs one thread per driver).
+// Drivers are given the io_services in turn : the handlers of a driver always
+// run on the same thread, so drivers need no synchronization of their own.
+class IoServicePool
+{
+    public:
+
+    using IoService    = boost::asio::io_service;
+    using IoServicePtr = std::shared_ptr<IoService>;
+
+    explicit IoServicePool(unsigned int size)
+    {
+        for(unsigned int i = 0; i < std::max(1u, size); i++) {
+            services_.push_back(std::make_shared<IoService>());
+        }
+    }
+    ~IoServicePool() { this->stop(); }
+
+    IoServicePool(const IoServicePool&)            = delete;
+    IoServicePool& operator=(const IoServicePool&) = delete;
+
+    size_t size()       const { return services_.size(); }
+    bool   is_running() const { return !threads_.empty(); }
+
+    // Round robin over the io_services.
+    IoServicePtr next_io_service()
+    {
+        return services_[next_++ % services_.size()];
+    }
+
+    void start()
+    {
+        if(this->is_running())
+            return;
+        for(auto& service : services_) {
+            service->restart();
+            work_.push_back(std::make_unique<IoService::work>(*service));
+            threads_.emplace_back([service]() { service->run(); });
+        }
+    }
+
+    void stop()
+    {
+        if(!this->is_running())
+            return;
+        work_.clear();
+        for(auto& service : services_) {
+            service->stop();
+        }
+        for(auto& thread : threads_) {
+            thread.join();
+        }
+        threads_.clear();
+    }
+
+    protected:
+
+    std::vector<IoServicePtr>                     services_;
+    std::vector<std::unique_ptr<IoService::work>> work_;
+    std::vector<std::thread>                      threads_;
+    size_t                                        next_ = 0;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_IO_SERVICE_POOL_H_
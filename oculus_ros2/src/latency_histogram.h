@@ -0,0 +1,119 @@
+#ifndef _DEF_OCULUS_ROS_LATENCY_HISTOGRAM_H_
+#define _DEF_OCULUS_ROS_LATENCY_HISTOGRAM_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace oculus {
+
+// HDR-style log-linear histogram of durations in nanoseconds.
+//
+// Each power of two is split in 2^SubBucketBits linear sub-buckets, which
+// gives a relative precision of ~3% over the whole range (1ns to ~18min).
+// record() only does relaxed atomic increments and can be called from any
+// thread. Readers take snapshots, the difference of two snapshots gives the
+// statistics over a time window.
+class LatencyHistogram
+{
+    public:
+
+    static constexpr unsigned int SubBucketBits = 5;
+    static constexpr unsigned int SubBuckets    = 1u << SubBucketBits;
+    static constexpr unsigned int MaxExponent   = 40;
+    static constexpr unsigned int BucketCount   = (MaxExponent - SubBucketBits + 2)*SubBuckets;
+
+    struct Snapshot
+    {
+        std::array<uint64_t, BucketCount> counts{};
+        uint64_t count = 0;
+        uint64_t sum   = 0;
+        uint64_t max   = 0; // since the histogram creation
+
+        Snapshot operator-(const Snapshot& older) const {
+            Snapshot res;
+            for(unsigned int i = 0; i < BucketCount; i++)
+                res.counts[i] = counts[i] - older.counts[i];
+            res.count = count - older.count;
+            res.sum   = sum - older.sum;
+            res.max   = max;
+            return res;
+        }
+
+        double mean() const { return count > 0 ? static_cast<double>(sum) / count : 0.0; }
+
+        // Upper bound of the bucket holding the requested quantile (0-1).
+        uint64_t percentile(double quantile) const {
+            if(count == 0)
+                return 0;
+            uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(quantile*count + 0.5));
+            uint64_t seen = 0;
+            for(unsigned int i = 0; i < BucketCount; i++) {
+                seen += counts[i];
+                if(seen >= target)
+                    return bucket_upper_bound(i);
+            }
+            return max;
+        }
+    };
+
+    LatencyHistogram() {
+        for(auto& c : counts_)
+            c.store(0, std::memory_order_relaxed);
+    }
+
+    void record(int64_t nanoseconds)
+    {
+        uint64_t value = nanoseconds > 0 ? nanoseconds : 0;
+        counts_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        uint64_t currentMax = max_.load(std::memory_order_relaxed);
+        while(value > currentMax
+              && !max_.compare_exchange_weak(currentMax, value, std::memory_order_relaxed));
+    }
+
+    Snapshot snapshot() const
+    {
+        Snapshot res;
+        for(unsigned int i = 0; i < BucketCount; i++)
+            res.counts[i] = counts_[i].load(std::memory_order_relaxed);
+        res.count = count_.load(std::memory_order_relaxed);
+        res.sum   = sum_.load(std::memory_order_relaxed);
+        res.max   = max_.load(std::memory_order_relaxed);
+        return res;
+    }
+
+    static unsigned int bucket_index(uint64_t value)
+    {
+        if(value < SubBuckets)
+            return value;
+        unsigned int exponent = 63 - __builtin_clzll(value);
+        if(exponent > MaxExponent)
+            return BucketCount - 1;
+        unsigned int sub = (value >> (exponent - SubBucketBits)) & (SubBuckets - 1);
+        return (exponent - SubBucketBits + 1)*SubBuckets + sub;
+    }
+
+    static uint64_t bucket_upper_bound(unsigned int index)
+    {
+        if(index < SubBuckets)
+            return index;
+        unsigned int exponent = index / SubBuckets + SubBucketBits - 1;
+        uint64_t sub = index % SubBuckets;
+        return ((SubBuckets + sub + 1) << (exponent - SubBucketBits)) - 1;
+    }
+
+    private:
+
+    std::array<std::atomic<uint64_t>, BucketCount> counts_;
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_LATENCY_HISTOGRAM_H_
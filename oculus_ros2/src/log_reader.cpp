@@ -0,0 +1,109 @@
+#include "log_reader.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace oculus {
+
+LogReader::LogReader(const std::string& filename)
+{
+    this->open(filename);
+}
+
+LogReader::~LogReader()
+{
+    this->close();
+}
+
+void LogReader::open(const std::string& filename)
+{
+    this->close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("Could not open '" + filename + "' : " + std::strerror(errno));
+    }
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) < 0 || fileStat.st_size < static_cast<off_t>(sizeof(log::LogFileHeader))) {
+        ::close(fd);
+        throw std::runtime_error("'" + filename + "' is not a .oculus log file.");
+    }
+    void* mapped = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if(mapped == MAP_FAILED) {
+        throw std::runtime_error("Could not map '" + filename + "' : " + std::strerror(errno));
+    }
+    // Items are read once in order, then accessed randomly.
+    madvise(mapped, fileStat.st_size, MADV_WILLNEED);
+
+    filename_ = filename;
+    data_     = static_cast<const uint8_t*>(mapped);
+    size_     = fileStat.st_size;
+
+    auto header = reinterpret_cast<const log::LogFileHeader*>(data_);
+    if(header->fileHeader != log::HeaderMagic) {
+        this->close();
+        throw std::runtime_error("'" + filename + "' is not a .oculus log file.");
+    }
+    this->build_index();
+}
+
+void LogReader::close()
+{
+    if(data_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    items_.clear();
+}
+
+void LogReader::build_index()
+{
+    auto header = reinterpret_cast<const log::LogFileHeader*>(data_);
+    size_t offset = header->sizeHeader;
+
+    auto is_message_at = [this](size_t position) {
+        if(position + sizeof(OculusMessageHeader) > size_)
+            return false;
+        return reinterpret_cast<const OculusMessageHeader*>(data_ + position)->oculusId
+            == OCULUS_CHECK_ID;
+    };
+
+    items_.clear();
+    items_.reserve(size_ / 65536);
+    while(offset + sizeof(log::LogItemHeader) <= size_) {
+        auto itemHeader = reinterpret_cast<const log::LogItemHeader*>(data_ + offset);
+        if(itemHeader->itemHeader != log::HeaderMagic)
+            break; // truncated or corrupted file, keeping what was read so far
+
+        // bag_to_oculus writes packed 36 bytes headers but announces 40 (see
+        // oculus_log.h). Looking for the sonar message at both places.
+        size_t payloadOffset = offset + itemHeader->sizeHeader;
+        if(!is_message_at(payloadOffset) && itemHeader->compression == 0
+           && is_message_at(offset + sizeof(log::LogItemHeader))) {
+            payloadOffset = offset + sizeof(log::LogItemHeader);
+        }
+
+        size_t payloadSize = itemHeader->payloadSize;
+        if(payloadSize == 0) {
+            if(!is_message_at(payloadOffset))
+                break;
+            payloadSize = sizeof(OculusMessageHeader)
+                + reinterpret_cast<const OculusMessageHeader*>(data_ + payloadOffset)->payloadSize;
+        }
+        if(payloadOffset + payloadSize > size_)
+            break;
+
+        items_.push_back(Item{itemHeader, data_ + payloadOffset, payloadSize,
+                              itemHeader->time_unix});
+        offset = payloadOffset + payloadSize;
+    }
+}
+
+} //namespace oculus
@@ -0,0 +1,60 @@
+#ifndef _DEF_OCULUS_ROS_LOG_READER_H_
+#define _DEF_OCULUS_ROS_LOG_READER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "oculus_log.h"
+
+namespace oculus {
+
+// Memory mapped .oculus log file. All items are indexed when the file is
+// opened, so accessing any item (seeking, looping) is free afterwards.
+class LogReader
+{
+    public:
+
+    struct Item
+    {
+        const log::LogItemHeader* header;
+        const uint8_t* data; // raw sonar message (OculusMessageHeader first)
+        size_t         size; // as stored in the file
+        double         time; // LogItemHeader::time_unix
+    };
+
+    LogReader() = default;
+    explicit LogReader(const std::string& filename);
+    ~LogReader();
+
+    LogReader(const LogReader&)            = delete;
+    LogReader& operator=(const LogReader&) = delete;
+
+    // Throws std::runtime_error if the file cannot be mapped or is not a
+    // .oculus log.
+    void open(const std::string& filename);
+    void close();
+
+    bool is_open() const { return data_ != nullptr; }
+    const std::string& filename() const { return filename_; }
+    size_t file_size() const { return size_; }
+
+    size_t item_count() const { return items_.size(); }
+    const Item& item(size_t index) const { return items_[index]; }
+    const std::vector<Item>& items() const { return items_; }
+
+    protected:
+
+    std::string       filename_;
+    const uint8_t*    data_ = nullptr;
+    size_t            size_ = 0;
+    std::vector<Item> items_;
+
+    void build_index();
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_LOG_READER_H_
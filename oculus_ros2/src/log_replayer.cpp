@@ -0,0 +1,129 @@
+#include "log_replayer.h"
+
+#include <cstring>
+
+namespace oculus {
+
+LogReplayer::LogReplayer(const std::string& filename, double rate, bool loop) :
+    reader_(filename),
+    rate_(rate),
+    loop_(loop),
+    running_(false),
+    seekIndex_(NoSeek),
+    replayedCount_(0),
+    loopCount_(0)
+{}
+
+LogReplayer::~LogReplayer()
+{
+    this->stop();
+}
+
+void LogReplayer::start()
+{
+    if(running_)
+        return;
+    if(thread_.joinable())
+        thread_.join(); // previous replay reached the end of the log
+    running_ = true;
+    thread_ = std::thread(&LogReplayer::run, this);
+}
+
+void LogReplayer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    stopCondition_.notify_all();
+    if(thread_.joinable())
+        thread_.join();
+}
+
+void LogReplayer::wait()
+{
+    if(thread_.joinable())
+        thread_.join();
+}
+
+void LogReplayer::run()
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Replay times are computed relative to a (log time, wall time) origin
+    // which is reset after a seek, a loop, or a jump back in log time.
+    size_t          index = 0;
+    bool            rebase = true;
+    double          logOrigin = 0.0;
+    Clock::time_point wallOrigin;
+
+    while(running_) {
+        size_t seek = seekIndex_.exchange(NoSeek);
+        if(seek != NoSeek) {
+            index  = seek;
+            rebase = true;
+        }
+        if(index >= reader_.item_count()) {
+            if(!loop_ || reader_.item_count() == 0)
+                break;
+            index = 0;
+            rebase = true;
+            loopCount_++;
+        }
+
+        const auto& item = reader_.item(index++);
+        if(rate_ > 0.0) {
+            if(rebase || item.time < logOrigin) {
+                logOrigin  = item.time;
+                wallOrigin = Clock::now();
+                rebase     = false;
+            }
+            auto target = wallOrigin + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>((item.time - logOrigin) / rate_));
+            std::unique_lock<std::mutex> lock(mutex_);
+            if(stopCondition_.wait_until(lock, target, [this]() { return !running_; }))
+                break;
+        }
+        this->dispatch(item);
+    }
+    running_ = false;
+}
+
+void LogReplayer::dispatch(const LogReader::Item& item)
+{
+    if(item.header->messageType != log::RawSonarMessage)
+        return;
+
+    // The callbacks take a std::vector, as the sonar driver does. The buffer
+    // keeps its capacity between items.
+    if(item.header->compression == log::PingCodecCompression) {
+        if(!codec_.decompress(item.data, item.size, buffer_))
+            return;
+    }
+    else if(item.header->compression == log::NoCompression) {
+        buffer_.assign(item.data, item.data + item.size);
+    }
+    else {
+        return;
+    }
+    if(buffer_.size() < sizeof(OculusMessageHeader))
+        return;
+    stamp_ = TimeSource::now();
+
+    auto header = reinterpret_cast<const OculusMessageHeader*>(buffer_.data());
+    if(header->msgId == messageSimplePingResult && buffer_.size() >= sizeof(OculusSimplePingResult)) {
+        auto metadata = reinterpret_cast<const OculusSimplePingResult*>(buffer_.data());
+        for(auto& callback : pingCallbacks_)
+            callback(*metadata, buffer_);
+    }
+    else if(buffer_.size() == sizeof(OculusStatusMsg)) {
+        // Status messages do not have a dedicated message id, they are
+        // recognized by their size.
+        auto status = reinterpret_cast<const OculusStatusMsg*>(buffer_.data());
+        for(auto& callback : statusCallbacks_)
+            callback(*status);
+    }
+    replayedCount_++;
+}
+
+} //namespace oculus
@@ -0,0 +1,87 @@
+#ifndef _DEF_OCULUS_ROS_LOG_REPLAYER_H_
+#define _DEF_OCULUS_ROS_LOG_REPLAYER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "log_reader.h"
+#include "ping_codec.h"
+
+namespace oculus {
+
+// Plays a .oculus log back through the same callbacks as oculus::SonarDriver,
+// to stand in for the sonar hardware. Callbacks are called from the replay
+// thread. Pings compressed with PingCodec (archives written by
+// oculus_batch_converter) are decompressed on the fly.
+//
+// rate : 1.0 plays in real time, 2.0 twice as fast, etc. A rate of 0 plays as
+// fast as possible.
+class LogReplayer
+{
+    public:
+
+    using TimeSource     = std::chrono::system_clock;
+    using TimePoint      = TimeSource::time_point;
+    using PingCallback   = std::function<void(const OculusSimplePingResult&, const std::vector<uint8_t>&)>;
+    using StatusCallback = std::function<void(const OculusStatusMsg&)>;
+
+    LogReplayer(const std::string& filename, double rate = 1.0, bool loop = false);
+    ~LogReplayer();
+
+    void add_ping_callback(const PingCallback& callback)     { pingCallbacks_.push_back(callback);   }
+    void add_status_callback(const StatusCallback& callback) { statusCallbacks_.push_back(callback); }
+
+    void start();
+    void stop();
+    bool is_running() const { return running_; }
+    // Blocks until the end of the log is reached (never returns if looping).
+    void wait();
+
+    // Next item to be replayed, can be called from any thread.
+    void seek(size_t index) { seekIndex_ = index; }
+
+    // Time at which the current message was emitted (as with the sonar
+    // driver, this is the host reception time, not the original log time).
+    TimePoint last_header_stamp() const { return stamp_; }
+
+    const LogReader& reader() const { return reader_; }
+    size_t replayed_count() const { return replayedCount_; }
+    size_t loop_count()     const { return loopCount_;     }
+
+    protected:
+
+    static constexpr size_t NoSeek = static_cast<size_t>(-1);
+
+    LogReader reader_;
+    double    rate_;
+    bool      loop_;
+
+    std::vector<PingCallback>   pingCallbacks_;
+    std::vector<StatusCallback> statusCallbacks_;
+
+    std::thread             thread_;
+    std::atomic<bool>       running_;
+    std::mutex              mutex_;
+    std::condition_variable stopCondition_;
+    std::atomic<size_t>     seekIndex_;
+    TimePoint               stamp_;
+    std::vector<uint8_t>    buffer_;
+    PingCodec               codec_;
+    std::atomic<size_t>     replayedCount_;
+    std::atomic<size_t>     loopCount_;
+
+    void run();
+    void dispatch(const LogReader::Item& item);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_LOG_REPLAYER_H_
@@ -0,0 +1,152 @@
+#include "log_stream_reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace oculus {
+
+LogStreamReader::LogStreamReader(const std::string& filename)
+{
+    this->open(filename);
+}
+
+LogStreamReader::~LogStreamReader()
+{
+    this->close();
+}
+
+void LogStreamReader::open(const std::string& filename)
+{
+    this->close();
+
+    fd_ = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd_ < 0) {
+        throw std::runtime_error("Could not open '" + filename + "' : " + std::strerror(errno));
+    }
+    struct stat fileStat;
+    if(fstat(fd_, &fileStat) < 0) {
+        this->close();
+        throw std::runtime_error("Could not open '" + filename + "' : " + std::strerror(errno));
+    }
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    filename_ = filename;
+    size_     = fileStat.st_size;
+
+    log::LogFileHeader header;
+    if(!this->fill(sizeof(header))) {
+        this->close();
+        throw std::runtime_error("'" + filename + "' is not a .oculus log file.");
+    }
+    std::memcpy(&header, buffer_.data() + begin_, sizeof(header));
+    if(header.fileHeader != log::HeaderMagic
+       || !this->fill(std::max<size_t>(header.sizeHeader, sizeof(header)))) {
+        this->close();
+        throw std::runtime_error("'" + filename + "' is not a .oculus log file.");
+    }
+    begin_ += header.sizeHeader;
+}
+
+void LogStreamReader::close()
+{
+    if(fd_ >= 0) {
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd_);
+    }
+    fd_    = -1;
+    size_  = 0;
+    begin_ = 0;
+    end_   = 0;
+    bufferOffset_ = 0;
+    dropped_      = 0;
+}
+
+bool LogStreamReader::fill(size_t count)
+{
+    if(end_ - begin_ >= count)
+        return true;
+    if(this->position() + count > size_)
+        return false;
+
+    // Moving the unread bytes (less than an item) to the front.
+    if(begin_ > 0) {
+        std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        bufferOffset_ += begin_;
+        end_   -= begin_;
+        begin_  = 0;
+    }
+    if(buffer_.size() < count)
+        buffer_.resize(std::max(count, ReadSize));
+
+    while(end_ < count) {
+        ssize_t bytes = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+        if(bytes < 0) {
+            if(errno == EINTR)
+                continue;
+            throw std::runtime_error("Could not read '" + filename_ + "' : " + std::strerror(errno));
+        }
+        if(bytes == 0)
+            return false; // the file shrank
+        end_ += bytes;
+    }
+
+    if(bufferOffset_ - dropped_ >= DropSize) {
+        posix_fadvise(fd_, dropped_, bufferOffset_ - dropped_, POSIX_FADV_DONTNEED);
+        dropped_ = bufferOffset_;
+    }
+    return true;
+}
+
+bool LogStreamReader::is_message_at(size_t position)
+{
+    if(!this->fill(position + sizeof(OculusMessageHeader)))
+        return false;
+    OculusMessageHeader header;
+    std::memcpy(&header, buffer_.data() + begin_ + position, sizeof(header));
+    return header.oculusId == OCULUS_CHECK_ID;
+}
+
+bool LogStreamReader::next(Item& item)
+{
+    if(fd_ < 0 || !this->fill(sizeof(log::LogItemHeader)))
+        return false;
+
+    // Positions are relative to the item start, fill() may move the buffer.
+    log::LogItemHeader header;
+    std::memcpy(&header, buffer_.data() + begin_, sizeof(header));
+    if(header.itemHeader != log::HeaderMagic)
+        return false;
+
+    // Same tolerance as LogReader::build_index for the headers written by
+    // bag_to_oculus (see oculus_log.h).
+    size_t payloadOffset = header.sizeHeader;
+    if(!this->is_message_at(payloadOffset) && header.compression == log::NoCompression
+       && this->is_message_at(sizeof(log::LogItemHeader))) {
+        payloadOffset = sizeof(log::LogItemHeader);
+    }
+
+    size_t payloadSize = header.payloadSize;
+    if(payloadSize == 0) {
+        if(!this->is_message_at(payloadOffset))
+            return false;
+        OculusMessageHeader message;
+        std::memcpy(&message, buffer_.data() + begin_ + payloadOffset, sizeof(message));
+        payloadSize = sizeof(OculusMessageHeader) + message.payloadSize;
+    }
+    if(this->position() + payloadOffset + payloadSize > size_ || !this->fill(payloadOffset + payloadSize))
+        return false;
+
+    item.header = reinterpret_cast<const log::LogItemHeader*>(buffer_.data() + begin_);
+    item.data   = buffer_.data() + begin_ + payloadOffset;
+    item.size   = payloadSize;
+    item.time   = header.time_unix;
+    begin_ += payloadOffset + payloadSize;
+    return true;
+}
+
+} //namespace oculus
@@ -0,0 +1,69 @@
+#ifndef _DEF_OCULUS_ROS_LOG_STREAM_READER_H_
+#define _DEF_OCULUS_ROS_LOG_STREAM_READER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "log_reader.h"
+
+namespace oculus {
+
+// Sequential reader of .oculus log files, for logs too large to be mapped and
+// indexed at once (see LogReader, which is meant for replay and seeking).
+//
+// Items are read in order through a buffer which only grows to the size of
+// the largest item, and the file pages already read are dropped from the page
+// cache : memory use does not depend on the file size.
+class LogStreamReader
+{
+    public:
+
+    // item.header and item.data stay valid until the next call to next().
+    using Item = LogReader::Item;
+
+    LogStreamReader() = default;
+    explicit LogStreamReader(const std::string& filename);
+    ~LogStreamReader();
+
+    LogStreamReader(const LogStreamReader&)            = delete;
+    LogStreamReader& operator=(const LogStreamReader&) = delete;
+
+    // Throws std::runtime_error if the file cannot be opened or is not a
+    // .oculus log.
+    void open(const std::string& filename);
+    void close();
+
+    bool is_open() const { return fd_ >= 0; }
+    const std::string& filename() const { return filename_; }
+    uint64_t file_size() const { return size_; }
+    // Bytes of the file consumed so far.
+    uint64_t position() const { return bufferOffset_ + begin_; }
+
+    // Returns false at the end of the file, or at the first truncated or
+    // corrupted item (keeping what was read so far, as LogReader does).
+    // Throws std::runtime_error on read errors.
+    bool next(Item& item);
+
+    protected:
+
+    static constexpr size_t ReadSize = 4*1024*1024;
+    static constexpr size_t DropSize = 64*1024*1024; // page cache release granularity
+
+    std::string          filename_;
+    int                  fd_   = -1;
+    uint64_t             size_ = 0;
+    std::vector<uint8_t> buffer_;
+    size_t               begin_ = 0; // unread bytes are [begin_, end_)
+    size_t               end_   = 0;
+    uint64_t             bufferOffset_ = 0; // file offset of buffer_[0]
+    uint64_t             dropped_      = 0; // released from the page cache
+
+    // Makes count bytes available from begin_, false if the file is too short.
+    bool fill(size_t count);
+    bool is_message_at(size_t position);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_LOG_STREAM_READER_H_
@@ -0,0 +1,259 @@
+#include "log_writer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace oculus {
+
+static constexpr size_t PageSize = 4096;
+
+LogWriter::LogWriter(const Options& options) :
+    options_(options),
+    ring_(nullptr),
+    capacity_(((options.buffer_size + PageSize - 1) / PageSize)*PageSize),
+    head_(0),
+    tail_(0),
+    bytesWritten_(0),
+    itemsWritten_(0),
+    itemsDropped_(0),
+    filesWritten_(0),
+    writeNanoseconds_(0),
+    startTime_(Clock::now()),
+    running_(true),
+    lastWrite_(startTime_),
+    nextOpen_(startTime_)
+{
+    if(capacity_ == 0 || posix_memalign(reinterpret_cast<void**>(&ring_), PageSize, capacity_) != 0) {
+        throw std::bad_alloc();
+    }
+    // Touching the pages now so that push() never page faults.
+    std::memset(ring_, 0, capacity_);
+    thread_ = std::thread(&LogWriter::run, this);
+}
+
+LogWriter::~LogWriter()
+{
+    this->stop();
+    std::free(ring_);
+}
+
+void LogWriter::copy_in(uint64_t index, const void* src, size_t size)
+{
+    size_t position = index % capacity_;
+    size_t first    = std::min(size, capacity_ - position);
+    std::memcpy(ring_ + position, src, first);
+    std::memcpy(ring_, static_cast<const uint8_t*>(src) + first, size - first);
+}
+
+void LogWriter::copy_out(uint64_t index, void* dst, size_t size) const
+{
+    size_t position = index % capacity_;
+    size_t first    = std::min(size, capacity_ - position);
+    std::memcpy(dst, ring_ + position, first);
+    std::memcpy(static_cast<uint8_t*>(dst) + first, ring_, size - first);
+}
+
+bool LogWriter::push(const uint8_t* message, size_t size, double time)
+{
+    const size_t itemSize = sizeof(log::LogItemHeader) + size;
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    if(!running_ || capacity_ - (head - tail) < itemSize) {
+        itemsDropped_++;
+        return false;
+    }
+
+    auto header = log::make_item_header(time, size);
+
+    this->copy_in(head, &header, sizeof(header));
+    this->copy_in(head + sizeof(header), message, size);
+    head_.store(head + itemSize, std::memory_order_release);
+    return true;
+}
+
+void LogWriter::stop()
+{
+    if(!thread_.joinable())
+        return;
+    running_ = false;
+    thread_.join();
+}
+
+LogWriter::Statistics LogWriter::statistics() const
+{
+    Statistics stats;
+    stats.bytes_written   = bytesWritten_;
+    stats.items_written   = itemsWritten_;
+    stats.items_dropped   = itemsDropped_;
+    stats.files_written   = filesWritten_;
+    stats.write_seconds   = 1.0e-9*writeNanoseconds_;
+    stats.elapsed_seconds = std::chrono::duration<double>(Clock::now() - startTime_).count();
+    stats.buffer_used     = head_ - tail_;
+    stats.buffer_capacity = capacity_;
+    return stats;
+}
+
+void LogWriter::run()
+{
+    while(running_) {
+        if(!this->write_batch(false)) {
+            // Not enough data for a full batch yet.
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    while(this->write_batch(true));
+    this->close_file();
+}
+
+bool LogWriter::rotation_needed(size_t nextItemSize) const
+{
+    if(fd_ < 0)
+        return true;
+    if(fileSize_ <= sizeof(log::LogFileHeader))
+        return false; // at least one item per file
+    if(options_.max_file_size > 0 && fileSize_ + nextItemSize > options_.max_file_size)
+        return true;
+    if(options_.max_file_duration > 0.0
+       && std::chrono::duration<double>(Clock::now() - fileStart_).count() > options_.max_file_duration)
+        return true;
+    return false;
+}
+
+// Writes whole items from the ring, up to batch_size bytes (or everything
+// available if flush is set or if nothing was written for flush_period).
+// Returns false if there was nothing to write.
+bool LogWriter::write_batch(bool flush)
+{
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const auto     now  = Clock::now();
+    if(head == tail)
+        return false;
+    if(!flush && head - tail < options_.batch_size
+       && std::chrono::duration<double>(now - lastWrite_).count() < options_.flush_period)
+        return false;
+    lastWrite_ = now;
+
+    // Walking item headers to cut the batch on an item boundary.
+    uint64_t end = tail;
+    size_t   items = 0;
+    double   firstTime = 0.0;
+    while(end < head && end - tail < options_.batch_size) {
+        log::LogItemHeader header;
+        this->copy_out(end, &header, sizeof(header));
+        size_t itemSize = sizeof(header) + header.payloadSize;
+        if(items == 0) {
+            firstTime = header.time_unix;
+            if(this->rotation_needed(itemSize)) {
+                this->close_file();
+                if(now >= nextOpen_)
+                    this->open_file(firstTime);
+            }
+        }
+        else if(fd_ >= 0 && this->rotation_needed(end - tail + itemSize)) {
+            // Without file, the whole batch is dropped.
+            break;
+        }
+        end += itemSize;
+        items++;
+    }
+
+    size_t position = tail % capacity_;
+    size_t size     = end - tail;
+    struct iovec chunks[2];
+    chunks[0].iov_base = ring_ + position;
+    chunks[0].iov_len  = std::min(size, capacity_ - position);
+    chunks[1].iov_base = ring_;
+    chunks[1].iov_len  = size - chunks[0].iov_len;
+
+    auto start = Clock::now();
+    int chunkCount = chunks[1].iov_len > 0 ? 2 : 1;
+    size_t remaining = size;
+    while(fd_ >= 0 && remaining > 0) {
+        ssize_t written = writev(fd_, chunks, chunkCount);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            std::cerr << "Oculus recorder : write to '" << filename_ << "' failed : "
+                      << std::strerror(errno) << std::endl;
+            this->close_file();
+            nextOpen_ = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(options_.reopen_period));
+            break;
+        }
+        remaining -= written;
+        // Partial write, skipping what was written.
+        for(int i = 0; i < chunkCount && written > 0; i++) {
+            size_t consumed = std::min<size_t>(written, chunks[i].iov_len);
+            chunks[i].iov_base = static_cast<uint8_t*>(chunks[i].iov_base) + consumed;
+            chunks[i].iov_len -= consumed;
+            written -= consumed;
+        }
+    }
+    writeNanoseconds_ += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+    fileSize_      += size - remaining;
+    bytesWritten_  += size - remaining;
+    if(fd_ >= 0)
+        itemsWritten_ += items;
+    else
+        itemsDropped_ += items; // no file, or the write failed
+    tail_.store(end, std::memory_order_release);
+    return true;
+}
+
+void LogWriter::open_file(double time)
+{
+    std::time_t seconds = static_cast<std::time_t>(time);
+    std::tm date;
+    gmtime_r(&seconds, &date);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &date);
+
+    std::string base = options_.directory + "/" + options_.prefix + "_" + stamp;
+    filename_ = base + ".oculus";
+    for(int i = 1; access(filename_.c_str(), F_OK) == 0; i++) {
+        filename_ = base + "_" + std::to_string(i) + ".oculus";
+    }
+
+    // Retried after reopen_period if this attempt fails.
+    nextOpen_ = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options_.reopen_period));
+    fd_ = ::open(filename_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd_ < 0) {
+        std::cerr << "Oculus recorder : could not open '" << filename_ << "' : "
+                  << std::strerror(errno) << std::endl;
+        return;
+    }
+    // Large sequential writes, the data is not read back.
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    auto header = log::make_file_header(time);
+    if(::write(fd_, &header, sizeof(header)) != sizeof(header)) {
+        std::cerr << "Oculus recorder : could not write to '" << filename_ << "'." << std::endl;
+        this->close_file();
+        return;
+    }
+    fileSize_  = sizeof(header);
+    fileStart_ = Clock::now();
+    filesWritten_++;
+}
+
+void LogWriter::close_file()
+{
+    if(fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = -1;
+    fileSize_ = 0;
+}
+
+} //namespace oculus
@@ -0,0 +1,116 @@
+#ifndef _DEF_OCULUS_ROS_LOG_WRITER_H_
+#define _DEF_OCULUS_ROS_LOG_WRITER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "oculus_log.h"
+
+namespace oculus {
+
+// Records raw sonar messages into .oculus log files (same layout as
+// scripts/bag_to_oculus).
+//
+// push() only copies the message into a preallocated ring buffer and never
+// blocks : if the ring is full the message is dropped and counted. A
+// dedicated thread writes whole items from the ring to disk in large batches
+// (directly from the page aligned ring memory) and rotates files by size and
+// duration. Data waiting for a full batch is written anyway after
+// flush_period. If no file can be opened the items are dropped (and counted)
+// and a new file is tried at most every reopen_period.
+class LogWriter
+{
+    public:
+
+    struct Options
+    {
+        std::string directory        = ".";
+        std::string prefix           = "oculus";
+        size_t      buffer_size      = 64*1024*1024;
+        size_t      batch_size       = 1024*1024;
+        size_t      max_file_size    = 0; // bytes, 0 for no limit
+        double      max_file_duration = 0.0; // seconds, 0 for no limit
+        double      flush_period     = 1.0; // seconds, longest wait for a full batch
+        double      reopen_period    = 1.0; // seconds between attempts to open a file
+    };
+
+    struct Statistics
+    {
+        uint64_t bytes_written  = 0;
+        uint64_t items_written  = 0;
+        uint64_t items_dropped  = 0;
+        uint64_t files_written  = 0;
+        double   write_seconds  = 0.0; // time spent in write calls
+        double   elapsed_seconds = 0.0;
+        size_t   buffer_used    = 0;
+        size_t   buffer_capacity = 0;
+
+        double sustained_rate() const { // MB/s since start
+            return elapsed_seconds > 0.0 ? 1.0e-6*bytes_written / elapsed_seconds : 0.0;
+        }
+        double disk_rate() const { // MB/s while writing
+            return write_seconds > 0.0 ? 1.0e-6*bytes_written / write_seconds : 0.0;
+        }
+    };
+
+    explicit LogWriter(const Options& options);
+    ~LogWriter();
+
+    LogWriter(const LogWriter&)            = delete;
+    LogWriter& operator=(const LogWriter&) = delete;
+
+    // Producer side (a single thread). time is the message reception time in
+    // seconds since epoch.
+    bool push(const uint8_t* message, size_t size, double time);
+
+    // Writes everything still in the ring and closes the current file.
+    void stop();
+
+    Statistics statistics() const;
+    const std::string& current_filename() const { return filename_; }
+
+    protected:
+
+    using Clock = std::chrono::steady_clock;
+
+    Options  options_;
+    uint8_t* ring_;
+    size_t   capacity_;
+
+    // Monotonic byte indexes in the ring, positions are index % capacity_.
+    alignas(64) std::atomic<uint64_t> head_; // written by push()
+    alignas(64) std::atomic<uint64_t> tail_; // written by the writer thread
+
+    std::atomic<uint64_t> bytesWritten_;
+    std::atomic<uint64_t> itemsWritten_;
+    std::atomic<uint64_t> itemsDropped_;
+    std::atomic<uint64_t> filesWritten_;
+    std::atomic<uint64_t> writeNanoseconds_;
+    Clock::time_point     startTime_;
+
+    std::atomic<bool> running_;
+    std::thread       thread_;
+
+    int               fd_ = -1;
+    std::string       filename_;
+    size_t            fileSize_ = 0;
+    Clock::time_point fileStart_;
+    Clock::time_point lastWrite_;
+    Clock::time_point nextOpen_; // no open attempt before, after a failure
+
+    void copy_in(uint64_t index, const void* src, size_t size);
+    void copy_out(uint64_t index, void* dst, size_t size) const;
+
+    void run();
+    bool write_batch(bool flush);
+    void open_file(double time);
+    void close_file();
+    bool rotation_needed(size_t nextItemSize) const;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_LOG_WRITER_H_
@@ -0,0 +1,60 @@
+#ifndef _DEF_OCULUS_ROS_MESSAGE_POOL_H_
+#define _DEF_OCULUS_ROS_MESSAGE_POOL_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace oculus {
+
+// Messages handed over to intra-process subscribers (see
+// oculus::publish_message). Ownership of a published message goes to the
+// subscribers so it cannot be reused : the next ones are allocated, and their
+// buffers reserved by prepare, after publishing (refill) rather than on the
+// path of the next message. Not thread safe, used by the publishing thread
+// only.
+template <typename MsgT>
+class MessagePool
+{
+    public:
+
+    using Prepare = std::function<void(MsgT&)>;
+
+    explicit MessagePool(size_t size = 1, Prepare prepare = Prepare()) :
+        size_(size), prepare_(std::move(prepare))
+    {}
+
+    // A prepared message, allocated on the spot if the pool is empty.
+    std::unique_ptr<MsgT> take()
+    {
+        if(messages_.empty())
+            return this->make();
+        auto msg = std::move(messages_.back());
+        messages_.pop_back();
+        return msg;
+    }
+
+    void refill()
+    {
+        while(messages_.size() < size_)
+            messages_.push_back(this->make());
+    }
+
+    protected:
+
+    size_t                             size_;
+    Prepare                            prepare_;
+    std::vector<std::unique_ptr<MsgT>> messages_;
+
+    std::unique_ptr<MsgT> make()
+    {
+        auto msg = std::make_unique<MsgT>();
+        if(prepare_)
+            prepare_(*msg);
+        return msg;
+    }
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_MESSAGE_POOL_H_
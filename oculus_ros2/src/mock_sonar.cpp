@@ -0,0 +1,413 @@
+#include "mock_sonar.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace oculus {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+sockaddr_in make_address(const std::string& address, uint16_t port)
+{
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if(inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        throw std::runtime_error("MockSonar : invalid address '" + address + "'");
+    }
+    return addr;
+}
+
+bool send_all(int fd, const uint8_t* data, size_t size)
+{
+    while(size > 0) {
+        ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+        if(sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+double ping_rate_hz(uint8_t pingRate)
+{
+    switch(pingRate) {
+        case pingRateNormal:  return 10.0;
+        case pingRateHigh:    return 15.0;
+        case pingRateHighest: return 40.0;
+        case pingRateLow:     return 5.0;
+        case pingRateLowest:  return 2.0;
+        default:              return 0.0; // standby
+    }
+}
+
+} //namespace
+
+std::vector<uint8_t> make_synthetic_ping(const OculusSimpleFireMessage& config,
+                                         unsigned int nBeams, unsigned int nRanges,
+                                         uint32_t seed)
+{
+    const bool use16Bits = config.flags & 0x02;
+    const bool withGain  = config.flags & 0x04;
+    const unsigned int sampleSize  = use16Bits ? 2 : 1;
+    const unsigned int rowSize     = nBeams*sampleSize + (withGain ? 4 : 0);
+    const unsigned int imageOffset = sizeof(OculusSimplePingResult) + nBeams*sizeof(int16_t);
+
+    std::vector<uint8_t> data(imageOffset + nRanges*rowSize);
+
+    OculusSimplePingResult metadata;
+    std::memset(&metadata, 0, sizeof(metadata));
+    metadata.fireMessage = config;
+    metadata.fireMessage.head.oculusId    = OCULUS_CHECK_ID;
+    metadata.fireMessage.head.msgId       = messageSimplePingResult;
+    metadata.fireMessage.head.payloadSize = data.size() - sizeof(OculusMessageHeader);
+    metadata.frequency       = config.masterMode == 2 ? 2.1e6 : 1.2e6;
+    metadata.temperature     = 15.0;
+    metadata.speeedOfSoundUsed = config.speedOfSound > 0.0 ? config.speedOfSound : 1500.0;
+    metadata.dataSize        = use16Bits ? dataSize16Bit : dataSize8Bit;
+    metadata.rangeResolution = config.range / nRanges;
+    metadata.nRanges         = nRanges;
+    metadata.nBeams          = nBeams;
+    metadata.imageOffset     = imageOffset;
+    metadata.imageSize       = nRanges*rowSize;
+    metadata.messageSize     = data.size();
+    std::memcpy(data.data(), &metadata, sizeof(metadata));
+
+    // 130° aperture in low frequency, 80° in high frequency (hundredths of
+    // degrees).
+    const int halfAperture = config.masterMode == 2 ? 4000 : 6500;
+    for(unsigned int b = 0; b < nBeams; b++) {
+        int16_t bearing = -halfAperture + (2*halfAperture*static_cast<int>(b)) / static_cast<int>(nBeams - 1);
+        std::memcpy(data.data() + sizeof(OculusSimplePingResult) + b*sizeof(int16_t),
+                    &bearing, sizeof(bearing));
+    }
+
+    // Speckle everywhere, plus a bright seabed echo at a range depending on
+    // the beam angle (flat bottom seen from above).
+    std::mt19937 random(seed);
+    std::exponential_distribution<float> speckle(1.0f);
+    const float maxValue = use16Bits ? 65535.0f : 255.0f;
+    for(unsigned int r = 0; r < nRanges; r++) {
+        uint8_t* row = data.data() + imageOffset + r*rowSize;
+        if(withGain) {
+            uint32_t gain = 1 + r / 4;
+            std::memcpy(row, &gain, sizeof(gain));
+            row += 4;
+        }
+        for(unsigned int b = 0; b < nBeams; b++) {
+            float angle  = (-1.0f + 2.0f*b / (nBeams - 1))*halfAperture*1.0e-2f*M_PI / 180.0f;
+            float bottom = 0.6f*nRanges / std::max(0.3f, std::cos(angle));
+            float echo   = std::exp(-0.5f*std::pow((r - bottom) / (0.01f*nRanges + 1.0f), 2.0f));
+            float value  = std::min(maxValue, maxValue*(0.05f*speckle(random) + 0.8f*echo*speckle(random)));
+            if(use16Bits) {
+                uint16_t sample = static_cast<uint16_t>(value);
+                std::memcpy(row + 2*b, &sample, sizeof(sample));
+            }
+            else {
+                row[b] = static_cast<uint8_t>(value);
+            }
+        }
+    }
+    return data;
+}
+
+MockSonar::MockSonar(const Options& options) :
+    options_(options),
+    random_(std::random_device()())
+{
+    std::memset(&config_, 0, sizeof(config_));
+    config_.head.oculusId = OCULUS_CHECK_ID;
+    config_.head.msgId    = messageSimpleFire;
+    config_.masterMode    = 1;
+    config_.pingRate      = pingRateNormal;
+    config_.gammaCorrection = 127;
+    config_.flags         = 0x09 | (options_.use16bits ? 0x02 : 0)
+                                 | (options_.with_gain ? 0x04 : 0)
+                                 | (options_.nbeams > 256 ? 0x40 : 0);
+    config_.range         = options_.range;
+    config_.gainPercent   = 50.0;
+
+    if(!options_.replay_file.empty()) {
+        reader_ = std::make_unique<LogReader>(options_.replay_file);
+    }
+    this->make_frames();
+}
+
+MockSonar::~MockSonar()
+{
+    this->stop();
+}
+
+void MockSonar::start()
+{
+    if(running_)
+        return;
+
+    statusFd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    int enable = 1;
+    ::setsockopt(statusFd_, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+
+    serverFd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::setsockopt(serverFd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    auto addr = make_address(options_.address, options_.data_port);
+    if(statusFd_ < 0 || serverFd_ < 0
+       || ::bind(serverFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+       || ::listen(serverFd_, 1) != 0)
+    {
+        std::string error = std::strerror(errno);
+        ::close(statusFd_);
+        ::close(serverFd_);
+        statusFd_ = serverFd_ = -1;
+        throw std::runtime_error("MockSonar : could not listen on " + options_.address
+                                 + ":" + std::to_string(options_.data_port) + " (" + error + ")");
+    }
+
+    running_ = true;
+    statusThread_ = std::thread(&MockSonar::run_status, this);
+    serverThread_ = std::thread(&MockSonar::run_server, this);
+}
+
+void MockSonar::stop()
+{
+    if(!running_)
+        return;
+    running_ = false;
+    // Unblocks accept, the other threads poll running_.
+    ::shutdown(serverFd_, SHUT_RDWR);
+    statusThread_.join();
+    serverThread_.join();
+    ::close(statusFd_);
+    ::close(serverFd_);
+    statusFd_ = serverFd_ = -1;
+}
+
+MockSonar::Statistics MockSonar::statistics() const
+{
+    Statistics stats;
+    stats.pings_sent       = pingsSent_;
+    stats.pings_dropped    = pingsDropped_;
+    stats.bytes_sent       = bytesSent_;
+    stats.configs_received = configsReceived_;
+    stats.connections      = connections_;
+    return stats;
+}
+
+void MockSonar::run_status()
+{
+    OculusStatusMsg status;
+    std::memset(&status, 0, sizeof(status));
+    status.hdr.oculusId    = OCULUS_CHECK_ID;
+    status.hdr.payloadSize = sizeof(status) - sizeof(OculusMessageHeader);
+    status.deviceId        = 0x4d4f434b; // "MOCK"
+    status.deviceType      = 1;
+    inet_pton(AF_INET, options_.address.c_str(), &status.ipAddr); // network byte order
+    inet_pton(AF_INET, "255.255.255.0", &status.ipMask);
+    status.temperature0    = 15.0;
+
+    auto destination = make_address(options_.status_address, options_.status_port);
+    auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options_.status_period));
+    auto next = Clock::now();
+    while(running_) {
+        if(Clock::now() >= next) {
+            ::sendto(statusFd_, &status, sizeof(status), 0,
+                     reinterpret_cast<sockaddr*>(&destination), sizeof(destination));
+            next += period;
+        }
+        std::this_thread::sleep_for(std::min<Clock::duration>(period, std::chrono::milliseconds(50)));
+    }
+}
+
+void MockSonar::run_server()
+{
+    while(running_) {
+        pollfd pfd = {serverFd_, POLLIN, 0};
+        if(::poll(&pfd, 1, 100) <= 0)
+            continue;
+        int fd = ::accept(serverFd_, nullptr, nullptr);
+        if(fd < 0)
+            continue;
+        int enable = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        connections_++;
+        clientFd_ = fd;
+        this->stream(fd);
+        clientFd_ = -1;
+        ::close(fd);
+    }
+}
+
+double MockSonar::ping_period() const
+{
+    if(config_.pingRate == pingRateStandby)
+        return 0.0;
+    double rate = options_.rate > 0.0 ? options_.rate : ping_rate_hz(config_.pingRate);
+    return rate > 0.0 ? 1.0 / rate : 0.0;
+}
+
+void MockSonar::stream(int fd)
+{
+    // The sonar fires on its own schedule : when the connection cannot keep up
+    // pings are skipped (ping_id gaps), not delayed.
+    auto nextPing  = Clock::now();
+    auto nextDummy = Clock::now();
+    received_.clear();
+    while(running_) {
+        auto now = Clock::now();
+        double period = this->ping_period();
+        if(period <= 0.0) {
+            if(now >= nextDummy) {
+                OculusMessageHeader dummy;
+                std::memset(&dummy, 0, sizeof(dummy));
+                dummy.oculusId = OCULUS_CHECK_ID;
+                dummy.msgId    = messageDummy;
+                if(!send_all(fd, reinterpret_cast<const uint8_t*>(&dummy), sizeof(dummy)))
+                    return;
+                nextDummy = now + std::chrono::seconds(1);
+            }
+            nextPing = now;
+        }
+        else if(now >= nextPing) {
+            auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(period));
+            nextPing += step;
+            if(nextPing < now) {
+                // Late by more than a period, the missed pings are lost.
+                auto missed = (now - nextPing) / step + 1;
+                pingId_        += missed;
+                pingsDropped_  += missed;
+                nextPing       += missed*step;
+            }
+            if(!this->send_ping(fd))
+                return;
+            continue;
+        }
+
+        auto wakeUp  = period > 0.0 ? nextPing : std::min(nextDummy, now + std::chrono::milliseconds(100));
+        int  timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wakeUp - Clock::now()).count();
+        pollfd pfd = {fd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, std::max(0, std::min(timeout, 100)));
+        if(ready > 0 && !this->read_messages(fd))
+            return;
+    }
+}
+
+bool MockSonar::read_messages(int fd)
+{
+    uint8_t buffer[4096];
+    ssize_t count = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if(count == 0)
+        return false; // client disconnected
+    if(count < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    received_.insert(received_.end(), buffer, buffer + count);
+
+    while(received_.size() >= sizeof(OculusMessageHeader)) {
+        OculusMessageHeader header;
+        std::memcpy(&header, received_.data(), sizeof(header));
+        if(header.oculusId != OCULUS_CHECK_ID) {
+            received_.clear(); // lost sync, waiting for the next message
+            break;
+        }
+        size_t size = sizeof(header) + header.payloadSize;
+        if(received_.size() < size)
+            break;
+        if(header.msgId == messageSimpleFire && size >= sizeof(OculusSimpleFireMessage)) {
+            OculusSimpleFireMessage config;
+            std::memcpy(&config, received_.data(), sizeof(config));
+            configsReceived_++;
+            this->apply_config(config);
+        }
+        received_.erase(received_.begin(), received_.begin() + size);
+    }
+    return true;
+}
+
+void MockSonar::apply_config(const OculusSimpleFireMessage& config)
+{
+    // Standby requests are always honored (the driver relies on them).
+    if(!options_.obey_config) {
+        config_.pingRate = config.pingRate;
+        return;
+    }
+    bool geometryChanged = config.masterMode != config_.masterMode
+                        || config.flags != config_.flags
+                        || config.range != config_.range;
+    config_ = config;
+    if(geometryChanged)
+        this->make_frames();
+}
+
+void MockSonar::make_frames()
+{
+    if(reader_)
+        return;
+    // A few different pings are cycled so that consumers do not see the
+    // exact same image over and over.
+    unsigned int nBeams = options_.nbeams;
+    if(options_.obey_config && configsReceived_ > 0)
+        nBeams = (config_.flags & 0x40) ? 512 : 256;
+    frames_.clear();
+    for(uint32_t i = 0; i < 8; i++) {
+        frames_.push_back(make_synthetic_ping(config_, nBeams, options_.nranges, i));
+    }
+}
+
+bool MockSonar::send_ping(int fd)
+{
+    uint32_t pingId = pingId_++;
+    if(options_.loss > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random_) < options_.loss) {
+        pingsDropped_++;
+        return true;
+    }
+    double delay = options_.delay;
+    if(options_.jitter > 0.0)
+        delay += std::uniform_real_distribution<double>(0.0, options_.jitter)(random_);
+    if(delay > 0.0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(delay));
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    if(reader_) {
+        // Replays the pings of the log in a loop.
+        for(size_t i = 0; i < reader_->item_count() && !data; i++) {
+            const auto& item = reader_->item(nextItem_++ % reader_->item_count());
+            auto header = reinterpret_cast<const OculusMessageHeader*>(item.data);
+            if(item.size >= sizeof(OculusSimplePingResult) && header->msgId == messageSimplePingResult) {
+                data = item.data;
+                size = item.size;
+            }
+        }
+        if(!data)
+            return false; // no ping in the log
+    }
+    else {
+        auto& frame = frames_[pingId % frames_.size()];
+        auto metadata = reinterpret_cast<OculusSimplePingResult*>(frame.data());
+        metadata->pingId        = pingId;
+        metadata->pingStartTime = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count());
+        data = frame.data();
+        size = frame.size();
+    }
+
+    if(!send_all(fd, data, size))
+        return false;
+    pingsSent_++;
+    bytesSent_ += size;
+    return true;
+}
+
+} //namespace oculus
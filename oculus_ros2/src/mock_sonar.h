@@ -0,0 +1,120 @@
+#ifndef _DEF_OCULUS_ROS_MOCK_SONAR_H_
+#define _DEF_OCULUS_ROS_MOCK_SONAR_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "log_reader.h"
+
+namespace oculus {
+
+// Stand-in for an Oculus sonar on the local host, speaking the network
+// protocol expected by oculus::SonarDriver :
+//  - OculusStatusMsg sent over UDP to status_port (the driver learns the
+//    sonar address from it),
+//  - a TCP server on data_port streaming OculusSimplePingResult messages
+//    (synthetic, or replayed from a .oculus log) and dummy messages while in
+//    standby,
+//  - OculusSimpleFireMessage received on the TCP connection change the ping
+//    geometry and rate.
+// Ping loss and delays can be injected to test the receiving side.
+class MockSonar
+{
+    public:
+
+    struct Options
+    {
+        std::string address        = "127.0.0.1"; // TCP server and advertised address
+        std::string status_address = "127.0.0.1"; // 255.255.255.255 to broadcast
+        uint16_t    status_port    = 52102;
+        uint16_t    data_port      = 52100;
+        double      status_period  = 1.0; // seconds
+
+        double       rate       = 0.0; // pings per second, 0 to follow the fire message pingRate
+        unsigned int nbeams     = 256;
+        unsigned int nranges    = 512;
+        bool         use16bits  = false;
+        bool         with_gain  = false;
+        double       range      = 10.0; // meters
+        bool         obey_config = true; // apply the received fire messages
+        std::string  replay_file; // replay the pings of this log instead of synthetic ones
+
+        double loss   = 0.0; // probability of dropping each ping
+        double delay  = 0.0; // added to each ping (seconds)
+        double jitter = 0.0; // uniform random delay added to each ping (seconds)
+    };
+
+    struct Statistics
+    {
+        uint64_t pings_sent       = 0;
+        uint64_t pings_dropped    = 0; // by loss injection
+        uint64_t bytes_sent       = 0;
+        uint64_t configs_received = 0;
+        uint64_t connections      = 0;
+    };
+
+    explicit MockSonar(const Options& options);
+    ~MockSonar();
+
+    MockSonar(const MockSonar&)            = delete;
+    MockSonar& operator=(const MockSonar&) = delete;
+
+    // Throws std::runtime_error if the sockets cannot be opened.
+    void start();
+    void stop();
+
+    bool is_connected() const { return clientFd_ >= 0; }
+    Statistics statistics() const;
+
+    protected:
+
+    Options options_;
+
+    std::atomic<bool> running_{false};
+    int  statusFd_ = -1;
+    int  serverFd_ = -1;
+    std::atomic<int> clientFd_{-1};
+    std::thread statusThread_;
+    std::thread serverThread_;
+
+    // Only used by serverThread_.
+    OculusSimpleFireMessage           config_;
+    std::vector<std::vector<uint8_t>> frames_; // synthetic pings, cycled
+    std::unique_ptr<LogReader>        reader_;
+    size_t                            nextItem_ = 0;
+    uint32_t                          pingId_   = 0;
+    std::vector<uint8_t>              received_;
+    std::mt19937                      random_;
+
+    std::atomic<uint64_t> pingsSent_{0};
+    std::atomic<uint64_t> pingsDropped_{0};
+    std::atomic<uint64_t> bytesSent_{0};
+    std::atomic<uint64_t> configsReceived_{0};
+    std::atomic<uint64_t> connections_{0};
+
+    void run_status();
+    void run_server();
+    void stream(int fd);
+    bool read_messages(int fd);
+    void apply_config(const OculusSimpleFireMessage& config);
+    void make_frames();
+    double ping_period() const;
+    bool send_ping(int fd);
+};
+
+// Builds a synthetic OculusSimplePingResult message (speckle plus a seabed
+// echo) as sent by the sonar.
+std::vector<uint8_t> make_synthetic_ping(const OculusSimpleFireMessage& config,
+                                         unsigned int nBeams, unsigned int nRanges,
+                                         uint32_t seed);
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_MOCK_SONAR_H_
@@ -0,0 +1,104 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "mock_sonar.h"
+
+// Mock Oculus sonar on the local host, for tests and load tests without
+// hardware (see oculus::MockSonar).
+
+static volatile std::sig_atomic_t interrupted = 0;
+
+static void usage()
+{
+    std::cout << "Usage : oculus_mock_sonar [options]\n"
+        "  --address <ip>         address of the TCP server, advertised in the status (127.0.0.1)\n"
+        "  --status-address <ip>  where status messages are sent (127.0.0.1, 255.255.255.255 to broadcast)\n"
+        "  --status-port <port>   (52102)\n"
+        "  --data-port <port>     (52100)\n"
+        "  --rate <hz>            ping rate, 0 to follow the received configuration (0)\n"
+        "  --nbeams <n>           (256)\n"
+        "  --nranges <n>          (512)\n"
+        "  --16bits               16 bits samples\n"
+        "  --gain                 prefix each range row with a gain\n"
+        "  --range <m>            (10.0)\n"
+        "  --ignore-config        ignore received configurations (except standby)\n"
+        "  --replay <file>        replay the pings of a .oculus log\n"
+        "  --loss <p>             probability of dropping each ping (0.0)\n"
+        "  --delay <s>            delay added to each ping (0.0)\n"
+        "  --jitter <s>           random delay added to each ping (0.0)\n"
+        "  --duration <s>         stop after this time (0 : run until interrupted)\n";
+}
+
+int main(int argc, char** argv)
+{
+    oculus::MockSonar::Options options;
+    double duration = 0.0;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if(i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if     (arg == "--address")        options.address        = value();
+        else if(arg == "--status-address") options.status_address = value();
+        else if(arg == "--status-port")    options.status_port    = std::stoi(value());
+        else if(arg == "--data-port")      options.data_port      = std::stoi(value());
+        else if(arg == "--rate")           options.rate           = std::stod(value());
+        else if(arg == "--nbeams")         options.nbeams         = std::stoi(value());
+        else if(arg == "--nranges")        options.nranges        = std::stoi(value());
+        else if(arg == "--16bits")         options.use16bits      = true;
+        else if(arg == "--gain")           options.with_gain      = true;
+        else if(arg == "--range")          options.range          = std::stod(value());
+        else if(arg == "--ignore-config")  options.obey_config    = false;
+        else if(arg == "--replay")         options.replay_file    = value();
+        else if(arg == "--loss")           options.loss           = std::stod(value());
+        else if(arg == "--delay")          options.delay          = std::stod(value());
+        else if(arg == "--jitter")         options.jitter         = std::stod(value());
+        else if(arg == "--duration")       duration               = std::stod(value());
+        else {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+
+    std::signal(SIGINT,  [](int) { interrupted = 1; });
+    std::signal(SIGTERM, [](int) { interrupted = 1; });
+
+    try {
+        oculus::MockSonar sonar(options);
+        sonar.start();
+        std::cout << "Mock sonar listening on " << options.address << ":" << options.data_port
+                  << ", status sent to " << options.status_address << ":" << options.status_port
+                  << std::endl;
+
+        auto start = std::chrono::steady_clock::now();
+        oculus::MockSonar::Statistics last;
+        while(!interrupted) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            auto stats = sonar.statistics();
+            std::cout << (sonar.is_connected() ? "connected" : "waiting") << " : "
+                      << stats.pings_sent - last.pings_sent << " pings/s, "
+                      << 1.0e-6*(stats.bytes_sent - last.bytes_sent) << " MB/s, "
+                      << stats.pings_dropped << " dropped, "
+                      << stats.configs_received << " configs received" << std::endl;
+            last = stats;
+            if(duration > 0.0 && std::chrono::steady_clock::now() - start
+                                 >= std::chrono::duration<double>(duration)) {
+                break;
+            }
+        }
+        sonar.stop();
+    }
+    catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
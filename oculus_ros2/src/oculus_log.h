@@ -0,0 +1,94 @@
+#ifndef _DEF_OCULUS_ROS_OCULUS_LOG_H_
+#define _DEF_OCULUS_ROS_OCULUS_LOG_H_
+
+#include <cstdint>
+#include <cstring>
+
+namespace oculus { namespace log {
+
+// Layout of the native .oculus log files, as written by scripts/bag_to_oculus.
+//
+// A file starts with a LogFileHeader, followed by items. Each item is a
+// LogItemHeader followed by a raw sonar message (OculusMessageHeader and its
+// payload). bag_to_oculus writes 36 bytes item headers while announcing 40 in
+// sizeHeader, and leaves rawSize and payloadSize to 0 : readers must not rely
+// on these fields.
+
+constexpr uint32_t HeaderMagic     = 2037;
+constexpr uint16_t RawSonarMessage = 10; // LogItemHeader::messageType
+
+// LogItemHeader::compression. Compressed items have valid rawSize and
+// payloadSize fields.
+constexpr uint16_t NoCompression        = 0;
+constexpr uint16_t PingCodecCompression = 1; // see oculus::PingCodec
+
+#pragma pack(push, 1)
+struct LogFileHeader
+{
+    uint32_t fileHeader;   // HeaderMagic
+    uint32_t sizeHeader;   // 48
+    char     source[16];   // "Oculus"
+    uint16_t version;      // 1
+    uint16_t encryption;   // 0
+    uint64_t key;          // 0
+    uint32_t spare1;       // 123
+    double   time_unix;
+};
+
+struct LogItemHeader
+{
+    uint32_t itemHeader;   // HeaderMagic
+    uint32_t sizeHeader;   // 40
+    uint16_t messageType;  // RawSonarMessage
+    uint16_t version;      // 2
+    uint32_t spare1;       // 125
+    double   time_unix;    // reception time of the message
+    uint16_t compression;  // NoCompression, PingCodecCompression
+    uint16_t spare2;       // 126
+    uint32_t rawSize;      // uncompressed message size
+    uint32_t payloadSize;  // message size as stored in the file
+};
+#pragma pack(pop)
+
+static_assert(sizeof(LogFileHeader) == 48, "Unexpected .oculus file header size");
+static_assert(sizeof(LogItemHeader) == 36, "Unexpected .oculus item header size");
+
+inline LogFileHeader make_file_header(double time)
+{
+    LogFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.fileHeader = HeaderMagic;
+    header.sizeHeader = sizeof(header);
+    std::strncpy(header.source, "Oculus", sizeof(header.source));
+    header.version    = 1;
+    header.encryption = 0;
+    header.key        = 0;
+    header.spare1     = 123;
+    header.time_unix  = time;
+    return header;
+}
+
+// payloadSize bytes are expected right after the header. Readers only look
+// for the payload of uncompressed items at both places (see above) :
+// compressed items announce the actual header size.
+inline LogItemHeader make_item_header(double time, uint32_t payloadSize,
+                                      uint16_t compression = NoCompression,
+                                      uint32_t rawSize = 0)
+{
+    LogItemHeader header;
+    header.itemHeader  = HeaderMagic;
+    header.sizeHeader  = compression == NoCompression ? 40 : sizeof(LogItemHeader);
+    header.messageType = RawSonarMessage;
+    header.version     = 2;
+    header.spare1      = 125;
+    header.time_unix   = time;
+    header.compression = compression;
+    header.spare2      = 126;
+    header.rawSize     = compression == NoCompression ? payloadSize : rawSize;
+    header.payloadSize = payloadSize;
+    return header;
+}
+
+}} //namespace oculus::log
+
+#endif //_DEF_OCULUS_ROS_OCULUS_LOG_H_
@@ -0,0 +1,326 @@
+#include "oculus_mosaic_node.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+#include "tf2/exceptions.h"
+#include "tf2/time.h"
+#include "tf2_ros/buffer_interface.h"
+
+#include "rclcpp_components/register_node_macro.hpp"
+
+OculusMosaicNode::OculusMosaicNode(const rclcpp::NodeOptions& options) :
+    Node("oculus_mosaic", options)
+{
+    if (!this->has_parameter("map_frame")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "map_frame";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Fixed frame of the mosaic, which lies in its z = 0 plane.";
+        param_desc.read_only = true;
+        this->declare_parameter<std::string>("map_frame", "map", param_desc);
+    }
+    if (!this->has_parameter("sonar_frame")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "sonar_frame";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Frame of the sonar (empty: header.frame_id of each ping).";
+        param_desc.read_only = true;
+        this->declare_parameter<std::string>("sonar_frame", "", param_desc);
+    }
+    if (!this->has_parameter("tf_timeout")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(10.0).set__step(0.0);
+        param_desc.name = "tf_timeout";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Time (in seconds) to wait for the sonar pose at the time of a ping before dropping the ping.";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<double>("tf_timeout", 0.1, param_desc);
+    }
+    if (!this->has_parameter("queue_depth")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(1000).set__step(1);
+        param_desc.name = "queue_depth";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Pings waiting for their projection before the oldest one is dropped.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("queue_depth", 8, param_desc);
+    }
+    if (!this->has_parameter("publish_period")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.05).set__to_value(60.0).set__step(0.0);
+        param_desc.name = "publish_period";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Period (in seconds) at which the tiles updated since the last period are published on mosaic_tiles.";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<double>("publish_period", 0.5, param_desc);
+    }
+    if (!this->has_parameter("mosaic.resolution")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.005).set__to_value(10.0).set__step(0.0);
+        param_desc.name = "mosaic.resolution";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Size (in meters) of the mosaic cells.";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<double>("mosaic.resolution", 0.1, param_desc);
+    }
+    if (!this->has_parameter("mosaic.tile_size")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(16).set__to_value(4096).set__step(1);
+        param_desc.name = "mosaic.tile_size";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Cells per side of the mosaic tiles (tiles are allocated, published and evicted as a whole).";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("mosaic.tile_size", 128, param_desc);
+    }
+    if (!this->has_parameter("mosaic.min_range")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(1000.0).set__step(0.0);
+        param_desc.name = "mosaic.min_range";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Range (in meters) below which samples are not projected (near field).";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<double>("mosaic.min_range", 0.5, param_desc);
+    }
+    if (!this->has_parameter("mosaic.max_range")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(1000.0).set__step(0.0);
+        param_desc.name = "mosaic.max_range";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Range (in meters) beyond which samples are not projected (0: full ping range).";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<double>("mosaic.max_range", 0.0, param_desc);
+    }
+    if (!this->has_parameter("mosaic.max_tiles")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(1000000).set__step(1);
+        param_desc.name = "mosaic.max_tiles";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Tiles kept in memory, the least recently updated ones are evicted to mosaic.directory beyond that.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("mosaic.max_tiles", 256, param_desc);
+    }
+    if (!this->has_parameter("mosaic.directory")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "mosaic.directory";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Directory where evicted tiles are written, and the whole mosaic on shutdown (empty: evicted tiles are dropped once published). Tiles already there are resumed.";
+        param_desc.read_only = true;
+        this->declare_parameter<std::string>("mosaic.directory", "", param_desc);
+    }
+    if (!this->has_parameter("mosaic.threads")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "mosaic.threads";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Threads sharing the tiles covered by a ping (0 for the number of cores, up to 4).";
+        param_desc.read_only = true;
+        this->declare_parameter<int>("mosaic.threads", 0, param_desc);
+    }
+
+    this->map_frame_   = this->get_parameter("map_frame").as_string();
+    this->sonar_frame_ = this->get_parameter("sonar_frame").as_string();
+    this->tf_timeout_  = this->get_parameter("tf_timeout").as_double();
+
+    oculus::SonarMosaic::Options mosaicOptions;
+    mosaicOptions.resolution = this->get_parameter("mosaic.resolution").as_double();
+    mosaicOptions.tile_size  = this->get_parameter("mosaic.tile_size").as_int();
+    mosaicOptions.min_range  = this->get_parameter("mosaic.min_range").as_double();
+    mosaicOptions.max_range  = this->get_parameter("mosaic.max_range").as_double();
+    mosaicOptions.max_tiles  = this->get_parameter("mosaic.max_tiles").as_int();
+    mosaicOptions.directory  = this->get_parameter("mosaic.directory").as_string();
+    mosaicOptions.threads    = std::max<int64_t>(0, this->get_parameter("mosaic.threads").as_int());
+    this->mosaic_ = std::make_unique<oculus::SonarMosaic>(mosaicOptions);
+    if(!mosaicOptions.directory.empty()) {
+        RCLCPP_INFO_STREAM(this->get_logger(), "Mosaic tiles in '" << mosaicOptions.directory << "' ("
+                           << this->mosaic_->statistics().stored_tiles << " tiles resumed).");
+    }
+
+    this->tf_buffer_   = std::make_unique<tf2_ros::Buffer>(this->get_clock());
+    this->tf_listener_ = std::make_unique<tf2_ros::TransformListener>(*this->tf_buffer_);
+
+    this->ping_queue_ = std::make_unique<PingQueue>(this->get_parameter("queue_depth").as_int(),
+                                                    PingQueue::OverflowPolicy::DropOldest);
+    this->running_ = true;
+    this->mosaic_thread_ = std::thread(&OculusMosaicNode::run_mosaic, this);
+
+    this->tile_publisher_ = this->create_publisher<TileMsg>("mosaic_tiles", 100);
+    this->ping_subscription_ = this->create_subscription<PingMsg>("ping", 10,
+        std::bind(&OculusMosaicNode::on_ping, this, std::placeholders::_1));
+    this->publish_timer_ = this->create_wall_timer(
+        std::chrono::duration<double>(this->get_parameter("publish_period").as_double()),
+        std::bind(&OculusMosaicNode::publish_tiles, this));
+    this->save_service_ = this->create_service<std_srvs::srv::Trigger>("~/save_mosaic",
+        std::bind(&OculusMosaicNode::save_mosaic, this, std::placeholders::_1, std::placeholders::_2));
+}
+
+OculusMosaicNode::~OculusMosaicNode()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mosaic_mutex_);
+        this->running_ = false;
+    }
+    this->mosaic_condition_.notify_one();
+    if(this->mosaic_thread_.joinable())
+        this->mosaic_thread_.join();
+
+    try {
+        if(size_t saved = this->mosaic_->save()) {
+            RCLCPP_INFO_STREAM(this->get_logger(), "Mosaic saved (" << saved << " tiles in memory written to '"
+                               << this->mosaic_->options().directory << "').");
+        }
+    }
+    catch(const std::exception& e) {
+        RCLCPP_ERROR_STREAM(this->get_logger(), "Could not save the mosaic : " << e.what());
+    }
+}
+
+void OculusMosaicNode::on_ping(PingMsg::ConstSharedPtr msg)
+{
+    if(auto slot = this->ping_queue_->acquire()) {
+        *slot = std::move(msg);
+        this->ping_queue_->push(slot);
+    }
+    std::lock_guard<std::mutex> lock(this->mosaic_mutex_);
+    this->mosaic_condition_.notify_one();
+}
+
+void OculusMosaicNode::run_mosaic()
+{
+    while(this->running_) {
+        if(auto slot = this->ping_queue_->pop()) {
+            PingMsg::ConstSharedPtr msg = std::move(*slot);
+            this->ping_queue_->release(slot);
+            try {
+                this->integrate(*msg);
+            }
+            catch(const std::exception& e) {
+                RCLCPP_ERROR_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                    "Could not update the mosaic : " << e.what());
+            }
+
+            uint64_t drops = this->ping_queue_->dropped();
+            if(drops != this->reported_ping_drops_) {
+                RCLCPP_WARN_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                    "The mosaic does not keep up with the pings : " << drops << " pings dropped so far (last one took "
+                    << 1000.0*this->mosaic_->statistics().last_duration << "ms).");
+                this->reported_ping_drops_ = drops;
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->mosaic_mutex_);
+        this->mosaic_condition_.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+            return !this->running_ || !this->ping_queue_->empty();
+        });
+    }
+}
+
+void OculusMosaicNode::integrate(const PingMsg& msg)
+{
+    if(msg.ping.data.size() < sizeof(OculusSimplePingResult)) {
+        RCLCPP_WARN_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+            "Ping " << msg.ping.ping_id << " is too short, not projected.");
+        return;
+    }
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, msg.ping.data.data(), sizeof(metadata));
+
+    // Pose of the sonar when the ping was received, waiting for the
+    // navigation to catch up at most tf_timeout seconds.
+    const std::string& frame = this->sonar_frame_.empty() ? msg.header.frame_id : this->sonar_frame_;
+    geometry_msgs::msg::TransformStamped transform;
+    try {
+        transform = this->tf_buffer_->lookupTransform(this->map_frame_, frame,
+            tf2_ros::fromMsg(msg.header.stamp), tf2::durationFromSec(this->tf_timeout_));
+    }
+    catch(const tf2::TransformException& e) {
+        this->pose_failures_++;
+        RCLCPP_WARN_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+            "No pose for ping " << msg.ping.ping_id << " (" << this->pose_failures_
+            << " pings dropped so far) : " << e.what());
+        return;
+    }
+
+    const auto& t = transform.transform.translation;
+    const auto& q = transform.transform.rotation;
+    auto pose = oculus::SonarMosaic::Pose::from_quaternion(t.x, t.y, t.z, q.x, q.y, q.z, q.w);
+    if(this->mosaic_->integrate(metadata, msg.ping.data, pose, rclcpp::Time(msg.header.stamp).seconds()) == 0) {
+        RCLCPP_DEBUG_STREAM(this->get_logger(), "Ping " << msg.ping.ping_id << " did not update the mosaic.");
+    }
+}
+
+void OculusMosaicNode::publish_tiles()
+{
+    // Dirty tiles are taken even without subscriber, they cannot be evicted
+    // before.
+    const bool subscribed = this->tile_publisher_->get_subscription_count()
+                          + this->tile_publisher_->get_intra_process_subscription_count() > 0;
+    const float resolution = this->mosaic_->options().resolution;
+    const unsigned int size = this->mosaic_->options().tile_size;
+    this->mosaic_->take_dirty([&](const oculus::SonarMosaic::Tile& tile) {
+        if(!subscribed)
+            return;
+        auto msg = std::make_unique<TileMsg>();
+        msg->header.frame_id = this->map_frame_;
+        msg->header.stamp    = rclcpp::Time(static_cast<int64_t>(1.0e9*tile.stamp));
+        msg->tile_x          = tile.x;
+        msg->tile_y          = tile.y;
+        msg->size            = size;
+        msg->resolution      = resolution;
+        msg->intensity.resize(tile.cells.size());
+        msg->weight.resize(tile.cells.size());
+        for(size_t i = 0; i < tile.cells.size(); i++) {
+            const auto& cell = tile.cells[i];
+            msg->intensity[i] = cell.weight > 0.0f ? cell.sum / cell.weight
+                                                   : std::numeric_limits<float>::quiet_NaN();
+            msg->weight[i]    = cell.weight;
+        }
+        this->tile_publisher_->publish(std::move(msg));
+    });
+}
+
+void OculusMosaicNode::save_mosaic(const std_srvs::srv::Trigger::Request::SharedPtr,
+                                   std_srvs::srv::Trigger::Response::SharedPtr response)
+{
+    std::ostringstream oss;
+    try {
+        size_t saved = this->mosaic_->save();
+        auto stats = this->mosaic_->statistics();
+        response->success = !this->mosaic_->options().directory.empty();
+        if(response->success)
+            oss << saved << " tiles written to '" << this->mosaic_->options().directory << "', ";
+        else
+            oss << "no mosaic.directory to save to, ";
+        oss << stats.pings << " pings projected (" << stats.rejected << " rejected, "
+            << this->pose_failures_ << " without pose, " << this->ping_queue_->dropped() << " dropped), "
+            << stats.resident_tiles << " tiles in memory, " << stats.stored_tiles << " on disk.";
+    }
+    catch(const std::exception& e) {
+        response->success = false;
+        oss << "Could not save the mosaic : " << e.what();
+    }
+    response->message = oss.str();
+    RCLCPP_INFO_STREAM(this->get_logger(), response->message);
+}
+
+RCLCPP_COMPONENTS_REGISTER_NODE(OculusMosaicNode)
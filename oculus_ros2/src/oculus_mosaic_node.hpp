@@ -0,0 +1,68 @@
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "rclcpp/rclcpp.hpp"
+
+#include "sonar_mosaic.h"
+#include "spsc_queue.h"
+
+#include "tf2_ros/buffer.h"
+#include "tf2_ros/transform_listener.h"
+
+#include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+#include "oculus_interfaces/msg/oculus_mosaic_tile.hpp"
+
+#include "std_srvs/srv/trigger.hpp"
+
+#include "rcl_interfaces/msg/parameter_descriptor.hpp"
+
+// Builds a georeferenced mosaic of the pings during a survey (see
+// oculus::SonarMosaic) : each ping is projected at the pose of its frame in
+// map_frame (from TF, at the time of the ping), and the tiles it updated are
+// published on the mosaic_tiles topic every publish_period seconds.
+class OculusMosaicNode : public rclcpp::Node
+{
+  public:
+    explicit OculusMosaicNode(const rclcpp::NodeOptions& options = rclcpp::NodeOptions());
+    ~OculusMosaicNode();
+
+  private:
+    using PingMsg   = oculus_interfaces::msg::OculusStampedPing;
+    using TileMsg   = oculus_interfaces::msg::OculusMosaicTile;
+    using PingQueue = oculus::SpscSlotQueue<PingMsg::ConstSharedPtr>;
+
+    std::string map_frame_;
+    std::string sonar_frame_;
+    double      tf_timeout_ = 0.1;
+
+    std::unique_ptr<oculus::SonarMosaic>       mosaic_;
+    std::unique_ptr<tf2_ros::Buffer>            tf_buffer_;
+    std::unique_ptr<tf2_ros::TransformListener> tf_listener_;
+
+    // The subscription only queues the pings (by pointer), waiting for the
+    // pose and projecting happen in mosaic_thread_ so that a late pose never
+    // blocks the executor.
+    std::unique_ptr<PingQueue> ping_queue_;
+    std::thread                mosaic_thread_;
+    std::atomic<bool>          running_{false};
+    std::mutex                 mosaic_mutex_;
+    std::condition_variable    mosaic_condition_;
+    uint64_t                   reported_ping_drops_ = 0;
+    std::atomic<uint64_t>      pose_failures_{0};
+
+    rclcpp::Subscription<PingMsg>::SharedPtr ping_subscription_{nullptr};
+    rclcpp::Publisher<TileMsg>::SharedPtr tile_publisher_{nullptr};
+    rclcpp::TimerBase::SharedPtr publish_timer_{nullptr};
+    rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr save_service_{nullptr};
+
+    void on_ping(PingMsg::ConstSharedPtr msg);
+    void run_mosaic();
+    void integrate(const PingMsg& msg);
+    void publish_tiles();
+    void save_mosaic(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                     std_srvs::srv::Trigger::Response::SharedPtr response);
+};
@@ -0,0 +1,413 @@
+#include "oculus_multi_sonar_node.hpp"
+
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+using AddressedSonarDriver = oculus::AddressedSonarDriver;
+
+OculusMultiSonarNode::OculusMultiSonarNode(const rclcpp::NodeOptions& options) :
+    Node("oculus_sonars", options)
+{
+    if (!this->has_parameter("sonars")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "sonars";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING_ARRAY;
+        param_desc.description = "Names of the managed sonars. Topics and parameters of each sonar are prefixed with its name.";
+        param_desc.read_only = true;
+        this->declare_parameter<std::vector<std::string>>("sonars", {"sonar"}, param_desc);
+    }
+    if (!this->has_parameter("io_threads")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(16).set__step(1);
+        param_desc.name = "io_threads";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Number of threads running the network IO of all the sonars.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("io_threads", 1, param_desc);
+    }
+    if (!this->has_parameter("qos_depth")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(10000).set__step(1);
+        param_desc.name = "qos_depth";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "History depth of the ping and status publishers.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("qos_depth", 100, param_desc);
+    }
+    if (!this->has_parameter("ping_queue.depth")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(256).set__step(1);
+        param_desc.name = "ping_queue.depth";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Number of pings of each sonar which can wait for the publishing thread.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("ping_queue.depth", 8, param_desc);
+    }
+    if (!this->has_parameter("diagnostics.period")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(3600.0).set__step(0.0);
+        param_desc.name = "diagnostics.period";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Period (in seconds) of the per sonar diagnostics published on /diagnostics (0 to disable).";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<double>("diagnostics.period", 1.0, param_desc);
+    }
+
+    // standby_delay, config.* and connection.*, shared by all the live sonars.
+    const auto supervisorOptions = oculus::declare_supervisor_parameters(*this);
+
+    const size_t qosDepth   = this->get_parameter("qos_depth").as_int();
+    const size_t queueDepth = this->get_parameter("ping_queue.depth").as_int();
+    const auto   names      = this->get_parameter("sonars").as_string_array();
+    for(const auto& name : names) {
+        this->declare_sonar_parameters(name);
+    }
+
+    // Without address, a driver connects to the first sonar it hears of : with
+    // several live sonars, two drivers would attach to the same one.
+    std::vector<std::string> live;
+    std::string              anonymous;
+    std::set<std::string>    addresses;
+    for(const auto& name : names) {
+        if(!this->get_parameter(name + ".replay.file").as_string().empty())
+            continue;
+        live.push_back(name);
+        const std::string ip = this->get_parameter(name + ".ip").as_string();
+        if(ip.empty())
+            anonymous = name;
+        else if(!addresses.insert(ip).second)
+            throw std::runtime_error("Several live sonars with address " + ip + ".");
+    }
+    if(live.size() > 1 && !anonymous.empty()) {
+        throw std::runtime_error("Sonar '" + anonymous + "' has no address (empty ip) : "
+            "the address of each live sonar must be given when several sonars are live.");
+    }
+
+    this->io_pool_ = std::make_unique<oculus::IoServicePool>(this->get_parameter("io_threads").as_int());
+    for(const auto& name : names) {
+        this->add_sonar(name, qosDepth, queueDepth, supervisorOptions);
+    }
+    if(!live.empty()) {
+        // Registered once all the parameters are declared.
+        this->param_cb_ = this->add_on_set_parameters_callback(
+            std::bind(&OculusMultiSonarNode::set_config_callback, this, std::placeholders::_1));
+    }
+
+    const double diagnosticsPeriod = this->get_parameter("diagnostics.period").as_double();
+    if(diagnosticsPeriod > 0.0) {
+        this->diagnostics_publisher_ = this->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics", 10);
+        this->diagnostics_timer_ = this->create_wall_timer(std::chrono::duration<double>(diagnosticsPeriod),
+            std::bind(&OculusMultiSonarNode::publish_diagnostics, this));
+    }
+    this->dump_statistics_service_ = this->create_service<std_srvs::srv::Trigger>("~/dump_statistics",
+        std::bind(&OculusMultiSonarNode::dump_statistics, this, std::placeholders::_1, std::placeholders::_2));
+
+    // Sources are started once every sonar is set up.
+    this->publisher_thread_.start(std::bind(&OculusMultiSonarNode::publish_next, this),
+                                  std::bind(&OculusMultiSonarNode::is_idle, this));
+    for(auto& sonar : this->sonars_) {
+        if(sonar->driver)
+            sonar->driver->start();
+    }
+    this->io_pool_->start();
+    for(auto& sonar : this->sonars_) {
+        if(sonar->replayer)
+            sonar->replayer->start();
+    }
+    this->graph_watcher_.start(*this, std::bind(&OculusMultiSonarNode::update_outputs, this));
+
+    RCLCPP_INFO_STREAM(this->get_logger(), "Managing " << this->sonars_.size() << " sonars ("
+                       << live.size() << " live) with " << this->io_pool_->size() << " IO threads.");
+}
+
+OculusMultiSonarNode::~OculusMultiSonarNode()
+{
+    this->graph_watcher_.stop();
+    for(auto& sonar : this->sonars_) {
+        if(sonar->replayer)
+            sonar->replayer->stop();
+    }
+    this->io_pool_->stop();
+    this->publisher_thread_.stop();
+}
+
+void OculusMultiSonarNode::declare_sonar_parameters(const std::string& name)
+{
+    if (!this->has_parameter(name + ".frame_id")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = name + ".frame_id";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Frame of reference of the pings of this sonar.";
+        param_desc.read_only = true;
+        this->declare_parameter<std::string>(name + ".frame_id", name, param_desc);
+    }
+    if (!this->has_parameter(name + ".ip")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = name + ".ip";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "IPv4 address of this sonar (empty to use the first sonar heard of, only allowed with a single live sonar).";
+        param_desc.read_only = true;
+        this->declare_parameter<std::string>(name + ".ip", "", param_desc);
+    }
+    if (!this->has_parameter(name + ".replay.file")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = name + ".replay.file";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Path to a .oculus log file to replay for this sonar (empty to connect to the sonar).";
+        param_desc.read_only = true;
+        this->declare_parameter<std::string>(name + ".replay.file", "", param_desc);
+    }
+    if (!this->has_parameter(name + ".replay.rate")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = name + ".replay.rate";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Replay speed factor (1.0 for real time, 0.0 to replay as fast as possible).";
+        param_desc.read_only = true;
+        this->declare_parameter<double>(name + ".replay.rate", 1.0, param_desc);
+    }
+    if (!this->has_parameter(name + ".replay.loop")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = name + ".replay.loop";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Restart the replay from the beginning when reaching the end of the log.";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>(name + ".replay.loop", false, param_desc);
+    }
+}
+
+void OculusMultiSonarNode::add_sonar(const std::string& name, size_t qosDepth, size_t queueDepth,
+                                     const oculus::SupervisorOptions& supervisorOptions)
+{
+    auto sonar = std::make_unique<Sonar>();
+    sonar->name        = name;
+    sonar->frame_id    = this->get_parameter(name + ".frame_id").as_string();
+    sonar->pipeline    = std::make_unique<oculus::SonarPipeline>(queueDepth,
+        oculus::SonarPipeline::PingQueue::OverflowPolicy::DropOldest);
+    sonar->ping_publisher   = this->create_publisher<oculus_interfaces::msg::OculusStampedPing>(name + "/ping", qosDepth);
+    sonar->status_publisher = this->create_publisher<oculus_interfaces::msg::OculusStatus>(name + "/status", qosDepth);
+
+    Sonar* s = sonar.get();
+    sonar->ping_pool = oculus::MessagePool<oculus_interfaces::msg::OculusStampedPing>(1,
+        [s](oculus_interfaces::msg::OculusStampedPing& msg) { msg.ping.data.reserve(s->ping_size); });
+    const std::string replayFile = this->get_parameter(name + ".replay.file").as_string();
+    if(!replayFile.empty()) {
+        sonar->replayer = std::make_unique<oculus::LogReplayer>(replayFile,
+            this->get_parameter(name + ".replay.rate").as_double(),
+            this->get_parameter(name + ".replay.loop").as_bool());
+        sonar->replayer->add_status_callback([this, s](const OculusStatusMsg& status) {
+            this->on_status(*s, status);
+        });
+        sonar->replayer->add_ping_callback([this, s](const OculusSimplePingResult& metadata,
+                                                     const std::vector<uint8_t>& data) {
+            this->on_ping(*s, metadata, data);
+        });
+        RCLCPP_INFO_STREAM(this->get_logger(), name << " : replaying '" << replayFile << "'.");
+    }
+    else {
+        AddressedSonarDriver::Options driverOptions;
+        driverOptions.address = this->get_parameter(name + ".ip").as_string();
+        auto service  = this->io_pool_->next_io_service();
+        sonar->driver = std::make_shared<AddressedSonarDriver>(service, driverOptions);
+        sonar->supervisor = std::make_unique<Sonar::Supervisor>(*this, name, name + ".",
+            supervisorOptions, *sonar->pipeline, sonar->driver, service);
+        sonar->driver->add_status_callback([this, s](const OculusStatusMsg& status) {
+            this->on_status(*s, status);
+        });
+        sonar->driver->add_ping_callback([this, s](const OculusSimplePingResult& metadata,
+                                                   const std::vector<uint8_t>& data) {
+            this->on_ping(*s, metadata, data);
+        });
+        sonar->driver->add_dummy_callback([s]() { s->supervisor->on_dummy(); });
+        RCLCPP_INFO_STREAM(this->get_logger(), name << " : live, sonar "
+            << (driverOptions.address.empty() ? std::string("first heard of") : driverOptions.address) << ".");
+    }
+    this->sonars_.push_back(std::move(sonar));
+}
+
+AddressedSonarDriver::TimePoint OculusMultiSonarNode::Sonar::ping_stamp() const
+{
+    if(this->replayer)
+        return this->replayer->last_header_stamp();
+    return this->driver->last_header_stamp();
+}
+
+void OculusMultiSonarNode::on_status(Sonar& sonar, const OculusStatusMsg& status)
+{
+    if(sonar.supervisor)
+        sonar.supervisor->on_status();
+    if(sonar.pipeline->push_status(status))
+        this->publisher_thread_.wake();
+}
+
+void OculusMultiSonarNode::on_ping(Sonar& sonar, const OculusSimplePingResult& pingMetadata,
+                                   const std::vector<uint8_t>& pingData)
+{
+    if(sonar.supervisor)
+        sonar.supervisor->on_ping();
+    // Dropped if the queue is full (counted by the queue).
+    if(sonar.pipeline->push_ping(pingMetadata, pingData, sonar.ping_stamp()))
+        this->publisher_thread_.wake();
+}
+
+bool OculusMultiSonarNode::is_idle() const
+{
+    for(const auto& sonar : this->sonars_) {
+        if(!sonar->pipeline->empty())
+            return false;
+    }
+    return true;
+}
+
+bool OculusMultiSonarNode::publish_next()
+{
+    // Each pipeline has a single producer (the driver of its sonar, whose
+    // callbacks never run concurrently) and this thread as consumer. One
+    // message of each sonar per round so a fast sonar cannot starve the
+    // others.
+    bool published = false;
+    for(auto& sonar : this->sonars_) {
+        Sonar& s = *sonar;
+        published |= s.pipeline->pop_status([&s](const OculusStatusMsg& status) {
+            oculus::copy_to_ros(s.status_msg, status);
+            s.status_publisher->publish(s.status_msg);
+        });
+        published |= s.pipeline->pop_ping([this, &s](oculus::PingSlot& ping) {
+            this->publish_ping(s, ping);
+        });
+
+        if(uint64_t drops = s.pipeline->new_drops()) {
+            RCLCPP_WARN_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                s.name << " : ping queue overflow, " << drops << " pings dropped so far.");
+        }
+    }
+    return published;
+}
+
+void OculusMultiSonarNode::publish_ping(Sonar& sonar, oculus::PingSlot& ping)
+{
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    if(sonar.supervisor)
+        sonar.supervisor->check_feedback(ping.metadata);
+    if(sonar.subscribers == 0)
+        return;
+
+    auto& statistics = sonar.pipeline->statistics();
+    // The ping is the only output : the slot buffer goes to the message
+    // (loaned messages live in middleware memory, they are filled by copy).
+    const bool takeData = !sonar.ping_publisher->can_loan_messages();
+    sonar.ping_size = ping.data.size();
+    Clock::time_point converted;
+    oculus::publish_message(*this, sonar.ping_publisher, sonar.ping_msg,
+        [&](oculus_interfaces::msg::OculusStampedPing& msg) {
+            if(takeData)
+                oculus::move_to_ros(msg.ping, ping.metadata, ping.data);
+            else
+                oculus::copy_to_ros(msg.ping, ping.metadata, ping.data);
+            msg.header.stamp    = oculus::to_ros_stamp(ping.stamp);
+            msg.header.frame_id = sonar.frame_id;
+            converted = Clock::now();
+            return true;
+        }, &sonar.ping_pool);
+    auto published = Clock::now();
+    statistics.record(oculus::PingStatistics::Conversion, converted - start);
+    statistics.record(oculus::PingStatistics::Publish, published - converted);
+    statistics.record(oculus::PingStatistics::Total, decltype(ping.stamp)::clock::now() - ping.stamp);
+}
+
+rcl_interfaces::msg::SetParametersResult OculusMultiSonarNode::set_config_callback(
+    const std::vector<rclcpp::Parameter>& parameters)
+{
+    // Each supervisor only handles the parameters prefixed with its sonar
+    // name.
+    rcl_interfaces::msg::SetParametersResult result;
+    result.successful = true;
+    result.reason = "";
+    for(auto& sonar : this->sonars_) {
+        if(!sonar->supervisor)
+            continue;
+        auto sonarResult = sonar->supervisor->set_parameters(parameters);
+        if(!sonarResult.successful) {
+            result.successful = false;
+            result.reason    += sonar->name + " : " + sonarResult.reason;
+        }
+    }
+    return result;
+}
+
+void OculusMultiSonarNode::update_outputs()
+{
+    for(auto& sonar : this->sonars_) {
+        sonar->subscribers = sonar->ping_publisher->get_subscription_count();
+        if(sonar->supervisor)
+            sonar->supervisor->update_outputs(sonar->subscribers > 0);
+    }
+}
+
+void OculusMultiSonarNode::publish_diagnostics()
+{
+    using oculus::add_diagnostic;
+
+    diagnostic_msgs::msg::DiagnosticArray msg;
+    msg.header.stamp = this->now();
+    for(auto& sonar : this->sonars_) {
+        auto report = sonar->pipeline->statistics().window();
+
+        diagnostic_msgs::msg::DiagnosticStatus status;
+        status.name        = std::string(this->get_fully_qualified_name()) + ": " + sonar->name;
+        status.hardware_id = sonar->name;
+        status.level       = diagnostic_msgs::msg::DiagnosticStatus::OK;
+        status.message     = "OK";
+
+        oculus::add_pipeline_diagnostics(status, report, *sonar->pipeline);
+        add_diagnostic(status, "subscribers", sonar->subscribers.load());
+        bool problem = false;
+        bool standby = false;
+        if(sonar->supervisor) {
+            problem = sonar->supervisor->add_diagnostics(status);
+            standby = sonar->supervisor->standby();
+        }
+
+        // Connection and configuration problems come first (level and message
+        // set by the supervisor).
+        if(!problem && report.missing_pings > 0) {
+            status.level   = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+            status.message = std::to_string(report.missing_pings) + " pings missing";
+        }
+        else if(!problem && report.pings == 0 && !standby) {
+            status.level   = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+            status.message = "No ping";
+        }
+        msg.status.push_back(status);
+    }
+    this->diagnostics_publisher_->publish(msg);
+}
+
+void OculusMultiSonarNode::dump_statistics(const std_srvs::srv::Trigger::Request::SharedPtr,
+                                           std_srvs::srv::Trigger::Response::SharedPtr response)
+{
+    std::ostringstream oss;
+    for(const auto& sonar : this->sonars_) {
+        const auto& queue = sonar->pipeline->ping_queue();
+        oss << "--- " << sonar->name << " ---\n"
+            << sonar->pipeline->statistics().total().to_string()
+            << "queue : " << queue.size() << "/" << queue.depth()
+            << ", " << queue.dropped() << " dropped\n";
+    }
+    response->success = true;
+    response->message = oss.str();
+    RCLCPP_INFO_STREAM(this->get_logger(), "Ping statistics :\n" << response->message);
+}
+
+#include "rclcpp_components/register_node_macro.hpp"
+
+RCLCPP_COMPONENTS_REGISTER_NODE(OculusMultiSonarNode)
@@ -0,0 +1,95 @@
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+
+#include "conversions.h"
+#include "io_service_pool.h"
+#include "log_replayer.h"
+#include "sonar_pipeline.h"
+#include "sonar_node_common.hpp"
+#include "addressed_sonar_driver.h"
+
+#include "oculus_interfaces/msg/oculus_status.hpp"
+#include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "std_srvs/srv/trigger.hpp"
+
+#include "rcl_interfaces/msg/parameter_descriptor.hpp"
+
+// Manages several Oculus sonars in a single node : one driver (or log
+// replayer) per sonar, all drivers sharing an io_service thread pool, and a
+// single publishing thread. Topics and parameters of each sonar are prefixed
+// with its name (<name>/ping, <name>/status, <name>.frame_id...).
+//
+// Live sonars (empty <name>.replay.file) are told apart by their address
+// (<name>.ip, see oculus::AddressedSonarDriver), which may only be left empty
+// with a single live sonar. Each live sonar is configured by its own
+// <name>.frequency_mode, <name>.range... parameters and supervised as in
+// OculusSonarNode (oculus::SonarSupervisor, with the node wide standby_delay,
+// config.* and connection.* parameters).
+class OculusMultiSonarNode : public rclcpp::Node
+{
+  public:
+    explicit OculusMultiSonarNode(const rclcpp::NodeOptions& options = rclcpp::NodeOptions());
+    ~OculusMultiSonarNode();
+
+  private:
+    struct Sonar
+    {
+        std::string name;
+        std::string frame_id;
+
+        using Supervisor = oculus::SonarSupervisor<oculus::AddressedSonarDriver>;
+
+        std::shared_ptr<oculus::AddressedSonarDriver> driver;
+        std::unique_ptr<oculus::LogReplayer>          replayer;
+        std::unique_ptr<oculus::SonarPipeline>        pipeline;
+        std::unique_ptr<Supervisor>                   supervisor; // live sonars only
+
+        rclcpp::Publisher<oculus_interfaces::msg::OculusStampedPing>::SharedPtr ping_publisher{nullptr};
+        rclcpp::Publisher<oculus_interfaces::msg::OculusStatus>::SharedPtr status_publisher{nullptr};
+        oculus_interfaces::msg::OculusStampedPing ping_msg;
+        oculus_interfaces::msg::OculusStatus      status_msg;
+        // Intra-process messages, data reserved to ping_size (see
+        // oculus::publish_message).
+        oculus::MessagePool<oculus_interfaces::msg::OculusStampedPing> ping_pool;
+        size_t ping_size = 0;
+
+        std::atomic<size_t> subscribers{0};
+
+        oculus::AddressedSonarDriver::TimePoint ping_stamp() const;
+    };
+    std::vector<std::unique_ptr<Sonar>> sonars_;
+
+    std::unique_ptr<oculus::IoServicePool> io_pool_;
+    oculus::PublisherThread                publisher_thread_;
+    oculus::GraphWatcher                   graph_watcher_;
+    rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr param_cb_{nullptr};
+
+    rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_publisher_{nullptr};
+    rclcpp::TimerBase::SharedPtr diagnostics_timer_{nullptr};
+    rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr dump_statistics_service_{nullptr};
+
+    void declare_sonar_parameters(const std::string& name);
+    void add_sonar(const std::string& name, size_t qosDepth, size_t queueDepth,
+                   const oculus::SupervisorOptions& supervisorOptions);
+
+    void on_status(Sonar& sonar, const OculusStatusMsg& status);
+    void on_ping(Sonar& sonar, const OculusSimplePingResult& pingMetadata,
+                 const std::vector<uint8_t>& pingData);
+    bool publish_next();
+    bool is_idle() const;
+    void publish_ping(Sonar& sonar, oculus::PingSlot& ping);
+
+    rcl_interfaces::msg::SetParametersResult set_config_callback(const std::vector<rclcpp::Parameter>& parameters);
+
+    void update_outputs();
+
+    void publish_diagnostics();
+    void dump_statistics(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                         std_srvs::srv::Trigger::Response::SharedPtr response);
+};
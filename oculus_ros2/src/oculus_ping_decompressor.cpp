@@ -0,0 +1,41 @@
+#include "oculus_ping_decompressor.hpp"
+
+#include "rclcpp_components/register_node_macro.hpp"
+
+OculusPingDecompressor::OculusPingDecompressor(const rclcpp::NodeOptions& options) :
+    Node("oculus_ping_decompressor", options)
+{
+    if (!this->has_parameter("qos_depth")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(10000).set__step(1);
+        param_desc.name = "qos_depth";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "History depth of the compressed_ping subscription and of the ping publisher.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("qos_depth", 100, param_desc);
+    }
+
+    const size_t qosDepth = this->get_parameter("qos_depth").as_int();
+    this->ping_publisher_ = this->create_publisher<oculus_interfaces::msg::OculusStampedPing>("ping", qosDepth);
+    this->compressed_ping_subscription_ = this->create_subscription<oculus_interfaces::msg::OculusCompressedPing>(
+        "compressed_ping", qosDepth,
+        std::bind(&OculusPingDecompressor::on_compressed_ping, this, std::placeholders::_1));
+}
+
+void OculusPingDecompressor::on_compressed_ping(const oculus_interfaces::msg::OculusCompressedPing::SharedPtr msg)
+{
+    // msg->ping.data is empty, only the metadata is copied.
+    auto ping = std::make_unique<oculus_interfaces::msg::OculusStampedPing>();
+    ping->header = msg->header;
+    ping->ping   = msg->ping;
+    if(!this->codec_.decompress(msg->data.data(), msg->data.size(), ping->ping.data)) {
+        RCLCPP_WARN_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+            "Could not decompress ping " << msg->ping.ping_id << ".");
+        return;
+    }
+    this->ping_publisher_->publish(std::move(ping));
+}
+
+RCLCPP_COMPONENTS_REGISTER_NODE(OculusPingDecompressor)
@@ -0,0 +1,24 @@
+#include <memory>
+
+#include "rclcpp/rclcpp.hpp"
+
+#include "ping_codec.h"
+
+#include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+#include "oculus_interfaces/msg/oculus_compressed_ping.hpp"
+
+// Republishes the compressed_ping topic of an OculusSonarNode as standard
+// OculusStampedPing messages (for instance on the shore side of a tether).
+class OculusPingDecompressor : public rclcpp::Node
+{
+  public:
+    explicit OculusPingDecompressor(const rclcpp::NodeOptions& options = rclcpp::NodeOptions());
+
+  private:
+    oculus::PingCodec codec_;
+
+    rclcpp::Subscription<oculus_interfaces::msg::OculusCompressedPing>::SharedPtr compressed_ping_subscription_{nullptr};
+    rclcpp::Publisher<oculus_interfaces::msg::OculusStampedPing>::SharedPtr ping_publisher_{nullptr};
+
+    void on_compressed_ping(const oculus_interfaces::msg::OculusCompressedPing::SharedPtr msg);
+};
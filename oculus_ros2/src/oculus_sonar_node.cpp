@@ -6,145 +6,550 @@ using namespace std;
 
 using SonarDriver = oculus::SonarDriver;
 
-OculusSonarNode::OculusSonarNode() : Node("oculus_sonar")
+OculusSonarNode::OculusSonarNode(const rclcpp::NodeOptions& options) :
+    Node("oculus_sonar", options)
 {
     if (!this->has_parameter("frame_id")) {
         this->declare_parameter<string>("frame_id", "sonar");
     }
-    if (!this->has_parameter("frequency_mode")) {
+    // standby_delay, config.* and connection.* (the sonar configuration
+    // parameters, frequency_mode, range..., are declared by the supervisor).
+    const auto supervisorOptions = oculus::declare_supervisor_parameters(*this);
+    if (!this->has_parameter("fan_image.enable")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "fan_image.enable";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Publish a cartesian fan view of the pings (sensor_msgs/Image).";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>("fan_image.enable", false, param_desc);
+    }
+    if (!this->has_parameter("fan_image.width")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
         rcl_interfaces::msg::IntegerRange range;
-        range.set__from_value(1).set__to_value(2).set__step(1);
-        param_desc.name = "frequency_mode";
+        range.set__from_value(16).set__to_value(4096).set__step(1);
+        param_desc.name = "fan_image.width";
         param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
-        param_desc.description = "Sonar beam frequency mode.\n\t1: Low frequency (1.2MHz, wide aperture).\n\t2: High frequency (2.1Mhz, narrow aperture).";
+        param_desc.description = "Width of the fan image in pixels (height is deduced from the sonar aperture).";
         param_desc.integer_range = {range};
-        this->declare_parameter<int>("frequency_mode", 1, param_desc);
+        param_desc.read_only = true;
+        this->declare_parameter<int>("fan_image.width", 512, param_desc);
+    }
+    if (!this->has_parameter("beam_intensities.enable")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "beam_intensities.enable";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Publish gain compensated float intensities of the pings (oculus_interfaces/OculusBeamIntensities).";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>("beam_intensities.enable", false, param_desc);
+    }
+    if (!this->has_parameter("detection.enable")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "detection.enable";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Detect returns in each beam and publish them on the detections topic (sensor_msgs/PointCloud2).";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>("detection.enable", false, param_desc);
+    }
+    if (!this->has_parameter("detection.mode")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "detection.mode";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Returns detected in each beam.\n"
+            "\tfirst_return: first sample above detection.threshold.\n"
+            "\tpeak: strongest sample (if above detection.threshold).\n"
+            "\tboth: both of them (point field type : 0 first return, 1 peak).";
+        param_desc.read_only = true;
+        this->declare_parameter<string>("detection.mode", "first_return", param_desc);
+    }
+    if (!this->has_parameter("detection.threshold")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(1.0);
+        param_desc.name = "detection.threshold";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Detection threshold on the gain compensated intensities (in [0,1], as published on beam_intensities).";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<double>("detection.threshold", 0.2, param_desc);
+    }
+    if (!this->has_parameter("detection.min_range")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "detection.min_range";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Range (m) below which nothing is detected (near field ringing).";
+        param_desc.read_only = true;
+        this->declare_parameter<double>("detection.min_range", 0.5, param_desc);
+    }
+    if (!this->has_parameter("detection.refine")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "detection.refine";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Sub-sample range refinement (threshold crossing interpolation, parabolic peak fit).";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>("detection.refine", true, param_desc);
+    }
+    if (!this->has_parameter("detection.threads")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "detection.threads";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Threads sharing the beams of 512 beams pings (0 for the number of cores, up to 4).";
+        param_desc.read_only = true;
+        this->declare_parameter<int>("detection.threads", 0, param_desc);
     }
-    if (!this->has_parameter("ping_rate")) {
+    if (!this->has_parameter("temporal_filter.enable")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "temporal_filter.enable";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Also publish the pings filtered across consecutive pings on the filtered_ping topic.";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>("temporal_filter.enable", false, param_desc);
+    }
+    if (!this->has_parameter("temporal_filter.mode")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "temporal_filter.mode";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Temporal filter applied to each sample.\n"
+            "\tema: exponential moving average (weight temporal_filter.alpha for the newest ping).\n"
+            "\tmedian: median of the last temporal_filter.frames pings.\n"
+            "\tmin: minimum of the last temporal_filter.frames pings.";
+        param_desc.read_only = true;
+        this->declare_parameter<string>("temporal_filter.mode", "ema", param_desc);
+    }
+    if (!this->has_parameter("temporal_filter.frames")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
         rcl_interfaces::msg::IntegerRange range;
-        range.set__from_value(0).set__to_value(5).set__step(1);
-        param_desc.name = "ping_rate";
+        range.set__from_value(1).set__to_value(oculus::TemporalFilter::MaxFrames).set__step(1);
+        param_desc.name = "temporal_filter.frames";
         param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
-        param_desc.description = "Frequency of ping fires.\n\t0: 10Hz max ping rate.\n\t1: 15Hz max ping rate.\n\t2: 40Hz max ping rate.\n\t3: 5Hz max ping rate.\n\t4: 2Hz max ping rate.\n\t5: Standby mode (no ping fire).";
+        param_desc.description = "Number of pings kept by the median and min filters.";
         param_desc.integer_range = {range};
-        this->declare_parameter<int>("ping_rate", 0, param_desc);
+        param_desc.read_only = true;
+        this->declare_parameter<int>("temporal_filter.frames", 5, param_desc);
+    }
+    if (!this->has_parameter("temporal_filter.alpha")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(1.0);
+        param_desc.name = "temporal_filter.alpha";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Weight of the newest ping in the exponential moving average.";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<double>("temporal_filter.alpha", 0.3, param_desc);
+    }
+    if (!this->has_parameter("compression.enable")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "compression.enable";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Also publish the pings compressed on the compressed_ping topic (oculus_interfaces/OculusCompressedPing).";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>("compression.enable", false, param_desc);
     }
-    if (!this->has_parameter("data_depth")) {
+    if (!this->has_parameter("compression.level")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
         rcl_interfaces::msg::IntegerRange range;
-        range.set__from_value(0).set__to_value(1).set__step(1);
-        param_desc.name = "data_depth";
+        range.set__from_value(1).set__to_value(19).set__step(1);
+        param_desc.name = "compression.level";
         param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
-        param_desc.description = "Ping data encoding bit count.\n\t0: Ping data encoded on 8bits.\n\t1: Ping data encoded on 16bits.";
+        param_desc.description = "zstd compression level (higher is smaller but slower).";
         param_desc.integer_range = {range};
-        this->declare_parameter<int>("data_depth", 0, param_desc);
+        param_desc.read_only = true;
+        this->declare_parameter<int>("compression.level", 1, param_desc);
     }
-    if (!this->has_parameter("nbeams")) {
+    if (!this->has_parameter("compression.quantization_bits")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
         rcl_interfaces::msg::IntegerRange range;
-        range.set__from_value(0).set__to_value(1).set__step(1);
-        param_desc.name = "nbeams";
+        range.set__from_value(0).set__to_value(16).set__step(1);
+        param_desc.name = "compression.quantization_bits";
         param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
-        param_desc.description = "Number of ping beams.\n\t0: Oculus outputs 256 beams.\n\t1: Oculus outputs 512 beams.";
+        param_desc.description = "Most significant bits kept for each sample (lossy compression, 0 for lossless).";
         param_desc.integer_range = {range};
-        this->declare_parameter<int>("nbeams", 0, param_desc);
+        param_desc.read_only = true;
+        this->declare_parameter<int>("compression.quantization_bits", 0, param_desc);
+    }
+    if (!this->has_parameter("replay.file")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "replay.file";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Path to a .oculus log file to replay instead of connecting to a sonar (empty to use the sonar).";
+        param_desc.read_only = true;
+        this->declare_parameter<string>("replay.file", "", param_desc);
+    }
+    if (!this->has_parameter("replay.rate")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(100.0).set__step(0.0);
+        param_desc.name = "replay.rate";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Replay speed factor (1.0: real time, 0.0: as fast as possible).";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<double>("replay.rate", 1.0, param_desc);
     }
-    if (!this->has_parameter("send_gain")) {
+    if (!this->has_parameter("replay.loop")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
-        param_desc.name = "send_gain";
+        param_desc.name = "replay.loop";
         param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
-        param_desc.description = "Send range gain with data.";
-        this->declare_parameter<bool>("send_gain", false);
+        param_desc.description = "Restart the replay at the beginning of the log when reaching its end.";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>("replay.loop", false, param_desc);
     }
-    if (!this->has_parameter("gain_assist")) {
+    if (!this->has_parameter("recorder.enable")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
-        param_desc.name = "gain_assist";
+        param_desc.name = "recorder.enable";
         param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
-        param_desc.description = "Enable auto gain.";
-        this->declare_parameter<bool>("gain_assist", false, param_desc);
+        param_desc.description = "Record the pings into .oculus log files.";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>("recorder.enable", false, param_desc);
     }
-    if (!this->has_parameter("range")) {
+    if (!this->has_parameter("recorder.directory")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
-        rcl_interfaces::msg::FloatingPointRange range;
-        range.set__from_value(0.3).set__to_value(40.0).set__step(0.1);
-        param_desc.name = "nbeams";
-        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
-        param_desc.description = "Sonar range (in meters), min=0.3, max=40.0.";
-        param_desc.floating_point_range = {range};
-        this->declare_parameter<double>("range", 3.0, param_desc);
+        param_desc.name = "recorder.directory";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Directory where the .oculus log files are written.";
+        param_desc.read_only = true;
+        this->declare_parameter<string>("recorder.directory", ".", param_desc);
+    }
+    if (!this->has_parameter("recorder.prefix")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "recorder.prefix";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Prefix of the .oculus log file names (followed by the UTC date).";
+        param_desc.read_only = true;
+        this->declare_parameter<string>("recorder.prefix", "oculus", param_desc);
     }
-    if (!this->has_parameter("gamma_correction")) {
+    if (!this->has_parameter("recorder.buffer_size")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
         rcl_interfaces::msg::IntegerRange range;
-        range.set__from_value(0).set__to_value(255).set__step(1);
-        param_desc.name = "gamma_correction";
+        range.set__from_value(1).set__to_value(4096).set__step(1);
+        param_desc.name = "recorder.buffer_size";
         param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
-        param_desc.description = "Gamma correction, min=0, max=255.";
+        param_desc.description = "Size of the recorder ring buffer (in MB). Pings are dropped when it is full.";
         param_desc.integer_range = {range};
-        this->declare_parameter<int>("gamma_correction", 127, param_desc);
+        param_desc.read_only = true;
+        this->declare_parameter<int>("recorder.buffer_size", 64, param_desc);
     }
-    if (!this->has_parameter("gain_percent")) {
+    if (!this->has_parameter("recorder.max_file_size")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
-        rcl_interfaces::msg::FloatingPointRange range;
-        range.set__from_value(0.1).set__to_value(100.0).set__step(0.1);
-        param_desc.name = "gain_percent";
-        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
-        param_desc.description = "Gain percentage (%), min=0.1, max=100.0.";
-        param_desc.floating_point_range = {range};
-        this->declare_parameter<double>("gain_percent", 50.0, param_desc);
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(0).set__to_value(1048576).set__step(1);
+        param_desc.name = "recorder.max_file_size";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Size (in MB) after which a new log file is started (0 for no limit).";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("recorder.max_file_size", 1024, param_desc);
     }
-    if (!this->has_parameter("sound_speed")) {
+    if (!this->has_parameter("recorder.max_file_duration")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
         rcl_interfaces::msg::FloatingPointRange range;
-        range.set__from_value(0.0).set__to_value(1600.0).set__step(0.1); // min = 1400.0 but must include 0.0 for configuration
-        param_desc.name = "sound_speed";
+        range.set__from_value(0.0).set__to_value(86400.0).set__step(0.0);
+        param_desc.name = "recorder.max_file_duration";
         param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
-        param_desc.description = "Sound speed (in m/s, set to 0 for it to be calculated using salinity), min=1400.0, max=1600.0.";
+        param_desc.description = "Duration (in seconds) after which a new log file is started (0 for no limit).";
         param_desc.floating_point_range = {range};
-        this->declare_parameter<double>("sound_speed", 0.0, param_desc);
+        param_desc.read_only = true;
+        this->declare_parameter<double>("recorder.max_file_duration", 0.0, param_desc);
     }
-    if (!this->has_parameter("use_salinity")) {
+    if (!this->has_parameter("shm.enable")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
-        param_desc.name = "use_salinity";
+        param_desc.name = "shm.enable";
         param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
-        param_desc.description = "Use salinity to calculate sound_speed.";
-        this->declare_parameter<bool>("use_salinity", true, param_desc);
+        param_desc.description = "Also publish the pings in a POSIX shared memory ring for non-ROS processes (see include/oculus_ros2/shm_ping_ring.h).";
+        param_desc.read_only = true;
+        this->declare_parameter<bool>("shm.enable", false, param_desc);
     }
-    if (!this->has_parameter("salinity")) {
+    if (!this->has_parameter("shm.name")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "shm.name";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Name of the shared memory ping ring (shm_open name, starting with '/'). Empty for /<node namespace and name>_pings (/oculus_sonar_pings for /oculus_sonar).";
+        param_desc.read_only = true;
+        this->declare_parameter<string>("shm.name", "", param_desc);
+    }
+    if (!this->has_parameter("shm.slots")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(2).set__to_value(256).set__step(1);
+        param_desc.name = "shm.slots";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Number of pings kept in the shared memory ring.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("shm.slots", 8, param_desc);
+    }
+    if (!this->has_parameter("shm.slot_size")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(64).set__step(1);
+        param_desc.name = "shm.slot_size";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Size (in MB) of a ping in the shared memory ring, larger pings are dropped.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("shm.slot_size", 4, param_desc);
+    }
+    if (!this->has_parameter("qos_depth")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(1000).set__step(1);
+        param_desc.name = "qos_depth";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "History depth of the ping and status publishers.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("qos_depth", 100, param_desc);
+    }
+    if (!this->has_parameter("ping_queue.depth")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(256).set__step(1);
+        param_desc.name = "ping_queue.depth";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Number of pings which can wait between the driver and the publishing thread.";
+        param_desc.integer_range = {range};
+        param_desc.read_only = true;
+        this->declare_parameter<int>("ping_queue.depth", 8, param_desc);
+    }
+    if (!this->has_parameter("ping_queue.overflow_policy")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = "ping_queue.overflow_policy";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_STRING;
+        param_desc.description = "Ping dropped when the ping queue is full.\n\tdrop_oldest: oldest queued ping.\n\tdrop_newest: incoming ping.";
+        param_desc.read_only = true;
+        this->declare_parameter<string>("ping_queue.overflow_policy", "drop_oldest", param_desc);
+    }
+    if (!this->has_parameter("diagnostics.period")) {
         rcl_interfaces::msg::ParameterDescriptor param_desc;
         rcl_interfaces::msg::FloatingPointRange range;
-        range.set__from_value(0.0).set__to_value(100.0).set__step(0.1);
-        param_desc.name = "salinity";
+        range.set__from_value(0.0).set__to_value(3600.0).set__step(0.0);
+        param_desc.name = "diagnostics.period";
         param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
-        param_desc.description = "Salinity (in parts per thousand (ppt,ppm,g/kg), used to calculate sound speed if needed), min=0.0, max=100";
+        param_desc.description = "Period (in seconds) of the latency and throughput diagnostics published on /diagnostics (0 to disable).";
         param_desc.floating_point_range = {range};
-        this->declare_parameter<double>("salinity", 0.0, param_desc);
+        param_desc.read_only = true;
+        this->declare_parameter<double>("diagnostics.period", 1.0, param_desc);
     }
     this->get_parameter("ping_topic", ping_topic_);
     this->get_parameter("status_topic", status_topic_);
 
-    this->param_cb_ = this->add_on_set_parameters_callback(std::bind(&OculusSonarNode::set_config_callback, this, std::placeholders::_1));
-    
-    this->ping_publisher_ = this->create_publisher<oculus_interfaces::msg::OculusStampedPing>(ping_topic_, 100);
-    this->status_publisher_ = this->create_publisher<oculus_interfaces::msg::OculusStatus>(status_topic_, 100);
+    const size_t qosDepth = this->get_parameter("qos_depth").as_int();
+    this->ping_publisher_ = this->create_publisher<oculus_interfaces::msg::OculusStampedPing>(ping_topic_, qosDepth);
+    this->ping_pool_ = oculus::MessagePool<oculus_interfaces::msg::OculusStampedPing>(1,
+        [this](oculus_interfaces::msg::OculusStampedPing& msg) { msg.ping.data.reserve(this->ping_size_); });
+    this->status_publisher_ = this->create_publisher<oculus_interfaces::msg::OculusStatus>(status_topic_, qosDepth);
 
-    this->sonar_driver_ = std::make_shared<SonarDriver>(this->io_service_.io_service());
-    this->io_service_.start();
-    if(!this->sonar_driver_->wait_next_message()) {
-        std::cerr << "Timeout reached while waiting for a connection to the Oculus sonar. "
-                  << "Is it properly connected ?" << std::endl;
+    this->fan_image_enabled_ = this->get_parameter("fan_image.enable").as_bool();
+    if(this->fan_image_enabled_) {
+        this->scan_converter_.set_width(this->get_parameter("fan_image.width").as_int());
+        this->fan_image_publisher_ = this->create_publisher<sensor_msgs::msg::Image>(fan_image_topic_, 10);
+    }
+
+    if(this->get_parameter("beam_intensities.enable").as_bool()) {
+        this->beam_intensities_publisher_ = this->create_publisher<oculus_interfaces::msg::OculusBeamIntensities>(
+            beam_intensities_topic_, 10);
+    }
+
+    if(this->get_parameter("temporal_filter.enable").as_bool()) {
+        oculus::TemporalFilter::Options options;
+        const std::string mode = this->get_parameter("temporal_filter.mode").as_string();
+        if(mode == "median") {
+            options.mode = oculus::TemporalFilter::Median;
+        }
+        else if(mode == "min") {
+            options.mode = oculus::TemporalFilter::Min;
+        }
+        else if(mode != "ema") {
+            RCLCPP_WARN_STREAM(this->get_logger(), "Unknown temporal_filter.mode '" << mode
+                               << "', using ema.");
+        }
+        options.frames = this->get_parameter("temporal_filter.frames").as_int();
+        options.alpha  = this->get_parameter("temporal_filter.alpha").as_double();
+        this->temporal_filter_ = std::make_unique<oculus::TemporalFilter>(options);
+        this->filtered_ping_publisher_ = this->create_publisher<oculus_interfaces::msg::OculusStampedPing>(
+            filtered_ping_topic_, qosDepth);
+    }
+
+    if(this->get_parameter("detection.enable").as_bool()) {
+        oculus::BeamDetector::Options options;
+        const std::string mode = this->get_parameter("detection.mode").as_string();
+        if(mode == "peak") {
+            options.mode = oculus::BeamDetector::Peak;
+        }
+        else if(mode == "both") {
+            options.mode = oculus::BeamDetector::Both;
+        }
+        else if(mode != "first_return") {
+            RCLCPP_WARN_STREAM(this->get_logger(), "Unknown detection.mode '" << mode
+                               << "', using first_return.");
+        }
+        options.threshold = this->get_parameter("detection.threshold").as_double();
+        options.min_range = this->get_parameter("detection.min_range").as_double();
+        options.refine    = this->get_parameter("detection.refine").as_bool();
+        options.threads   = std::max<int64_t>(0, this->get_parameter("detection.threads").as_int());
+        this->beam_detector_ = std::make_unique<oculus::BeamDetector>(options);
+        this->detections_publisher_ = this->create_publisher<sensor_msgs::msg::PointCloud2>(
+            detections_topic_, 10);
+    }
+
+    if(this->get_parameter("compression.enable").as_bool()) {
+        oculus::PingCodec::Options options;
+        options.level             = this->get_parameter("compression.level").as_int();
+        options.quantization_bits = this->get_parameter("compression.quantization_bits").as_int();
+        this->ping_codec_ = std::make_unique<oculus::PingCodec>(options);
+        this->compressed_ping_publisher_ = this->create_publisher<oculus_interfaces::msg::OculusCompressedPing>(
+            compressed_ping_topic_, qosDepth);
     }
-    this->sonar_driver_->add_status_callback(std::bind(&OculusSonarNode::publish_status, this, std::placeholders::_1));
-    this->sonar_driver_->add_ping_callback(std::bind(&OculusSonarNode::publish_ping, this, std::placeholders::_1, std::placeholders::_2));
+
+    if(this->get_parameter("recorder.enable").as_bool()) {
+        oculus::LogWriter::Options options;
+        options.directory         = this->get_parameter("recorder.directory").as_string();
+        options.prefix            = this->get_parameter("recorder.prefix").as_string();
+        options.buffer_size       = this->get_parameter("recorder.buffer_size").as_int()*1024*1024;
+        options.max_file_size     = this->get_parameter("recorder.max_file_size").as_int()*1024*1024;
+        options.max_file_duration = this->get_parameter("recorder.max_file_duration").as_double();
+        this->recorder_ = std::make_unique<oculus::LogWriter>(options);
+        this->recorder_timer_ = this->create_wall_timer(std::chrono::seconds(10),
+            std::bind(&OculusSonarNode::report_recorder_statistics, this));
+        RCLCPP_INFO_STREAM(this->get_logger(), "Recording pings in '" << options.directory << "'.");
+    }
+
+    if(this->get_parameter("shm.enable").as_bool()) {
+        oculus::ShmPingWriter::Options options;
+        options.name           = this->get_parameter("shm.name").as_string();
+        if(options.name.empty()) {
+            // One ring per node : /ns/oculus_sonar gives /ns_oculus_sonar_pings.
+            std::string name = this->get_fully_qualified_name();
+            std::replace(name.begin() + 1, name.end(), '/', '_');
+            options.name = name + "_pings";
+        }
+        options.slots          = this->get_parameter("shm.slots").as_int();
+        options.slot_data_size = this->get_parameter("shm.slot_size").as_int()*1024*1024;
+        try {
+            this->shm_writer_ = std::make_unique<oculus::ShmPingWriter>(options);
+            RCLCPP_INFO_STREAM(this->get_logger(), "Publishing pings in shared memory '" << options.name << "'.");
+        }
+        catch(const std::exception& e) {
+            RCLCPP_ERROR_STREAM(this->get_logger(), e.what());
+        }
+    }
+
+    const double diagnosticsPeriod = this->get_parameter("diagnostics.period").as_double();
+    if(diagnosticsPeriod > 0.0) {
+        this->diagnostics_publisher_ = this->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics", 10);
+        this->diagnostics_timer_ = this->create_wall_timer(std::chrono::duration<double>(diagnosticsPeriod),
+            std::bind(&OculusSonarNode::publish_diagnostics, this));
+    }
+    this->dump_statistics_service_ = this->create_service<std_srvs::srv::Trigger>("~/dump_statistics",
+        std::bind(&OculusSonarNode::dump_statistics, this, std::placeholders::_1, std::placeholders::_2));
+
+    const std::string overflowPolicy = this->get_parameter("ping_queue.overflow_policy").as_string();
+    if(overflowPolicy != "drop_oldest" && overflowPolicy != "drop_newest") {
+        RCLCPP_WARN_STREAM(this->get_logger(), "Unknown ping_queue.overflow_policy '" << overflowPolicy
+                           << "', using drop_oldest.");
+    }
+    using PingQueue = oculus::SonarPipeline::PingQueue;
+    this->pipeline_ = std::make_unique<oculus::SonarPipeline>(this->get_parameter("ping_queue.depth").as_int(),
+        overflowPolicy == "drop_newest" ? PingQueue::OverflowPolicy::DropNewest
+                                        : PingQueue::OverflowPolicy::DropOldest);
+
+    const std::string replayFile = this->get_parameter("replay.file").as_string();
+    if(!replayFile.empty()) {
+        this->replayer_ = std::make_unique<oculus::LogReplayer>(replayFile,
+            this->get_parameter("replay.rate").as_double(),
+            this->get_parameter("replay.loop").as_bool());
+        this->replayer_->add_status_callback(std::bind(&OculusSonarNode::on_status, this, std::placeholders::_1));
+        this->replayer_->add_ping_callback(std::bind(&OculusSonarNode::on_ping, this, std::placeholders::_1, std::placeholders::_2));
+        RCLCPP_INFO_STREAM(this->get_logger(), "Replaying " << this->replayer_->reader().item_count()
+                           << " messages from '" << replayFile << "'.");
+        // No sonar to configure, the configuration parameters are only kept
+        // up to date.
+        this->supervisor_ = std::make_unique<Supervisor>(*this, "", "", supervisorOptions,
+                                                         *this->pipeline_, nullptr, nullptr);
+        this->param_cb_ = this->add_on_set_parameters_callback(std::bind(&OculusSonarNode::set_config_callback, this, std::placeholders::_1));
+        this->start_publisher();
+        this->graph_watcher_.start(*this, std::bind(&OculusSonarNode::update_outputs, this));
+        this->replayer_->start();
+        return;
+    }
+
+    // The callbacks are registered before the io thread starts so that no
+    // message is missed. The constructor does not wait for the sonar : the
+    // supervisor applies the configuration once it is heard of.
+    this->sonar_driver_ = std::make_shared<SonarDriver>(this->io_service_.io_service());
+    this->supervisor_ = std::make_unique<Supervisor>(*this, "", "", supervisorOptions,
+                                                     *this->pipeline_, this->sonar_driver_,
+                                                     this->io_service_.io_service());
+    this->param_cb_ = this->add_on_set_parameters_callback(std::bind(&OculusSonarNode::set_config_callback, this, std::placeholders::_1));
+    this->sonar_driver_->add_status_callback(std::bind(&OculusSonarNode::on_status, this, std::placeholders::_1));
+    this->sonar_driver_->add_ping_callback(std::bind(&OculusSonarNode::on_ping, this, std::placeholders::_1, std::placeholders::_2));
     // callback on dummy messages to reactivate the pings as needed
-    this->sonar_driver_->add_dummy_callback(std::bind(&OculusSonarNode::handle_dummy, this));
+    this->sonar_driver_->add_dummy_callback([this]() { this->supervisor_->on_dummy(); });
+    this->start_publisher();
+    this->io_service_.start();
+    this->graph_watcher_.start(*this, std::bind(&OculusSonarNode::update_outputs, this));
 }
 
 OculusSonarNode::~OculusSonarNode()
 {
+    this->graph_watcher_.stop();
+    if(this->replayer_)
+        this->replayer_->stop();
     this->io_service_.stop();
+    this->publisher_thread_.stop();
+    if(this->recorder_) {
+        this->recorder_->stop();
+        this->report_recorder_statistics();
+    }
+}
+
+void OculusSonarNode::on_status(const OculusStatusMsg& status)
+{
+    this->supervisor_->on_status();
+    if(this->pipeline_->push_status(status))
+        this->publisher_thread_.wake();
+}
+
+void OculusSonarNode::on_ping(const OculusSimplePingResult& pingMetadata,
+                              const std::vector<uint8_t>& pingData)
+{
+    this->supervisor_->on_ping();
+
+    if(this->recorder_) {
+        // The recorder only copies the ping in its ring buffer and never
+        // blocks.
+        auto stamp = this->ping_stamp().time_since_epoch();
+        this->recorder_->push(pingData.data(), pingData.size(),
+                              std::chrono::duration<double>(stamp).count());
+    }
+
+    // Dropped if the queue is full (counted by the queue).
+    if(this->pipeline_->push_ping(pingMetadata, pingData, this->ping_stamp()))
+        this->publisher_thread_.wake();
+}
+
+void OculusSonarNode::start_publisher()
+{
+    this->publisher_thread_.start(std::bind(&OculusSonarNode::publish_next, this),
+                                  [this]() { return this->pipeline_->empty(); });
+}
+
+bool OculusSonarNode::publish_next()
+{
+    bool published = this->pipeline_->pop_status([this](const OculusStatusMsg& status) {
+        this->publish_status(status);
+    });
+    published |= this->pipeline_->pop_ping([this](PingSlot& ping) {
+        this->publish_ping(ping);
+    });
+
+    if(uint64_t drops = this->pipeline_->new_drops()) {
+        const auto& queue = this->pipeline_->ping_queue();
+        RCLCPP_WARN_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+            "Ping queue overflow : " << drops << " pings dropped so far (queue "
+            << queue.size() << "/" << queue.depth() << ").");
+    }
+    return published;
 }
 
 void OculusSonarNode::publish_status(const OculusStatusMsg& status)
@@ -156,215 +561,315 @@ void OculusSonarNode::publish_status(const OculusStatusMsg& status)
     this->status_publisher_->publish(msg);
 }
 
-inline rclcpp::Time to_ros_stamp(const SonarDriver::TimePoint& stamp)
+SonarDriver::TimePoint OculusSonarNode::ping_stamp() const
 {
-    size_t nano = std::chrono::duration_cast<std::chrono::nanoseconds>(
-        stamp.time_since_epoch()).count();
-    size_t seconds = nano / 1000000000;
-    return rclcpp::Time(seconds, nano - 1000000000*seconds);
+    if(this->replayer_)
+        return this->replayer_->last_header_stamp();
+    return this->sonar_driver_->last_header_stamp();
 }
 
-void OculusSonarNode::publish_ping(const OculusSimplePingResult& pingMetadata,
-                  const std::vector<uint8_t>& pingData)
+void OculusSonarNode::fill_ping_message(oculus_interfaces::msg::OculusStampedPing& msg,
+                                        PingSlot& ping, bool takeData)
 {
-    static oculus_interfaces::msg::OculusStampedPing msg;
-     
-    
-    if(this->count_subscribers(this->ping_topic_) == 0) {
-        cout << "Going to standby mode" << endl;
-        this->sonar_driver_->standby();
-        //return;
-    }
-    
-    oculus::copy_to_ros(msg.ping, pingMetadata);
-    msg.ping.data.resize(pingData.size());
-    for(int i = 0; i < msg.ping.data.size(); i++)
-        msg.ping.data[i] = pingData[i];
-
-    msg.header.stamp    = to_ros_stamp(this->sonar_driver_->last_header_stamp());
+    if(takeData)
+        oculus::move_to_ros(msg.ping, ping.metadata, ping.data);
+    else
+        oculus::copy_to_ros(msg.ping, ping.metadata, ping.data);
+    msg.header.stamp    = oculus::to_ros_stamp(ping.stamp);
     msg.header.frame_id = "oculus_sonar";
-    this->ping_publisher_->publish(msg);
 }
 
-void OculusSonarNode::handle_dummy()
+void OculusSonarNode::publish_ping(PingSlot& ping)
 {
-    if(this->count_subscribers(this->ping_topic_) > 0) {
-        cout << "Exiting standby mode" << endl;
-        this->sonar_driver_->resume();
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    auto& statistics = this->pipeline_->statistics();
+    this->supervisor_->check_feedback(ping.metadata);
+
+    // Each output is only computed if someone listens to it (subscriber
+    // counts are kept up to date by the graph watcher thread, they are read
+    // once so that the outputs reading ping.data are known before it is
+    // handed over to the ping message).
+    const bool compressedWanted  = this->ping_codec_ && this->compressed_ping_subscribers_ > 0;
+    const bool fanImageWanted    = this->fan_image_enabled_ && this->fan_image_subscribers_ > 0;
+    const bool intensitiesWanted = this->beam_intensities_subscribers_ > 0;
+    const bool filteredWanted    = this->temporal_filter_ && this->filtered_ping_subscribers_ > 0;
+    const bool detectionsWanted  = this->beam_detector_ && this->detections_subscribers_ > 0;
+    if(this->shm_readers_) {
+        // First, this is the lowest latency output.
+        if(!this->shm_writer_->push(ping.metadata, ping.data,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(ping.stamp.time_since_epoch()).count())) {
+            RCLCPP_WARN_STREAM_THROTTLE(this->get_logger(), *this->get_clock(), 10000,
+                "Ping of " << ping.data.size() << " bytes too large for the shared memory ring (shm.slot_size).");
+        }
+    }
+    if(this->ping_subscribers_ > 0) {
+        // The ping data was already copied once, into the slot : the slot
+        // buffer goes to the message unless another output still reads it
+        // (loaned messages live in middleware memory, they are filled by copy).
+        const bool dataNeeded = compressedWanted || fanImageWanted || intensitiesWanted
+                             || filteredWanted || detectionsWanted;
+        const bool takeData = !dataNeeded && !this->ping_publisher_->can_loan_messages();
+        this->ping_size_ = ping.data.size();
+        Clock::time_point converted;
+        oculus::publish_message(*this, this->ping_publisher_, this->ping_msg_,
+            [&](oculus_interfaces::msg::OculusStampedPing& msg) {
+                this->fill_ping_message(msg, ping, takeData);
+                converted = Clock::now();
+                return true;
+            }, &this->ping_pool_);
+        auto published = Clock::now();
+        statistics.record(oculus::PingStatistics::Conversion, converted - start);
+        statistics.record(oculus::PingStatistics::Publish, published - converted);
+    }
+
+    const builtin_interfaces::msg::Time stamp = oculus::to_ros_stamp(ping.stamp);
+    if(compressedWanted) {
+        this->publish_compressed_ping(ping, stamp);
+    }
+    if(fanImageWanted) {
+        this->publish_fan_image(ping, stamp);
+    }
+    if(intensitiesWanted) {
+        this->publish_beam_intensities(ping, stamp);
+    }
+    if(this->temporal_filter_) {
+        if(filteredWanted) {
+            this->publish_filtered_ping(ping, stamp);
+        }
+        else {
+            // Pings are skipped while nobody listens, the history is stale.
+            this->temporal_filter_->invalidate();
+        }
     }
+    if(detectionsWanted) {
+        auto detectionStart = Clock::now();
+        this->publish_detections(ping, stamp);
+        statistics.record(oculus::PingStatistics::Detection, Clock::now() - detectionStart);
+    }
+    statistics.record(oculus::PingStatistics::Total, decltype(ping.stamp)::clock::now() - ping.stamp);
 }
 
-rcl_interfaces::msg::SetParametersResult OculusSonarNode::set_config_callback(const std::vector<rclcpp::Parameter> &parameters)
+void OculusSonarNode::publish_compressed_ping(const PingSlot& ping,
+                                              const builtin_interfaces::msg::Time& stamp)
 {
-    SonarDriver::PingConfig currentConfig;
-    std::memset(&currentConfig, 0, sizeof(currentConfig));
-    // flags
-    currentConfig.flags = 0x09; // always in meters, simple ping
+    oculus::publish_message(*this, this->compressed_ping_publisher_, this->compressed_ping_msg_,
+        [&](oculus_interfaces::msg::OculusCompressedPing& msg) {
+            if(!this->ping_codec_->compress(ping.metadata, ping.data, msg.data))
+                return false;
+            oculus::copy_to_ros(msg.ping, ping.metadata);
+            msg.header.stamp      = stamp;
+            msg.header.frame_id   = "oculus_sonar";
+            msg.raw_size          = ping.data.size();
+            msg.quantization_bits = this->ping_codec_->options().quantization_bits;
+            this->compressed_bytes_ += msg.data.size();
+            this->uncompressed_bytes_ += ping.data.size();
+            return true;
+        });
+}
 
-    bool use_salinity;
-    for (const rclcpp::Parameter & param : parameters) {
-        // try {
-        if (param.get_name() == "frequency_mode") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating frequency_mode to " << param.as_int() << " (1: 1.2MHz, 2: 2.1MHz).");
-            currentConfig.masterMode = param.as_int();
-        } 
-        else if (param.get_name() == "ping_rate") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating ping_rate to " << param.as_int() << " (0: 10Hz, 1: 15Hz, 2: 40Hz, 3: 5Hz, 4: 2Hz, 5: Standby mode).");
-            switch(param.as_int())
-            {
-                case 0: currentConfig.pingRate = pingRateNormal;  break; // 10Hz
-                case 1: currentConfig.pingRate = pingRateHigh;    break; // 15Hz
-                case 2: currentConfig.pingRate = pingRateHighest; break; // 40Hz
-                case 3: currentConfig.pingRate = pingRateLow;     break; // 5Hz
-                case 4: currentConfig.pingRate = pingRateLowest;  break; // 2Hz
-                case 5: currentConfig.pingRate = pingRateStandby; break; // standby mode
-                default:break;
-            }
-        } 
-        else if (param.get_name() == "data_depth") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating data_depth to " << param.as_int() << " (0: 8 bits, 1: 16 bits).");
-            switch(param.as_int())
-            {
-                case 0: // 8 bits
-                    break;
-                case 1: // 16 bits
-                    currentConfig.flags |= 0x02;
-                    break;
-                default:break;
-            }
-        } 
-        else if (param.get_name() == "nbeams") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating nbeams to " << param.as_int() << " (0: 256 beams, 1: 512 beams).");
-            switch(param.as_int())
-            {
-                case 0: // 256 beams
-                    break;
-                case 1: // 512 beams
-                    currentConfig.flags |= 0x40;
-                    break;
-                default:break;
-            }
-        } 
-        else if (param.get_name() == "send_gain") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating send_gain to " << param.as_bool());
-            if(param.as_bool())
-                currentConfig.flags |= 0x04;
-
-        } 
-        else if (param.get_name() == "gain_assist") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating gain_assist to " << param.as_bool());
-            if(param.as_bool())
-                currentConfig.flags |= 0x10;
-
-        } 
-        else if (param.get_name() == "range") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating range to " << param.as_double() <<"m.");
-            currentConfig.range = param.as_double();
-
-        } 
-        else if (param.get_name() == "gamma_correction") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating gamma_correction to " << param.as_int());
-            currentConfig.gammaCorrection = param.as_int();
-
-        } 
-        else if (param.get_name() == "gain_percent") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating gain_percent to " << param.as_double() << "%.");
-            currentConfig.gainPercent = param.as_double();
-
-        } 
-        else if (param.get_name() == "use_salinity") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating use_salinity to " << param.as_bool());
-            use_salinity = param.as_bool();
-            if(use_salinity)
-                currentConfig.speedOfSound = 0.0;
-
-        } 
-        else if (param.get_name() == "sound_speed") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating sound_speed to " << param.as_double() << "m/s.");
-            if(!use_salinity)
-            {
-                if(param.as_double() >= 1400.0 && param.as_double() <= 1600.0)
-                    currentConfig.speedOfSound = param.as_double();
-                else
-                    RCLCPP_INFO_STREAM(this->get_logger(), "Speed of sound must be between 1400.0 and 1600.0.");
+void OculusSonarNode::publish_filtered_ping(const PingSlot& ping,
+                                            const builtin_interfaces::msg::Time& stamp)
+{
+    oculus::publish_message(*this, this->filtered_ping_publisher_, this->filtered_ping_msg_,
+        [&](oculus_interfaces::msg::OculusStampedPing& msg) {
+            // Filtered in place in the message data.
+            if(!this->temporal_filter_->filter(ping.metadata, ping.data, msg.ping.data))
+                return false;
+            oculus::copy_to_ros(msg.ping, ping.metadata);
+            msg.header.stamp    = stamp;
+            msg.header.frame_id = "oculus_sonar";
+            return true;
+        });
+}
+
+void OculusSonarNode::publish_beam_intensities(const PingSlot& ping,
+                                               const builtin_interfaces::msg::Time& stamp)
+{
+    oculus::publish_message(*this, this->beam_intensities_publisher_, this->beam_intensities_msg_,
+        [&](oculus_interfaces::msg::OculusBeamIntensities& msg) {
+            if(!this->beam_decoder_.decode(ping.metadata, ping.data, msg.intensities))
+                return false;
+            oculus::BeamDecoder::bearings(ping.metadata, ping.data, msg.bearings);
+            msg.header.stamp      = stamp;
+            msg.header.frame_id   = "oculus_sonar";
+            msg.ping_id           = ping.metadata.pingId;
+            msg.n_beams           = ping.metadata.nBeams;
+            msg.n_ranges          = ping.metadata.nRanges;
+            msg.range_resolution  = ping.metadata.rangeResolution;
+            return true;
+        });
+}
+
+void OculusSonarNode::publish_detections(const PingSlot& ping,
+                                         const builtin_interfaces::msg::Time& stamp)
+{
+    using Point = oculus::BeamDetector::Point;
+    oculus::publish_message(*this, this->detections_publisher_, this->detections_msg_,
+        [&](sensor_msgs::msg::PointCloud2& msg) {
+            if(msg.fields.empty()) {
+                auto field = [&](const char* name, uint32_t offset, uint8_t datatype) {
+                    sensor_msgs::msg::PointField f;
+                    f.name     = name;
+                    f.offset   = offset;
+                    f.datatype = datatype;
+                    f.count    = 1;
+                    msg.fields.push_back(f);
+                };
+                field("x",         offsetof(Point, x),         sensor_msgs::msg::PointField::FLOAT32);
+                field("y",         offsetof(Point, y),         sensor_msgs::msg::PointField::FLOAT32);
+                field("z",         offsetof(Point, z),         sensor_msgs::msg::PointField::FLOAT32);
+                field("intensity", offsetof(Point, intensity), sensor_msgs::msg::PointField::FLOAT32);
+                field("beam",      offsetof(Point, beam),      sensor_msgs::msg::PointField::UINT16);
+                field("type",      offsetof(Point, type),      sensor_msgs::msg::PointField::UINT8);
             }
+            // Points are written in place, resizing down keeps the capacity.
+            msg.data.resize(this->beam_detector_->max_points(ping.metadata.nBeams)*sizeof(Point));
+            size_t count = this->beam_detector_->detect(ping.metadata, ping.data,
+                                                        reinterpret_cast<Point*>(msg.data.data()));
+            msg.data.resize(count*sizeof(Point));
+            msg.header.stamp    = stamp;
+            msg.header.frame_id = "oculus_sonar";
+            msg.height       = 1;
+            msg.width        = count;
+            msg.is_bigendian = false;
+            msg.point_step   = sizeof(Point);
+            msg.row_step     = msg.data.size();
+            msg.is_dense     = true;
+            return true;
+        });
+}
 
-        } else if (param.get_name() == "salinity") {
-            RCLCPP_INFO_STREAM(this->get_logger(), "Updating salinity to " << param.as_double() << " parts per thousand (ppt,ppm,g/kg).");
-            currentConfig.salinity = param.as_double();
-        }
-        // } catch (const std::runtime_error & e) {
-        // result.successful = false;
-        // RCLCPP_WARN(get_node()->get_logger(), "%s", e.what());
-        // }
-    }
-    // send config to Oculus sonar and wait for feedback
-    auto feedback = this->sonar_driver_->request_ping_config(currentConfig);
-
-    rcl_interfaces::msg::SetParametersResult result;
-    result.successful = true;
-    result.reason = "";
-
-    if(currentConfig.masterMode != feedback.masterMode)
-    {
-        result.successful = false;
-        result.reason.append("Could not update frequency_mode.\n");
-    }
-    //currentConfig.pingRate      != feedback.pingRate // is broken (?) sonar side
-    if((currentConfig.flags & 0x02) ? 1 : 0 != (feedback.flags & 0x02) ? 1 : 0)
-    {
-        result.successful = false;
-        result.reason.append("Could not update data_depth.\n");
-    }
-    if((currentConfig.flags & 0x04) ? 1 : 0 != (feedback.flags & 0x04) ? 1 : 0)
-    {
-        result.successful = false;
-        result.reason.append("Could not update send_gain.\n");
-    }
-    if((currentConfig.flags & 0x10) ? 1 : 0 != (feedback.flags & 0x10) ? 1 : 0)
-    {
-        result.successful = false;
-        result.reason.append("Could not update gain_assist.\n");
-    }
-    if((currentConfig.flags & 0x40) ? 1 : 0 != (feedback.flags & 0x40) ? 1 : 0)
-    {
-        result.successful = false;
-        result.reason.append("Could not update nbeams.\n");
-    }
-    if(currentConfig.range != feedback.range)
-    {
-        result.successful = false;
-        result.reason.append("Could not update range.\n");
-    }
-    if(currentConfig.gammaCorrection != feedback.gammaCorrection)
-    {
-        result.successful = false;
-        result.reason.append("Could not update gamma_correction.\n");
-    }
-    if(currentConfig.gainPercent != feedback.gainPercent)
-    {
-        result.successful = false;
-        result.reason.append("Could not update gain_percent.\n");
-    }
-    if(currentConfig.speedOfSound != feedback.speedOfSound)
-    {
-        result.successful = false;
-        result.reason.append("Could not update sound_speed.\n");
-    }
-    if(currentConfig.salinity != feedback.salinity)
-    {
-        result.successful = false;
-        result.reason.append("Could not update salinity.\n");
-    }
-    //(currentConfig.flags & 0x08) ? 1 : 0 != (feedback.flags & 0x08) ? 1 : 0
+void OculusSonarNode::publish_fan_image(const PingSlot& ping,
+                                        const builtin_interfaces::msg::Time& stamp)
+{
+    oculus::publish_message(*this, this->fan_image_publisher_, this->fan_image_msg_,
+        [&](sensor_msgs::msg::Image& msg) {
+            if(!this->scan_converter_.convert(ping.metadata, ping.data, msg.data))
+                return false;
+            bool is16Bits = (ping.metadata.dataSize == dataSize16Bit);
+            msg.header.stamp    = stamp;
+            msg.header.frame_id = "oculus_sonar";
+            msg.width    = this->scan_converter_.width();
+            msg.height   = this->scan_converter_.height();
+            msg.encoding = is16Bits ? "mono16" : "mono8";
+            msg.is_bigendian = false;
+            msg.step     = msg.width*(is16Bits ? 2 : 1);
+            return true;
+        });
+}
 
-    return result;
+void OculusSonarNode::report_recorder_statistics()
+{
+    auto stats = this->recorder_->statistics();
+    RCLCPP_INFO_STREAM(this->get_logger(), "Recorder : " << stats.items_written << " pings ("
+        << 1.0e-6*stats.bytes_written << " MB) written in " << stats.files_written << " files, "
+        << stats.items_dropped << " dropped, " << stats.sustained_rate() << " MB/s sustained ("
+        << stats.disk_rate() << " MB/s disk), buffer "
+        << 100.0*stats.buffer_used / stats.buffer_capacity << "% used.");
+}
+
+void OculusSonarNode::publish_diagnostics()
+{
+    using oculus::add_diagnostic;
+
+    auto report = this->pipeline_->statistics().window();
+
+    diagnostic_msgs::msg::DiagnosticStatus status;
+    status.name        = std::string(this->get_fully_qualified_name()) + ": ping pipeline";
+    status.hardware_id = "oculus_sonar";
+    status.level       = diagnostic_msgs::msg::DiagnosticStatus::OK;
+    status.message     = "OK";
+
+    oculus::add_pipeline_diagnostics(status, report, *this->pipeline_);
+    // Connection and configuration problems come first.
+    const bool problem = this->supervisor_->add_diagnostics(status);
+    if(this->ping_codec_ && this->compressed_bytes_ > 0) {
+        add_diagnostic(status, "compression_ratio", static_cast<double>(this->uncompressed_bytes_) / this->compressed_bytes_);
+    }
+    if(this->shm_writer_) {
+        add_diagnostic(status, "shm_readers_active",  static_cast<int>(this->shm_readers_));
+        add_diagnostic(status, "shm_pings_total",     this->shm_writer_->pushed());
+        add_diagnostic(status, "shm_oversized_total", this->shm_writer_->oversized());
+    }
+    if(this->recorder_) {
+        auto recorder = this->recorder_->statistics();
+        add_diagnostic(status, "recorder_rate_mbps",   recorder.sustained_rate());
+        add_diagnostic(status, "recorder_drops_total", recorder.items_dropped);
+    }
+
+    if(!problem && report.missing_pings > 0) {
+        status.level   = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+        status.message = std::to_string(report.missing_pings) + " pings missing";
+    }
+    else if(!problem && report.pings == 0) {
+        status.level   = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+        status.message = "No ping";
+    }
+
+    diagnostic_msgs::msg::DiagnosticArray msg;
+    msg.header.stamp = this->now();
+    msg.status.push_back(status);
+    this->diagnostics_publisher_->publish(msg);
+}
+
+void OculusSonarNode::dump_statistics(const std_srvs::srv::Trigger::Request::SharedPtr,
+                                      std_srvs::srv::Trigger::Response::SharedPtr response)
+{
+    std::ostringstream oss;
+    const auto& queue = this->pipeline_->ping_queue();
+    oss << this->pipeline_->statistics().total().to_string()
+        << "queue : " << queue.size() << "/" << queue.depth()
+        << ", " << queue.dropped() << " dropped\n";
+    response->success = true;
+    response->message = oss.str();
+    RCLCPP_INFO_STREAM(this->get_logger(), "Ping statistics :\n" << response->message);
 }
 
-int main(int argc, char * argv[])
+void OculusSonarNode::update_outputs()
 {
-    rclcpp::init(argc, argv);
-    rclcpp::spin(std::make_shared<OculusSonarNode>());
-    rclcpp::shutdown();
-    return 0;
+    auto count = [](const auto& publisher) -> size_t {
+        return publisher ? publisher->get_subscription_count() : 0;
+    };
+    this->ping_subscribers_            = count(this->ping_publisher_);
+    this->compressed_ping_subscribers_ = count(this->compressed_ping_publisher_);
+    this->fan_image_subscribers_       = count(this->fan_image_publisher_);
+    this->beam_intensities_subscribers_ = count(this->beam_intensities_publisher_);
+    this->detections_subscribers_       = count(this->detections_publisher_);
+    this->filtered_ping_subscribers_    = count(this->filtered_ping_publisher_);
+    // Shared memory readers are not in the ROS graph, they are seen polling
+    // the ring.
+    this->shm_readers_ = this->shm_writer_ && this->shm_writer_->readers_active(std::chrono::seconds(1));
+
+    const bool wanted = this->recorder_
+                     || this->ping_subscribers_ > 0
+                     || this->compressed_ping_subscribers_ > 0
+                     || this->fan_image_subscribers_ > 0
+                     || this->beam_intensities_subscribers_ > 0
+                     || this->detections_subscribers_ > 0
+                     || this->filtered_ping_subscribers_ > 0
+                     || this->shm_readers_;
+    this->supervisor_->update_outputs(wanted);
+}
+
+rcl_interfaces::msg::SetParametersResult OculusSonarNode::set_config_callback(const std::vector<rclcpp::Parameter> &parameters)
+{
+    auto result = this->supervisor_->set_parameters(parameters);
+    if(!result.successful)
+        return result;
+
+    for (const rclcpp::Parameter & param : parameters) {
+        if(param.get_name() == "frequency_mode" || param.get_name() == "nbeams" || param.get_name() == "range") {
+            this->scan_converter_.invalidate();
+            if(this->temporal_filter_)
+                this->temporal_filter_->invalidate();
+        }
+    }
+    return result;
 }
+
+#include "rclcpp_components/register_node_macro.hpp"
+
+// The standalone oculus_sonar_node executable is generated from this
+// registration (see CMakeLists.txt).
+RCLCPP_COMPONENTS_REGISTER_NODE(OculusSonarNode)
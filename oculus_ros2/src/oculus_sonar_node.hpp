@@ -1,42 +1,165 @@
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
 #include <sstream>
 #include <thread>
 #include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "rclcpp/rclcpp.hpp"
 
 #include "conversions.h"
+#include "scan_converter.h"
+#include "log_replayer.h"
+#include "log_writer.h"
+#include "sonar_pipeline.h"
+#include "sonar_node_common.hpp"
+#include "ping_codec.h"
+#include "sonar_config.h"
+#include "beam_decoder.h"
+#include "beam_detector.h"
+#include "temporal_filter.h"
+#include "shm_ping_writer.h"
+#include "connection_monitor.h"
 
 #include <oculus_driver/AsyncService.h>
 #include <oculus_driver/SonarDriver.h>
 
 #include "oculus_interfaces/msg/oculus_status.hpp"
 #include "oculus_interfaces/msg/oculus_stamped_ping.hpp"
+#include "oculus_interfaces/msg/oculus_compressed_ping.hpp"
+#include "oculus_interfaces/msg/oculus_beam_intensities.hpp"
+
+#include "sensor_msgs/msg/image.hpp"
+#include "sensor_msgs/msg/point_cloud2.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "std_srvs/srv/trigger.hpp"
 
 #include "rcl_interfaces/msg/parameter_descriptor.hpp"
 
 class OculusSonarNode : public rclcpp::Node
 {
   public:
-    OculusSonarNode();
+    explicit OculusSonarNode(const rclcpp::NodeOptions& options = rclcpp::NodeOptions());
     ~OculusSonarNode();
 
 
   private:
     std::shared_ptr<oculus::SonarDriver> sonar_driver_;
     oculus::AsyncService io_service_;
+    // Stands in for sonar_driver_ when replay.file is set.
+    std::unique_ptr<oculus::LogReplayer> replayer_;
 
     std::string ping_topic_ = "ping";
     std::string status_topic_ = "status";
+    std::string fan_image_topic_ = "fan_image";
+    std::string compressed_ping_topic_ = "compressed_ping";
+    std::string beam_intensities_topic_ = "beam_intensities";
+    std::string detections_topic_ = "detections";
+    std::string filtered_ping_topic_ = "filtered_ping";
     rclcpp::Publisher<oculus_interfaces::msg::OculusStatus>::SharedPtr status_publisher_{nullptr};
     rclcpp::Publisher<oculus_interfaces::msg::OculusStampedPing>::SharedPtr ping_publisher_{nullptr};
+
+    using PingSlot = oculus::PingSlot;
+
+    // Driver callbacks only fill the pipeline queues, conversion and
+    // publishing happen in publisher_thread_ so that a slow middleware never
+    // delays the socket reads. The pipeline also holds the ping statistics.
+    std::unique_ptr<oculus::SonarPipeline> pipeline_;
+    oculus::PublisherThread                publisher_thread_;
+
+    // Reused for every ping when publishing by reference : the data buffer
+    // keeps its capacity so the steady state does not allocate. With
+    // intra-process, messages come from ping_pool_, their data reserved to
+    // the size of the last ping (ping_size_).
+    oculus_interfaces::msg::OculusStampedPing ping_msg_;
+    oculus::MessagePool<oculus_interfaces::msg::OculusStampedPing> ping_pool_;
+    size_t ping_size_ = 0;
+
+    std::unique_ptr<oculus::LogWriter> recorder_;
+    rclcpp::TimerBase::SharedPtr recorder_timer_{nullptr};
+
+    rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_publisher_{nullptr};
+    rclcpp::TimerBase::SharedPtr diagnostics_timer_{nullptr};
+    rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr dump_statistics_service_{nullptr};
+
+    // Compression runs in publisher_thread_, never in the driver callbacks.
+    std::unique_ptr<oculus::PingCodec> ping_codec_;
+    rclcpp::Publisher<oculus_interfaces::msg::OculusCompressedPing>::SharedPtr compressed_ping_publisher_{nullptr};
+    oculus_interfaces::msg::OculusCompressedPing compressed_ping_msg_;
+    std::atomic<uint64_t> compressed_bytes_{0};
+    std::atomic<uint64_t> uncompressed_bytes_{0};
+
+    // Subscriber counts of the outputs, updated by graph_watcher_ on graph
+    // changes so that the ping path never queries the ROS graph.
+    oculus::GraphWatcher       graph_watcher_;
+    std::atomic<size_t>        ping_subscribers_{0};
+    std::atomic<size_t>        compressed_ping_subscribers_{0};
+    std::atomic<size_t>        fan_image_subscribers_{0};
+    std::atomic<size_t>        beam_intensities_subscribers_{0};
+    std::atomic<size_t>        detections_subscribers_{0};
+    std::atomic<size_t>        filtered_ping_subscribers_{0};
+
+    bool fan_image_enabled_ = false;
+    oculus::ScanConverter scan_converter_;
+    rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr fan_image_publisher_{nullptr};
+    sensor_msgs::msg::Image fan_image_msg_;
     
+    // Sonar configuration, standby and connection supervision (see
+    // oculus::SonarSupervisor). Without driver when replaying a log.
+    using Supervisor = oculus::SonarSupervisor<oculus::SonarDriver>;
+    std::unique_ptr<Supervisor> supervisor_;
+
+    oculus::BeamDecoder beam_decoder_;
+    rclcpp::Publisher<oculus_interfaces::msg::OculusBeamIntensities>::SharedPtr beam_intensities_publisher_{nullptr};
+    oculus_interfaces::msg::OculusBeamIntensities beam_intensities_msg_;
+
+    // Per-beam detections, published as a point cloud.
+    std::unique_ptr<oculus::BeamDetector> beam_detector_;
+    rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr detections_publisher_{nullptr};
+    sensor_msgs::msg::PointCloud2 detections_msg_;
+
+    // Speckle filtering across pings, published next to the raw pings.
+    std::unique_ptr<oculus::TemporalFilter> temporal_filter_;
+    rclcpp::Publisher<oculus_interfaces::msg::OculusStampedPing>::SharedPtr filtered_ping_publisher_{nullptr};
+    oculus_interfaces::msg::OculusStampedPing filtered_ping_msg_;
+
+    // Ping ring in shared memory for non-ROS processes, written by
+    // publisher_thread_ while shm_readers_ (updated by graph_watcher_) is set.
+    std::unique_ptr<oculus::ShmPingWriter> shm_writer_;
+    std::atomic<bool>                      shm_readers_{false};
+
     rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr param_cb_{nullptr};
 
     rcl_interfaces::msg::SetParametersResult set_config_callback(const std::vector<rclcpp::Parameter> & parameters);
     
+    oculus::SonarDriver::TimePoint ping_stamp() const;
+    void on_status(const OculusStatusMsg& status);
+    void on_ping(const OculusSimplePingResult& pingMetadata,
+                 const std::vector<uint8_t>& pingData);
+    void start_publisher();
+    bool publish_next();
+
     void publish_status(const OculusStatusMsg& status);
-    void publish_ping(const OculusSimplePingResult& pingMetadata,
-                      const std::vector<uint8_t>& pingData);
-    void handle_dummy();
+    void publish_ping(PingSlot& ping);
+    void fill_ping_message(oculus_interfaces::msg::OculusStampedPing& msg,
+                           PingSlot& ping, bool takeData);
+    void publish_compressed_ping(const PingSlot& ping,
+                                 const builtin_interfaces::msg::Time& stamp);
+    void publish_filtered_ping(const PingSlot& ping,
+                               const builtin_interfaces::msg::Time& stamp);
+    void publish_beam_intensities(const PingSlot& ping,
+                                  const builtin_interfaces::msg::Time& stamp);
+    void publish_detections(const PingSlot& ping,
+                            const builtin_interfaces::msg::Time& stamp);
+    void publish_fan_image(const PingSlot& ping,
+                           const builtin_interfaces::msg::Time& stamp);
+    void update_outputs();
+    void report_recorder_statistics();
+    void publish_diagnostics();
+    void dump_statistics(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                         std_srvs::srv::Trigger::Response::SharedPtr response);
+
 };
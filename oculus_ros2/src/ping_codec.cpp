@@ -0,0 +1,228 @@
+#include "ping_codec.h"
+
+#include <cstring>
+#include <new>
+
+#include <zstd.h>
+
+#include "ping_layout.h"
+
+namespace oculus {
+
+namespace {
+
+constexpr uint32_t CodecMagic   = 0x5a50434f; // "OCPZ"
+constexpr uint8_t  CodecVersion = 1;
+
+enum CodecFlags : uint8_t {
+    Transformed = 0x01, // image stored as planes (else whole message as is)
+    Delta       = 0x02,
+    HasGain     = 0x04,
+};
+
+#pragma pack(push, 1)
+struct CodecHeader
+{
+    uint32_t magic;
+    uint8_t  version;
+    uint8_t  flags;
+    uint8_t  quantizationBits;
+    uint8_t  sampleSize;
+    uint32_t rawSize;
+    uint32_t imageOffset;
+    uint16_t nBeams;
+    uint16_t nRanges;
+};
+#pragma pack(pop)
+
+inline uint16_t load16(const uint8_t* src) { return src[0] | (src[1] << 8); }
+inline void store16(uint8_t* dst, uint16_t value) { dst[0] = value; dst[1] = value >> 8; }
+
+} //namespace
+
+PingCodec::PingCodec() :
+    PingCodec(Options())
+{}
+
+PingCodec::PingCodec(const Options& options) :
+    options_(options),
+    compressContext_(ZSTD_createCCtx()),
+    decompressContext_(ZSTD_createDCtx())
+{
+    if(!compressContext_ || !decompressContext_) {
+        ZSTD_freeCCtx(compressContext_);
+        ZSTD_freeDCtx(decompressContext_);
+        throw std::bad_alloc();
+    }
+}
+
+PingCodec::~PingCodec()
+{
+    ZSTD_freeCCtx(compressContext_);
+    ZSTD_freeDCtx(decompressContext_);
+}
+
+size_t PingCodec::raw_size(const uint8_t* data, size_t size)
+{
+    if(size < sizeof(CodecHeader))
+        return 0;
+    auto header = reinterpret_cast<const CodecHeader*>(data);
+    if(header->magic != CodecMagic || header->version != CodecVersion)
+        return 0;
+    return header->rawSize;
+}
+
+bool PingCodec::compress(const OculusSimplePingResult& metadata,
+                         const std::vector<uint8_t>& data,
+                         std::vector<uint8_t>& output)
+{
+    PingLayout layout(metadata, data);
+
+    CodecHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic   = CodecMagic;
+    header.version = CodecVersion;
+    header.rawSize = data.size();
+
+    const uint8_t* source = data.data();
+    if(layout.is_valid()) {
+        const unsigned int bits  = 8*layout.sample_size;
+        const unsigned int quant = (options_.quantization_bits > 0 && options_.quantization_bits < bits)
+                                 ? options_.quantization_bits : 0;
+        const unsigned int shift = quant > 0 ? bits - quant : 0;
+        const size_t samples     = static_cast<size_t>(layout.n_ranges)*layout.n_beams;
+        const size_t imageOffset = metadata.imageOffset;
+        const size_t imageEnd    = imageOffset + static_cast<size_t>(layout.n_ranges)*layout.row_stride;
+
+        header.flags = Transformed | (options_.delta ? Delta : 0) | (layout.has_gain ? HasGain : 0);
+        header.quantizationBits = quant;
+        header.sampleSize  = layout.sample_size;
+        header.imageOffset = imageOffset;
+        header.nBeams      = layout.n_beams;
+        header.nRanges     = layout.n_ranges;
+
+        // [prefix][gains][low bytes][high bytes][suffix], same size as data.
+        planes_.resize(data.size());
+        std::memcpy(planes_.data(), data.data(), imageOffset);
+        uint8_t* gains = planes_.data() + imageOffset;
+        uint8_t* low   = gains + (layout.has_gain ? layout.n_ranges*PingLayout::GainSize : 0);
+        uint8_t* high  = low + samples;
+        std::memcpy(low + samples*layout.sample_size, data.data() + imageEnd, data.size() - imageEnd);
+
+        previous_.assign(layout.n_beams, 0);
+        uint16_t* previous = previous_.data();
+        const bool delta   = options_.delta;
+        for(unsigned int r = 0; r < layout.n_ranges; r++) {
+            if(layout.has_gain) {
+                std::memcpy(gains + r*PingLayout::GainSize, layout.row(r) - PingLayout::GainSize,
+                            PingLayout::GainSize);
+            }
+            const uint8_t* row = layout.row(r);
+            uint8_t* lowRow    = low  + static_cast<size_t>(r)*layout.n_beams;
+            uint8_t* highRow   = high + static_cast<size_t>(r)*layout.n_beams;
+            if(layout.is_16bit()) {
+                for(unsigned int b = 0; b < layout.n_beams; b++) {
+                    uint16_t value = load16(row + 2*b) >> shift;
+                    uint16_t res   = delta ? value - previous[b] : value;
+                    previous[b] = value;
+                    lowRow[b]   = res;
+                    highRow[b]  = res >> 8;
+                }
+            }
+            else {
+                for(unsigned int b = 0; b < layout.n_beams; b++) {
+                    uint8_t value = row[b] >> shift;
+                    lowRow[b]   = delta ? value - previous[b] : value;
+                    previous[b] = value;
+                }
+            }
+        }
+        source = planes_.data();
+    }
+
+    output.resize(sizeof(header) + ZSTD_compressBound(data.size()));
+    std::memcpy(output.data(), &header, sizeof(header));
+    size_t compressed = ZSTD_compressCCtx(compressContext_, output.data() + sizeof(header),
+                                          output.size() - sizeof(header), source, data.size(),
+                                          options_.level);
+    if(ZSTD_isError(compressed)) {
+        output.clear();
+        return false;
+    }
+    output.resize(sizeof(header) + compressed);
+    return true;
+}
+
+bool PingCodec::decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& output)
+{
+    if(raw_size(data, size) == 0)
+        return false;
+    CodecHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    std::vector<uint8_t>& target = (header.flags & Transformed) ? planes_ : output;
+    target.resize(header.rawSize);
+    size_t decompressed = ZSTD_decompressDCtx(decompressContext_, target.data(), target.size(),
+                                              data + sizeof(header), size - sizeof(header));
+    if(ZSTD_isError(decompressed) || decompressed != header.rawSize)
+        return false;
+    if(!(header.flags & Transformed))
+        return true;
+
+    const bool         hasGain    = header.flags & HasGain;
+    const bool         delta      = header.flags & Delta;
+    const unsigned int sampleSize = header.sampleSize;
+    const unsigned int nBeams     = header.nBeams;
+    const unsigned int nRanges    = header.nRanges;
+    const unsigned int gainSize   = hasGain ? PingLayout::GainSize : 0;
+    const size_t rowStride   = nBeams*sampleSize + gainSize;
+    const size_t samples     = static_cast<size_t>(nRanges)*nBeams;
+    const size_t imageOffset = header.imageOffset;
+    const size_t imageEnd    = imageOffset + nRanges*rowStride;
+    if(imageEnd > header.rawSize || sampleSize < 1 || sampleSize > 2)
+        return false;
+
+    // Quantized samples are restored at the middle of their interval.
+    const unsigned int shift = header.quantizationBits > 0 ? 8*sampleSize - header.quantizationBits : 0;
+    const uint16_t     half  = shift > 0 ? 1u << (shift - 1) : 0;
+
+    output.resize(header.rawSize);
+    std::memcpy(output.data(), planes_.data(), imageOffset);
+    const uint8_t* gains = planes_.data() + imageOffset;
+    const uint8_t* low   = gains + nRanges*gainSize;
+    const uint8_t* high  = low + samples;
+    std::memcpy(output.data() + imageEnd, low + samples*sampleSize, header.rawSize - imageEnd);
+
+    previous_.assign(nBeams, 0);
+    uint16_t* previous = previous_.data();
+    for(unsigned int r = 0; r < nRanges; r++) {
+        uint8_t* row = output.data() + imageOffset + r*rowStride;
+        if(hasGain) {
+            std::memcpy(row, gains + r*gainSize, gainSize);
+            row += gainSize;
+        }
+        const uint8_t* lowRow  = low  + static_cast<size_t>(r)*nBeams;
+        const uint8_t* highRow = high + static_cast<size_t>(r)*nBeams;
+        if(sampleSize == 2) {
+            for(unsigned int b = 0; b < nBeams; b++) {
+                uint16_t value = lowRow[b] | (highRow[b] << 8);
+                if(delta)
+                    value += previous[b];
+                previous[b] = value;
+                store16(row + 2*b, shift > 0 ? (value << shift) | half : value);
+            }
+        }
+        else {
+            for(unsigned int b = 0; b < nBeams; b++) {
+                uint8_t value = lowRow[b];
+                if(delta)
+                    value += previous[b];
+                previous[b] = value;
+                row[b] = shift > 0 ? (value << shift) | half : value;
+            }
+        }
+    }
+    return true;
+}
+
+} //namespace oculus
@@ -0,0 +1,68 @@
+#ifndef _DEF_OCULUS_ROS_PING_CODEC_H_
+#define _DEF_OCULUS_ROS_PING_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+typedef struct ZSTD_CCtx_s ZSTD_CCtx;
+typedef struct ZSTD_DCtx_s ZSTD_DCtx;
+
+namespace oculus {
+
+// Compression of full ping messages (metadata, bearings and image).
+//
+// The image is transformed before being compressed with zstd :
+//  - optional quantization (lossy) : only the quantization_bits most
+//    significant bits of each sample are kept,
+//  - delta coding along range (each range row minus the previous one, the
+//    echoes of a beam vary slowly with range),
+//  - byte-plane split for 16 bits samples (low bytes then high bytes) and
+//    range gains in their own plane.
+// Lossless compression restores the exact original message.
+//
+// Compressed buffers are self-describing : a small header gives the
+// transform parameters and the original size.
+class PingCodec
+{
+    public:
+
+    struct Options
+    {
+        bool         delta             = true;
+        unsigned int quantization_bits = 0; // 0 for lossless
+        int          level             = 1; // zstd compression level
+    };
+
+    PingCodec();
+    explicit PingCodec(const Options& options);
+    ~PingCodec();
+
+    PingCodec(const PingCodec&)            = delete;
+    PingCodec& operator=(const PingCodec&) = delete;
+
+    const Options& options() const { return options_; }
+
+    bool compress(const OculusSimplePingResult& metadata,
+                  const std::vector<uint8_t>& data,
+                  std::vector<uint8_t>& output);
+    bool decompress(const uint8_t* data, size_t size,
+                    std::vector<uint8_t>& output);
+
+    // Uncompressed size of a compressed buffer (0 if invalid).
+    static size_t raw_size(const uint8_t* data, size_t size);
+
+    protected:
+
+    Options    options_;
+    ZSTD_CCtx* compressContext_;
+    ZSTD_DCtx* decompressContext_;
+    std::vector<uint8_t>  planes_;
+    std::vector<uint16_t> previous_;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_PING_CODEC_H_
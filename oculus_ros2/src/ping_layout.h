@@ -0,0 +1,65 @@
+#ifndef _DEF_OCULUS_ROS_PING_LAYOUT_H_
+#define _DEF_OCULUS_ROS_PING_LAYOUT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+namespace oculus {
+
+// Describes where the beam bearings and the image samples are located in a
+// full OculusSimplePingResult message (as delivered by the driver).
+//
+// The image is stored range-major : one row per range, each row holding
+// nBeams samples of sample_size bytes, optionally prefixed by a 4 bytes gain
+// value when the send_gain flag (0x04) was set in the fire message.
+struct PingLayout
+{
+    unsigned int n_beams     = 0;
+    unsigned int n_ranges    = 0;
+    unsigned int sample_size = 1;
+    bool         has_gain    = false;
+    unsigned int row_stride  = 0;
+    const int16_t* bearings  = nullptr; // hundredths of degrees
+    const uint8_t* image     = nullptr;
+
+    static constexpr unsigned int GainSize = 4;
+
+    PingLayout() = default;
+    PingLayout(const OculusSimplePingResult& metadata, const std::vector<uint8_t>& data)
+    {
+        n_beams     = metadata.nBeams;
+        n_ranges    = metadata.nRanges;
+        sample_size = (metadata.dataSize == dataSize16Bit) ? 2 : 1;
+        has_gain    = (metadata.fireMessage.flags & 0x04) != 0;
+        row_stride  = n_beams*sample_size + (has_gain ? GainSize : 0);
+
+        size_t bearingsEnd = sizeof(OculusSimplePingResult) + n_beams*sizeof(int16_t);
+        if(data.size() >= bearingsEnd)
+            bearings = reinterpret_cast<const int16_t*>(data.data() + sizeof(OculusSimplePingResult));
+        if(data.size() >= metadata.imageOffset + static_cast<size_t>(n_ranges)*row_stride)
+            image = data.data() + metadata.imageOffset;
+    }
+
+    bool is_valid() const { return bearings && image && n_beams > 1 && n_ranges > 1; }
+    bool is_16bit() const { return sample_size == 2; }
+
+    // First sample of a range row (gain prefix skipped).
+    const uint8_t* row(unsigned int rangeIndex) const {
+        return image + rangeIndex*row_stride + (has_gain ? GainSize : 0);
+    }
+    uint32_t gain(unsigned int rangeIndex) const {
+        uint32_t value = 1;
+        if(has_gain) {
+            const uint8_t* src = image + rangeIndex*row_stride;
+            value = src[0] | (src[1] << 8) | (src[2] << 16) | (static_cast<uint32_t>(src[3]) << 24);
+        }
+        return value;
+    }
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_PING_LAYOUT_H_
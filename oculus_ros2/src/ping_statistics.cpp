@@ -0,0 +1,94 @@
+#include "ping_statistics.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace oculus {
+
+const char* PingStatistics::stage_name(Stage stage)
+{
+    switch(stage) {
+        case Receive:    return "receive";
+        case Queue:      return "queue";
+        case Conversion: return "conversion";
+        case Publish:    return "publish";
+        case Detection:  return "detection";
+        case Total:      return "total";
+        default:         return "unknown";
+    }
+}
+
+PingStatistics::PingStatistics() :
+    start_(Clock::now()),
+    lastWindow_(start_)
+{}
+
+void PingStatistics::count_ping(uint32_t pingId, size_t bytes)
+{
+    if(hasLastPingId_ && pingId > lastPingId_ + 1) {
+        gaps_.fetch_add(1, std::memory_order_relaxed);
+        missing_.fetch_add(pingId - lastPingId_ - 1, std::memory_order_relaxed);
+    }
+    // A lower ping_id is a sonar restart, not a gap.
+    hasLastPingId_ = true;
+    lastPingId_    = pingId;
+    pings_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+PingStatistics::Report PingStatistics::total() const
+{
+    Report report;
+    report.period = std::chrono::duration<double>(Clock::now() - start_).count();
+    report.pings  = pings_.load(std::memory_order_relaxed);
+    report.bytes  = bytes_.load(std::memory_order_relaxed);
+    report.gaps   = gaps_.load(std::memory_order_relaxed);
+    report.missing_pings = missing_.load(std::memory_order_relaxed);
+    for(unsigned int i = 0; i < StageCount; i++)
+        report.stages[i] = stages_[i].snapshot();
+    return report;
+}
+
+PingStatistics::Report PingStatistics::window()
+{
+    std::lock_guard<std::mutex> lock(windowMutex_);
+
+    Report current = this->total();
+    auto now = Clock::now();
+
+    Report res;
+    res.period = std::chrono::duration<double>(now - lastWindow_).count();
+    res.pings  = current.pings - lastReport_.pings;
+    res.bytes  = current.bytes - lastReport_.bytes;
+    res.gaps   = current.gaps  - lastReport_.gaps;
+    res.missing_pings = current.missing_pings - lastReport_.missing_pings;
+    for(unsigned int i = 0; i < StageCount; i++)
+        res.stages[i] = current.stages[i] - lastReport_.stages[i];
+
+    lastReport_ = current;
+    lastWindow_ = now;
+    return res;
+}
+
+std::string PingStatistics::Report::to_string() const
+{
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1)
+        << "pings : " << pings << " in " << period << "s (" << this->ping_rate() << " Hz, "
+        << 1.0e-6*this->byte_rate() << " MB/s)\n"
+        << "gaps  : " << gaps << " (" << missing_pings << " missing pings)\n"
+        << "latency (us)   count     mean      p50      p90      p99      max\n";
+    for(unsigned int i = 0; i < StageCount; i++) {
+        const auto& s = stages[i];
+        oss << std::left << std::setw(12) << stage_name(static_cast<Stage>(i)) << std::right
+            << std::setw(8) << s.count
+            << std::setw(9) << 1.0e-3*s.mean()
+            << std::setw(9) << 1.0e-3*s.percentile(0.5)
+            << std::setw(9) << 1.0e-3*s.percentile(0.9)
+            << std::setw(9) << 1.0e-3*s.percentile(0.99)
+            << std::setw(9) << 1.0e-3*s.max << "\n";
+    }
+    return oss.str();
+}
+
+} //namespace oculus
@@ -0,0 +1,82 @@
+#ifndef _DEF_OCULUS_ROS_PING_STATISTICS_H_
+#define _DEF_OCULUS_ROS_PING_STATISTICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "latency_histogram.h"
+
+namespace oculus {
+
+// Per-ping latency and throughput statistics of the node pipeline.
+//
+// Stages :
+//  - Receive    : header stamp (host time at which the driver received the
+//                 ping header) to the driver ping callback.
+//  - Queue      : driver callback to the publisher thread.
+//  - Conversion : oculus::copy_to_ros and message filling.
+//  - Publish    : middleware publish call.
+//  - Detection  : per-beam detection and point cloud publishing.
+//  - Total      : header stamp to the end of publish.
+//
+// Recording is lock-free. window() and total() are meant to be called from
+// the (low rate) reporting side.
+class PingStatistics
+{
+    public:
+
+    enum Stage { Receive, Queue, Conversion, Publish, Detection, Total, StageCount };
+    static const char* stage_name(Stage stage);
+
+    struct Report
+    {
+        double   period = 0.0; // seconds covered by the report
+        uint64_t pings  = 0;
+        uint64_t bytes  = 0;
+        uint64_t gaps   = 0;   // ping_id discontinuities
+        uint64_t missing_pings = 0;
+        std::array<LatencyHistogram::Snapshot, StageCount> stages;
+
+        double ping_rate() const { return period > 0.0 ? pings / period : 0.0; }
+        double byte_rate() const { return period > 0.0 ? bytes / period : 0.0; }
+        std::string to_string() const;
+    };
+
+    PingStatistics();
+
+    void record(Stage stage, std::chrono::nanoseconds duration) {
+        stages_[stage].record(duration.count());
+    }
+    // To be called from a single thread, in ping order.
+    void count_ping(uint32_t pingId, size_t bytes);
+
+    // Statistics since the previous call to window().
+    Report window();
+    // Statistics since the creation of this object.
+    Report total() const;
+
+    private:
+
+    using Clock = std::chrono::steady_clock;
+
+    std::array<LatencyHistogram, StageCount> stages_;
+    std::atomic<uint64_t> pings_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> gaps_{0};
+    std::atomic<uint64_t> missing_{0};
+    bool                  hasLastPingId_ = false;
+    uint32_t              lastPingId_    = 0;
+    Clock::time_point     start_;
+
+    std::mutex        windowMutex_;
+    Report            lastReport_;
+    Clock::time_point lastWindow_;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_PING_STATISTICS_H_
@@ -0,0 +1,213 @@
+#include "scan_converter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "cpu_features.h"
+
+#ifdef OCULUS_ROS2_AVX2
+#include <immintrin.h>
+#endif
+
+namespace oculus {
+
+namespace {
+
+#ifdef OCULUS_ROS2_AVX2
+// Remaps the pixels 8 at a time and returns the number of pixels done, the
+// remainder is left to the portable loop. A 32 bits gather at a sample index
+// loads the sample and its right neighbour (next beam) at once.
+template <typename T>
+OCULUS_AVX2_TARGET size_t remap_avx2(const int32_t* offsets, const uint32_t* weights, size_t count,
+                                     const uint16_t* polar, size_t stride, uint32_t weightOne,
+                                     T* output)
+{
+    const __m256i lowMask = _mm256_set1_epi32(0xffff);
+    const __m256i one     = _mm256_set1_epi32(weightOne);
+    const __m256i nextRow = _mm256_set1_epi32(stride);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + i));
+        __m256i w   = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+        __m256i top    = _mm256_i32gather_epi32(reinterpret_cast<const int*>(polar), idx, 2);
+        __m256i bottom = _mm256_i32gather_epi32(reinterpret_cast<const int*>(polar),
+                                                _mm256_add_epi32(idx, nextRow), 2);
+        __m256i wb = _mm256_and_si256(w, lowMask);
+        __m256i wr = _mm256_srli_epi32(w, 16);
+        __m256i wb0 = _mm256_sub_epi32(one, wb);
+        __m256i wr0 = _mm256_sub_epi32(one, wr);
+
+        __m256i h0 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(top, lowMask), wb0),
+                                      _mm256_mullo_epi32(_mm256_srli_epi32(top, 16), wb));
+        __m256i h1 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_and_si256(bottom, lowMask), wb0),
+                                      _mm256_mullo_epi32(_mm256_srli_epi32(bottom, 16), wb));
+        __m256i res = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(h0, wr0),
+                                                         _mm256_mullo_epi32(h1, wr)), 16);
+
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(res),
+                                          _mm256_extracti128_si256(res, 1));
+        if constexpr(sizeof(T) == 2) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+        }
+        else {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i),
+                             _mm_packus_epi16(packed, packed));
+        }
+    }
+    return i;
+}
+#endif
+
+} //namespace
+
+ScanConverter::ScanConverter(unsigned int width) :
+    width_(width),
+    invalidated_(true)
+{}
+
+uint64_t ScanConverter::hash_bearings(const int16_t* bearings, unsigned int nBeams)
+{
+    // Bearings are not necessarily aligned in the ping data, they are hashed
+    // byte per byte.
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(bearings);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(size_t i = 0; i < nBeams*sizeof(int16_t); i++) {
+        hash = (hash ^ bytes[i])*0x100000001b3ull;
+    }
+    return hash;
+}
+
+void ScanConverter::set_width(unsigned int width)
+{
+    if(width != width_) {
+        width_ = width;
+        this->invalidate();
+    }
+}
+
+bool ScanConverter::convert(const OculusSimplePingResult& metadata,
+                            const std::vector<uint8_t>& data,
+                            std::vector<uint8_t>& output)
+{
+    PingLayout layout(metadata, data);
+    if(!layout.is_valid() || width_ < 2)
+        return false;
+
+    Key key;
+    key.n_beams          = metadata.nBeams;
+    key.n_ranges         = metadata.nRanges;
+    key.range            = metadata.fireMessage.range;
+    key.range_resolution = metadata.rangeResolution;
+    key.frequency_mode   = metadata.fireMessage.masterMode;
+    key.bearings_hash    = hash_bearings(layout.bearings, layout.n_beams);
+    key.width            = width_;
+    if(invalidated_.exchange(false) || key != key_) {
+        this->build_lut(key, metadata, layout);
+    }
+
+    this->unpack(layout);
+
+    output.resize(static_cast<size_t>(width_)*height_*layout.sample_size);
+    if(layout.is_16bit())
+        this->remap(reinterpret_cast<uint16_t*>(output.data()));
+    else
+        this->remap(output.data());
+    return true;
+}
+
+void ScanConverter::build_lut(const Key& key, const OculusSimplePingResult& metadata,
+                              const PingLayout& layout)
+{
+    const unsigned int nBeams  = layout.n_beams;
+    const unsigned int nRanges = layout.n_ranges;
+
+    std::vector<double> bearings(nBeams);
+    for(unsigned int b = 0; b < nBeams; b++) {
+        bearings[b] = 0.01*layout.bearings[b]*M_PI / 180.0;
+    }
+    const double halfAperture = std::max(std::abs(bearings.front()), std::abs(bearings.back()));
+    const double maxRange     = metadata.rangeResolution*(nRanges - 1);
+
+    // The fan spans [-R.sin(a), R.sin(a)] horizontally and [0, R] vertically.
+    const double halfWidth = maxRange*std::sin(std::min(halfAperture, 0.5*M_PI));
+    const double scale     = 2.0*halfWidth / (width_ - 1);
+    height_ = static_cast<unsigned int>(std::ceil(maxRange / scale)) + 1;
+
+    const int32_t outside = nRanges*nBeams;
+    offsets_.assign(static_cast<size_t>(width_)*height_, outside);
+    weights_.assign(static_cast<size_t>(width_)*height_, 0);
+
+    for(unsigned int v = 0; v < height_; v++) {
+        double y = maxRange - scale*v;
+        for(unsigned int u = 0; u < width_; u++) {
+            double x = scale*u - halfWidth;
+            double r = std::sqrt(x*x + y*y) / metadata.rangeResolution;
+            double theta = std::atan2(x, y);
+            if(r > nRanges - 1 || theta < bearings.front() || theta > bearings.back())
+                continue;
+
+            // Bearings are not evenly spaced, they are looked up.
+            auto it = std::upper_bound(bearings.begin(), bearings.end(), theta);
+            unsigned int b = std::min<unsigned int>(std::max<long>(it - bearings.begin(), 1) - 1,
+                                                    nBeams - 2);
+            double fb = (theta - bearings[b]) / (bearings[b + 1] - bearings[b]);
+            unsigned int ri = std::min<unsigned int>(static_cast<unsigned int>(r), nRanges - 2);
+            double fr = r - ri;
+
+            size_t pixel = static_cast<size_t>(v)*width_ + u;
+            offsets_[pixel] = ri*nBeams + b;
+            weights_[pixel] = static_cast<uint32_t>(std::lround(WeightOne*std::clamp(fb, 0.0, 1.0)))
+                           | (static_cast<uint32_t>(std::lround(WeightOne*std::clamp(fr, 0.0, 1.0))) << 16);
+        }
+    }
+
+    // Zeroed tail read by out-of-fan pixels (and by the 32 bits gathers).
+    polar_.assign(static_cast<size_t>(nRanges + 1)*nBeams + 2, 0);
+
+    key_ = key;
+    lutBuilds_++;
+}
+
+void ScanConverter::unpack(const PingLayout& layout)
+{
+    uint16_t* dst = polar_.data();
+    for(unsigned int r = 0; r < layout.n_ranges; r++, dst += layout.n_beams) {
+        const uint8_t* src = layout.row(r);
+        if(layout.is_16bit()) {
+            std::memcpy(dst, src, layout.n_beams*sizeof(uint16_t));
+        }
+        else {
+            for(unsigned int b = 0; b < layout.n_beams; b++)
+                dst[b] = src[b];
+        }
+    }
+}
+
+template <typename T>
+void ScanConverter::remap(T* output) const
+{
+    const size_t count  = offsets_.size();
+    const size_t stride = key_.n_beams;
+    const uint16_t* polar = polar_.data();
+    size_t i = 0;
+
+#ifdef OCULUS_ROS2_AVX2
+    if(has_avx2())
+        i = remap_avx2(offsets_.data(), weights_.data(), count, polar, stride, WeightOne, output);
+#endif
+
+    for(; i < count; i++) {
+        const uint16_t* p = polar + offsets_[i];
+        uint32_t wb = weights_[i] & 0xffff;
+        uint32_t wr = weights_[i] >> 16;
+        uint32_t h0 = p[0]*(WeightOne - wb)      + p[1]*wb;
+        uint32_t h1 = p[stride]*(WeightOne - wb) + p[stride + 1]*wb;
+        output[i] = static_cast<T>((h0*(WeightOne - wr) + h1*wr) >> 16);
+    }
+}
+
+template void ScanConverter::remap<uint8_t>(uint8_t*) const;
+template void ScanConverter::remap<uint16_t>(uint16_t*) const;
+
+} //namespace oculus
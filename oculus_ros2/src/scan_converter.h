@@ -0,0 +1,94 @@
+#ifndef _DEF_OCULUS_ROS_SCAN_CONVERTER_H_
+#define _DEF_OCULUS_ROS_SCAN_CONVERTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "ping_layout.h"
+
+namespace oculus {
+
+// Converts the beam x range polar image of a ping into a cartesian fan view
+// (apex at the bottom center of the output image, range increasing upwards).
+//
+// A remap table (top-left polar sample and bilinear weights for each output
+// pixel) is built on the first ping and cached. It is only rebuilt when the
+// sonar geometry (including the range resolution and the beam bearings) or
+// the output width change, or after invalidate() was called.
+class ScanConverter
+{
+    public:
+
+    struct Key
+    {
+        uint16_t     n_beams          = 0;
+        uint16_t     n_ranges         = 0;
+        double       range            = 0.0;
+        double       range_resolution = 0.0;
+        uint8_t      frequency_mode   = 0;
+        uint64_t     bearings_hash    = 0; // see hash_bearings
+        unsigned int width            = 0;
+
+        bool operator==(const Key& other) const {
+            return n_beams == other.n_beams && n_ranges == other.n_ranges
+                && range == other.range && range_resolution == other.range_resolution
+                && frequency_mode == other.frequency_mode
+                && bearings_hash == other.bearings_hash && width == other.width;
+        }
+        bool operator!=(const Key& other) const { return !(*this == other); }
+    };
+
+    explicit ScanConverter(unsigned int width = 512);
+
+    // FNV-1a hash of the raw bearings of a ping. The sonar may change its
+    // bearing table without changing the other key fields (firmware update,
+    // other sonar model in a replayed log).
+    static uint64_t hash_bearings(const int16_t* bearings, unsigned int nBeams);
+
+    void set_width(unsigned int width);
+    // Can be called from any thread.
+    void invalidate() { invalidated_ = true; }
+
+    // Writes the fan image in output (row-major, width() x height(), uint8_t
+    // samples for 8 bits pings, uint16_t for 16 bits pings). Returns false if
+    // the ping could not be converted.
+    bool convert(const OculusSimplePingResult& metadata,
+                 const std::vector<uint8_t>& data,
+                 std::vector<uint8_t>& output);
+
+    unsigned int width()  const { return width_;  }
+    unsigned int height() const { return height_; }
+    unsigned int lut_builds() const { return lutBuilds_; }
+
+    protected:
+
+    // Fixed point bilinear weights are stored on 8 bits (0-256).
+    static constexpr unsigned int WeightOne = 256;
+
+    unsigned int      width_;
+    unsigned int      height_ = 0;
+    Key               key_;
+    std::atomic<bool> invalidated_;
+    unsigned int      lutBuilds_ = 0;
+
+    // Per output pixel : index of the top-left sample in polar_ and weights
+    // packed as (beam weight | range weight << 16). Pixels outside of the fan
+    // point to a zeroed block at the end of polar_.
+    std::vector<int32_t>  offsets_;
+    std::vector<uint32_t> weights_;
+    // Unpacked samples (gain prefix removed, widened to 16 bits).
+    std::vector<uint16_t> polar_;
+
+    void build_lut(const Key& key, const OculusSimplePingResult& metadata,
+                   const PingLayout& layout);
+    void unpack(const PingLayout& layout);
+    template <typename T>
+    void remap(T* output) const;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_SCAN_CONVERTER_H_
@@ -0,0 +1,155 @@
+#include "shm_ping_writer.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace oculus {
+
+ShmPingWriter::ShmPingWriter(const Options& options) :
+    options_(options),
+    size_(shm::ring_size(options.slots, options.slot_data_size)),
+    memory_(nullptr),
+    header_(nullptr),
+    slots_(nullptr)
+{
+    if(options_.slots < 2) {
+        throw std::runtime_error("The shared memory ping ring needs at least 2 slots");
+    }
+
+    int fd = this->create();
+    if(ftruncate(fd, size_) < 0) {
+        int error = errno;
+        ::close(fd);
+        shm_unlink(options_.name.c_str());
+        throw std::runtime_error("Could not allocate shared memory '" + options_.name + "' : "
+                                 + std::strerror(error));
+    }
+    // Pages are populated now so that push() never page faults.
+    memory_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if(memory_ == MAP_FAILED) {
+        shm_unlink(options_.name.c_str());
+        throw std::runtime_error("Could not map shared memory '" + options_.name + "' : "
+                                 + std::strerror(errno));
+    }
+
+    // ftruncate zero filled the memory : all slots are empty with an even
+    // sequence number.
+    header_ = new(memory_) shm::RingHeader;
+    header_->version       = shm::RingVersion;
+    header_->slot_count    = options_.slots;
+    header_->padding       = 0;
+    header_->slot_size     = shm::slot_size(options_.slot_data_size);
+    header_->data_capacity = options_.slot_data_size;
+    header_->writer_pid    = getpid();
+    header_->write_count.store(0, std::memory_order_relaxed);
+    header_->notify.store(0, std::memory_order_relaxed);
+    header_->reader_heartbeat.store(0, std::memory_order_relaxed);
+    slots_ = static_cast<uint8_t*>(memory_) + sizeof(shm::RingHeader);
+    for(unsigned int i = 0; i < options_.slots; i++) {
+        new(slots_ + i*header_->slot_size) shm::SlotHeader;
+    }
+    header_->magic.store(shm::RingMagic, std::memory_order_release);
+}
+
+// Writer process of an existing ring (0 if unknown).
+static pid_t ring_writer(const std::string& name)
+{
+    pid_t writer = 0;
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        return writer;
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) == 0 && static_cast<size_t>(fileStat.st_size) >= sizeof(shm::RingHeader)) {
+        void* memory = mmap(nullptr, sizeof(shm::RingHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if(memory != MAP_FAILED) {
+            auto header = static_cast<const shm::RingHeader*>(memory);
+            if(header->magic.load(std::memory_order_acquire) == shm::RingMagic)
+                writer = header->writer_pid;
+            munmap(memory, sizeof(shm::RingHeader));
+        }
+    }
+    ::close(fd);
+    return writer;
+}
+
+// Returns the descriptor of the new shared memory object.
+int ShmPingWriter::create()
+{
+    int fd = shm_open(options_.name.c_str(), O_CREAT | O_EXCL | O_RDWR, options_.mode);
+    if(fd < 0 && errno == EEXIST) {
+        // Only a ring left by a writer which is gone is replaced (its readers
+        // keep the old mapping and must reopen).
+        pid_t writer = ring_writer(options_.name);
+        if(writer > 0 && writer != getpid() && (kill(writer, 0) == 0 || errno == EPERM)) {
+            throw std::runtime_error("Shared memory '" + options_.name + "' is used by the running process "
+                                     + std::to_string(writer));
+        }
+        shm_unlink(options_.name.c_str());
+        fd = shm_open(options_.name.c_str(), O_CREAT | O_EXCL | O_RDWR, options_.mode);
+    }
+    if(fd < 0) {
+        throw std::runtime_error("Could not create shared memory '" + options_.name + "' : "
+                                 + std::strerror(errno));
+    }
+    // shm_open applies the umask.
+    fchmod(fd, options_.mode);
+    return fd;
+}
+
+ShmPingWriter::~ShmPingWriter()
+{
+    munmap(memory_, size_);
+    shm_unlink(options_.name.c_str());
+}
+
+bool ShmPingWriter::push(const OculusSimplePingResult& metadata,
+                         const std::vector<uint8_t>& data,
+                         int64_t stamp)
+{
+    if(data.size() > options_.slot_data_size) {
+        oversized_++;
+        return false;
+    }
+
+    const uint64_t index = header_->write_count.load(std::memory_order_relaxed);
+    auto slot = reinterpret_cast<shm::SlotHeader*>(slots_ + (index % options_.slots)*header_->slot_size);
+
+    const uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->index        = index;
+    slot->stamp        = stamp;
+    slot->data_size    = data.size();
+    std::memcpy(&slot->metadata, &metadata, sizeof(metadata));
+    std::memcpy(shm::slot_data(slot), data.data(), data.size());
+    slot->publish_time = shm::monotonic_ns();
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    header_->write_count.store(index + 1, std::memory_order_release);
+
+    header_->notify.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header_->notify),
+            FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    return true;
+}
+
+bool ShmPingWriter::readers_active(std::chrono::nanoseconds timeout) const
+{
+    int64_t heartbeat = header_->reader_heartbeat.load(std::memory_order_relaxed);
+    return heartbeat > 0 && shm::monotonic_ns() - heartbeat < timeout.count();
+}
+
+} //namespace oculus
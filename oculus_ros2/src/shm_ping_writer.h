@@ -0,0 +1,69 @@
+#ifndef _DEF_OCULUS_ROS_SHM_PING_WRITER_H_
+#define _DEF_OCULUS_ROS_SHM_PING_WRITER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "oculus_ros2/shm_ping_ring.h"
+
+namespace oculus {
+
+// Writer side of the shared memory ping ring (see
+// include/oculus_ros2/shm_ping_ring.h for the layout and the reader).
+//
+// The ring is created at construction and removed at destruction. A ring
+// left by a dead writer is replaced, the construction fails if its writer is
+// still running. push() never blocks nor allocates : it copies the ping in
+// the next slot and wakes up the waiting readers.
+class ShmPingWriter
+{
+    public:
+
+    struct Options
+    {
+        std::string  name           = "/oculus_sonar_pings";
+        unsigned int slots          = 8;
+        size_t       slot_data_size = 4*1024*1024; // bytes, larger pings are dropped
+        unsigned int mode           = 0660; // readers map the ring read-write
+    };
+
+    // Throws std::runtime_error if the shared memory cannot be created or is
+    // used by another running writer.
+    explicit ShmPingWriter(const Options& options);
+    ~ShmPingWriter();
+
+    ShmPingWriter(const ShmPingWriter&)            = delete;
+    ShmPingWriter& operator=(const ShmPingWriter&) = delete;
+
+    // stamp is in nanoseconds since epoch. Returns false if the ping does not
+    // fit in a slot.
+    bool push(const OculusSimplePingResult& metadata,
+              const std::vector<uint8_t>& data,
+              int64_t stamp);
+
+    // True if a reader polled the ring during the last timeout.
+    bool readers_active(std::chrono::nanoseconds timeout) const;
+
+    const Options& options() const { return options_; }
+    uint64_t pushed()    const { return header_->write_count.load(std::memory_order_relaxed); }
+    uint64_t oversized() const { return oversized_; }
+
+    protected:
+
+    Options           options_;
+    size_t            size_;
+    void*             memory_;
+    shm::RingHeader*  header_;
+    uint8_t*          slots_;
+    uint64_t          oversized_ = 0;
+
+    int create();
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_SHM_PING_WRITER_H_
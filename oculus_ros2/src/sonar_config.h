@@ -0,0 +1,240 @@
+#ifndef _DEF_OCULUS_ROS_SONAR_CONFIG_H_
+#define _DEF_OCULUS_ROS_SONAR_CONFIG_H_
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+#include <oculus_driver/SonarDriver.h>
+
+namespace oculus {
+
+// A field of a requested fire configuration which differs from the one
+// actually applied by the sonar (as echoed in
+// OculusSimplePingResult::fireMessage). Fields are named after the
+// OculusSonarNode parameters, values are given as these parameters.
+struct ConfigMismatch
+{
+    std::string name;
+    std::string requested;
+    std::string applied;
+};
+
+inline std::vector<ConfigMismatch> config_mismatches(const OculusSimpleFireMessage& requested,
+                                                     const OculusSimpleFireMessage& applied)
+{
+    std::vector<ConfigMismatch> mismatches;
+    auto add = [&](const char* name, double req, double app) {
+        std::ostringstream reqStr, appStr;
+        reqStr << req;
+        appStr << app;
+        mismatches.push_back(ConfigMismatch{name, reqStr.str(), appStr.str()});
+    };
+    auto check_flag = [&](uint8_t flag, const char* name) {
+        if((requested.flags & flag) != (applied.flags & flag))
+            add(name, (requested.flags & flag) ? 1 : 0, (applied.flags & flag) ? 1 : 0);
+    };
+    auto check_value = [&](double req, double app, double tolerance, const char* name) {
+        if(std::abs(req - app) > tolerance)
+            add(name, req, app);
+    };
+
+    if(requested.masterMode != applied.masterMode)
+        add("frequency_mode", requested.masterMode, applied.masterMode);
+    // pingRate is not reliably echoed by the sonar, not checked.
+    check_flag(0x02, "data_depth");
+    check_flag(0x04, "send_gain");
+    check_flag(0x10, "gain_assist");
+    check_flag(0x40, "nbeams");
+    check_value(requested.range,       applied.range,       1.0e-3, "range");
+    check_value(requested.gainPercent, applied.gainPercent, 1.0e-3, "gain_percent");
+    check_value(requested.salinity,    applied.salinity,    1.0e-3, "salinity");
+    if(requested.gammaCorrection != applied.gammaCorrection)
+        add("gamma_correction", requested.gammaCorrection, applied.gammaCorrection);
+    // A null speed of sound lets the sonar compute it from salinity.
+    if(requested.speedOfSound != 0.0)
+        check_value(requested.speedOfSound, applied.speedOfSound, 1.0e-3, "sound_speed");
+    return mismatches;
+}
+
+// Configuration of a sonar between the parameters and the sonar : requested
+// changes are merged until flush() hands the configuration to send, the
+// configuration echoed by the next pings is then checked against it by
+// check(), and check_timeout() (on a timer) concludes when the sonar did not
+// apply it in time, pings or not. All the methods can be called from
+// different threads.
+class SonarConfigTracker
+{
+    public:
+
+    using Config = SonarDriver::PingConfig;
+    using Clock  = std::chrono::steady_clock;
+
+    enum Feedback {
+        None,       // no configuration awaiting feedback
+        Waiting,    // the pings do not echo the sent configuration yet
+        Applied,    // the sonar applied the sent configuration
+        NotApplied, // still not applied after the feedback timeout
+    };
+
+    struct Statistics
+    {
+        uint64_t    configs_sent      = 0;
+        bool        awaiting_feedback = false;
+        uint64_t    missing_pings     = 0;     // during the last reconfiguration
+        bool        no_feedback       = false; // no ping before the feedback timeout
+        std::string mismatches;                // parameters not applied, comma separated
+        std::vector<ConfigMismatch> mismatch_details;
+    };
+
+    explicit SonarConfigTracker(double feedbackTimeout = 5.0) :
+        feedbackTimeout_(feedbackTimeout)
+    {
+        std::memset(&requested_, 0, sizeof(requested_));
+        sent_       = requested_;
+        lastEchoed_ = requested_;
+    }
+
+    void set_feedback_timeout(double timeout) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        feedbackTimeout_ = timeout;
+    }
+
+    // Replaces the requested configuration. Changes made before the next
+    // flush() are merged.
+    void request(const Config& config, bool isChange = true)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requested_ = config;
+        if(isChange)
+            changes_++;
+    }
+
+    // Returns the configuration to send and waits for its feedback. changes
+    // is set to the number of request() merged in it, missingPings is the
+    // total of missing pings so far (those missed until the feedback are
+    // counted).
+    Config flush(uint64_t missingPings, unsigned int& changes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        changes  = changes_;
+        changes_ = 0;
+        sent_        = requested_;
+        sentTime_    = Clock::now();
+        sentMissing_ = missingPings;
+        sentCount_++;
+        awaiting_    = true;
+        echoed_      = false;
+        return sent_;
+    }
+
+    // Checks the configuration echoed by a ping. elapsed is set to the time
+    // since the configuration was sent when the feedback is conclusive.
+    Feedback check(const OculusSimpleFireMessage& echoed, uint64_t missingPings,
+                   double& elapsed)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!awaiting_)
+            return None;
+        echoed_     = true;
+        lastEchoed_ = echoed;
+        elapsed = std::chrono::duration<double>(Clock::now() - sentTime_).count();
+        if(config_mismatches(sent_, echoed).empty()) {
+            awaiting_   = false;
+            noFeedback_ = false;
+            mismatches_.clear();
+            missingPings_ = missingPings - sentMissing_;
+            return Applied;
+        }
+        if(elapsed > feedbackTimeout_) {
+            this->conclude_not_applied();
+            return NotApplied;
+        }
+        return Waiting;
+    }
+
+    // Concludes when the configuration was not applied within the feedback
+    // timeout, even if no ping arrived meanwhile (the mismatches are those of
+    // the last ping received, if any). elapsed is set as by check().
+    Feedback check_timeout(double& elapsed)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!awaiting_)
+            return None;
+        elapsed = std::chrono::duration<double>(Clock::now() - sentTime_).count();
+        if(elapsed <= feedbackTimeout_)
+            return Waiting;
+        this->conclude_not_applied();
+        return NotApplied;
+    }
+
+    // Gives the sonar a new feedback timeout, for when it was not expected to
+    // ping (standby) since the configuration was sent.
+    void restart_feedback()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sentTime_ = Clock::now();
+    }
+
+    bool awaiting_feedback() const { return awaiting_; }
+
+    // Last configuration returned by flush(), the requested one if none was.
+    Config current() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sentCount_ > 0 ? sent_ : requested_;
+    }
+
+    Statistics statistics() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Statistics stats;
+        stats.configs_sent      = sentCount_;
+        stats.awaiting_feedback = awaiting_;
+        stats.missing_pings     = missingPings_;
+        stats.no_feedback       = noFeedback_;
+        stats.mismatch_details  = mismatches_;
+        for(const auto& mismatch : mismatches_) {
+            stats.mismatches += (stats.mismatches.empty() ? "" : ", ") + mismatch.name;
+        }
+        return stats;
+    }
+
+    protected:
+
+    mutable std::mutex mutex_;
+    double             feedbackTimeout_;
+    Config             requested_;
+    Config             sent_;
+    unsigned int       changes_      = 0;
+    Clock::time_point  sentTime_;
+    uint64_t           sentMissing_  = 0;
+    uint64_t           missingPings_ = 0;
+    uint64_t           sentCount_    = 0;
+    bool               echoed_       = false; // a ping was checked since flush()
+    Config             lastEchoed_;
+    bool               noFeedback_   = false;
+    std::vector<ConfigMismatch> mismatches_;
+    std::atomic<bool>  awaiting_{false};
+
+    // mutex_ must be held.
+    void conclude_not_applied()
+    {
+        awaiting_   = false;
+        noFeedback_ = !echoed_;
+        mismatches_.clear();
+        if(echoed_)
+            mismatches_ = config_mismatches(sent_, lastEchoed_);
+    }
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_SONAR_CONFIG_H_
@@ -0,0 +1,475 @@
+#include "sonar_mosaic.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "ping_layout.h"
+
+namespace oculus {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char TileMagic[4] = {'O', 'M', 'T', '1'};
+
+// Segments of the fan border used to bound it in the map frame.
+constexpr unsigned int FanBorderSegments = 32;
+
+// Coordinates beyond this are a broken pose, not a survey.
+constexpr double MaxCoordinate = 1.0e8;
+
+int64_t floor_div(int64_t value, int64_t divisor)
+{
+    int64_t quotient = value / divisor;
+    return (value % divisor != 0 && value < 0) ? quotient - 1 : quotient;
+}
+
+void write_all(int fd, struct iovec* chunks, int count, const std::string& filename)
+{
+    int index = 0;
+    while(index < count) {
+        ssize_t written = writev(fd, chunks + index, count - index);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            throw std::runtime_error("Could not write to '" + filename + "' : " + std::strerror(errno));
+        }
+        // Partial write, skipping what was written.
+        while(index < count && static_cast<size_t>(written) >= chunks[index].iov_len) {
+            written -= chunks[index].iov_len;
+            index++;
+        }
+        if(index < count) {
+            chunks[index].iov_base = static_cast<uint8_t*>(chunks[index].iov_base) + written;
+            chunks[index].iov_len -= written;
+        }
+    }
+}
+
+} //namespace
+
+SonarMosaic::Pose SonarMosaic::Pose::from_quaternion(double x, double y, double z,
+                                                     double qx, double qy, double qz, double qw)
+{
+    Pose pose;
+    double norm = std::sqrt(qx*qx + qy*qy + qz*qz + qw*qw);
+    if(norm > 0.0) {
+        qx /= norm; qy /= norm; qz /= norm; qw /= norm;
+        pose.rotation[0] = 1.0 - 2.0*(qy*qy + qz*qz);
+        pose.rotation[1] = 2.0*(qx*qy - qz*qw);
+        pose.rotation[2] = 2.0*(qx*qz + qy*qw);
+        pose.rotation[3] = 2.0*(qx*qy + qz*qw);
+        pose.rotation[4] = 1.0 - 2.0*(qx*qx + qz*qz);
+        pose.rotation[5] = 2.0*(qy*qz - qx*qw);
+        pose.rotation[6] = 2.0*(qx*qz - qy*qw);
+        pose.rotation[7] = 2.0*(qy*qz + qx*qw);
+        pose.rotation[8] = 1.0 - 2.0*(qx*qx + qy*qy);
+    }
+    pose.translation[0] = x;
+    pose.translation[1] = y;
+    pose.translation[2] = z;
+    return pose;
+}
+
+SonarMosaic::SonarMosaic(const Options& options) :
+    options_(options)
+{
+    if(!(options_.resolution > 0.0f) || options_.tile_size == 0) {
+        throw std::runtime_error("SonarMosaic : resolution and tile_size must be positive.");
+    }
+    options_.max_tiles = std::max(1u, options_.max_tiles);
+
+    unsigned int threads = options_.threads;
+    if(threads == 0)
+        threads = std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+    if(threads > 1)
+        pool_ = std::make_unique<WorkStealingPool>(threads);
+
+    if(!options_.directory.empty()) {
+        fs::create_directories(options_.directory);
+        this->index_directory();
+    }
+}
+
+SonarMosaic::~SonarMosaic()
+{
+}
+
+bool SonarMosaic::update_bearings(const int16_t* bearings, unsigned int nBeams)
+{
+    if(bearings_.size() == nBeams
+       && std::memcmp(bearings_.data(), bearings, nBeams*sizeof(int16_t)) == 0)
+        return true;
+
+    bearings_.resize(nBeams);
+    std::memcpy(bearings_.data(), bearings, nBeams*sizeof(int16_t));
+
+    // Sines in increasing order, beams may be given either way.
+    std::vector<float> sines(nBeams);
+    bool ascending = bearings_.back() > bearings_.front();
+    for(unsigned int i = 0; i < nBeams; i++) {
+        unsigned int b = ascending ? i : nBeams - 1 - i;
+        sines[i] = std::sin(bearings_[b]*(0.01*M_PI / 180.0));
+        if(i > 0 && !(sines[i] > sines[i - 1])) {
+            bearings_.clear();
+            return false;
+        }
+    }
+
+    sinMin_ = sines.front();
+    sinMax_ = sines.back();
+    bearingLut_.resize(BearingLutSize);
+    unsigned int j = 0;
+    for(unsigned int i = 0; i < BearingLutSize; i++) {
+        float s = sinMin_ + (sinMax_ - sinMin_)*i / (BearingLutSize - 1);
+        while(j + 2 < nBeams && sines[j + 1] < s)
+            j++;
+        float t = std::clamp((s - sines[j]) / (sines[j + 1] - sines[j]), 0.0f, 1.0f);
+        float beam = j + t;
+        bearingLut_[i] = ascending ? beam : (nBeams - 1) - beam;
+    }
+    return true;
+}
+
+size_t SonarMosaic::integrate(const OculusSimplePingResult& metadata,
+                              const std::vector<uint8_t>& data,
+                              const Pose& pose, double stamp)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    PingLayout layout(metadata, data);
+    if(!layout.is_valid() || !(metadata.rangeResolution > 0.0)
+       || !this->update_bearings(layout.bearings, layout.n_beams)
+       || !decoder_.decode(metadata, data, image_)) {
+        statistics_.rejected++;
+        return 0;
+    }
+
+    // Sonar image plane as seen in the mosaic plane.
+    const double* r = pose.rotation;
+    double det = r[0]*r[4] - r[1]*r[3];
+    const float fullRange = metadata.rangeResolution*(layout.n_ranges - 1);
+    const float maxRange  = options_.max_range > 0.0f ? std::min(options_.max_range, fullRange) : fullRange;
+    if(std::abs(det) < 1.0e-2 || !(maxRange > options_.min_range)
+       || !(std::abs(pose.translation[0]) < MaxCoordinate)
+       || !(std::abs(pose.translation[1]) < MaxCoordinate)) {
+        statistics_.rejected++;
+        return 0;
+    }
+
+    Projection projection;
+    projection.image              = image_.data();
+    projection.nBeams             = layout.n_beams;
+    projection.nRanges            = layout.n_ranges;
+    projection.invRangeResolution = 1.0f / metadata.rangeResolution;
+    projection.minRange2          = options_.min_range*options_.min_range;
+    projection.maxRange2          = maxRange*maxRange;
+    projection.sinMin             = sinMin_;
+    projection.lutScale           = (BearingLutSize - 1) / (sinMax_ - sinMin_);
+    projection.lutMax             = BearingLutSize - 1;
+    projection.inverse[0]         =  r[4] / det;
+    projection.inverse[1]         = -r[1] / det;
+    projection.inverse[2]         = -r[3] / det;
+    projection.inverse[3]         =  r[0] / det;
+    projection.translation[0]     = pose.translation[0];
+    projection.translation[1]     = pose.translation[1];
+
+    // Bounding box of the fan in the mosaic plane : apex and far border,
+    // padded by the sagitta of the border segments and by a cell.
+    double minX = pose.translation[0], maxX = minX;
+    double minY = pose.translation[1], maxY = minY;
+    const double firstBearing = bearings_.front()*(0.01*M_PI / 180.0);
+    const double lastBearing  = bearings_.back()*(0.01*M_PI / 180.0);
+    const double step = (lastBearing - firstBearing) / FanBorderSegments;
+    for(unsigned int i = 0; i <= FanBorderSegments; i++) {
+        double bearing = firstBearing + i*step;
+        double xs =  maxRange*std::cos(bearing);
+        double ys = -maxRange*std::sin(bearing);
+        double x = r[0]*xs + r[1]*ys + pose.translation[0];
+        double y = r[3]*xs + r[4]*ys + pose.translation[1];
+        minX = std::min(minX, x); maxX = std::max(maxX, x);
+        minY = std::min(minY, y); maxY = std::max(maxY, y);
+    }
+    const double resolution = options_.resolution;
+    const double padding = maxRange*(1.0 - std::cos(0.5*step)) + resolution;
+    const int64_t size = options_.tile_size;
+    const int64_t cellX0 = std::floor((minX - padding) / resolution);
+    const int64_t cellX1 = std::floor((maxX + padding) / resolution);
+    const int64_t cellY0 = std::floor((minY - padding) / resolution);
+    const int64_t cellY1 = std::floor((maxY + padding) / resolution);
+
+    // Tiles overlapping the box and within maxRange of the apex.
+    candidates_.clear();
+    const double tileWidth = size*resolution;
+    for(int64_t ty = floor_div(cellY0, size); ty <= floor_div(cellY1, size); ty++) {
+        for(int64_t tx = floor_div(cellX0, size); tx <= floor_div(cellX1, size); tx++) {
+            double dx = std::clamp(pose.translation[0], tx*tileWidth, (tx + 1)*tileWidth) - pose.translation[0];
+            double dy = std::clamp(pose.translation[1], ty*tileWidth, (ty + 1)*tileWidth) - pose.translation[1];
+            if(dx*dx + dy*dy > static_cast<double>(maxRange)*maxRange)
+                continue;
+            Candidate candidate;
+            candidate.x      = tx;
+            candidate.y      = ty;
+            auto found       = tiles_.find(key(tx, ty));
+            candidate.tile   = found != tiles_.end() ? found->second.get() : nullptr;
+            candidate.stored = !candidate.tile && stored_.count(key(tx, ty)) > 0;
+            candidate.cellX0 = std::max<int64_t>(cellX0 - tx*size, 0);
+            candidate.cellX1 = std::min<int64_t>(cellX1 - tx*size + 1, size);
+            candidate.cellY0 = std::max<int64_t>(cellY0 - ty*size, 0);
+            candidate.cellY1 = std::min<int64_t>(cellY1 - ty*size + 1, size);
+            candidate.cells  = 0;
+            candidates_.push_back(std::move(candidate));
+        }
+    }
+
+    if(pool_ && candidates_.size() > 1) {
+        for(auto& candidate : candidates_) {
+            pool_->submit([this, &projection, &candidate]() {
+                this->project(projection, candidate);
+            });
+        }
+        pool_->wait_idle();
+    }
+    else {
+        for(auto& candidate : candidates_)
+            this->project(projection, candidate);
+    }
+
+    statistics_.pings++;
+    size_t cells = 0;
+    for(auto& candidate : candidates_) {
+        if(candidate.created) {
+            candidate.tile = candidate.created.get();
+            tiles_.emplace(key(candidate.x, candidate.y), std::move(candidate.created));
+            if(candidate.stored)
+                statistics_.loads++;
+        }
+        if(candidate.cells > 0) {
+            candidate.tile->dirty      = true;
+            candidate.tile->stamp      = stamp;
+            candidate.tile->lastUpdate = statistics_.pings;
+            cells += candidate.cells;
+        }
+    }
+    this->evict();
+
+    statistics_.last_cells    = cells;
+    statistics_.last_duration = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    return cells;
+}
+
+void SonarMosaic::project(const Projection& p, Candidate& candidate) const
+{
+    const int    size       = options_.tile_size;
+    const double resolution = options_.resolution;
+    const float  stepX      = p.inverse[0]*resolution;
+    const float  stepY      = p.inverse[2]*resolution;
+    const float* lut        = bearingLut_.data();
+    const unsigned int lastBeam  = p.nBeams  - 2;
+    const unsigned int lastRange = p.nRanges - 2;
+
+    Tile* tile = candidate.tile;
+    for(int cy = candidate.cellY0; cy < candidate.cellY1; cy++) {
+        // Row start in double (map coordinates can be large), steps along
+        // the row in float.
+        double x = (static_cast<double>(candidate.x)*size + candidate.cellX0 + 0.5)*resolution - p.translation[0];
+        double y = (static_cast<double>(candidate.y)*size + cy + 0.5)*resolution - p.translation[1];
+        float xs = p.inverse[0]*x + p.inverse[1]*y;
+        float ys = p.inverse[2]*x + p.inverse[3]*y;
+        for(int cx = candidate.cellX0; cx < candidate.cellX1; cx++, xs += stepX, ys += stepY) {
+            float range2 = xs*xs + ys*ys;
+            if(xs <= 0.0f || range2 < p.minRange2 || range2 > p.maxRange2)
+                continue;
+            float range = std::sqrt(range2);
+            float u = (-ys / range - p.sinMin)*p.lutScale;
+            if(!(u >= 0.0f && u <= p.lutMax))
+                continue;
+
+            float beam  = lut[static_cast<unsigned int>(u + 0.5f)];
+            float row   = range*p.invRangeResolution;
+            unsigned int b0 = std::min(static_cast<unsigned int>(beam), lastBeam);
+            unsigned int r0 = std::min(static_cast<unsigned int>(row),  lastRange);
+            float wb = beam - b0;
+            float wr = row  - r0;
+            const float* sample = p.image + r0*p.nBeams + b0;
+            float near  = sample[0] + wb*(sample[1] - sample[0]);
+            float far   = sample[p.nBeams] + wb*(sample[p.nBeams + 1] - sample[p.nBeams]);
+            float value = near + wr*(far - near);
+
+            if(!tile) {
+                candidate.created = this->make_tile(candidate.x, candidate.y, candidate.stored);
+                tile = candidate.created.get();
+            }
+            Cell& cell = tile->cells[cy*size + cx];
+            cell.sum    += value;
+            cell.weight += 1.0f;
+            candidate.cells++;
+        }
+    }
+}
+
+std::unique_ptr<SonarMosaic::Tile> SonarMosaic::make_tile(int32_t x, int32_t y, bool stored) const
+{
+    auto tile = std::make_unique<Tile>();
+    tile->x = x;
+    tile->y = y;
+    tile->cells.assign(static_cast<size_t>(options_.tile_size)*options_.tile_size, Cell{0.0f, 0.0f});
+    if(stored)
+        this->read_tile(*tile);
+    return tile;
+}
+
+void SonarMosaic::evict()
+{
+    if(tiles_.size() <= options_.max_tiles)
+        return;
+
+    // Dirty tiles are kept until they have been handed out.
+    std::vector<std::pair<uint64_t, uint64_t>> clean; // lastUpdate, key
+    for(const auto& entry : tiles_) {
+        if(!entry.second->dirty)
+            clean.emplace_back(entry.second->lastUpdate, entry.first);
+    }
+    size_t count = std::min(tiles_.size() - options_.max_tiles, clean.size());
+    std::partial_sort(clean.begin(), clean.begin() + count, clean.end());
+    for(size_t i = 0; i < count; i++) {
+        auto found = tiles_.find(clean[i].second);
+        if(!options_.directory.empty()) {
+            this->write_tile(*found->second);
+            stored_.insert(found->first);
+        }
+        tiles_.erase(found);
+        statistics_.evictions++;
+    }
+}
+
+void SonarMosaic::take_dirty(const std::function<void(const Tile&)>& f)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(auto& entry : tiles_) {
+        if(entry.second->dirty) {
+            f(*entry.second);
+            entry.second->dirty = false;
+        }
+    }
+}
+
+size_t SonarMosaic::save()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(options_.directory.empty())
+        return 0;
+    for(const auto& entry : tiles_) {
+        this->write_tile(*entry.second);
+        stored_.insert(entry.first);
+    }
+    return tiles_.size();
+}
+
+SonarMosaic::Statistics SonarMosaic::statistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Statistics statistics     = statistics_;
+    statistics.resident_tiles = tiles_.size();
+    statistics.stored_tiles   = stored_.size();
+    return statistics;
+}
+
+std::string SonarMosaic::tile_path(int32_t x, int32_t y) const
+{
+    return (fs::path(options_.directory) / ("tile_" + std::to_string(x) + "_"
+                                            + std::to_string(y) + ".mosaic")).string();
+}
+
+void SonarMosaic::write_tile(const Tile& tile) const
+{
+    TileFileHeader header;
+    std::memcpy(header.magic, TileMagic, sizeof(header.magic));
+    header.tile_size  = options_.tile_size;
+    header.resolution = options_.resolution;
+    header.x          = tile.x;
+    header.y          = tile.y;
+    header.reserved   = 0;
+
+    // Written aside then renamed, an interrupted write never leaves a
+    // truncated tile behind.
+    const std::string filename  = this->tile_path(tile.x, tile.y);
+    const std::string temporary = filename + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        throw std::runtime_error("Could not open '" + temporary + "' : " + std::strerror(errno));
+    }
+    struct iovec chunks[2] = {
+        {&header, sizeof(header)},
+        {const_cast<Cell*>(tile.cells.data()), tile.cells.size()*sizeof(Cell)},
+    };
+    try {
+        write_all(fd, chunks, 2, temporary);
+    }
+    catch(...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    if(std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        throw std::runtime_error("Could not rename '" + temporary + "' : " + std::strerror(errno));
+    }
+}
+
+void SonarMosaic::read_tile(Tile& tile) const
+{
+    const std::string filename = this->tile_path(tile.x, tile.y);
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw std::runtime_error("Could not open '" + filename + "' : " + std::strerror(errno));
+    }
+    TileFileHeader header;
+    const size_t cellsSize = tile.cells.size()*sizeof(Cell);
+    bool complete = ::pread(fd, &header, sizeof(header), 0) == sizeof(header)
+        && std::memcmp(header.magic, TileMagic, sizeof(header.magic)) == 0
+        && header.tile_size == options_.tile_size
+        && ::pread(fd, tile.cells.data(), cellsSize, sizeof(header)) == static_cast<ssize_t>(cellsSize);
+    ::close(fd);
+    if(!complete) {
+        throw std::runtime_error("'" + filename + "' is not a valid mosaic tile.");
+    }
+}
+
+void SonarMosaic::index_directory()
+{
+    for(const auto& entry : fs::directory_iterator(options_.directory)) {
+        const std::string name = entry.path().filename().string();
+        if(!entry.is_regular_file() || name.rfind("tile_", 0) != 0 || entry.path().extension() != ".mosaic")
+            continue;
+
+        TileFileHeader header;
+        int fd = ::open(entry.path().c_str(), O_RDONLY | O_CLOEXEC);
+        bool valid = fd >= 0 && ::read(fd, &header, sizeof(header)) == sizeof(header)
+            && std::memcmp(header.magic, TileMagic, sizeof(header.magic)) == 0;
+        if(fd >= 0)
+            ::close(fd);
+        if(!valid) {
+            throw std::runtime_error("'" + entry.path().string() + "' is not a valid mosaic tile.");
+        }
+        if(header.tile_size != options_.tile_size || header.resolution != options_.resolution) {
+            throw std::runtime_error("'" + entry.path().string() + "' belongs to a mosaic with another"
+                                     " resolution or tile size, use another directory.");
+        }
+        stored_.insert(key(header.x, header.y));
+    }
+}
+
+} //namespace oculus
@@ -0,0 +1,208 @@
+#ifndef _DEF_OCULUS_ROS_SONAR_MOSAIC_H_
+#define _DEF_OCULUS_ROS_SONAR_MOSAIC_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "beam_decoder.h"
+#include "work_stealing_pool.h"
+
+namespace oculus {
+
+// Incremental 2D mosaic of the pings in a fixed frame (the map frame), built
+// ping by ping during a survey.
+//
+// The mosaic lies in the z = 0 plane of the map frame, divided into square
+// tiles of tile_size x tile_size cells of resolution meters. A tile is only
+// allocated when a ping first covers it. Its cells are a single contiguous
+// block (row-major, size rows along y of size cells along x) holding the sum
+// and the weight of the intensities projected on each cell, the mosaic being
+// sum / weight.
+//
+// Pings are projected backwards : each cell of the area covered by the fan
+// is brought into the sonar image plane (z = 0 of the sonar frame, x
+// forward, y left) through the sonar pose and samples the decoded ping
+// (BeamDecoder, gain compensated intensities) bilinearly. Unlike splatting
+// the samples, this leaves no hole at long range where the beams diverge,
+// and each cell being written by a single task, the covered tiles are
+// projected in parallel without synchronization. The image plane is
+// projected as is on the mosaic plane, which is exact for a level sonar and
+// a good approximation for a small tilt.
+//
+// Tiles updated by a ping stay dirty until take_dirty() hands them out, so
+// that only those are republished (dirty tiles are never evicted, take_dirty()
+// has to be called regularly). When more than max_tiles tiles are in
+// memory, the least recently updated clean tiles are evicted to directory
+// and read back when a ping covers them again, so memory stays bounded
+// during long surveys. Tiles already in directory are picked up at
+// construction, which resumes an interrupted survey. Tile files are named
+// tile_<x>_<y>.mosaic and hold a TileFileHeader followed by the cells.
+//
+// All the methods can be called from different threads.
+class SonarMosaic
+{
+    public:
+
+    struct Options
+    {
+        float        resolution = 0.1f; // meters per cell
+        unsigned int tile_size  = 128;  // cells per tile side
+        float        min_range  = 0.5f; // meters, skips the near field
+        float        max_range  = 0.0f; // meters, 0 for the full ping range
+        unsigned int max_tiles  = 256;  // tiles in memory before eviction
+        std::string  directory;         // evicted tiles, empty : dropped
+        unsigned int threads    = 0;    // 0 for the number of cores, up to 4
+    };
+
+    // Sonar frame to map frame : p_map = rotation*p_sonar + translation,
+    // rotation being row-major.
+    struct Pose
+    {
+        double rotation[9]    = {1.0, 0.0, 0.0,
+                                 0.0, 1.0, 0.0,
+                                 0.0, 0.0, 1.0};
+        double translation[3] = {0.0, 0.0, 0.0};
+
+        static Pose from_quaternion(double x, double y, double z,
+                                    double qx, double qy, double qz, double qw);
+    };
+
+    struct Cell
+    {
+        float sum;
+        float weight; // number of pings projected on the cell
+    };
+
+    struct Tile
+    {
+        int32_t           x; // the tile covers [x*size, (x + 1)*size[ cells along x
+        int32_t           y;
+        std::vector<Cell> cells;
+        double            stamp      = 0.0; // time of the last ping which updated it
+        uint64_t          lastUpdate = 0;   // ping count at that time
+        bool              dirty      = false;
+    };
+
+    struct TileFileHeader
+    {
+        char     magic[4]; // "OMT1"
+        uint32_t tile_size;
+        float    resolution;
+        int32_t  x;
+        int32_t  y;
+        uint32_t reserved;
+    };
+
+    struct Statistics
+    {
+        uint64_t pings          = 0; // integrated
+        uint64_t rejected       = 0; // malformed or seen edge-on
+        uint64_t last_cells     = 0; // cells updated by the last ping
+        uint64_t resident_tiles = 0;
+        uint64_t stored_tiles   = 0; // in directory
+        uint64_t evictions      = 0;
+        uint64_t loads          = 0;
+        double   last_duration  = 0.0; // seconds spent in the last integrate()
+    };
+
+    explicit SonarMosaic(const Options& options);
+    ~SonarMosaic();
+
+    SonarMosaic(const SonarMosaic&)            = delete;
+    SonarMosaic& operator=(const SonarMosaic&) = delete;
+
+    // Projects a ping at its sonar pose and returns the number of cells it
+    // updated. Returns 0 if the ping is malformed or if its image plane is
+    // seen edge-on from the mosaic plane. Throws std::runtime_error if a tile
+    // cannot be written to or read from directory.
+    size_t integrate(const OculusSimplePingResult& metadata,
+                     const std::vector<uint8_t>& data,
+                     const Pose& pose, double stamp);
+
+    // Calls f on each tile updated since the last call and clears their
+    // dirty flag. Tiles cannot be kept beyond the call.
+    void take_dirty(const std::function<void(const Tile&)>& f);
+
+    // Writes all the tiles in memory to directory (on shutdown, directory
+    // then holds the whole mosaic). Returns the number of tiles written.
+    size_t save();
+
+    Statistics statistics() const;
+    const Options& options() const { return options_; }
+
+    protected:
+
+    // A tile overlapped by the fan of the ping being projected. Tasks only
+    // write in their own Candidate, tiles are allocated or loaded by the task
+    // on the first cell hit and inserted in tiles_ once all tasks are done.
+    struct Candidate
+    {
+        int32_t               x;
+        int32_t               y;
+        Tile*                 tile;
+        std::unique_ptr<Tile> created;
+        bool                  stored;
+        int                   cellX0, cellX1, cellY0, cellY1; // in tile cells, end excluded
+        size_t                cells;
+    };
+
+    // Ping geometry of the projection. Fractional beam indexes are looked up
+    // from the sine of the bearing, which avoids an atan2 per cell.
+    struct Projection
+    {
+        const float* image = nullptr;
+        unsigned int nBeams = 0;
+        unsigned int nRanges = 0;
+        float invRangeResolution = 0.0f;
+        float minRange2 = 0.0f;
+        float maxRange2 = 0.0f;
+        float sinMin = 0.0f;
+        float lutScale = 0.0f;
+        float lutMax = 0.0f;
+        // Map plane to sonar plane : sonar = inverse*(map - translation)
+        double inverse[4];
+        double translation[2];
+    };
+
+    static constexpr unsigned int BearingLutSize = 4096;
+
+    Options                          options_;
+    mutable std::mutex               mutex_;
+    std::unique_ptr<WorkStealingPool> pool_;
+    BeamDecoder                      decoder_;
+    std::vector<float>               image_;
+    std::vector<int16_t>             bearings_;   // bearings the lut was built for
+    std::vector<float>               bearingLut_; // sine of bearing -> fractional beam
+    float                            sinMin_ = 0.0f;
+    float                            sinMax_ = 0.0f;
+
+    std::unordered_map<uint64_t, std::unique_ptr<Tile>> tiles_;
+    std::unordered_set<uint64_t>     stored_;
+    std::vector<Candidate>           candidates_;
+    Statistics                       statistics_;
+
+    static uint64_t key(int32_t x, int32_t y) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+    }
+
+    bool update_bearings(const int16_t* bearings, unsigned int nBeams);
+    void project(const Projection& projection, Candidate& candidate) const;
+    std::unique_ptr<Tile> make_tile(int32_t x, int32_t y, bool stored) const;
+    std::string tile_path(int32_t x, int32_t y) const;
+    void write_tile(const Tile& tile) const;
+    void read_tile(Tile& tile) const;
+    void index_directory();
+    void evict();
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_SONAR_MOSAIC_H_
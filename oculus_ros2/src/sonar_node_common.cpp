@@ -0,0 +1,629 @@
+#include "sonar_node_common.hpp"
+
+#include <cstring>
+#include <sstream>
+
+#include "addressed_sonar_driver.h"
+
+#include "rcl_interfaces/msg/parameter_descriptor.hpp"
+
+namespace oculus {
+
+ConfigParameters declare_ping_config_parameters(rclcpp::Node& node, const std::string& prefix)
+{
+    if (!node.has_parameter(prefix + "frequency_mode")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(1).set__to_value(2).set__step(1);
+        param_desc.name = prefix + "frequency_mode";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Sonar beam frequency mode.\n\t1: Low frequency (1.2MHz, wide aperture).\n\t2: High frequency (2.1Mhz, narrow aperture).";
+        param_desc.integer_range = {range};
+        node.declare_parameter<int>(prefix + "frequency_mode", 1, param_desc);
+    }
+    if (!node.has_parameter(prefix + "ping_rate")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(0).set__to_value(5).set__step(1);
+        param_desc.name = prefix + "ping_rate";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Frequency of ping fires.\n\t0: 10Hz max ping rate.\n\t1: 15Hz max ping rate.\n\t2: 40Hz max ping rate.\n\t3: 5Hz max ping rate.\n\t4: 2Hz max ping rate.\n\t5: Standby mode (no ping fire).";
+        param_desc.integer_range = {range};
+        node.declare_parameter<int>(prefix + "ping_rate", 0, param_desc);
+    }
+    if (!node.has_parameter(prefix + "data_depth")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(0).set__to_value(1).set__step(1);
+        param_desc.name = prefix + "data_depth";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Ping data encoding bit count.\n\t0: Ping data encoded on 8bits.\n\t1: Ping data encoded on 16bits.";
+        param_desc.integer_range = {range};
+        node.declare_parameter<int>(prefix + "data_depth", 0, param_desc);
+    }
+    if (!node.has_parameter(prefix + "nbeams")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(0).set__to_value(1).set__step(1);
+        param_desc.name = prefix + "nbeams";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Number of ping beams.\n\t0: Oculus outputs 256 beams.\n\t1: Oculus outputs 512 beams.";
+        param_desc.integer_range = {range};
+        node.declare_parameter<int>(prefix + "nbeams", 0, param_desc);
+    }
+    if (!node.has_parameter(prefix + "send_gain")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = prefix + "send_gain";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Send range gain with data.";
+        node.declare_parameter<bool>(prefix + "send_gain", false, param_desc);
+    }
+    if (!node.has_parameter(prefix + "gain_assist")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = prefix + "gain_assist";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Enable auto gain.";
+        node.declare_parameter<bool>(prefix + "gain_assist", false, param_desc);
+    }
+    if (!node.has_parameter(prefix + "range")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.3).set__to_value(40.0).set__step(0.1);
+        param_desc.name = prefix + "range";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Sonar range (in meters), min=0.3, max=40.0.";
+        param_desc.floating_point_range = {range};
+        node.declare_parameter<double>(prefix + "range", 3.0, param_desc);
+    }
+    if (!node.has_parameter(prefix + "gamma_correction")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::IntegerRange range;
+        range.set__from_value(0).set__to_value(255).set__step(1);
+        param_desc.name = prefix + "gamma_correction";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_INTEGER;
+        param_desc.description = "Gamma correction, min=0, max=255.";
+        param_desc.integer_range = {range};
+        node.declare_parameter<int>(prefix + "gamma_correction", 127, param_desc);
+    }
+    if (!node.has_parameter(prefix + "gain_percent")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.1).set__to_value(100.0).set__step(0.1);
+        param_desc.name = prefix + "gain_percent";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Gain percentage (%), min=0.1, max=100.0.";
+        param_desc.floating_point_range = {range};
+        node.declare_parameter<double>(prefix + "gain_percent", 50.0, param_desc);
+    }
+    if (!node.has_parameter(prefix + "sound_speed")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(1600.0).set__step(0.1); // min = 1400.0 but must include 0.0 for configuration
+        param_desc.name = prefix + "sound_speed";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Sound speed (in m/s, set to 0 for it to be calculated using salinity), min=1400.0, max=1600.0.";
+        param_desc.floating_point_range = {range};
+        node.declare_parameter<double>(prefix + "sound_speed", 0.0, param_desc);
+    }
+    if (!node.has_parameter(prefix + "use_salinity")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        param_desc.name = prefix + "use_salinity";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_BOOL;
+        param_desc.description = "Use salinity to calculate sound_speed.";
+        node.declare_parameter<bool>(prefix + "use_salinity", true, param_desc);
+    }
+    if (!node.has_parameter(prefix + "salinity")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(100.0).set__step(0.1);
+        param_desc.name = prefix + "salinity";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Salinity (in parts per thousand (ppt,ppm,g/kg), used to calculate sound speed if needed), min=0.0, max=100";
+        param_desc.floating_point_range = {range};
+        node.declare_parameter<double>(prefix + "salinity", 0.0, param_desc);
+    }
+
+    ConfigParameters parameters;
+    for(const auto& name : {"frequency_mode", "ping_rate", "data_depth", "nbeams", "send_gain",
+                            "gain_assist", "range", "gamma_correction", "gain_percent",
+                            "sound_speed", "use_salinity", "salinity"}) {
+        parameters.emplace(name, node.get_parameter(prefix + name));
+    }
+    return parameters;
+}
+
+SonarDriver::PingConfig make_ping_config(const ConfigParameters& parameters, std::string& errors)
+{
+    SonarDriver::PingConfig config;
+    std::memset(&config, 0, sizeof(config));
+    // flags
+    config.flags = 0x09; // always in meters, simple ping
+
+    config.masterMode = parameters.at("frequency_mode").as_int();
+    switch(parameters.at("ping_rate").as_int())
+    {
+        case 0: config.pingRate = pingRateNormal;  break; // 10Hz
+        case 1: config.pingRate = pingRateHigh;    break; // 15Hz
+        case 2: config.pingRate = pingRateHighest; break; // 40Hz
+        case 3: config.pingRate = pingRateLow;     break; // 5Hz
+        case 4: config.pingRate = pingRateLowest;  break; // 2Hz
+        case 5: config.pingRate = pingRateStandby; break; // standby mode
+        default:break;
+    }
+    if(parameters.at("data_depth").as_int() == 1) // 16 bits
+        config.flags |= 0x02;
+    if(parameters.at("nbeams").as_int() == 1) // 512 beams
+        config.flags |= 0x40;
+    if(parameters.at("send_gain").as_bool())
+        config.flags |= 0x04;
+    if(parameters.at("gain_assist").as_bool())
+        config.flags |= 0x10;
+    config.range           = parameters.at("range").as_double();
+    config.gammaCorrection = parameters.at("gamma_correction").as_int();
+    config.gainPercent     = parameters.at("gain_percent").as_double();
+    config.salinity        = parameters.at("salinity").as_double();
+    if(parameters.at("use_salinity").as_bool()) {
+        config.speedOfSound = 0.0;
+    }
+    else {
+        config.speedOfSound = parameters.at("sound_speed").as_double();
+        if(config.speedOfSound < 1400.0 || config.speedOfSound > 1600.0) {
+            errors.append("sound_speed: must be between 1400.0 and 1600.0 m/s when use_salinity is false.\n");
+        }
+    }
+    return config;
+}
+
+SupervisorOptions declare_supervisor_parameters(rclcpp::Node& node)
+{
+    if (!node.has_parameter("standby_delay")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(-1.0).set__to_value(3600.0).set__step(0.0);
+        param_desc.name = "standby_delay";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Time (in seconds) without subscriber to any ping output of a sonar before putting it in standby (negative to never standby).";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        node.declare_parameter<double>("standby_delay", 2.0, param_desc);
+    }
+    if (!node.has_parameter("config.coalesce_delay")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.0).set__to_value(5.0).set__step(0.0);
+        param_desc.name = "config.coalesce_delay";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Delay (in seconds) during which sonar parameter changes are merged before being sent to the sonar.";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        node.declare_parameter<double>("config.coalesce_delay", 0.05, param_desc);
+    }
+    if (!node.has_parameter("config.feedback_timeout")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.1).set__to_value(60.0).set__step(0.0);
+        param_desc.name = "config.feedback_timeout";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Time (in seconds) given to the sonar to apply a configuration before reporting mismatching parameters.";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        node.declare_parameter<double>("config.feedback_timeout", 5.0, param_desc);
+    }
+    if (!node.has_parameter("connection.timeout")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.1).set__to_value(60.0).set__step(0.0);
+        param_desc.name = "connection.timeout";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Time (in seconds) without message from the sonar before the connection is considered lost.";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        node.declare_parameter<double>("connection.timeout", 2.0, param_desc);
+    }
+    if (!node.has_parameter("connection.backoff_initial")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.01).set__to_value(60.0).set__step(0.0);
+        param_desc.name = "connection.backoff_initial";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Delay (in seconds) between the first reconnection attempts, doubled after each attempt.";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        node.declare_parameter<double>("connection.backoff_initial", 0.5, param_desc);
+    }
+    if (!node.has_parameter("connection.backoff_max")) {
+        rcl_interfaces::msg::ParameterDescriptor param_desc;
+        rcl_interfaces::msg::FloatingPointRange range;
+        range.set__from_value(0.01).set__to_value(600.0).set__step(0.0);
+        param_desc.name = "connection.backoff_max";
+        param_desc.type = rclcpp::ParameterType::PARAMETER_DOUBLE;
+        param_desc.description = "Maximum delay (in seconds) between two reconnection attempts.";
+        param_desc.floating_point_range = {range};
+        param_desc.read_only = true;
+        node.declare_parameter<double>("connection.backoff_max", 10.0, param_desc);
+    }
+
+    SupervisorOptions options;
+    options.standby_delay              = node.get_parameter("standby_delay").as_double();
+    options.coalesce_delay             = node.get_parameter("config.coalesce_delay").as_double();
+    options.feedback_timeout           = node.get_parameter("config.feedback_timeout").as_double();
+    options.connection.timeout         = node.get_parameter("connection.timeout").as_double();
+    options.connection.backoff_initial = node.get_parameter("connection.backoff_initial").as_double();
+    options.connection.backoff_max     = node.get_parameter("connection.backoff_max").as_double();
+    return options;
+}
+
+template <typename Driver>
+SonarSupervisor<Driver>::SonarSupervisor(rclcpp::Node& node, const std::string& name,
+                                         const std::string& prefix,
+                                         const SupervisorOptions& options,
+                                         const SonarPipeline& pipeline,
+                                         const std::shared_ptr<Driver>& driver,
+                                         const IoServicePtr& service) :
+    node_(node),
+    logPrefix_(name.empty() ? "" : name + " : "),
+    prefix_(prefix),
+    options_(options),
+    pipeline_(pipeline),
+    driver_(driver),
+    service_(service),
+    configTracker_(options.feedback_timeout),
+    lastWanted_(std::chrono::steady_clock::now())
+{
+    this->configParameters_ = declare_ping_config_parameters(node, prefix);
+    std::string errors;
+    this->configTracker_.request(make_ping_config(this->configParameters_, errors), false);
+    if(!errors.empty()) {
+        RCLCPP_WARN_STREAM(node.get_logger(), logPrefix_ << "Invalid sonar configuration : " << errors);
+    }
+    if(!driver)
+        return;
+
+    this->configTimer_ = node.create_wall_timer(std::chrono::duration<double>(options.coalesce_delay),
+        std::bind(&SonarSupervisor::flush_config, this));
+    this->configTimer_->cancel();
+    // The constructor does not wait for the sonar : the configuration is
+    // applied once it is heard of.
+    this->connection_ = std::make_unique<ConnectionMonitor>(options.connection);
+    this->connectionTimer_ = node.create_wall_timer(std::chrono::milliseconds(100),
+        std::bind(&SonarSupervisor::supervise_connection, this));
+}
+
+template <typename Driver>
+rcl_interfaces::msg::SetParametersResult SonarSupervisor<Driver>::set_parameters(
+    const std::vector<rclcpp::Parameter>& parameters)
+{
+    rcl_interfaces::msg::SetParametersResult result;
+    result.successful = true;
+    result.reason = "";
+
+    // Changes are merged with the current values of all the configuration
+    // parameters, so the sonar always receives a complete configuration.
+    ConfigParameters merged = this->configParameters_;
+    std::vector<const rclcpp::Parameter*> changes;
+    for(const rclcpp::Parameter& param : parameters) {
+        if(param.get_name().compare(0, prefix_.size(), prefix_) != 0)
+            continue;
+        auto it = merged.find(param.get_name().substr(prefix_.size()));
+        if(it == merged.end())
+            continue;
+        it->second = param;
+        changes.push_back(&param);
+    }
+    if(changes.empty())
+        return result;
+
+    std::string errors;
+    auto config = make_ping_config(merged, errors);
+    if(!errors.empty()) {
+        result.successful = false;
+        result.reason     = errors;
+        return result;
+    }
+    for(auto param : changes) {
+        RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "Updating " << param->get_name()
+                           << " to " << param->value_to_string() << ".");
+    }
+    this->configParameters_ = merged;
+
+    if(!driver_) {
+        // Replaying a log, there is no sonar to configure.
+        return result;
+    }
+
+    // The configuration is sent by flush_config once the burst of parameter
+    // changes is over (the timer restarts on each change), the sonar
+    // feedback is checked on the next pings.
+    this->configTracker_.request(config);
+    this->configTimer_->reset();
+    return result;
+}
+
+template <typename Driver>
+void SonarSupervisor<Driver>::flush_config()
+{
+    this->configTimer_->cancel();
+
+    unsigned int changes = 0;
+    auto config = this->configTracker_.flush(pipeline_.statistics().total().missing_pings, changes);
+    if(changes > 0) {
+        RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "Sending sonar configuration ("
+            << changes << " parameter updates merged)" << (this->standby_ ? ", in standby." : "."));
+    }
+    else {
+        RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "Sending sonar configuration"
+            << (this->standby_ ? ", in standby." : "."));
+    }
+    this->send_config(config);
+}
+
+template <typename Driver>
+void SonarSupervisor<Driver>::send_config(const SonarDriver::PingConfig& config)
+{
+    // Commands come from the executor (timers), the GraphWatcher and the
+    // driver callbacks : they are all run by the io_service thread of the
+    // driver, in order. The standby state is read when the command runs, so
+    // the last command sent always matches the last standby change.
+    boost::asio::post(*service_, [this, config]() {
+        auto toSend = config;
+        // Standby is a configuration like the others (the one requested
+        // with a standby ping rate) : a configuration sent while in standby
+        // does not wake the sonar up.
+        if(this->standby_)
+            toSend.pingRate = pingRateStandby;
+        driver_->send_ping_config(toSend);
+    });
+}
+
+template <typename Driver>
+void SonarSupervisor<Driver>::send_current_config()
+{
+    boost::asio::post(*service_, [this]() {
+        auto config = this->configTracker_.current();
+        if(this->standby_)
+            config.pingRate = pingRateStandby;
+        driver_->send_ping_config(config);
+    });
+}
+
+template <typename Driver>
+void SonarSupervisor<Driver>::check_feedback(const OculusSimplePingResult& ping)
+{
+    if(!this->configTracker_.awaiting_feedback())
+        return;
+
+    double elapsed = 0.0;
+    auto feedback = this->configTracker_.check(ping.fireMessage, pipeline_.statistics().total().missing_pings, elapsed);
+    this->report_feedback(feedback, elapsed);
+}
+
+template <typename Driver>
+void SonarSupervisor<Driver>::report_feedback(SonarConfigTracker::Feedback feedback, double elapsed)
+{
+    switch(feedback) {
+        case SonarConfigTracker::Applied:
+            RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "Sonar configuration applied after " << elapsed
+                << "s (" << this->configTracker_.statistics().missing_pings << " pings missing meanwhile).");
+            break;
+        case SonarConfigTracker::NotApplied: {
+            auto stats = this->configTracker_.statistics();
+            if(stats.no_feedback) {
+                RCLCPP_WARN_STREAM(node_.get_logger(), logPrefix_ << "No ping from the sonar "
+                    << elapsed << "s after sending the configuration, cannot tell whether it was applied.");
+                break;
+            }
+            std::ostringstream oss;
+            for(const auto& mismatch : stats.mismatch_details) {
+                oss << "\n  " << mismatch.name << " : requested " << mismatch.requested
+                    << ", applied " << mismatch.applied;
+            }
+            RCLCPP_WARN_STREAM(node_.get_logger(), logPrefix_ << "Sonar did not apply the configuration after "
+                << elapsed << "s, mismatching parameters :" << oss.str());
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+template <typename Driver>
+void SonarSupervisor<Driver>::update_outputs(bool wanted)
+{
+    this->pingsWanted_ = wanted;
+    if(!driver_ || options_.standby_delay < 0.0)
+        return;
+
+    // Resume as soon as someone subscribes, standby only after standby_delay
+    // without subscriber so that a restarting consumer does not make the
+    // sonar flap.
+    auto now = std::chrono::steady_clock::now();
+    if(wanted) {
+        this->lastWanted_ = now;
+        if(this->standby_) {
+            RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "Exiting standby mode.");
+            this->standby_ = false;
+            // A configuration sent in standby is only checked once the
+            // sonar pings again.
+            this->configTracker_.restart_feedback();
+            this->send_current_config();
+        }
+    }
+    else if(!this->standby_ && std::chrono::duration<double>(now - this->lastWanted_).count() >= options_.standby_delay) {
+        RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "No subscriber, going to standby mode.");
+        this->standby_ = true;
+        this->send_current_config();
+    }
+}
+
+template <typename Driver>
+void SonarSupervisor<Driver>::on_dummy()
+{
+    this->on_message();
+
+    // Dummy messages are sent while the sonar does not fire : resume if it was
+    // stopped while someone is listening (sonar restarted...).
+    if(this->pingsWanted_ && !this->standby_) {
+        this->send_current_config();
+    }
+}
+
+template <typename Driver>
+void SonarSupervisor<Driver>::supervise_connection()
+{
+    using Monitor = ConnectionMonitor;
+
+    const auto previous = this->connection_->state();
+    const auto action   = this->connection_->update(std::chrono::steady_clock::now(),
+                                                    this->pingsWanted_ && !this->standby_);
+    const auto stats    = this->connection_->statistics();
+    if(stats.state != previous) {
+        switch(stats.state) {
+            case Monitor::Configuring:
+                RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "Sonar connected, configuring.");
+                break;
+            case Monitor::Streaming:
+                if(previous == Monitor::Reconnecting) {
+                    RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "Sonar reconnected after "
+                        << stats.last_reconnect_duration << "s without data ("
+                        << stats.reconnects << " reconnections so far).");
+                }
+                else {
+                    RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "Sonar streaming, first ping "
+                        << stats.time_to_first_ping << "s after startup.");
+                }
+                break;
+            case Monitor::Lost:
+                RCLCPP_WARN_STREAM(node_.get_logger(), logPrefix_ << "Connection to the sonar lost (nothing received for "
+                    << this->connection_->options().timeout << "s).");
+                break;
+            default:
+                break;
+        }
+    }
+    else if(stats.state == Monitor::Discovering) {
+        RCLCPP_INFO_STREAM_THROTTLE(node_.get_logger(), *node_.get_clock(), 10000,
+            logPrefix_ << "Waiting for the Oculus sonar... Is it properly connected ?");
+    }
+
+    if(action == Monitor::ApplyConfig) {
+        if(stats.state == Monitor::Reconnecting) {
+            RCLCPP_INFO_STREAM(node_.get_logger(), logPrefix_ << "Reconnection attempt " << stats.attempts << ".");
+        }
+        // The sonar may have been power cycled : the cached configuration is
+        // sent again (with a standby ping rate if in standby).
+        this->flush_config();
+    }
+
+    // The feedback of a configuration is also concluded without ping (sonar
+    // ignoring it, or not pinging at all), except in standby.
+    if(!this->standby_) {
+        double elapsed = 0.0;
+        this->report_feedback(this->configTracker_.check_timeout(elapsed), elapsed);
+    }
+}
+
+template <typename Driver>
+bool SonarSupervisor<Driver>::add_diagnostics(diagnostic_msgs::msg::DiagnosticStatus& status) const
+{
+    using diagnostic_msgs::msg::DiagnosticStatus;
+
+    auto config = this->configTracker_.statistics();
+    add_diagnostic(status, "standby",              static_cast<int>(this->standby_));
+    add_diagnostic(status, "configs_sent_total",   config.configs_sent);
+    add_diagnostic(status, "config_pending",       static_cast<int>(config.awaiting_feedback));
+    add_diagnostic(status, "config_missing_pings", config.missing_pings);
+    if(!config.mismatches.empty()) {
+        add_diagnostic(status, "config_mismatches", config.mismatches);
+    }
+    // One entry per parameter not applied, for monitoring tools.
+    for(const auto& mismatch : config.mismatch_details) {
+        add_diagnostic(status, "config_mismatch." + mismatch.name,
+                       "requested " + mismatch.requested + ", applied " + mismatch.applied);
+    }
+    if(config.no_feedback) {
+        add_diagnostic(status, "config_no_feedback", 1);
+    }
+    if(!this->connection_)
+        return false;
+
+    auto connection = this->connection_->statistics();
+    add_diagnostic(status, "connection_state", std::string(ConnectionMonitor::state_name(connection.state)));
+    add_diagnostic(status, "connection_time_to_first_ping_s", connection.time_to_first_ping);
+    add_diagnostic(status, "connection_last_reconnect_s",     connection.last_reconnect_duration);
+    add_diagnostic(status, "connection_reconnects_total",     connection.reconnects);
+    add_diagnostic(status, "connection_reconnect_attempts",   connection.attempts);
+
+    if(connection.state != ConnectionMonitor::Streaming) {
+        status.level   = connection.state == ConnectionMonitor::Configuring
+                       ? DiagnosticStatus::WARN : DiagnosticStatus::ERROR;
+        status.message = std::string("Sonar ") + ConnectionMonitor::state_name(connection.state);
+        return true;
+    }
+    if(!config.mismatches.empty()) {
+        status.level   = DiagnosticStatus::WARN;
+        status.message = "Sonar configuration not applied";
+        return true;
+    }
+    if(config.no_feedback) {
+        status.level   = DiagnosticStatus::WARN;
+        status.message = "No sonar configuration feedback";
+        return true;
+    }
+    return false;
+}
+
+template class SonarSupervisor<SonarDriver>;
+template class SonarSupervisor<AddressedSonarDriver>;
+
+
+void GraphWatcher::start(rclcpp::Node& node, std::function<void()> update)
+{
+    if(watching_)
+        return;
+    watching_ = true;
+    thread_ = std::thread([this, &node, update]() {
+        auto event = node.get_graph_event();
+        while(watching_) {
+            update();
+            try {
+                node.wait_for_graph_change(event, std::chrono::milliseconds(200));
+            }
+            catch(const std::exception&) {
+                // The context is shutting down.
+                break;
+            }
+            event->check_and_clear();
+        }
+    });
+}
+
+void GraphWatcher::stop()
+{
+    watching_ = false;
+    if(thread_.joinable())
+        thread_.join();
+}
+
+void add_pipeline_diagnostics(diagnostic_msgs::msg::DiagnosticStatus& status,
+                              const PingStatistics::Report& report,
+                              const SonarPipeline& pipeline)
+{
+    add_diagnostic(status, "ping_rate_hz",      report.ping_rate());
+    add_diagnostic(status, "byte_rate_mbps",    1.0e-6*report.byte_rate());
+    add_diagnostic(status, "pings",             report.pings);
+    add_diagnostic(status, "ping_id_gaps",      report.gaps);
+    add_diagnostic(status, "missing_pings",     report.missing_pings);
+    add_diagnostic(status, "queue_size",        pipeline.ping_queue().size());
+    add_diagnostic(status, "queue_depth",       pipeline.ping_queue().depth());
+    add_diagnostic(status, "queue_drops_total", pipeline.ping_queue().dropped());
+    for(unsigned int i = 0; i < PingStatistics::StageCount; i++) {
+        const auto& stage = report.stages[i];
+        std::string name  = std::string("latency_") + PingStatistics::stage_name(
+            static_cast<PingStatistics::Stage>(i));
+        add_diagnostic(status, name + "_mean_us", 1.0e-3*stage.mean());
+        add_diagnostic(status, name + "_p50_us",  1.0e-3*stage.percentile(0.5));
+        add_diagnostic(status, name + "_p99_us",  1.0e-3*stage.percentile(0.99));
+    }
+}
+
+} //namespace oculus
@@ -0,0 +1,225 @@
+#ifndef _DEF_OCULUS_ROS_SONAR_NODE_COMMON_HPP_
+#define _DEF_OCULUS_ROS_SONAR_NODE_COMMON_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+
+#include <boost/asio.hpp>
+
+#include <oculus_driver/SonarDriver.h>
+
+#include "connection_monitor.h"
+#include "message_pool.h"
+#include "sonar_config.h"
+#include "sonar_pipeline.h"
+
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "rcl_interfaces/msg/set_parameters_result.hpp"
+
+// Building blocks shared by OculusSonarNode and OculusMultiSonarNode.
+namespace oculus {
+
+// Current value of each sonar configuration parameter, by unprefixed name
+// (frequency_mode, range...).
+using ConfigParameters = std::map<std::string, rclcpp::Parameter>;
+
+// Declares the sonar configuration parameters (prefix + frequency_mode...)
+// and returns their current values.
+ConfigParameters declare_ping_config_parameters(rclcpp::Node& node,
+                                                const std::string& prefix = "");
+
+// Fire message of a complete set of configuration parameters. Invalid
+// combinations are described in errors.
+SonarDriver::PingConfig make_ping_config(const ConfigParameters& parameters,
+                                         std::string& errors);
+
+// Standby, configuration and connection settings of the live sonars, same
+// parameters for all the nodes : standby_delay, config.coalesce_delay,
+// config.feedback_timeout and connection.*.
+struct SupervisorOptions
+{
+    double standby_delay    = 2.0;  // seconds, negative to never standby
+    double coalesce_delay   = 0.05; // seconds
+    double feedback_timeout = 5.0;  // seconds
+    ConnectionMonitor::Options connection;
+};
+
+// Declares the SupervisorOptions parameters and returns their values.
+SupervisorOptions declare_supervisor_parameters(rclcpp::Node& node);
+
+// Configuration, standby and connection of a live sonar, shared by
+// OculusSonarNode (oculus::SonarDriver) and OculusMultiSonarNode
+// (oculus::AddressedSonarDriver, one supervisor per sonar) :
+//  - set_parameters merges the changes of the configuration parameters, the
+//    resulting configuration is sent by flush_config once coalesce_delay
+//    elapsed without change, and checked against the next pings by
+//    check_feedback (concluded after feedback_timeout even without ping),
+//  - update_outputs (called by the GraphWatcher) puts the sonar in standby
+//    after standby_delay without anybody wanting its pings, and resumes it.
+//    Standby is the requested configuration with a standby ping rate, so
+//    configurations sent in standby keep the sonar in standby,
+//  - the driver callbacks feed the ConnectionMonitor, supervise_connection
+//    (timer) sends the configuration again on connection and reconnection.
+//
+// These run on different threads (executor, GraphWatcher, driver) : the
+// driver commands are posted to the io_service running the driver, so they
+// never run concurrently and are sent in order.
+//
+// Without driver (replayed log) the configuration parameters are still
+// merged, nothing is sent.
+template <typename Driver>
+class SonarSupervisor
+{
+    public:
+
+    using IoServicePtr = std::shared_ptr<boost::asio::io_service>;
+
+    // name prefixes the log messages (empty for a single sonar), prefix the
+    // names of the configuration parameters. service is the io_service
+    // running driver (both null when replaying).
+    SonarSupervisor(rclcpp::Node& node, const std::string& name, const std::string& prefix,
+                    const SupervisorOptions& options, const SonarPipeline& pipeline,
+                    const std::shared_ptr<Driver>& driver, const IoServicePtr& service);
+
+    SonarSupervisor(const SonarSupervisor&)            = delete;
+    SonarSupervisor& operator=(const SonarSupervisor&) = delete;
+
+    // Parameter callback. Parameters which are not configuration parameters
+    // of this sonar are ignored.
+    rcl_interfaces::msg::SetParametersResult set_parameters(const std::vector<rclcpp::Parameter>& parameters);
+
+    // Driver callbacks.
+    void on_ping()    { if(connection_) connection_->on_ping();    }
+    void on_message() { if(connection_) connection_->on_message(); }
+    void on_status()  { if(connection_) connection_->on_status();  }
+    void on_dummy();
+
+    // Publishing thread, on each ping.
+    void check_feedback(const OculusSimplePingResult& ping);
+
+    // GraphWatcher thread, wanted is whether someone wants the pings.
+    void update_outputs(bool wanted);
+
+    bool has_driver()   const { return driver_ != nullptr; }
+    bool pings_wanted() const { return pingsWanted_; }
+    bool standby()      const { return standby_;     }
+    const ConfigParameters& config_parameters() const { return configParameters_; }
+
+    // Configuration and connection entries. Returns true if the level and
+    // message of status were set (connection not streaming, configuration
+    // not applied).
+    bool add_diagnostics(diagnostic_msgs::msg::DiagnosticStatus& status) const;
+
+    protected:
+
+    rclcpp::Node&           node_;
+    std::string             logPrefix_;
+    std::string             prefix_;
+    SupervisorOptions       options_;
+    const SonarPipeline&    pipeline_;
+    std::shared_ptr<Driver> driver_;
+    IoServicePtr            service_;
+
+    ConfigParameters             configParameters_;
+    SonarConfigTracker           configTracker_;
+    rclcpp::TimerBase::SharedPtr configTimer_{nullptr};
+
+    std::atomic<bool>                     pingsWanted_{true};
+    std::atomic<bool>                     standby_{false};
+    std::chrono::steady_clock::time_point lastWanted_;
+
+    std::unique_ptr<ConnectionMonitor> connection_;
+    rclcpp::TimerBase::SharedPtr       connectionTimer_{nullptr};
+
+    void flush_config();
+    void send_config(const SonarDriver::PingConfig& config);
+    void send_current_config();
+    void report_feedback(SonarConfigTracker::Feedback feedback, double elapsed);
+    void supervise_connection();
+};
+
+// Publishes with the cheapest path available : loaned message if the
+// middleware supports it, unique_ptr move if intra-process is enabled (taken
+// from pool if given, allocated otherwise), reusedMsg by reference otherwise
+// (steady state without allocation). fill returns false if there is nothing
+// to publish.
+template <typename MsgT, typename FillT>
+void publish_message(const rclcpp::Node& node,
+                     const typename rclcpp::Publisher<MsgT>::SharedPtr& publisher,
+                     MsgT& reusedMsg, FillT&& fill, MessagePool<MsgT>* pool = nullptr)
+{
+    if(publisher->can_loan_messages()) {
+        auto loaned = publisher->borrow_loaned_message();
+        if(fill(loaned.get()))
+            publisher->publish(std::move(loaned));
+    }
+    else if(node.get_node_options().use_intra_process_comms()) {
+        // Ownership goes to the intra-process subscribers, publishing by
+        // reference would make rclcpp copy the whole message once more.
+        auto msg = pool ? pool->take() : std::make_unique<MsgT>();
+        if(fill(*msg))
+            publisher->publish(std::move(msg));
+        if(pool)
+            pool->refill();
+    }
+    else {
+        // Inter-process only : the message is serialized before publish
+        // returns, so the same buffers are reused for every message.
+        if(fill(reusedMsg))
+            publisher->publish(reusedMsg);
+    }
+}
+
+// Calls update() from its own thread on each change of the ROS graph (and at
+// least every 200ms), so that the ping path never queries the graph.
+class GraphWatcher
+{
+    public:
+
+    GraphWatcher() = default;
+    ~GraphWatcher() { this->stop(); }
+
+    GraphWatcher(const GraphWatcher&)            = delete;
+    GraphWatcher& operator=(const GraphWatcher&) = delete;
+
+    void start(rclcpp::Node& node, std::function<void()> update);
+    void stop();
+
+    protected:
+
+    std::thread       thread_;
+    std::atomic<bool> watching_{false};
+};
+
+inline void add_diagnostic(diagnostic_msgs::msg::DiagnosticStatus& status,
+                           const std::string& key, const std::string& value)
+{
+    diagnostic_msgs::msg::KeyValue kv;
+    kv.key   = key;
+    kv.value = value;
+    status.values.push_back(kv);
+}
+
+template <typename T>
+void add_diagnostic(diagnostic_msgs::msg::DiagnosticStatus& status,
+                    const std::string& key, const T& value)
+{
+    add_diagnostic(status, key, std::to_string(value));
+}
+
+// Rates, ping id gaps, queue and per stage latencies of a ping pipeline.
+void add_pipeline_diagnostics(diagnostic_msgs::msg::DiagnosticStatus& status,
+                              const PingStatistics::Report& report,
+                              const SonarPipeline& pipeline);
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_SONAR_NODE_COMMON_HPP_
@@ -0,0 +1,195 @@
+#ifndef _DEF_OCULUS_ROS_SONAR_PIPELINE_H_
+#define _DEF_OCULUS_ROS_SONAR_PIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "ping_statistics.h"
+#include "spsc_queue.h"
+
+namespace oculus {
+
+// A ping waiting to be published. Filled in the driver callback, the data
+// buffer keeps its capacity between pings. The consumer may take the data
+// buffer (swap it with the one of the message to publish) : the slot then
+// reuses whatever buffer it was given back.
+struct PingSlot
+{
+    using TimePoint = std::chrono::system_clock::time_point; // as SonarDriver::TimePoint
+
+    OculusSimplePingResult                metadata;
+    TimePoint                             stamp;
+    std::chrono::steady_clock::time_point received;
+    std::vector<uint8_t>                  data;
+};
+
+// Ping path of one sonar, from the driver callbacks (single producer) to a
+// publishing thread (single consumer) : bounded queues of preallocated slots,
+// so that a slow middleware never delays the socket reads, and the latency
+// and throughput statistics of the pings going through.
+class SonarPipeline
+{
+    public:
+
+    using PingQueue   = SpscSlotQueue<PingSlot>;
+    using StatusQueue = SpscSlotQueue<OculusStatusMsg>;
+
+    SonarPipeline(size_t depth, PingQueue::OverflowPolicy policy) :
+        pings_(depth, policy),
+        statuses_(4, StatusQueue::OverflowPolicy::DropOldest)
+    {}
+
+    SonarPipeline(const SonarPipeline&)            = delete;
+    SonarPipeline& operator=(const SonarPipeline&) = delete;
+
+    // Producer side. Return false if the message was dropped (counted by the
+    // queue).
+    bool push_status(const OculusStatusMsg& status)
+    {
+        OculusStatusMsg* slot = statuses_.acquire();
+        if(!slot)
+            return false;
+        *slot = status;
+        statuses_.push(slot);
+        return true;
+    }
+
+    bool push_ping(const OculusSimplePingResult& metadata,
+                   const std::vector<uint8_t>& data, PingSlot::TimePoint stamp)
+    {
+        PingSlot* slot = pings_.acquire();
+        if(!slot)
+            return false;
+        slot->metadata = metadata;
+        slot->stamp    = stamp;
+        slot->received = std::chrono::steady_clock::now();
+        statistics_.record(PingStatistics::Receive, PingSlot::TimePoint::clock::now() - stamp);
+        slot->data.assign(data.cbegin(), data.cend());
+        pings_.push(slot);
+        return true;
+    }
+
+    // Consumer side : call f on the oldest queued message, if any, and
+    // return whether there was one. The queue latency and the ping id
+    // sequence are recorded before f is called. f is given a mutable
+    // PingSlot, it may swap its data out.
+    template <typename F>
+    bool pop_status(F&& f)
+    {
+        OculusStatusMsg* status = statuses_.pop();
+        if(!status)
+            return false;
+        f(*status);
+        statuses_.release(status);
+        return true;
+    }
+
+    template <typename F>
+    bool pop_ping(F&& f)
+    {
+        PingSlot* ping = pings_.pop();
+        if(!ping)
+            return false;
+        statistics_.record(PingStatistics::Queue, std::chrono::steady_clock::now() - ping->received);
+        statistics_.count_ping(ping->metadata.pingId, ping->data.size());
+        f(*ping);
+        pings_.release(ping);
+        return true;
+    }
+
+    bool empty() const { return pings_.empty() && statuses_.empty(); }
+
+    // Consumer side : total of the dropped pings if some were dropped since
+    // the previous call, 0 otherwise (overflows are reported as they happen).
+    uint64_t new_drops()
+    {
+        uint64_t drops = pings_.dropped();
+        if(drops == reportedDrops_)
+            return 0;
+        reportedDrops_ = drops;
+        return drops;
+    }
+
+    const PingQueue&      ping_queue() const { return pings_;      }
+    PingStatistics&       statistics()       { return statistics_; }
+    const PingStatistics& statistics() const { return statistics_; }
+
+    protected:
+
+    PingQueue      pings_;
+    StatusQueue    statuses_;
+    PingStatistics statistics_;
+    uint64_t       reportedDrops_ = 0;
+};
+
+// Thread calling step() until stopped, step() returning whether it had
+// something to do. The thread sleeps while idle() holds, until wake() is
+// called. wake() is cheap enough to be called by the producers for each
+// message : the lock is only taken when the thread is (about to be) sleeping.
+class PublisherThread
+{
+    public:
+
+    PublisherThread() = default;
+    ~PublisherThread() { this->stop(); }
+
+    PublisherThread(const PublisherThread&)            = delete;
+    PublisherThread& operator=(const PublisherThread&) = delete;
+
+    void start(std::function<bool()> step, std::function<bool()> idle)
+    {
+        if(running_)
+            return;
+        running_ = true;
+        thread_ = std::thread([this, step, idle]() {
+            while(running_) {
+                if(step())
+                    continue;
+                std::unique_lock<std::mutex> lock(mutex_);
+                waiting_ = true;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(running_ && idle()) {
+                    condition_.wait_for(lock, std::chrono::milliseconds(100));
+                }
+                waiting_ = false;
+            }
+        });
+    }
+
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiting_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            condition_.notify_one();
+        }
+    }
+
+    void stop()
+    {
+        running_ = false;
+        this->wake();
+        if(thread_.joinable())
+            thread_.join();
+    }
+
+    protected:
+
+    std::thread             thread_;
+    std::atomic<bool>       running_{false};
+    std::atomic<bool>       waiting_{false};
+    std::mutex              mutex_;
+    std::condition_variable condition_;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_SONAR_PIPELINE_H_
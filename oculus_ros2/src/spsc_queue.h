@@ -0,0 +1,125 @@
+#ifndef _DEF_OCULUS_ROS_SPSC_QUEUE_H_
+#define _DEF_OCULUS_ROS_SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace oculus {
+
+// Bounded single-producer / single-consumer queue of preallocated slots.
+//
+// The producer acquires a slot, fills it in place and pushes it. The consumer
+// pops a slot, processes it in place and releases it. Slots are never
+// reallocated, so buffers held by T (std::vector...) keep their capacity and
+// the steady state does not allocate.
+//
+// When depth() slots are already queued, acquire() either returns nullptr
+// (DropNewest) or takes back the oldest queued slot (DropOldest). The latter
+// is the only place where the producer touches the consumer index, which is
+// why popping is done with a compare-and-swap.
+template <typename T>
+class SpscSlotQueue
+{
+    public:
+
+    enum class OverflowPolicy { DropOldest, DropNewest };
+
+    SpscSlotQueue(size_t depth, OverflowPolicy policy, const T& prototype = T()) :
+        depth_(depth > 0 ? depth : 1),
+        policy_(policy),
+        // depth queued slots, one being filled and one being processed
+        slots_(depth_ + 2, prototype),
+        queue_(slots_.size()),
+        free_(slots_.size()),
+        head_(0), tail_(0),
+        freeHead_(0), freeTail_(0),
+        pushed_(0), dropped_(0)
+    {
+        for(auto& slot : slots_) {
+            free_[freeHead_++].store(&slot, std::memory_order_relaxed);
+        }
+    }
+
+    SpscSlotQueue(const SpscSlotQueue&)            = delete;
+    SpscSlotQueue& operator=(const SpscSlotQueue&) = delete;
+
+    // Producer side.
+    T* acquire()
+    {
+        if(this->size() >= depth_) {
+            if(policy_ == OverflowPolicy::DropNewest) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            if(T* oldest = this->pop()) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return oldest;
+            }
+        }
+        // At most depth_ slots queued and one held by the consumer : there
+        // is always a free slot here.
+        uint64_t tail = freeTail_.load(std::memory_order_relaxed);
+        if(tail == freeHead_.load(std::memory_order_acquire))
+            return nullptr;
+        T* slot = free_[tail % free_.size()].load(std::memory_order_relaxed);
+        freeTail_.store(tail + 1, std::memory_order_release);
+        return slot;
+    }
+
+    void push(T* slot)
+    {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        queue_[head % queue_.size()].store(slot, std::memory_order_relaxed);
+        head_.store(head + 1, std::memory_order_release);
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Consumer side (pop is also used by the producer in DropOldest mode).
+    T* pop()
+    {
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        while(tail != head_.load(std::memory_order_acquire)) {
+            T* slot = queue_[tail % queue_.size()].load(std::memory_order_relaxed);
+            if(tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel))
+                return slot;
+        }
+        return nullptr;
+    }
+
+    void release(T* slot)
+    {
+        uint64_t head = freeHead_.load(std::memory_order_relaxed);
+        free_[head % free_.size()].store(slot, std::memory_order_relaxed);
+        freeHead_.store(head + 1, std::memory_order_release);
+    }
+
+    // Statistics, can be read from any thread.
+    size_t   size()    const { return head_.load() - tail_.load(); }
+    size_t   depth()   const { return depth_;   }
+    uint64_t pushed()  const { return pushed_;  }
+    uint64_t dropped() const { return dropped_; }
+    bool     empty()   const { return this->size() == 0; }
+
+    private:
+
+    const size_t         depth_;
+    const OverflowPolicy policy_;
+    std::vector<T>       slots_;
+
+    std::vector<std::atomic<T*>> queue_; // producer -> consumer
+    std::vector<std::atomic<T*>> free_;  // consumer -> producer
+
+    alignas(64) std::atomic<uint64_t> head_;
+    alignas(64) std::atomic<uint64_t> tail_;
+    alignas(64) std::atomic<uint64_t> freeHead_;
+    alignas(64) std::atomic<uint64_t> freeTail_;
+
+    std::atomic<uint64_t> pushed_;
+    std::atomic<uint64_t> dropped_;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_SPSC_QUEUE_H_
@@ -0,0 +1,289 @@
+#include "temporal_filter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cpu_features.h"
+
+#ifdef OCULUS_ROS2_AVX2
+#include <immintrin.h>
+#endif
+
+namespace oculus {
+
+namespace {
+
+#ifdef OCULUS_ROS2_AVX2
+template <typename T> struct Simd;
+template <> struct Simd<uint8_t>
+{
+    OCULUS_AVX2_TARGET static __m256i min(__m256i a, __m256i b) { return _mm256_min_epu8(a, b); }
+    OCULUS_AVX2_TARGET static __m256i max(__m256i a, __m256i b) { return _mm256_max_epu8(a, b); }
+};
+template <> struct Simd<uint16_t>
+{
+    OCULUS_AVX2_TARGET static __m256i min(__m256i a, __m256i b) { return _mm256_min_epu16(a, b); }
+    OCULUS_AVX2_TARGET static __m256i max(__m256i a, __m256i b) { return _mm256_max_epu16(a, b); }
+};
+
+OCULUS_AVX2_TARGET inline __m256i load(const void* src) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+}
+OCULUS_AVX2_TARGET inline void store(void* dst, __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), v);
+}
+
+// The AVX2 row kernels process whole vectors and return the number of
+// samples done, the remainder is left to the portable loops.
+
+template <typename T>
+OCULUS_AVX2_TARGET size_t min_row_avx2(const uint8_t* const* rows, unsigned int count,
+                                       uint8_t* output, size_t n)
+{
+    constexpr size_t Lanes = 32 / sizeof(T);
+    size_t i = 0;
+    for(; i + Lanes <= n; i += Lanes) {
+        __m256i v = load(rows[0] + i*sizeof(T));
+        for(unsigned int k = 1; k < count; k++)
+            v = Simd<T>::min(v, load(rows[k] + i*sizeof(T)));
+        store(output + i*sizeof(T), v);
+    }
+    return i;
+}
+
+template <typename T>
+OCULUS_AVX2_TARGET size_t median_row_avx2(const uint8_t* const* rows, unsigned int count,
+                                          uint8_t* output, size_t n)
+{
+    constexpr size_t Lanes = 32 / sizeof(T);
+    __m256i v[TemporalFilter::MaxFrames] = {};
+    size_t i = 0;
+    for(; i + Lanes <= n; i += Lanes) {
+        for(unsigned int k = 0; k < count; k++)
+            v[k] = load(rows[k] + i*sizeof(T));
+        for(unsigned int round = 0; round < count; round++) {
+            for(unsigned int k = round & 1; k + 1 < count; k += 2) {
+                __m256i low = Simd<T>::min(v[k], v[k + 1]);
+                v[k + 1]    = Simd<T>::max(v[k], v[k + 1]);
+                v[k]        = low;
+            }
+        }
+        store(output + i*sizeof(T), v[count / 2]);
+    }
+    return i;
+}
+
+template <typename T>
+OCULUS_AVX2_TARGET size_t ema_row_avx2(const uint8_t* input, float* accumulator, uint8_t* output,
+                                       size_t n, float alpha)
+{
+    const __m256 vAlpha = _mm256_set1_ps(alpha);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i samples;
+        if(sizeof(T) == 2)
+            samples = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 2*i)));
+        else
+            samples = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(input + i)));
+        __m256 acc = _mm256_loadu_ps(accumulator + i);
+        acc = _mm256_fmadd_ps(vAlpha, _mm256_sub_ps(_mm256_cvtepi32_ps(samples), acc), acc);
+        _mm256_storeu_ps(accumulator + i, acc);
+
+        // acc stays within the sample range, no saturation needed.
+        __m256i rounded = _mm256_cvtps_epi32(acc);
+        __m128i packed  = _mm_packus_epi32(_mm256_castsi256_si128(rounded),
+                                           _mm256_extracti128_si256(rounded, 1));
+        if(sizeof(T) == 2) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 2*i), packed);
+        }
+        else {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(packed, packed));
+        }
+    }
+    return i;
+}
+#endif
+
+// Samples are not necessarily aligned in the ping data (odd gain prefix
+// offsets), they are read and written with memcpy.
+template <typename T>
+inline T get(const uint8_t* src, size_t index) {
+    T value;
+    std::memcpy(&value, src + index*sizeof(T), sizeof(T));
+    return value;
+}
+template <typename T>
+inline void set(uint8_t* dst, size_t index, T value) {
+    std::memcpy(dst + index*sizeof(T), &value, sizeof(T));
+}
+
+template <typename T>
+void min_row(const uint8_t* const* rows, unsigned int count, uint8_t* output, size_t n,
+             bool avx2)
+{
+    size_t i = 0;
+#ifdef OCULUS_ROS2_AVX2
+    if(avx2)
+        i = min_row_avx2<T>(rows, count, output, n);
+#else
+    (void)avx2;
+#endif
+    for(; i < n; i++) {
+        T v = get<T>(rows[0], i);
+        for(unsigned int k = 1; k < count; k++)
+            v = std::min(v, get<T>(rows[k], i));
+        set<T>(output, i, v);
+    }
+}
+
+// Odd-even transposition sort of count values (count rounds of
+// compare-exchange), the median being the middle one (upper median for an
+// even count).
+template <typename T>
+void median_row(const uint8_t* const* rows, unsigned int count, uint8_t* output, size_t n,
+                bool avx2)
+{
+    size_t i = 0;
+#ifdef OCULUS_ROS2_AVX2
+    if(avx2)
+        i = median_row_avx2<T>(rows, count, output, n);
+#else
+    (void)avx2;
+#endif
+    // Same network on blocks of samples, the inner loops over the block being
+    // simple enough for the compiler to vectorize them. The last block is
+    // sorted whole : the samples past size are not used but must be
+    // initialized.
+    constexpr size_t Block = 64;
+    T s[TemporalFilter::MaxFrames][Block] = {};
+    for(; i < n; i += Block) {
+        const size_t size = std::min(Block, n - i);
+        for(unsigned int k = 0; k < count; k++)
+            std::memcpy(s[k], rows[k] + i*sizeof(T), size*sizeof(T));
+        for(unsigned int round = 0; round < count; round++) {
+            for(unsigned int k = round & 1; k + 1 < count; k += 2) {
+                for(size_t j = 0; j < Block; j++) {
+                    T low       = std::min(s[k][j], s[k + 1][j]);
+                    s[k + 1][j] = std::max(s[k][j], s[k + 1][j]);
+                    s[k][j]     = low;
+                }
+            }
+        }
+        std::memcpy(output + i*sizeof(T), s[count / 2], size*sizeof(T));
+    }
+}
+
+template <typename T>
+void ema_row(const uint8_t* input, float* accumulator, uint8_t* output, size_t n, float alpha,
+             bool avx2)
+{
+    size_t i = 0;
+#ifdef OCULUS_ROS2_AVX2
+    if(avx2)
+        i = ema_row_avx2<T>(input, accumulator, output, n, alpha);
+#else
+    (void)avx2;
+#endif
+    for(; i < n; i++) {
+        accumulator[i] += alpha*(get<T>(input, i) - accumulator[i]);
+        set<T>(output, i, static_cast<T>(accumulator[i] + 0.5f));
+    }
+}
+
+} //namespace
+
+TemporalFilter::TemporalFilter() :
+    TemporalFilter(Options())
+{}
+
+TemporalFilter::TemporalFilter(const Options& options) :
+    options_(options),
+    invalidated_(false)
+{
+    options_.frames = std::max(1u, std::min(options_.frames, MaxFrames));
+    options_.alpha  = std::max(0.0f, std::min(options_.alpha, 1.0f));
+}
+
+void TemporalFilter::reset(const Key& key)
+{
+    key_       = key;
+    rowSize_   = static_cast<size_t>(key.n_beams)*key.sample_size;
+    frameSize_ = rowSize_*key.n_ranges;
+    if(options_.mode == Ema) {
+        accumulator_.resize(static_cast<size_t>(key.n_beams)*key.n_ranges);
+    }
+    else {
+        ring_.resize(frameSize_*options_.frames);
+    }
+    head_       = 0;
+    frameCount_ = 0;
+    resets_++;
+}
+
+bool TemporalFilter::filter(const OculusSimplePingResult& metadata,
+                            const std::vector<uint8_t>& data,
+                            std::vector<uint8_t>& output)
+{
+    PingLayout layout(metadata, data);
+    if(!layout.is_valid())
+        return false;
+
+    Key key;
+    key.n_beams        = metadata.nBeams;
+    key.n_ranges       = metadata.nRanges;
+    key.sample_size    = layout.sample_size;
+    key.has_gain       = layout.has_gain;
+    key.range          = metadata.fireMessage.range;
+    key.frequency_mode = metadata.fireMessage.masterMode;
+    if(invalidated_.exchange(false) || key != key_ || frameCount_ == 0) {
+        this->reset(key);
+    }
+
+    // Header, bearings and gains come from the newest ping.
+    output.assign(data.cbegin(), data.cend());
+    if(layout.is_16bit())
+        this->filter_image<uint16_t>(layout, data.data(), output.data());
+    else
+        this->filter_image<uint8_t>(layout, data.data(), output.data());
+    return true;
+}
+
+template <typename T>
+void TemporalFilter::filter_image(const PingLayout& input, const uint8_t* inputBase,
+                                  uint8_t* outputBase)
+{
+    const unsigned int nRanges = input.n_ranges;
+    const size_t       nBeams  = input.n_beams;
+    const bool         avx2    = has_avx2();
+
+    if(options_.mode == Ema) {
+        // The first ping initializes the average.
+        float alpha = frameCount_ == 0 ? 1.0f : options_.alpha;
+        for(unsigned int r = 0; r < nRanges; r++) {
+            uint8_t* outputRow = outputBase + (input.row(r) - inputBase);
+            ema_row<T>(input.row(r), accumulator_.data() + r*nBeams, outputRow, nBeams, alpha, avx2);
+        }
+        frameCount_ = 1;
+        return;
+    }
+
+    uint8_t* slot = ring_.data() + head_*frameSize_;
+    for(unsigned int r = 0; r < nRanges; r++) {
+        std::memcpy(slot + r*rowSize_, input.row(r), rowSize_);
+    }
+    head_       = (head_ + 1) % options_.frames;
+    frameCount_ = std::min(frameCount_ + 1, options_.frames);
+
+    const uint8_t* rows[MaxFrames];
+    for(unsigned int r = 0; r < nRanges; r++) {
+        for(unsigned int k = 0; k < frameCount_; k++)
+            rows[k] = ring_.data() + k*frameSize_ + r*rowSize_;
+        uint8_t* outputRow = outputBase + (input.row(r) - inputBase);
+        if(options_.mode == Median)
+            median_row<T>(rows, frameCount_, outputRow, nBeams, avx2);
+        else
+            min_row<T>(rows, frameCount_, outputRow, nBeams, avx2);
+    }
+}
+
+} //namespace oculus
@@ -0,0 +1,98 @@
+#ifndef _DEF_OCULUS_ROS_TEMPORAL_FILTER_H_
+#define _DEF_OCULUS_ROS_TEMPORAL_FILTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <oculus_driver/Oculus.h>
+
+#include "ping_layout.h"
+
+namespace oculus {
+
+// Speckle reduction across consecutive pings, sample by sample over the
+// beam x range grid :
+//  - Ema    : exponential moving average (weight alpha for the newest ping),
+//  - Median : median of the last frames pings,
+//  - Min    : minimum of the last frames pings (keeps only persistent echoes).
+//
+// The last pings are kept in a ring allocated once per sonar geometry, and
+// the per-ping cost is bounded by MaxFrames. The filter restarts from the
+// current ping when the geometry (nbeams, nranges, range, frequency mode,
+// data depth, gain flag) changes, or on the first ping after invalidate().
+//
+// Samples are filtered as sent by the sonar : when send_gain is set the row
+// gains of the newest ping are kept in the output.
+class TemporalFilter
+{
+    public:
+
+    enum Mode { Ema, Median, Min };
+
+    static constexpr unsigned int MaxFrames = 9;
+
+    struct Options
+    {
+        Mode         mode   = Ema;
+        unsigned int frames = 5;    // Median and Min, at most MaxFrames
+        float        alpha  = 0.3f; // Ema
+    };
+
+    struct Key
+    {
+        uint16_t n_beams        = 0;
+        uint16_t n_ranges       = 0;
+        uint8_t  sample_size    = 0;
+        bool     has_gain       = false;
+        double   range          = 0.0;
+        uint8_t  frequency_mode = 0;
+
+        bool operator==(const Key& other) const {
+            return n_beams == other.n_beams && n_ranges == other.n_ranges
+                && sample_size == other.sample_size && has_gain == other.has_gain
+                && range == other.range && frequency_mode == other.frequency_mode;
+        }
+        bool operator!=(const Key& other) const { return !(*this == other); }
+    };
+
+    TemporalFilter();
+    explicit TemporalFilter(const Options& options);
+
+    // Can be called from any thread.
+    void invalidate() { invalidated_ = true; }
+
+    // Adds a ping to the filter and writes the filtered ping in output (same
+    // layout as data : header, bearings and gains are copied, image samples
+    // are filtered). Returns false if the ping is malformed.
+    bool filter(const OculusSimplePingResult& metadata,
+                const std::vector<uint8_t>& data,
+                std::vector<uint8_t>& output);
+
+    const Options& options() const { return options_; }
+    unsigned int frame_count() const { return frameCount_; } // pings in the filter
+    unsigned int resets()      const { return resets_; }
+
+    protected:
+
+    Options options_;
+    Key     key_;
+    std::atomic<bool> invalidated_;
+
+    size_t rowSize_   = 0; // bytes of samples in a row (gain excluded)
+    size_t frameSize_ = 0;
+    std::vector<uint8_t> ring_;        // frames packed samples images (Median, Min)
+    std::vector<float>   accumulator_; // Ema
+    unsigned int head_       = 0;      // next ring slot
+    unsigned int frameCount_ = 0;
+    unsigned int resets_     = 0;
+
+    void reset(const Key& key);
+    template <typename T>
+    void filter_image(const PingLayout& input, const uint8_t* inputBase,
+                      uint8_t* outputBase);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_TEMPORAL_FILTER_H_
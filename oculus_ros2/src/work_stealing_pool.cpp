@@ -0,0 +1,135 @@
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+
+namespace oculus {
+
+namespace {
+
+// Pool and index of the worker running on the current thread.
+thread_local const WorkStealingPool* currentPool  = nullptr;
+thread_local int                     currentIndex = -1;
+
+} //namespace
+
+WorkStealingPool::WorkStealingPool(unsigned int threads) :
+    running_(true),
+    queued_(0),
+    pending_(0),
+    nextWorker_(0),
+    steals_(0)
+{
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for(unsigned int i = 0; i < threads; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for(unsigned int i = 0; i < threads; i++) {
+        threads_.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wakeCondition_.notify_all();
+    for(auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+int WorkStealingPool::worker_index() const
+{
+    return currentPool == this ? currentIndex : -1;
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    int index = this->worker_index();
+    if(index < 0)
+        index = nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+    pending_.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+        queued_.fetch_add(1);
+    }
+    // Sleeping workers check queued_ with mutex_ held : taking it here
+    // ensures the notification is not lost.
+    std::lock_guard<std::mutex> lock(mutex_);
+    wakeCondition_.notify_one();
+}
+
+bool WorkStealingPool::pop(unsigned int index, Task& task)
+{
+    {
+        auto& own = *workers_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued_.fetch_sub(1);
+            return true;
+        }
+    }
+    for(size_t i = 1; i < workers_.size(); i++) {
+        auto& victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_.fetch_sub(1);
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(unsigned int index)
+{
+    currentPool  = this;
+    currentIndex = index;
+
+    Task task;
+    while(true) {
+        if(this->pop(index, task)) {
+            try {
+                task();
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if(!error_)
+                    error_ = std::current_exception();
+            }
+            task = nullptr;
+            if(pending_.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                idleCondition_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        wakeCondition_.wait(lock, [this]() { return !running_ || queued_ > 0; });
+        if(!running_)
+            return;
+    }
+}
+
+void WorkStealingPool::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idleCondition_.wait(lock, [this]() { return pending_ == 0; });
+    if(error_) {
+        auto error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+} //namespace oculus
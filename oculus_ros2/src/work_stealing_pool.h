@@ -0,0 +1,80 @@
+#ifndef _DEF_OCULUS_ROS_WORK_STEALING_POOL_H_
+#define _DEF_OCULUS_ROS_WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace oculus {
+
+// Thread pool in which each worker owns a task deque. Tasks submitted by a
+// worker go to its own deque and are popped back in LIFO order (the data they
+// work on is still in cache), idle workers steal the oldest task of the
+// others. Tasks submitted from outside of the pool are spread over the
+// deques.
+//
+// Tasks are meant to be coarse (a chunk of pings), so each deque is simply
+// protected by its own mutex.
+class WorkStealingPool
+{
+    public:
+
+    using Task = std::function<void()>;
+
+    // threads = 0 : one worker per hardware thread.
+    explicit WorkStealingPool(unsigned int threads = 0);
+    // Waits for the running tasks, tasks still queued are dropped.
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&)            = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Can be called from any thread, including from a task.
+    void submit(Task task);
+
+    // Blocks until all the submitted tasks (and the tasks they submitted)
+    // are done. Rethrows the first exception thrown by a task, if any.
+    void wait_idle();
+
+    unsigned int size() const { return threads_.size(); }
+    // Index of the calling worker in [0, size()), -1 if the caller is not a
+    // worker of this pool (for per worker scratch data).
+    int worker_index() const;
+
+    uint64_t steals() const { return steals_.load(std::memory_order_relaxed); }
+
+    protected:
+
+    struct alignas(64) Worker
+    {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread>             threads_;
+
+    std::mutex              mutex_;
+    std::condition_variable wakeCondition_;
+    std::condition_variable idleCondition_;
+    std::atomic<bool>       running_;
+    std::atomic<size_t>     queued_;  // submitted, not started yet
+    std::atomic<size_t>     pending_; // submitted, not finished yet
+    std::atomic<unsigned int> nextWorker_;
+    std::atomic<uint64_t>   steals_;
+    std::exception_ptr      error_;
+
+    void run(unsigned int index);
+    bool pop(unsigned int index, Task& task);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_ROS_WORK_STEALING_POOL_H_
@@ -0,0 +1,181 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include <gtest/gtest.h>
+
+#include "addressed_sonar_driver.h"
+#include "mock_sonar.h"
+
+namespace {
+
+// Not the sonar ports, so that the tests do not interfere with a sonar (or
+// a mock sonar) running on the host.
+constexpr uint16_t StatusPort = 52412;
+constexpr uint16_t DataPort   = 52410;
+
+oculus::MockSonar::Options mock_options(const std::string& address)
+{
+    oculus::MockSonar::Options options;
+    options.address        = address;
+    options.status_address = "127.0.0.1";
+    options.status_port    = StatusPort;
+    options.data_port      = DataPort;
+    options.status_period  = 0.1;
+    options.rate           = 50.0;
+    options.nranges        = 64;
+    return options;
+}
+
+bool wait_for(const std::function<bool()>& condition, double timeout = 5.0)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+    while(!condition()) {
+        if(std::chrono::steady_clock::now() > end)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+class AddressedSonarDriverTest : public ::testing::Test
+{
+    protected:
+
+    using Driver = oculus::AddressedSonarDriver;
+
+    std::shared_ptr<boost::asio::io_service> service_ = std::make_shared<boost::asio::io_service>();
+    std::unique_ptr<boost::asio::io_service::work> work_;
+    std::thread thread_;
+
+    std::atomic<uint64_t> pings_{0};
+    std::atomic<uint64_t> dummies_{0};
+    std::atomic<uint16_t> lastBeams_{0};
+    std::mutex            mutex_;
+    std::set<uint32_t>    statusAddresses_;
+
+    std::unique_ptr<Driver> make_driver(const std::string& address)
+    {
+        Driver::Options options;
+        options.address     = address;
+        options.status_port = StatusPort;
+        options.data_port   = DataPort;
+        auto driver = std::make_unique<Driver>(service_, options);
+        driver->add_ping_callback([this](const OculusSimplePingResult& metadata,
+                                         const std::vector<uint8_t>& data) {
+            EXPECT_EQ(data.size(), static_cast<size_t>(metadata.messageSize));
+            lastBeams_ = metadata.nBeams;
+            pings_++;
+        });
+        driver->add_status_callback([this](const OculusStatusMsg& status) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            statusAddresses_.insert(ntohl(status.ipAddr));
+        });
+        driver->add_dummy_callback([this]() { dummies_++; });
+        return driver;
+    }
+
+    void run()
+    {
+        work_   = std::make_unique<boost::asio::io_service::work>(*service_);
+        thread_ = std::thread([this]() { service_->run(); });
+    }
+
+    // Called at the end of each test : the drivers have to outlive the
+    // io_service thread.
+    void TearDown() override
+    {
+        work_.reset();
+        service_->stop();
+        if(thread_.joinable())
+            thread_.join();
+    }
+};
+
+TEST_F(AddressedSonarDriverTest, ConnectsToTheGivenSonarOnly)
+{
+    oculus::MockSonar first(mock_options("127.0.0.1"));
+    oculus::MockSonar second(mock_options("127.0.0.2"));
+    first.start();
+    second.start();
+
+    auto driver = this->make_driver("127.0.0.2");
+    driver->start();
+    this->run();
+
+    ASSERT_TRUE(wait_for([&]() { return pings_ >= 10; }));
+    EXPECT_TRUE(driver->connected());
+    EXPECT_EQ(driver->sonar_address(), "127.0.0.2");
+    EXPECT_EQ(first.statistics().connections, 0u);
+    EXPECT_EQ(second.statistics().connections, 1u);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        EXPECT_EQ(statusAddresses_, (std::set<uint32_t>{0x7f000002}));
+    }
+    this->TearDown();
+}
+
+TEST_F(AddressedSonarDriverTest, FirstSonarHeardOfWithoutAddress)
+{
+    oculus::MockSonar sonar(mock_options("127.0.0.2"));
+    sonar.start();
+
+    auto driver = this->make_driver("");
+    EXPECT_EQ(driver->sonar_address(), "");
+    driver->start();
+    this->run();
+
+    ASSERT_TRUE(wait_for([&]() { return pings_ >= 5; }));
+    EXPECT_EQ(driver->sonar_address(), "127.0.0.2");
+    this->TearDown();
+}
+
+TEST_F(AddressedSonarDriverTest, SendsCommandsToTheSonar)
+{
+    oculus::MockSonar sonar(mock_options("127.0.0.1"));
+    sonar.start();
+
+    auto driver = this->make_driver("127.0.0.1");
+    driver->start();
+    this->run();
+    ASSERT_TRUE(wait_for([&]() { return pings_ > 0; }));
+    EXPECT_EQ(lastBeams_, 256);
+
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.pingRate   = pingRateNormal;
+    config.flags      = 0x09 | 0x40; // 512 beams
+    config.range      = 10.0;
+    driver->send_ping_config(config);
+    EXPECT_TRUE(wait_for([&]() { return lastBeams_ == 512; }));
+
+    driver->standby();
+    EXPECT_TRUE(wait_for([&]() { return dummies_ > 0; }));
+    const uint64_t pings = pings_;
+    driver->resume();
+    EXPECT_TRUE(wait_for([&]() { return pings_ > pings; }));
+    EXPECT_EQ(sonar.statistics().configs_received, 3u);
+    this->TearDown();
+}
+
+TEST(AddressedSonarDriver, RejectsInvalidAddresses)
+{
+    auto service = std::make_shared<boost::asio::io_service>();
+    oculus::AddressedSonarDriver::Options options;
+    options.address = "192.168.1";
+    EXPECT_THROW(oculus::AddressedSonarDriver(service, options), std::runtime_error);
+    options.address = "0.0.0.0";
+    EXPECT_THROW(oculus::AddressedSonarDriver(service, options), std::runtime_error);
+}
+
+} //namespace
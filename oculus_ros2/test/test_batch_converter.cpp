@@ -0,0 +1,143 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "batch_converter.h"
+#include "log_reader.h"
+#include "mock_sonar.h"
+#include "oculus_log.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<uint8_t> read_file(const fs::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                                std::istreambuf_iterator<char>());
+}
+
+void write_file(const fs::path& path, const std::vector<uint8_t>& data)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+// .oculus log of synthetic pings (8 and 16 bits, with and without gains).
+void write_log(const fs::path& path, unsigned int count)
+{
+    std::vector<uint8_t> data;
+    auto append = [&](const void* bytes, size_t size) {
+        data.insert(data.end(), static_cast<const uint8_t*>(bytes),
+                    static_cast<const uint8_t*>(bytes) + size);
+    };
+    const double start = 1.6e9;
+    auto fileHeader = oculus::log::make_file_header(start);
+    append(&fileHeader, sizeof(fileHeader));
+    for(unsigned int i = 0; i < count; i++) {
+        OculusSimpleFireMessage config;
+        std::memset(&config, 0, sizeof(config));
+        config.masterMode = 1;
+        config.flags      = 0x09 | (i % 2 ? 0x02 : 0) | (i % 3 ? 0x04 : 0);
+        config.range      = 10.0;
+        auto ping = oculus::make_synthetic_ping(config, 256, 200, i);
+        OculusSimplePingResult metadata;
+        std::memcpy(&metadata, ping.data(), sizeof(metadata));
+        metadata.pingId = i;
+        std::memcpy(ping.data(), &metadata, sizeof(metadata));
+
+        auto itemHeader = oculus::log::make_item_header(start + 0.1*i, ping.size());
+        append(&itemHeader, sizeof(itemHeader));
+        append(ping.data(), ping.size());
+    }
+    write_file(path, data);
+}
+
+class BatchConverterTest : public ::testing::Test
+{
+    protected:
+
+    fs::path directory_;
+
+    void SetUp() override
+    {
+        directory_ = fs::temp_directory_path() / ("oculus_batch_converter_test_" + std::to_string(getpid()));
+        fs::remove_all(directory_);
+        fs::create_directories(directory_);
+    }
+
+    void TearDown() override
+    {
+        fs::remove_all(directory_);
+    }
+
+    bool convert(oculus::BatchConverter::Format format, const fs::path& input,
+                 const fs::path& output)
+    {
+        oculus::BatchConverter::Options options;
+        options.format           = format;
+        options.output_directory = output.string();
+        options.threads          = 2;
+        options.chunk_size       = 64*1024; // several chunks per recording
+        oculus::BatchConverter converter(options);
+        converter.add_log(input.string());
+        return converter.run();
+    }
+};
+
+TEST_F(BatchConverterTest, ArchiveRoundTripIsLossless)
+{
+    const auto original = directory_ / "pings.oculus";
+    write_log(original, 40);
+
+    ASSERT_TRUE(this->convert(oculus::BatchConverter::Archive, original, directory_ / "archive"));
+    const auto archive = directory_ / "archive" / "pings_compressed.oculus";
+    ASSERT_TRUE(fs::exists(archive));
+    EXPECT_LT(fs::file_size(archive), fs::file_size(original));
+    oculus::LogReader reader(archive.string());
+    ASSERT_EQ(reader.item_count(), 40u);
+    EXPECT_EQ(reader.item(0).header->compression, oculus::log::PingCodecCompression);
+
+    ASSERT_TRUE(this->convert(oculus::BatchConverter::OculusLog, archive, directory_ / "restored"));
+    const auto restored = directory_ / "restored" / "pings_compressed.oculus";
+    ASSERT_TRUE(fs::exists(restored));
+    EXPECT_EQ(read_file(restored), read_file(original));
+}
+
+TEST_F(BatchConverterTest, FailedConversionLeavesNoOutput)
+{
+    const auto original = directory_ / "pings.oculus";
+    write_log(original, 40);
+    ASSERT_TRUE(this->convert(oculus::BatchConverter::Archive, original, directory_ / "archive"));
+
+    // Corrupting the payload of the last compressed ping : the first chunks
+    // are written before decompression fails.
+    const auto archive = directory_ / "archive" / "pings_compressed.oculus";
+    auto data = read_file(archive);
+    size_t lastPayload;
+    {
+        // Items follow the file header.
+        oculus::LogReader reader(archive.string());
+        const uint8_t* first = reinterpret_cast<const uint8_t*>(reader.item(0).header);
+        lastPayload = sizeof(oculus::log::LogFileHeader) + (reader.items().back().data - first);
+    }
+    ASSERT_LT(lastPayload + 64, data.size());
+    std::memset(data.data() + lastPayload + 16, 0xff, data.size() - lastPayload - 16);
+    const auto corrupted = directory_ / "corrupted.oculus";
+    write_file(corrupted, data);
+
+    EXPECT_FALSE(this->convert(oculus::BatchConverter::OculusLog, corrupted, directory_ / "restored"));
+    EXPECT_FALSE(fs::exists(directory_ / "restored" / "corrupted.oculus"));
+    EXPECT_FALSE(fs::exists(directory_ / "restored" / "corrupted.oculus.part"));
+}
+
+} //namespace
@@ -0,0 +1,166 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "beam_decoder.h"
+#include "cpu_features.h"
+#include "mock_sonar.h"
+#include "ping_layout.h"
+
+namespace {
+
+// 250 beams : not a multiple of the vectorized row length, so the tail of
+// the rows goes through the scalar loop.
+std::vector<uint8_t> make_ping(bool use16Bits, bool withGain,
+                               unsigned int nBeams = 250, unsigned int nRanges = 200)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09 | (use16Bits ? 0x02 : 0) | (withGain ? 0x04 : 0);
+    config.range      = 10.0;
+    return oculus::make_synthetic_ping(config, nBeams, nRanges, 3);
+}
+
+OculusSimplePingResult metadata_of(const std::vector<uint8_t>& ping)
+{
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    return metadata;
+}
+
+void set_gain(std::vector<uint8_t>& ping, unsigned int rangeIndex, uint32_t gain)
+{
+    oculus::PingLayout layout(metadata_of(ping), ping);
+    uint8_t* dst = ping.data() + (layout.row(rangeIndex) - ping.data()) - oculus::PingLayout::GainSize;
+    for(unsigned int i = 0; i < oculus::PingLayout::GainSize; i++)
+        dst[i] = (gain >> (8*i)) & 0xff;
+}
+
+// Raw sample value, read independently from the decoder.
+unsigned int raw_sample(const oculus::PingLayout& layout, unsigned int r, unsigned int b)
+{
+    const uint8_t* row = layout.row(r);
+    if(layout.is_16bit())
+        return row[2*b] | (row[2*b + 1] << 8);
+    return row[b];
+}
+
+TEST(BeamDecoder, NormalizesSamples)
+{
+    oculus::BeamDecoder decoder;
+    for(bool use16Bits : {false, true}) {
+        auto ping = make_ping(use16Bits, false);
+        auto metadata = metadata_of(ping);
+        oculus::PingLayout layout(metadata, ping);
+
+        std::vector<float> output;
+        ASSERT_TRUE(decoder.decode(metadata, ping, output));
+        ASSERT_EQ(output.size(), static_cast<size_t>(layout.n_ranges)*layout.n_beams);
+
+        const float fullScale = use16Bits ? 65535.0f : 255.0f;
+        for(unsigned int r = 0; r < layout.n_ranges; r++) {
+            for(unsigned int b = 0; b < layout.n_beams; b++) {
+                const float value = output[r*layout.n_beams + b];
+                ASSERT_FLOAT_EQ(value, raw_sample(layout, r, b) / fullScale)
+                    << "16 bits " << use16Bits << ", range " << r << ", beam " << b;
+                ASSERT_GE(value, 0.0f);
+                ASSERT_LE(value, 1.0f);
+            }
+        }
+    }
+}
+
+TEST(BeamDecoder, UndoesRangeGains)
+{
+    oculus::BeamDecoder decoder;
+    for(bool use16Bits : {false, true}) {
+        auto ping = make_ping(use16Bits, true);
+        set_gain(ping, 10, 1);
+        set_gain(ping, 11, 4);
+        set_gain(ping, 12, 0); // ignored
+        auto metadata = metadata_of(ping);
+        oculus::PingLayout layout(metadata, ping);
+
+        std::vector<float> output;
+        ASSERT_TRUE(decoder.decode(metadata, ping, output));
+
+        const float fullScale = use16Bits ? 65535.0f : 255.0f;
+        const float gainScale[3] = {1.0f, 0.5f, 1.0f};
+        for(unsigned int r = 10; r < 13; r++) {
+            for(unsigned int b = 0; b < layout.n_beams; b++) {
+                ASSERT_FLOAT_EQ(output[r*layout.n_beams + b],
+                                gainScale[r - 10]*raw_sample(layout, r, b) / fullScale)
+                    << "16 bits " << use16Bits << ", range " << r << ", beam " << b;
+            }
+        }
+    }
+}
+
+TEST(BeamDecoder, DecodesInCallerBuffer)
+{
+    oculus::BeamDecoder decoder;
+    auto ping = make_ping(true, true);
+    auto metadata = metadata_of(ping);
+
+    std::vector<float> expected;
+    ASSERT_TRUE(decoder.decode(metadata, ping, expected));
+    // One guard value past the end, which must be left untouched.
+    std::vector<float> output(expected.size() + 1, -1.0f);
+    ASSERT_TRUE(decoder.decode(metadata, ping, output.data()));
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), output.begin()));
+    EXPECT_EQ(output.back(), -1.0f);
+}
+
+TEST(BeamDecoder, PortableAndAvx2KernelsAgree)
+{
+    oculus::BeamDecoder decoder;
+    for(bool use16Bits : {false, true}) {
+        auto ping = make_ping(use16Bits, true);
+        std::vector<float> portable, avx2;
+        oculus::set_avx2_enabled(false);
+        ASSERT_TRUE(decoder.decode(metadata_of(ping), ping, portable));
+        oculus::set_avx2_enabled(true);
+        ASSERT_TRUE(decoder.decode(metadata_of(ping), ping, avx2));
+        EXPECT_EQ(portable, avx2) << "16 bits " << use16Bits;
+    }
+}
+
+TEST(BeamDecoder, BearingsInRadians)
+{
+    auto ping = make_ping(false, false, 256);
+    std::vector<float> bearings;
+    ASSERT_TRUE(oculus::BeamDecoder::bearings(metadata_of(ping), ping, bearings));
+    ASSERT_EQ(bearings.size(), 256u);
+    // 130° aperture of the synthetic low frequency pings.
+    EXPECT_NEAR(bearings.front(), -65.0*M_PI / 180.0, 1.0e-5);
+    EXPECT_NEAR(bearings.back(),   65.0*M_PI / 180.0, 1.0e-5);
+    for(size_t b = 1; b < bearings.size(); b++)
+        EXPECT_GT(bearings[b], bearings[b - 1]) << "beam " << b;
+}
+
+TEST(BeamDecoder, RejectsMalformedPings)
+{
+    oculus::BeamDecoder decoder;
+    std::vector<float> output;
+
+    auto ping = make_ping(true, true);
+    auto metadata = metadata_of(ping);
+    ping.resize(ping.size() - 1);
+    EXPECT_FALSE(decoder.decode(metadata, ping, output));
+    // The bearings are still there.
+    EXPECT_TRUE(oculus::BeamDecoder::bearings(metadata, ping, output));
+
+    ping.resize(sizeof(OculusSimplePingResult));
+    EXPECT_FALSE(decoder.decode(metadata, ping, output));
+    EXPECT_FALSE(oculus::BeamDecoder::bearings(metadata, ping, output));
+
+    ping = make_ping(false, false);
+    metadata = metadata_of(ping);
+    metadata.nBeams = 1;
+    EXPECT_FALSE(decoder.decode(metadata, ping, output));
+}
+
+} //namespace
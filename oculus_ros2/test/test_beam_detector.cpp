@@ -0,0 +1,283 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "beam_detector.h"
+#include "cpu_features.h"
+#include "mock_sonar.h"
+#include "ping_layout.h"
+
+namespace {
+
+using Detector = oculus::BeamDetector;
+
+OculusSimplePingResult metadata_of(const std::vector<uint8_t>& ping)
+{
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    return metadata;
+}
+
+// Ping with a black image, to be drawn with set_sample. 100 beams : not a
+// multiple of the vector width, 200 ranges over 10m (5cm resolution).
+class BeamDetectorTest : public ::testing::Test
+{
+    protected:
+
+    std::vector<uint8_t> ping_;
+
+    void make_ping(bool use16Bits, bool withGain,
+                   unsigned int nBeams = 100, unsigned int nRanges = 200)
+    {
+        OculusSimpleFireMessage config;
+        std::memset(&config, 0, sizeof(config));
+        config.masterMode = 1;
+        config.flags      = 0x09 | (use16Bits ? 0x02 : 0) | (withGain ? 0x04 : 0);
+        config.range      = 10.0;
+        ping_ = oculus::make_synthetic_ping(config, nBeams, nRanges, 5);
+
+        oculus::PingLayout layout(metadata_of(ping_), ping_);
+        for(unsigned int r = 0; r < nRanges; r++) {
+            this->set_gain(r, 1);
+            std::memset(this->row(r), 0, nBeams*layout.sample_size);
+        }
+    }
+
+    oculus::PingLayout layout() const { return oculus::PingLayout(metadata_of(ping_), ping_); }
+
+    uint8_t* row(unsigned int rangeIndex)
+    {
+        return ping_.data() + (this->layout().row(rangeIndex) - ping_.data());
+    }
+
+    // value in [0,1], before gain.
+    void set_sample(unsigned int rangeIndex, unsigned int beam, float value)
+    {
+        auto layout = this->layout();
+        if(layout.is_16bit()) {
+            uint16_t sample = static_cast<uint16_t>(std::lround(65535.0f*value));
+            std::memcpy(this->row(rangeIndex) + 2*beam, &sample, sizeof(sample));
+        }
+        else {
+            this->row(rangeIndex)[beam] = static_cast<uint8_t>(std::lround(255.0f*value));
+        }
+    }
+
+    void set_gain(unsigned int rangeIndex, uint32_t gain)
+    {
+        if(!this->layout().has_gain)
+            return;
+        std::memcpy(this->row(rangeIndex) - oculus::PingLayout::GainSize, &gain, sizeof(gain));
+    }
+
+    std::vector<Detector::Point> detect(Detector& detector)
+    {
+        auto metadata = metadata_of(ping_);
+        std::vector<Detector::Point> points(detector.max_points(metadata.nBeams));
+        points.resize(detector.detect(metadata, ping_, points.data()));
+        return points;
+    }
+};
+
+float range_of(const Detector::Point& point)
+{
+    return std::sqrt(point.x*point.x + point.y*point.y);
+}
+
+TEST_F(BeamDetectorTest, FirstReturnAndPeak)
+{
+    for(bool use16Bits : {false, true}) {
+        this->make_ping(use16Bits, false);
+        // A weak return before a stronger one, on every other beam.
+        for(unsigned int b = 0; b < 100; b += 2) {
+            this->set_sample(40 + b / 10, b, 0.5f);
+            this->set_sample(120, b, 1.0f);
+        }
+
+        Detector::Options options;
+        options.mode    = Detector::Both;
+        options.refine  = false;
+        options.threads = 1;
+        Detector detector(options);
+        auto points = this->detect(detector);
+        ASSERT_EQ(points.size(), 100u) << "16 bits " << use16Bits;
+
+        for(unsigned int i = 0; i < 50; i++) {
+            const auto& first = points[2*i];
+            const auto& peak  = points[2*i + 1];
+            EXPECT_EQ(first.beam, 2*i);
+            EXPECT_EQ(first.type, Detector::FirstReturnPoint);
+            EXPECT_NEAR(range_of(first), 0.05f*(40 + (2*i) / 10), 1.0e-4);
+            EXPECT_NEAR(first.intensity, 0.5f, 1.0e-2);
+            EXPECT_EQ(peak.beam, 2*i);
+            EXPECT_EQ(peak.type, Detector::PeakPoint);
+            EXPECT_NEAR(range_of(peak), 0.05f*120, 1.0e-4);
+            EXPECT_NEAR(peak.intensity, 1.0f, 1.0e-6);
+            EXPECT_EQ(peak.z, 0.0f);
+        }
+    }
+}
+
+TEST_F(BeamDetectorTest, PointsInTheSonarFrame)
+{
+    this->make_ping(false, false);
+    for(unsigned int b = 0; b < 100; b++)
+        this->set_sample(100, b, 1.0f);
+
+    Detector::Options options;
+    options.refine  = false;
+    options.threads = 1;
+    Detector detector(options);
+    auto points = this->detect(detector);
+    ASSERT_EQ(points.size(), 100u);
+
+    // Bearings go from -65° (port) to 65° (starboard), y points to port.
+    const float angle = 65.0f*M_PI / 180.0f;
+    EXPECT_NEAR(points.front().x, 5.0f*std::cos(angle),  1.0e-3);
+    EXPECT_NEAR(points.front().y, 5.0f*std::sin(angle),  1.0e-3);
+    EXPECT_NEAR(points.back().x,  5.0f*std::cos(angle),  1.0e-3);
+    EXPECT_NEAR(points.back().y,  -5.0f*std::sin(angle), 1.0e-3);
+}
+
+TEST_F(BeamDetectorTest, RefinedRanges)
+{
+    this->make_ping(false, false);
+    // Threshold crossing 60% of the way from row 49 to row 50, symmetric
+    // peak centered on row 80.
+    this->set_sample(49, 0, 0.0f);
+    this->set_sample(50, 0, 0.5f);
+    this->set_sample(79, 0, 0.6f);
+    this->set_sample(80, 0, 1.0f);
+    this->set_sample(81, 0, 0.6f);
+    // Peak shifted towards row 91.
+    this->set_sample(89, 1, 0.4f);
+    this->set_sample(90, 1, 1.0f);
+    this->set_sample(91, 1, 0.8f);
+
+    Detector::Options options;
+    options.mode    = Detector::Both;
+    options.threads = 1;
+    Detector detector(options);
+    auto points = this->detect(detector);
+    ASSERT_EQ(points.size(), 4u);
+    EXPECT_NEAR(range_of(points[0]), 0.05f*(50.0f - 0.3f / 0.5f), 1.0e-3);
+    EXPECT_NEAR(range_of(points[1]), 0.05f*80.0f, 1.0e-4);
+    EXPECT_GT(range_of(points[3]), 0.05f*90.0f);
+    EXPECT_LT(range_of(points[3]), 0.05f*90.5f);
+}
+
+TEST_F(BeamDetectorTest, SkipsNearFieldAndEmptyBeams)
+{
+    this->make_ping(false, false);
+    for(unsigned int b = 0; b < 50; b++) {
+        this->set_sample(10, b, 1.0f);  // 0.5m, ringdown
+        this->set_sample(60, b, 0.5f);
+    }
+
+    Detector::Options options;
+    options.refine    = false;
+    options.min_range = 1.0f;
+    options.threads   = 1;
+    Detector detector(options);
+    auto points = this->detect(detector);
+    ASSERT_EQ(points.size(), 50u);
+    for(const auto& point : points)
+        EXPECT_NEAR(range_of(point), 3.0f, 1.0e-4) << "beam " << point.beam;
+}
+
+TEST_F(BeamDetectorTest, ThresholdOnGainCompensatedSamples)
+{
+    for(bool use16Bits : {false, true}) {
+        this->make_ping(use16Bits, true);
+        // 0.6 with a gain of 4 is 0.3 once compensated, 0.3 with a gain of
+        // 4 is 0.15 : below the default 0.2 threshold.
+        this->set_gain(30, 4);
+        this->set_sample(30, 0, 0.3f);
+        this->set_sample(30, 1, 0.6f);
+
+        Detector::Options options;
+        options.refine  = false;
+        options.threads = 1;
+        Detector detector(options);
+        auto points = this->detect(detector);
+        ASSERT_EQ(points.size(), 1u) << "16 bits " << use16Bits;
+        EXPECT_EQ(points[0].beam, 1);
+        EXPECT_NEAR(points[0].intensity, 0.3f, 1.0e-2);
+    }
+}
+
+TEST_F(BeamDetectorTest, ParallelScanMatchesSerialScan)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09 | 0x02 | 0x04 | 0x40;
+    config.range      = 20.0;
+    ping_ = oculus::make_synthetic_ping(config, 512, 400, 11);
+
+    Detector::Options options;
+    options.mode      = Detector::Both;
+    options.threshold = 0.1f;
+    options.threads   = 1;
+    Detector serial(options);
+    options.threads            = 4;
+    options.parallel_min_beams = 64;
+    Detector parallel(options);
+
+    auto expected = this->detect(serial);
+    ASSERT_GT(expected.size(), 512u);
+    for(int i = 0; i < 20; i++) {
+        auto points = this->detect(parallel);
+        ASSERT_EQ(points.size(), expected.size());
+        EXPECT_EQ(std::memcmp(points.data(), expected.data(),
+                              points.size()*sizeof(Detector::Point)), 0) << "ping " << i;
+    }
+}
+
+TEST_F(BeamDetectorTest, PortableAndAvx2KernelsAgree)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.range      = 20.0;
+    Detector::Options options;
+    options.mode      = Detector::Both;
+    options.threshold = 0.1f;
+    options.threads   = 1;
+    Detector detector(options);
+    for(bool use16Bits : {false, true}) {
+        config.flags = 0x09 | 0x04 | (use16Bits ? 0x02 : 0);
+        ping_ = oculus::make_synthetic_ping(config, 250, 400, 12);
+
+        oculus::set_avx2_enabled(false);
+        auto portable = this->detect(detector);
+        oculus::set_avx2_enabled(true);
+        auto avx2 = this->detect(detector);
+        ASSERT_EQ(avx2.size(), portable.size()) << "16 bits " << use16Bits;
+        EXPECT_EQ(std::memcmp(avx2.data(), portable.data(),
+                              avx2.size()*sizeof(Detector::Point)), 0) << "16 bits " << use16Bits;
+    }
+}
+
+TEST_F(BeamDetectorTest, RejectsMalformedPings)
+{
+    this->make_ping(false, false);
+    this->set_sample(100, 0, 1.0f);
+    Detector::Options options;
+    options.threads = 1;
+    Detector detector(options);
+
+    auto metadata = metadata_of(ping_);
+    std::vector<Detector::Point> points(detector.max_points(metadata.nBeams));
+    ping_.resize(ping_.size() - 1);
+    EXPECT_EQ(detector.detect(metadata, ping_, points.data()), 0u);
+
+    this->make_ping(false, false);
+    metadata = metadata_of(ping_);
+    metadata.rangeResolution = 0.0;
+    EXPECT_EQ(detector.detect(metadata, ping_, points.data()), 0u);
+}
+
+} //namespace
@@ -0,0 +1,134 @@
+#include <chrono>
+
+#include <gtest/gtest.h>
+
+#include "connection_monitor.h"
+
+namespace {
+
+using Monitor = oculus::ConnectionMonitor;
+using Clock   = Monitor::Clock;
+
+// Time is driven by the test : t(1.5) is 1.5s after the monitor start.
+class ConnectionMonitorTest : public ::testing::Test
+{
+    protected:
+
+    Clock::time_point start_ = Clock::now();
+    Monitor::Options  options_;
+    Monitor           monitor_{options_, start_};
+
+    Clock::time_point t(double seconds) const
+    {
+        return start_ + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    // Pings every 0.1s in [from, to[, with an update after each one.
+    void stream(double from, double to, bool pingsExpected = true)
+    {
+        for(double time = from; time < to; time += 0.1) {
+            monitor_.on_ping(t(time));
+            EXPECT_EQ(monitor_.update(t(time), pingsExpected), Monitor::None) << "at " << time << "s";
+        }
+    }
+};
+
+TEST_F(ConnectionMonitorTest, ConfiguresOnceTheSonarIsHeardOf)
+{
+    EXPECT_EQ(monitor_.update(t(0.5), true), Monitor::None);
+    EXPECT_EQ(monitor_.state(), Monitor::Discovering);
+
+    monitor_.on_status(t(1.0));
+    EXPECT_EQ(monitor_.update(t(1.0), true), Monitor::ApplyConfig);
+    EXPECT_EQ(monitor_.state(), Monitor::Configuring);
+
+    // Status messages do not tell the configuration worked.
+    monitor_.on_status(t(1.5));
+    EXPECT_EQ(monitor_.update(t(1.5), true), Monitor::None);
+    EXPECT_EQ(monitor_.state(), Monitor::Configuring);
+
+    monitor_.on_ping(t(1.6));
+    EXPECT_EQ(monitor_.update(t(1.6), true), Monitor::None);
+    EXPECT_EQ(monitor_.state(), Monitor::Streaming);
+    EXPECT_NEAR(monitor_.statistics(t(1.6)).time_to_first_ping, 1.6, 1.0e-6);
+}
+
+TEST_F(ConnectionMonitorTest, LostReconnectedAndReconfigured)
+{
+    monitor_.on_message(t(0.1));
+    EXPECT_EQ(monitor_.update(t(0.1), true), Monitor::ApplyConfig);
+    this->stream(0.2, 3.0);
+    EXPECT_EQ(monitor_.state(), Monitor::Streaming);
+
+    // Stale : no ping since 2.9s, not lost before the 2s timeout.
+    EXPECT_EQ(monitor_.update(t(4.0), true), Monitor::None);
+    EXPECT_EQ(monitor_.state(), Monitor::Streaming);
+    // Status messages do not keep a sonar which should ping alive.
+    monitor_.on_status(t(4.5));
+    EXPECT_EQ(monitor_.update(t(5.0), true), Monitor::None);
+    EXPECT_EQ(monitor_.state(), Monitor::Lost);
+
+    // Reconnection attempts with an exponential backoff.
+    EXPECT_EQ(monitor_.update(t(5.1), true), Monitor::ApplyConfig);
+    EXPECT_EQ(monitor_.state(), Monitor::Reconnecting);
+    EXPECT_EQ(monitor_.update(t(5.3), true), Monitor::None);
+    EXPECT_EQ(monitor_.update(t(5.6), true), Monitor::ApplyConfig); // +0.5s
+    EXPECT_EQ(monitor_.update(t(6.5), true), Monitor::None);
+    EXPECT_EQ(monitor_.update(t(6.6), true), Monitor::ApplyConfig); // +1.0s
+    EXPECT_EQ(monitor_.statistics(t(6.6)).attempts, 3u);
+
+    // Streaming again once the sonar pings.
+    monitor_.on_ping(t(7.0));
+    EXPECT_EQ(monitor_.update(t(7.0), true), Monitor::None);
+    EXPECT_EQ(monitor_.state(), Monitor::Streaming);
+    auto stats = monitor_.statistics(t(7.0));
+    EXPECT_EQ(stats.reconnects, 1u);
+    EXPECT_EQ(stats.attempts, 0u);
+    EXPECT_NEAR(stats.last_reconnect_duration, 7.0 - 2.9, 1.0e-3);
+
+    // A second loss starts the backoff over.
+    EXPECT_EQ(monitor_.update(t(9.5), true), Monitor::None);
+    EXPECT_EQ(monitor_.state(), Monitor::Lost);
+    EXPECT_EQ(monitor_.update(t(9.6), true), Monitor::ApplyConfig);
+    EXPECT_EQ(monitor_.update(t(10.1), true), Monitor::ApplyConfig);
+}
+
+TEST_F(ConnectionMonitorTest, StandbyKeptAliveByStatusMessages)
+{
+    monitor_.on_message(t(0.1));
+    EXPECT_EQ(monitor_.update(t(0.1), true), Monitor::ApplyConfig);
+    this->stream(0.2, 1.0);
+
+    // In standby, without dummy messages : the status broadcasts (every
+    // second or so) are the only messages.
+    for(double time = 1.0; time < 10.0; time += 1.0) {
+        monitor_.on_status(t(time));
+        EXPECT_EQ(monitor_.update(t(time + 0.5), false), Monitor::None) << "at " << time << "s";
+        EXPECT_EQ(monitor_.state(), Monitor::Streaming) << "at " << time << "s";
+    }
+
+    // Lost without any message.
+    EXPECT_EQ(monitor_.update(t(12.0), false), Monitor::None);
+    EXPECT_EQ(monitor_.state(), Monitor::Lost);
+}
+
+TEST_F(ConnectionMonitorTest, PingsGivenTimeToResumeAfterStandby)
+{
+    monitor_.on_message(t(0.1));
+    EXPECT_EQ(monitor_.update(t(0.1), true), Monitor::ApplyConfig);
+    this->stream(0.2, 1.0);
+    for(double time = 1.0; time < 5.0; time += 0.5) {
+        monitor_.on_message(t(time)); // dummy messages
+        EXPECT_EQ(monitor_.update(t(time), false), Monitor::None);
+    }
+
+    // Resumed at 5s : no ping since 0.9s, but the sonar gets timeout seconds
+    // to fire again.
+    EXPECT_EQ(monitor_.update(t(5.0), true), Monitor::None);
+    EXPECT_EQ(monitor_.update(t(6.5), true), Monitor::None);
+    EXPECT_EQ(monitor_.state(), Monitor::Streaming);
+    this->stream(6.8, 8.0);
+    EXPECT_EQ(monitor_.state(), Monitor::Streaming);
+}
+
+} //namespace
@@ -0,0 +1,137 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "log_reader.h"
+#include "mock_sonar.h"
+#include "oculus_log.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<uint8_t> make_ping(uint32_t pingId, unsigned int nRanges)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09 | (pingId % 2 ? 0x02 : 0);
+    config.range      = 10.0;
+    auto ping = oculus::make_synthetic_ping(config, 256, nRanges, pingId);
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    metadata.pingId = pingId;
+    std::memcpy(ping.data(), &metadata, sizeof(metadata));
+    return ping;
+}
+
+class LogReaderTest : public ::testing::Test
+{
+    protected:
+
+    fs::path             directory_;
+    std::vector<uint8_t> data_;
+
+    void SetUp() override
+    {
+        directory_ = fs::temp_directory_path() / ("oculus_log_reader_test_" + std::to_string(getpid()));
+        fs::remove_all(directory_);
+        fs::create_directories(directory_);
+        auto fileHeader = oculus::log::make_file_header(1.6e9);
+        this->append(&fileHeader, sizeof(fileHeader));
+    }
+
+    void TearDown() override
+    {
+        fs::remove_all(directory_);
+    }
+
+    void append(const void* bytes, size_t size)
+    {
+        data_.insert(data_.end(), static_cast<const uint8_t*>(bytes),
+                     static_cast<const uint8_t*>(bytes) + size);
+    }
+
+    std::string write(const std::string& name, size_t truncation = 0)
+    {
+        const auto filename = directory_ / name;
+        std::ofstream file(filename, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data_.data()), data_.size() - truncation);
+        return filename.string();
+    }
+};
+
+TEST_F(LogReaderTest, ReadsItems)
+{
+    std::vector<std::vector<uint8_t>> pings;
+    for(uint32_t i = 0; i < 20; i++) {
+        pings.push_back(make_ping(i, 100 + i));
+        auto itemHeader = oculus::log::make_item_header(1.6e9 + 0.1*i, pings.back().size());
+        this->append(&itemHeader, sizeof(itemHeader));
+        this->append(pings.back().data(), pings.back().size());
+    }
+
+    oculus::LogReader reader(this->write("items.oculus"));
+    ASSERT_EQ(reader.item_count(), pings.size());
+    for(size_t i = 0; i < pings.size(); i++) {
+        const auto& item = reader.item(i);
+        EXPECT_DOUBLE_EQ(item.time, 1.6e9 + 0.1*i);
+        EXPECT_EQ(item.header->compression, oculus::log::NoCompression);
+        ASSERT_EQ(item.size, pings[i].size()) << "item " << i;
+        EXPECT_EQ(std::memcmp(item.data, pings[i].data(), item.size), 0) << "item " << i;
+    }
+}
+
+// bag_to_oculus writes packed 36 bytes item headers announcing 40 bytes in
+// sizeHeader, with payloadSize left to 0.
+TEST_F(LogReaderTest, ReadsBagToOculusHeaders)
+{
+    std::vector<std::vector<uint8_t>> pings;
+    for(uint32_t i = 0; i < 10; i++) {
+        pings.push_back(make_ping(i, 64));
+        auto itemHeader = oculus::log::make_item_header(1.6e9 + i, 0);
+        itemHeader.rawSize = 0;
+        ASSERT_EQ(sizeof(itemHeader), 36u);
+        ASSERT_EQ(itemHeader.sizeHeader, 40u);
+        this->append(&itemHeader, sizeof(itemHeader));
+        this->append(pings.back().data(), pings.back().size());
+    }
+
+    oculus::LogReader reader(this->write("bag_to_oculus.oculus"));
+    ASSERT_EQ(reader.item_count(), pings.size());
+    for(size_t i = 0; i < pings.size(); i++) {
+        const auto& item = reader.item(i);
+        EXPECT_DOUBLE_EQ(item.time, 1.6e9 + i);
+        ASSERT_EQ(item.size, pings[i].size()) << "item " << i;
+        EXPECT_EQ(std::memcmp(item.data, pings[i].data(), item.size), 0) << "item " << i;
+    }
+}
+
+TEST_F(LogReaderTest, KeepsItemsBeforeTruncation)
+{
+    std::vector<uint8_t> ping = make_ping(0, 100);
+    for(int i = 0; i < 3; i++) {
+        auto itemHeader = oculus::log::make_item_header(1.6e9 + i, ping.size());
+        this->append(&itemHeader, sizeof(itemHeader));
+        this->append(ping.data(), ping.size());
+    }
+
+    oculus::LogReader reader(this->write("truncated.oculus", ping.size() / 2));
+    EXPECT_EQ(reader.item_count(), 2u);
+}
+
+TEST_F(LogReaderTest, RejectsOtherFiles)
+{
+    data_.assign(256, 0x42);
+    EXPECT_THROW(oculus::LogReader(this->write("other.bin")), std::runtime_error);
+    EXPECT_THROW(oculus::LogReader((directory_ / "missing.oculus").string()), std::runtime_error);
+}
+
+} //namespace
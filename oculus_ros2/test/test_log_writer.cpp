@@ -0,0 +1,139 @@
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "log_reader.h"
+#include "log_writer.h"
+#include "mock_sonar.h"
+#include "oculus_log.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<uint8_t> make_ping(uint32_t pingId, unsigned int nRanges)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09 | (pingId % 2 ? 0x02 : 0);
+    config.range      = 10.0;
+    auto ping = oculus::make_synthetic_ping(config, 256, nRanges, pingId);
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    metadata.pingId = pingId;
+    std::memcpy(ping.data(), &metadata, sizeof(metadata));
+    return ping;
+}
+
+class LogWriterTest : public ::testing::Test
+{
+    protected:
+
+    fs::path directory_;
+
+    void SetUp() override
+    {
+        directory_ = fs::temp_directory_path() / ("oculus_log_writer_test_" + std::to_string(getpid()));
+        fs::remove_all(directory_);
+        fs::create_directories(directory_);
+    }
+
+    void TearDown() override
+    {
+        fs::remove_all(directory_);
+    }
+};
+
+// Written items are read back by LogReader as pushed.
+TEST_F(LogWriterTest, RoundTrip)
+{
+    std::vector<std::vector<uint8_t>> pings;
+    std::string filename;
+    {
+        oculus::LogWriter::Options options;
+        options.directory = directory_.string();
+        options.prefix    = "round_trip";
+        oculus::LogWriter writer(options);
+        for(uint32_t i = 0; i < 50; i++) {
+            pings.push_back(make_ping(i, 100 + i));
+            ASSERT_TRUE(writer.push(pings.back().data(), pings.back().size(), 1.6e9 + 0.1*i));
+        }
+        writer.stop();
+        filename = writer.current_filename();
+
+        auto stats = writer.statistics();
+        EXPECT_EQ(stats.items_written, pings.size());
+        EXPECT_EQ(stats.items_dropped, 0u);
+        EXPECT_EQ(stats.files_written, 1u);
+    }
+
+    oculus::LogReader reader(filename);
+    ASSERT_EQ(reader.item_count(), pings.size());
+    for(size_t i = 0; i < pings.size(); i++) {
+        const auto& item = reader.item(i);
+        EXPECT_DOUBLE_EQ(item.time, 1.6e9 + 0.1*i);
+        EXPECT_EQ(item.header->compression, oculus::log::NoCompression);
+        ASSERT_EQ(item.size, pings[i].size()) << "item " << i;
+        EXPECT_EQ(std::memcmp(item.data, pings[i].data(), item.size), 0) << "item " << i;
+    }
+}
+
+TEST_F(LogWriterTest, FlushesAfterFlushPeriod)
+{
+    oculus::LogWriter::Options options;
+    options.directory    = directory_.string();
+    options.flush_period = 0.1;
+    oculus::LogWriter writer(options);
+    auto ping = make_ping(0, 100);
+    ASSERT_TRUE(writer.push(ping.data(), ping.size(), 1.6e9));
+    // Far below batch_size, written by time only.
+    for(int i = 0; i < 100 && writer.statistics().items_written == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(writer.statistics().items_written, 1u);
+}
+
+TEST_F(LogWriterTest, CountsItemsWithoutFileAsDropped)
+{
+    oculus::LogWriter::Options options;
+    options.directory = (directory_ / "missing").string();
+    oculus::LogWriter writer(options);
+    auto ping = make_ping(0, 100);
+    for(int i = 0; i < 5; i++) {
+        ASSERT_TRUE(writer.push(ping.data(), ping.size(), 1.6e9 + i));
+    }
+    writer.stop();
+    auto stats = writer.statistics();
+    EXPECT_EQ(stats.items_written, 0u);
+    EXPECT_EQ(stats.items_dropped, 5u);
+    EXPECT_EQ(stats.buffer_used, 0u);
+}
+
+TEST_F(LogWriterTest, FileIsReadableUpToTheLastFlush)
+{
+    oculus::LogWriter::Options options;
+    options.directory    = directory_.string();
+    options.flush_period = 0.05;
+    oculus::LogWriter writer(options);
+    auto ping = make_ping(0, 100);
+    for(int i = 0; i < 3; i++) {
+        ASSERT_TRUE(writer.push(ping.data(), ping.size(), 1.6e9 + i));
+    }
+    for(int i = 0; i < 100 && writer.statistics().items_written < 3; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    // Still recording : what was flushed is a valid log.
+    oculus::LogReader reader(writer.current_filename());
+    EXPECT_EQ(reader.item_count(), 3u);
+    writer.stop();
+}
+
+} //namespace
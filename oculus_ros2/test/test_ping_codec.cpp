@@ -0,0 +1,133 @@
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mock_sonar.h"
+#include "ping_codec.h"
+#include "ping_layout.h"
+
+namespace {
+
+std::vector<uint8_t> make_ping(bool use16Bits, bool withGain,
+                               unsigned int nBeams = 256, unsigned int nRanges = 300)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09 | (use16Bits ? 0x02 : 0) | (withGain ? 0x04 : 0);
+    config.range      = 10.0;
+    return oculus::make_synthetic_ping(config, nBeams, nRanges, 7);
+}
+
+OculusSimplePingResult metadata_of(const std::vector<uint8_t>& ping)
+{
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    return metadata;
+}
+
+// Writable first sample of a range row.
+uint8_t* row_of(std::vector<uint8_t>& ping, unsigned int rangeIndex)
+{
+    oculus::PingLayout layout(metadata_of(ping), ping);
+    return ping.data() + (layout.row(rangeIndex) - ping.data());
+}
+
+std::vector<uint8_t> round_trip(const oculus::PingCodec::Options& options,
+                                const std::vector<uint8_t>& ping)
+{
+    oculus::PingCodec codec(options);
+    std::vector<uint8_t> compressed, restored;
+    EXPECT_TRUE(codec.compress(metadata_of(ping), ping, compressed));
+    EXPECT_EQ(oculus::PingCodec::raw_size(compressed.data(), compressed.size()), ping.size());
+    EXPECT_TRUE(codec.decompress(compressed.data(), compressed.size(), restored));
+    return restored;
+}
+
+TEST(PingCodec, LosslessRoundTrip)
+{
+    for(bool use16Bits : {false, true}) {
+        for(bool withGain : {false, true}) {
+            auto ping = make_ping(use16Bits, withGain);
+            oculus::PingLayout layout(metadata_of(ping), ping);
+            ASSERT_TRUE(layout.is_valid());
+            ASSERT_EQ(layout.is_16bit(), use16Bits);
+            ASSERT_EQ(layout.has_gain, withGain);
+
+            oculus::PingCodec::Options options;
+            EXPECT_EQ(round_trip(options, ping), ping) << "16 bits " << use16Bits << ", gains " << withGain;
+            options.delta = false;
+            EXPECT_EQ(round_trip(options, ping), ping) << "16 bits " << use16Bits << ", gains " << withGain;
+        }
+    }
+}
+
+TEST(PingCodec, DeltaWrapsAround)
+{
+    // Range to range steps of +-255 (8 bits) and +-65535 (16 bits) : the
+    // deltas only fit in a sample when computed modulo 2^bits.
+    for(bool use16Bits : {false, true}) {
+        auto ping = make_ping(use16Bits, true, 64, 32);
+        oculus::PingLayout layout(metadata_of(ping), ping);
+        for(unsigned int r = 0; r < layout.n_ranges; r++) {
+            uint8_t* row = row_of(ping, r);
+            for(unsigned int b = 0; b < layout.n_beams*layout.sample_size; b++) {
+                row[b] = ((r + b / layout.sample_size) % 2) ? 0xff : 0x00;
+            }
+        }
+        EXPECT_EQ(round_trip(oculus::PingCodec::Options(), ping), ping) << "16 bits " << use16Bits;
+    }
+}
+
+TEST(PingCodec, QuantizationBounds)
+{
+    for(bool use16Bits : {false, true}) {
+        const unsigned int bits = use16Bits ? 16 : 8;
+        for(unsigned int quantization : {2u, 4u, 6u}) {
+            auto ping = make_ping(use16Bits, true);
+            oculus::PingCodec::Options options;
+            options.quantization_bits = quantization;
+            auto restored = round_trip(options, ping);
+            ASSERT_EQ(restored.size(), ping.size());
+
+            // Samples are restored at the middle of their quantization
+            // interval, everything else is untouched.
+            oculus::PingLayout layout(metadata_of(ping), ping);
+            const long maxError = 1l << (bits - quantization - 1);
+            const size_t imageEnd = metadata_of(ping).imageOffset
+                                  + static_cast<size_t>(layout.n_ranges)*layout.row_stride;
+            for(size_t i = 0; i < metadata_of(ping).imageOffset; i++) {
+                ASSERT_EQ(restored[i], ping[i]) << "byte " << i;
+            }
+            for(size_t i = imageEnd; i < ping.size(); i++) {
+                ASSERT_EQ(restored[i], ping[i]) << "byte " << i;
+            }
+            for(unsigned int r = 0; r < layout.n_ranges; r++) {
+                const uint8_t* original = layout.row(r);
+                const uint8_t* decoded  = restored.data() + (original - ping.data());
+                EXPECT_EQ(std::memcmp(original - oculus::PingLayout::GainSize,
+                                      decoded - oculus::PingLayout::GainSize,
+                                      oculus::PingLayout::GainSize), 0) << "gain of range " << r;
+                for(unsigned int b = 0; b < layout.n_beams; b++) {
+                    long a = use16Bits ? original[2*b] | (original[2*b + 1] << 8) : original[b];
+                    long d = use16Bits ? decoded[2*b]  | (decoded[2*b + 1]  << 8) : decoded[b];
+                    ASSERT_LE(std::labs(a - d), maxError)
+                        << bits << " bits, " << quantization << " bits kept, range "
+                        << r << ", beam " << b;
+                }
+            }
+        }
+    }
+}
+
+TEST(PingCodec, RejectsInvalidBuffers)
+{
+    oculus::PingCodec codec;
+    std::vector<uint8_t> garbage(64, 0x5a), restored;
+    EXPECT_EQ(oculus::PingCodec::raw_size(garbage.data(), garbage.size()), 0u);
+    EXPECT_FALSE(codec.decompress(garbage.data(), garbage.size(), restored));
+}
+
+} //namespace
@@ -0,0 +1,151 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "cpu_features.h"
+#include "mock_sonar.h"
+#include "ping_layout.h"
+#include "scan_converter.h"
+
+namespace {
+
+std::vector<uint8_t> make_ping(bool use16Bits, uint32_t seed = 1,
+                               unsigned int nBeams = 256, unsigned int nRanges = 300)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09 | (use16Bits ? 0x02 : 0);
+    config.range      = 10.0;
+    return oculus::make_synthetic_ping(config, nBeams, nRanges, seed);
+}
+
+OculusSimplePingResult metadata_of(const std::vector<uint8_t>& ping)
+{
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    return metadata;
+}
+
+void set_metadata(std::vector<uint8_t>& ping, const OculusSimplePingResult& metadata)
+{
+    std::memcpy(ping.data(), &metadata, sizeof(metadata));
+}
+
+void set_bearing(std::vector<uint8_t>& ping, unsigned int beam, int16_t bearing)
+{
+    std::memcpy(ping.data() + sizeof(OculusSimplePingResult) + beam*sizeof(int16_t),
+                &bearing, sizeof(bearing));
+}
+
+TEST(ScanConverter, FanGeometry)
+{
+    for(bool use16Bits : {false, true}) {
+        // Uniform image : every pixel of the fan has the same value.
+        auto ping = make_ping(use16Bits);
+        auto metadata = metadata_of(ping);
+        oculus::PingLayout layout(metadata, ping);
+        std::memset(ping.data() + metadata.imageOffset, 0x80,
+                    static_cast<size_t>(layout.n_ranges)*layout.row_stride);
+        const unsigned int value = use16Bits ? 0x8080 : 0x80;
+
+        oculus::ScanConverter converter(201);
+        std::vector<uint8_t> output;
+        ASSERT_TRUE(converter.convert(metadata, ping, output));
+        const unsigned int width = converter.width(), height = converter.height();
+        ASSERT_EQ(output.size(), static_cast<size_t>(width)*height*layout.sample_size);
+        auto pixel = [&](unsigned int u, unsigned int v) -> unsigned int {
+            size_t index = static_cast<size_t>(v)*width + u;
+            if(use16Bits)
+                return output[2*index] | (output[2*index + 1] << 8);
+            return output[index];
+        };
+
+        // 130° fan : the apex is at the bottom center, the fan is as wide as
+        // 2.sin(65°) ranges.
+        EXPECT_NEAR(static_cast<double>(width - 1) / (height - 1), 2.0*std::sin(65.0*M_PI / 180.0), 0.02);
+        EXPECT_EQ(pixel(width / 2, height - 2), value);       // next to the apex
+        EXPECT_EQ(pixel(width / 2, 1),          value);       // max range, straight ahead
+        EXPECT_EQ(pixel(width / 2, height / 2), value);
+        EXPECT_EQ(pixel(0, 0),                  0u);          // out of range
+        EXPECT_EQ(pixel(width - 1, 0),          0u);
+        EXPECT_EQ(pixel(0, height - 1),         0u);          // out of the aperture
+        EXPECT_EQ(pixel(width - 1, height - 1), 0u);
+    }
+}
+
+TEST(ScanConverter, PortableAndAvx2KernelsAgree)
+{
+    for(bool use16Bits : {false, true}) {
+        auto ping = make_ping(use16Bits, 4, 512, 400);
+        auto metadata = metadata_of(ping);
+        // Width not a multiple of the vector length.
+        oculus::ScanConverter converter(397);
+        std::vector<uint8_t> portable, avx2;
+        oculus::set_avx2_enabled(false);
+        EXPECT_FALSE(oculus::has_avx2());
+        ASSERT_TRUE(converter.convert(metadata, ping, portable));
+        oculus::set_avx2_enabled(true);
+        ASSERT_TRUE(converter.convert(metadata, ping, avx2));
+        EXPECT_EQ(portable, avx2) << "16 bits " << use16Bits;
+    }
+}
+
+TEST(ScanConverter, LutRebuiltOnGeometryChangesOnly)
+{
+    oculus::ScanConverter converter(256);
+    std::vector<uint8_t> output;
+
+    auto ping = make_ping(false);
+    ASSERT_TRUE(converter.convert(metadata_of(ping), ping, output));
+    EXPECT_EQ(converter.lut_builds(), 1u);
+    const unsigned int height = converter.height();
+
+    // New samples, same geometry.
+    auto next = make_ping(false, 2);
+    ASSERT_TRUE(converter.convert(metadata_of(next), next, output));
+    EXPECT_EQ(converter.lut_builds(), 1u);
+
+    // Same range and number of ranges, but another range resolution (the
+    // sonar may not use the whole window).
+    auto metadata = metadata_of(ping);
+    metadata.rangeResolution *= 0.5;
+    set_metadata(ping, metadata);
+    ASSERT_TRUE(converter.convert(metadata, ping, output));
+    EXPECT_EQ(converter.lut_builds(), 2u);
+    EXPECT_EQ(converter.height(), height);
+    ASSERT_TRUE(converter.convert(metadata, ping, output));
+    EXPECT_EQ(converter.lut_builds(), 2u);
+
+    // Another bearing table, the rest of the key being the same.
+    set_bearing(ping, 128, 12);
+    ASSERT_TRUE(converter.convert(metadata, ping, output));
+    EXPECT_EQ(converter.lut_builds(), 3u);
+    ASSERT_TRUE(converter.convert(metadata, ping, output));
+    EXPECT_EQ(converter.lut_builds(), 3u);
+
+    converter.set_width(300);
+    ASSERT_TRUE(converter.convert(metadata, ping, output));
+    EXPECT_EQ(converter.lut_builds(), 4u);
+    EXPECT_EQ(output.size(), static_cast<size_t>(converter.width())*converter.height());
+
+    converter.invalidate();
+    ASSERT_TRUE(converter.convert(metadata, ping, output));
+    EXPECT_EQ(converter.lut_builds(), 5u);
+}
+
+TEST(ScanConverter, BearingsHash)
+{
+    auto ping = make_ping(false);
+    auto bearings = reinterpret_cast<const int16_t*>(ping.data() + sizeof(OculusSimplePingResult));
+    const uint64_t hash = oculus::ScanConverter::hash_bearings(bearings, 256);
+    EXPECT_EQ(oculus::ScanConverter::hash_bearings(bearings, 256), hash);
+    EXPECT_NE(oculus::ScanConverter::hash_bearings(bearings, 255), hash);
+
+    set_bearing(ping, 0, -6499);
+    EXPECT_NE(oculus::ScanConverter::hash_bearings(bearings, 256), hash);
+}
+
+} //namespace
@@ -0,0 +1,207 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "mock_sonar.h"
+#include "shm_ping_writer.h"
+#include "oculus_ros2/shm_ping_ring.h"
+
+namespace {
+
+using Reader = oculus::shm::PingRingReader;
+
+std::vector<uint8_t> make_ping(uint32_t pingId, unsigned int nRanges = 100)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09;
+    config.range      = 10.0;
+    auto ping = oculus::make_synthetic_ping(config, 256, nRanges, pingId);
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    metadata.pingId = pingId;
+    std::memcpy(ping.data(), &metadata, sizeof(metadata));
+    return ping;
+}
+
+OculusSimplePingResult metadata_of(const std::vector<uint8_t>& ping)
+{
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    return metadata;
+}
+
+class ShmPingRingTest : public ::testing::Test
+{
+    protected:
+
+    oculus::ShmPingWriter::Options options_;
+
+    void SetUp() override
+    {
+        options_.name           = "/oculus_shm_ping_ring_test_" + std::to_string(getpid());
+        options_.slots          = 4;
+        options_.slot_data_size = 256*1024;
+    }
+
+    void push(oculus::ShmPingWriter& writer, const std::vector<uint8_t>& ping, int64_t stamp)
+    {
+        EXPECT_TRUE(writer.push(metadata_of(ping), ping, stamp));
+    }
+};
+
+TEST_F(ShmPingRingTest, ReadsPushedPings)
+{
+    oculus::ShmPingWriter writer(options_);
+    push(writer, make_ping(0), 0); // before the reader creation, not read
+
+    Reader reader(options_.name);
+    EXPECT_EQ(reader.slot_count(), 4u);
+    EXPECT_EQ(reader.data_capacity(), options_.slot_data_size);
+
+    std::vector<std::vector<uint8_t>> pings;
+    for(uint32_t i = 1; i < 4; i++) {
+        pings.push_back(make_ping(i, 100 + i));
+        push(writer, pings.back(), 1000*i);
+    }
+    EXPECT_EQ(writer.pushed(), 4u);
+
+    oculus::shm::Ping ping;
+    for(uint32_t i = 1; i < 4; i++) {
+        ASSERT_TRUE(reader.try_read(ping)) << "ping " << i;
+        EXPECT_EQ(ping.index, i);
+        EXPECT_EQ(ping.stamp, 1000*i);
+        EXPECT_GT(ping.publish_time, 0);
+        EXPECT_EQ(ping.metadata.pingId, i);
+        EXPECT_EQ(ping.data, pings[i - 1]);
+    }
+    EXPECT_FALSE(reader.try_read(ping));
+    EXPECT_EQ(reader.missed(), 0u);
+}
+
+TEST_F(ShmPingRingTest, SkipsAheadWhenLate)
+{
+    oculus::ShmPingWriter writer(options_);
+    Reader reader(options_.name);
+    for(uint32_t i = 0; i < 10; i++)
+        push(writer, make_ping(i), i);
+
+    // The slot of the next ping may be being written : only slots - 1 pings
+    // are left.
+    oculus::shm::Ping ping;
+    for(uint32_t i = 7; i < 10; i++) {
+        ASSERT_TRUE(reader.try_read(ping));
+        EXPECT_EQ(ping.metadata.pingId, i);
+    }
+    EXPECT_FALSE(reader.try_read(ping));
+    EXPECT_EQ(reader.missed(), 7u);
+}
+
+TEST_F(ShmPingRingTest, DropsOversizedPings)
+{
+    options_.slot_data_size = 64*1024;
+    oculus::ShmPingWriter writer(options_);
+    Reader reader(options_.name);
+
+    auto ping = make_ping(0, 400);
+    ASSERT_GT(ping.size(), options_.slot_data_size);
+    EXPECT_FALSE(writer.push(metadata_of(ping), ping, 0));
+    EXPECT_EQ(writer.oversized(), 1u);
+    EXPECT_EQ(writer.pushed(), 0u);
+
+    oculus::shm::Ping read;
+    EXPECT_FALSE(reader.try_read(read));
+}
+
+TEST_F(ShmPingRingTest, WaitsForTheNextPing)
+{
+    oculus::ShmPingWriter writer(options_);
+    Reader reader(options_.name);
+    EXPECT_FALSE(writer.readers_active(std::chrono::seconds(1)));
+
+    oculus::shm::Ping ping;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(reader.read(ping, std::chrono::milliseconds(50)));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+    EXPECT_TRUE(writer.readers_active(std::chrono::seconds(1)));
+
+    auto sent = make_ping(42);
+    std::thread pusher([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        push(writer, sent, 42);
+    });
+    EXPECT_TRUE(reader.read(ping, std::chrono::seconds(5)));
+    pusher.join();
+    EXPECT_EQ(ping.data, sent);
+}
+
+// Every ping read must be consistent, even when the writer goes round the
+// ring during the copy.
+TEST_F(ShmPingRingTest, ConsistentUnderConcurrentWrites)
+{
+    oculus::ShmPingWriter writer(options_);
+    Reader reader(options_.name);
+
+    constexpr uint32_t Count = 5000;
+    std::atomic<bool> done(false);
+    std::thread pusher([&]() {
+        std::vector<uint8_t> data(8192);
+        OculusSimplePingResult metadata;
+        std::memset(&metadata, 0, sizeof(metadata));
+        for(uint32_t i = 0; i < Count; i++) {
+            metadata.pingId = i;
+            std::fill(data.begin(), data.end(), static_cast<uint8_t>(i));
+            writer.push(metadata, data, i);
+        }
+        done = true;
+    });
+
+    uint64_t read = 0;
+    uint64_t lastIndex = 0;
+    oculus::shm::Ping ping;
+    auto check = [&]() {
+        if(read > 0) {
+            EXPECT_GT(ping.index, lastIndex);
+        }
+        lastIndex = ping.index;
+        read++;
+        EXPECT_EQ(ping.metadata.pingId, ping.index);
+        EXPECT_EQ(ping.stamp, static_cast<int64_t>(ping.index));
+        ASSERT_EQ(ping.data.size(), 8192u);
+        for(uint8_t value : ping.data)
+            ASSERT_EQ(value, static_cast<uint8_t>(ping.index)) << "ping " << ping.index;
+    };
+    while(!done) {
+        if(reader.read(ping, std::chrono::milliseconds(10)))
+            check();
+    }
+    pusher.join();
+    while(reader.try_read(ping))
+        check();
+    EXPECT_EQ(read + reader.missed(), Count);
+}
+
+TEST_F(ShmPingRingTest, ReaderNeedsAWriter)
+{
+    EXPECT_THROW(Reader reader(options_.name), std::runtime_error);
+    {
+        oculus::ShmPingWriter writer(options_);
+        EXPECT_NO_THROW(Reader reader(options_.name));
+    }
+    // Removed with the writer.
+    EXPECT_THROW(Reader reader(options_.name), std::runtime_error);
+
+    options_.slots = 1;
+    EXPECT_THROW(oculus::ShmPingWriter writer(options_), std::runtime_error);
+}
+
+} //namespace
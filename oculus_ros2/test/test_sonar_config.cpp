@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "sonar_config.h"
+
+namespace {
+
+using Tracker = oculus::SonarConfigTracker;
+
+OculusSimpleFireMessage make_config(double range, bool use512Beams = false)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode      = 1;
+    config.pingRate        = pingRateNormal;
+    config.flags           = 0x09 | (use512Beams ? 0x40 : 0);
+    config.range           = range;
+    config.gainPercent     = 50.0;
+    config.gammaCorrection = 127;
+    return config;
+}
+
+void wait(double seconds)
+{
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+TEST(SonarConfig, MismatchesAreNamedAfterTheParameters)
+{
+    auto requested = make_config(20.0, true);
+    auto applied   = make_config(10.0, false);
+    applied.pingRate = pingRateStandby; // not echoed reliably, never reported
+
+    auto mismatches = oculus::config_mismatches(requested, applied);
+    ASSERT_EQ(mismatches.size(), 2u);
+    EXPECT_EQ(mismatches[0].name,      "nbeams");
+    EXPECT_EQ(mismatches[0].requested, "1");
+    EXPECT_EQ(mismatches[0].applied,   "0");
+    EXPECT_EQ(mismatches[1].name,      "range");
+    EXPECT_EQ(mismatches[1].requested, "20");
+    EXPECT_EQ(mismatches[1].applied,   "10");
+
+    EXPECT_TRUE(oculus::config_mismatches(requested, requested).empty());
+}
+
+TEST(SonarConfig, ChangesAreMergedUntilFlush)
+{
+    Tracker tracker;
+    tracker.request(make_config(5.0), false);
+    EXPECT_EQ(tracker.current().range, 5.0);
+    tracker.request(make_config(10.0));
+    tracker.request(make_config(15.0));
+
+    unsigned int changes = 0;
+    auto sent = tracker.flush(0, changes);
+    EXPECT_EQ(changes, 2u);
+    EXPECT_EQ(sent.range, 15.0);
+    EXPECT_TRUE(tracker.awaiting_feedback());
+
+    // current() is the sent configuration, not the pending one.
+    tracker.request(make_config(20.0));
+    EXPECT_EQ(tracker.current().range, 15.0);
+    EXPECT_EQ(tracker.statistics().configs_sent, 1u);
+}
+
+TEST(SonarConfig, AppliedOnMatchingPing)
+{
+    Tracker tracker;
+    tracker.request(make_config(10.0));
+    unsigned int changes = 0;
+    tracker.flush(3, changes);
+
+    double elapsed = -1.0;
+    EXPECT_EQ(tracker.check(make_config(5.0), 4, elapsed), Tracker::Waiting);
+    EXPECT_EQ(tracker.check(make_config(10.0), 7, elapsed), Tracker::Applied);
+    EXPECT_GE(elapsed, 0.0);
+    EXPECT_FALSE(tracker.awaiting_feedback());
+    EXPECT_EQ(tracker.check(make_config(5.0), 7, elapsed), Tracker::None);
+
+    auto stats = tracker.statistics();
+    EXPECT_EQ(stats.missing_pings, 4u);
+    EXPECT_TRUE(stats.mismatches.empty());
+    EXPECT_FALSE(stats.no_feedback);
+}
+
+TEST(SonarConfig, NotAppliedAfterTimeoutWithLastPingMismatches)
+{
+    Tracker tracker(0.05);
+    tracker.request(make_config(10.0, true));
+    unsigned int changes = 0;
+    tracker.flush(0, changes);
+
+    double elapsed = 0.0;
+    EXPECT_EQ(tracker.check(make_config(5.0, true), 0, elapsed), Tracker::Waiting);
+    EXPECT_EQ(tracker.check_timeout(elapsed), Tracker::Waiting);
+    wait(0.1);
+    // Concluded by the timer, without any new ping.
+    EXPECT_EQ(tracker.check_timeout(elapsed), Tracker::NotApplied);
+    EXPECT_GT(elapsed, 0.05);
+    EXPECT_FALSE(tracker.awaiting_feedback());
+
+    auto stats = tracker.statistics();
+    EXPECT_FALSE(stats.no_feedback);
+    EXPECT_EQ(stats.mismatches, "range");
+    ASSERT_EQ(stats.mismatch_details.size(), 1u);
+    EXPECT_EQ(stats.mismatch_details[0].requested, "10");
+    EXPECT_EQ(stats.mismatch_details[0].applied,   "5");
+
+    // A new configuration clears the conclusion once applied.
+    tracker.request(make_config(5.0, true));
+    tracker.flush(0, changes);
+    EXPECT_EQ(tracker.check(make_config(5.0, true), 0, elapsed), Tracker::Applied);
+    EXPECT_TRUE(tracker.statistics().mismatches.empty());
+}
+
+TEST(SonarConfig, NoFeedbackWithoutPing)
+{
+    Tracker tracker(0.05);
+    tracker.request(make_config(10.0));
+    unsigned int changes = 0;
+    tracker.flush(0, changes);
+
+    double elapsed = 0.0;
+    wait(0.1);
+    EXPECT_EQ(tracker.check_timeout(elapsed), Tracker::NotApplied);
+    auto stats = tracker.statistics();
+    EXPECT_TRUE(stats.no_feedback);
+    EXPECT_TRUE(stats.mismatch_details.empty());
+}
+
+TEST(SonarConfig, RestartFeedbackGivesANewTimeout)
+{
+    Tracker tracker(0.2);
+    tracker.request(make_config(10.0));
+    unsigned int changes = 0;
+    tracker.flush(0, changes);
+
+    // Sent in standby, the sonar pings again 0.15s later.
+    wait(0.15);
+    tracker.restart_feedback();
+    wait(0.1);
+    double elapsed = 0.0;
+    EXPECT_EQ(tracker.check_timeout(elapsed), Tracker::Waiting);
+    EXPECT_EQ(tracker.check(make_config(10.0), 0, elapsed), Tracker::Applied);
+}
+
+} //namespace
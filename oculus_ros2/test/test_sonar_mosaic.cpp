@@ -0,0 +1,235 @@
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "mock_sonar.h"
+#include "ping_layout.h"
+#include "sonar_mosaic.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Mosaic = oculus::SonarMosaic;
+using CellKey = std::pair<int64_t, int64_t>; // global cell indexes along x and y
+
+OculusSimplePingResult metadata_of(const std::vector<uint8_t>& ping)
+{
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    return metadata;
+}
+
+// 130° fan of 20m (200 ranges of 10cm) with the same sample everywhere.
+std::vector<uint8_t> make_ping(uint8_t value = 128)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09;
+    config.range      = 20.0;
+    auto ping = oculus::make_synthetic_ping(config, 256, 200, 0);
+    oculus::PingLayout layout(metadata_of(ping), ping);
+    std::memset(ping.data() + metadata_of(ping).imageOffset, value,
+                static_cast<size_t>(layout.n_ranges)*layout.row_stride);
+    return ping;
+}
+
+Mosaic::Options mosaic_options(unsigned int threads = 1)
+{
+    Mosaic::Options options;
+    options.resolution = 0.1f;
+    options.tile_size  = 32;
+    options.min_range  = 1.0f;
+    options.threads    = threads;
+    return options;
+}
+
+Mosaic::Pose yawed(double x, double y, double yaw)
+{
+    return Mosaic::Pose::from_quaternion(x, y, 0.0, 0.0, 0.0, std::sin(0.5*yaw), std::cos(0.5*yaw));
+}
+
+// Updated cells, taken from the dirty tiles.
+std::map<CellKey, Mosaic::Cell> take_cells(Mosaic& mosaic)
+{
+    std::map<CellKey, Mosaic::Cell> cells;
+    const int64_t size = mosaic.options().tile_size;
+    mosaic.take_dirty([&](const Mosaic::Tile& tile) {
+        for(int64_t cy = 0; cy < size; cy++) {
+            for(int64_t cx = 0; cx < size; cx++) {
+                const auto& cell = tile.cells[cy*size + cx];
+                if(cell.weight > 0.0f)
+                    cells[{tile.x*size + cx, tile.y*size + cy}] = cell;
+            }
+        }
+    });
+    return cells;
+}
+
+// Cell of a point of the map frame.
+CellKey cell_at(double x, double y, double resolution = 0.1)
+{
+    return {static_cast<int64_t>(std::floor(x / resolution)),
+            static_cast<int64_t>(std::floor(y / resolution))};
+}
+
+TEST(SonarMosaic, ProjectsTheFanAtTheSonarPose)
+{
+    Mosaic mosaic(mosaic_options());
+    auto ping = make_ping();
+    // Sonar at (100, 50) looking along y.
+    const size_t updated = mosaic.integrate(metadata_of(ping), ping, yawed(100.0, 50.0, 0.5*M_PI), 1.0);
+    auto cells = take_cells(mosaic);
+    ASSERT_GT(updated, 0u);
+    EXPECT_EQ(cells.size(), updated);
+
+    for(const auto& entry : cells) {
+        EXPECT_EQ(entry.second.weight, 1.0f);
+        EXPECT_NEAR(entry.second.sum, 128.0f / 255.0f, 1.0e-5);
+        // Cell centers are within the fan.
+        double x = (entry.first.first  + 0.5)*0.1 - 100.0;
+        double y = (entry.first.second + 0.5)*0.1 - 50.0;
+        double range = std::sqrt(x*x + y*y);
+        EXPECT_GE(range, 1.0);
+        EXPECT_LE(range, 19.9 + 1.0e-3);
+        EXPECT_LE(std::abs(std::atan2(-x, y)), 65.0*M_PI / 180.0 + 1.0e-3);
+    }
+
+    EXPECT_EQ(cells.count(cell_at(100.05, 60.05)), 1u); // 10m ahead
+    EXPECT_EQ(cells.count(cell_at(92.05, 55.05)),  1u); // to port
+    EXPECT_EQ(cells.count(cell_at(100.05, 50.55)), 0u); // near field
+    EXPECT_EQ(cells.count(cell_at(100.05, 40.05)), 0u); // behind
+    EXPECT_EQ(cells.count(cell_at(110.05, 50.05)), 0u); // out of the aperture
+    EXPECT_EQ(cells.count(cell_at(100.05, 71.05)), 0u); // out of range
+
+    // About the area of the fan section.
+    const double area = (130.0 / 360.0)*M_PI*(19.9*19.9 - 1.0);
+    EXPECT_NEAR(updated*0.01, area, 0.02*area);
+
+    auto stats = mosaic.statistics();
+    EXPECT_EQ(stats.pings, 1u);
+    EXPECT_EQ(stats.last_cells, updated);
+}
+
+TEST(SonarMosaic, AveragesOverlappingPings)
+{
+    Mosaic mosaic(mosaic_options());
+    auto dark   = make_ping(51);
+    auto bright = make_ping(153);
+    mosaic.integrate(metadata_of(dark), dark, yawed(0.0, 0.0, 0.0), 1.0);
+    auto first = take_cells(mosaic);
+    EXPECT_TRUE(take_cells(mosaic).empty()); // handed out once
+
+    mosaic.integrate(metadata_of(bright), bright, yawed(0.0, 0.0, 0.0), 2.0);
+    auto cells = take_cells(mosaic);
+    ASSERT_EQ(cells.size(), first.size());
+    for(const auto& entry : cells) {
+        EXPECT_EQ(entry.second.weight, 2.0f);
+        EXPECT_NEAR(entry.second.sum / entry.second.weight, 0.4f, 1.0e-5);
+    }
+}
+
+TEST(SonarMosaic, ParallelProjectionMatchesSerialProjection)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09 | 0x04;
+    config.range      = 20.0;
+    auto ping = oculus::make_synthetic_ping(config, 256, 200, 3);
+
+    Mosaic serial(mosaic_options(1));
+    Mosaic parallel(mosaic_options(4));
+    for(int i = 0; i < 5; i++) {
+        auto pose = yawed(0.3*i, -0.2*i, 0.1*i);
+        EXPECT_EQ(serial.integrate(metadata_of(ping), ping, pose, i),
+                  parallel.integrate(metadata_of(ping), ping, pose, i));
+    }
+    auto expected = take_cells(serial);
+    auto cells    = take_cells(parallel);
+    ASSERT_EQ(cells.size(), expected.size());
+    for(const auto& entry : expected) {
+        const auto& cell = cells[entry.first];
+        EXPECT_EQ(cell.sum,    entry.second.sum);
+        EXPECT_EQ(cell.weight, entry.second.weight);
+    }
+}
+
+TEST(SonarMosaic, EvictsAndReloadsTiles)
+{
+    const fs::path directory = fs::temp_directory_path() / ("oculus_mosaic_test_" + std::to_string(getpid()));
+    fs::remove_all(directory);
+
+    auto options = mosaic_options();
+    options.max_tiles = 4;
+    options.directory = directory.string();
+    auto ping = make_ping();
+    size_t savedTiles = 0;
+    {
+        Mosaic mosaic(options);
+        mosaic.integrate(metadata_of(ping), ping, yawed(0.0, 0.0, 0.0), 1.0);
+        // Dirty tiles are kept until handed out.
+        EXPECT_EQ(mosaic.statistics().evictions, 0u);
+        take_cells(mosaic);
+
+        // Far away, the first fan tiles are evicted to the directory.
+        mosaic.integrate(metadata_of(ping), ping, yawed(1000.0, 0.0, 0.0), 2.0);
+        take_cells(mosaic);
+        auto stats = mosaic.statistics();
+        EXPECT_GT(stats.evictions, 0u);
+        EXPECT_EQ(stats.stored_tiles, stats.evictions);
+
+        // Back over the first fan : the evicted tiles are read back.
+        mosaic.integrate(metadata_of(ping), ping, yawed(0.0, 0.0, 0.0), 3.0);
+        for(const auto& entry : take_cells(mosaic))
+            EXPECT_EQ(entry.second.weight, 2.0f);
+        EXPECT_GT(mosaic.statistics().loads, 0u);
+        savedTiles = mosaic.save();
+    }
+
+    // A new mosaic resumes the survey from the directory.
+    {
+        Mosaic mosaic(options);
+        EXPECT_GE(mosaic.statistics().stored_tiles, savedTiles);
+        EXPECT_EQ(mosaic.statistics().resident_tiles, 0u);
+        mosaic.integrate(metadata_of(ping), ping, yawed(1000.0, 0.0, 0.0), 4.0);
+        for(const auto& entry : take_cells(mosaic))
+            EXPECT_EQ(entry.second.weight, 2.0f);
+    }
+
+    // Tiles of another mosaic are not mixed in.
+    options.resolution = 0.2f;
+    EXPECT_THROW(Mosaic mosaic(options), std::runtime_error);
+    fs::remove_all(directory);
+}
+
+TEST(SonarMosaic, RejectsMalformedPingsAndEdgeOnPoses)
+{
+    Mosaic mosaic(mosaic_options());
+    auto ping = make_ping();
+    auto metadata = metadata_of(ping);
+
+    // Sonar pitched 90° : its image plane is seen edge-on.
+    auto pitched = Mosaic::Pose::from_quaternion(0.0, 0.0, 0.0, 0.0, std::sin(M_PI / 4), 0.0, std::cos(M_PI / 4));
+    EXPECT_EQ(mosaic.integrate(metadata, ping, pitched, 1.0), 0u);
+
+    auto truncated = ping;
+    truncated.resize(truncated.size() - 1);
+    EXPECT_EQ(mosaic.integrate(metadata, truncated, Mosaic::Pose(), 1.0), 0u);
+
+    auto stats = mosaic.statistics();
+    EXPECT_EQ(stats.rejected, 2u);
+    EXPECT_EQ(stats.pings, 0u);
+    EXPECT_EQ(stats.resident_tiles, 0u);
+}
+
+} //namespace
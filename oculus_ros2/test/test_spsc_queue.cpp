@@ -0,0 +1,140 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "sonar_pipeline.h"
+#include "spsc_queue.h"
+
+namespace {
+
+using Queue  = oculus::SpscSlotQueue<int>;
+using Policy = Queue::OverflowPolicy;
+
+void push_value(Queue& queue, int value)
+{
+    int* slot = queue.acquire();
+    ASSERT_NE(slot, nullptr);
+    *slot = value;
+    queue.push(slot);
+}
+
+std::vector<int> drain(Queue& queue)
+{
+    std::vector<int> values;
+    while(int* slot = queue.pop()) {
+        values.push_back(*slot);
+        queue.release(slot);
+    }
+    return values;
+}
+
+TEST(SpscSlotQueue, DropOldestKeepsTheNewest)
+{
+    Queue queue(3, Policy::DropOldest);
+    for(int i = 0; i < 5; i++) {
+        push_value(queue, i);
+    }
+    EXPECT_EQ(queue.size(), 3u);
+    EXPECT_EQ(queue.pushed(), 5u);
+    EXPECT_EQ(queue.dropped(), 2u);
+    EXPECT_EQ(drain(queue), (std::vector<int>{2, 3, 4}));
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(SpscSlotQueue, DropNewestKeepsTheOldest)
+{
+    Queue queue(3, Policy::DropNewest);
+    for(int i = 0; i < 3; i++) {
+        push_value(queue, i);
+    }
+    EXPECT_EQ(queue.acquire(), nullptr);
+    EXPECT_EQ(queue.acquire(), nullptr);
+    EXPECT_EQ(queue.pushed(), 3u);
+    EXPECT_EQ(queue.dropped(), 2u);
+    EXPECT_EQ(drain(queue), (std::vector<int>{0, 1, 2}));
+
+    // Room again once drained.
+    push_value(queue, 3);
+    EXPECT_EQ(drain(queue), (std::vector<int>{3}));
+    EXPECT_EQ(queue.dropped(), 2u);
+}
+
+TEST(SpscSlotQueue, DropOldestWhileTheConsumerHoldsASlot)
+{
+    Queue queue(2, Policy::DropOldest);
+    push_value(queue, 0);
+    push_value(queue, 1);
+    int* held = queue.pop();
+    ASSERT_NE(held, nullptr);
+    EXPECT_EQ(*held, 0);
+    for(int i = 2; i < 6; i++) {
+        push_value(queue, i);
+    }
+    EXPECT_EQ(*held, 0); // never handed back to the producer
+    queue.release(held);
+    EXPECT_EQ(queue.dropped(), 3u);
+    EXPECT_EQ(drain(queue), (std::vector<int>{4, 5}));
+}
+
+TEST(SpscSlotQueue, ConcurrentValuesStayOrdered)
+{
+    for(auto policy : {Policy::DropOldest, Policy::DropNewest}) {
+        Queue queue(4, policy);
+        constexpr int Count = 100000;
+        std::atomic<bool> done(false);
+        std::vector<int> received;
+        std::thread consumer([&]() {
+            while(true) {
+                bool finished = done;
+                while(int* slot = queue.pop()) {
+                    received.push_back(*slot);
+                    queue.release(slot);
+                }
+                if(finished)
+                    break;
+                std::this_thread::yield();
+            }
+        });
+        for(int i = 0; i < Count; i++) {
+            if(int* slot = queue.acquire()) {
+                *slot = i;
+                queue.push(slot);
+            }
+        }
+        done = true;
+        consumer.join();
+
+        EXPECT_EQ(received.size() + queue.dropped(), static_cast<size_t>(Count));
+        for(size_t i = 1; i < received.size(); i++) {
+            ASSERT_LT(received[i - 1], received[i]);
+        }
+    }
+}
+
+// The consumer may swap the ping buffer out of the slot (handed over to the
+// published message) : the slot is filled again with whatever it got back.
+TEST(SonarPipeline, SlotDataCanBeTakenByTheConsumer)
+{
+    oculus::SonarPipeline pipeline(2, oculus::SonarPipeline::PingQueue::OverflowPolicy::DropOldest);
+    OculusSimplePingResult metadata;
+    std::memset(&metadata, 0, sizeof(metadata));
+
+    std::vector<uint8_t> taken;
+    for(uint8_t i = 0; i < 4; i++) {
+        metadata.pingId = i;
+        std::vector<uint8_t> data(100 + i, i);
+        ASSERT_TRUE(pipeline.push_ping(metadata, data, std::chrono::system_clock::now()));
+        ASSERT_TRUE(pipeline.pop_ping([&](oculus::PingSlot& ping) {
+            EXPECT_EQ(ping.data, data);
+            ping.data.swap(taken);
+        }));
+        EXPECT_EQ(taken, data);
+    }
+    EXPECT_TRUE(pipeline.empty());
+}
+
+} //namespace
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "cpu_features.h"
+#include "mock_sonar.h"
+#include "ping_layout.h"
+#include "temporal_filter.h"
+
+namespace {
+
+using Filter = oculus::TemporalFilter;
+
+// 250 beams : not a multiple of the vector width.
+std::vector<uint8_t> make_ping(bool use16Bits, bool withGain, uint32_t seed,
+                               double range = 10.0, unsigned int nBeams = 250)
+{
+    OculusSimpleFireMessage config;
+    std::memset(&config, 0, sizeof(config));
+    config.masterMode = 1;
+    config.flags      = 0x09 | (use16Bits ? 0x02 : 0) | (withGain ? 0x04 : 0);
+    config.range      = range;
+    return oculus::make_synthetic_ping(config, nBeams, 100, seed);
+}
+
+OculusSimplePingResult metadata_of(const std::vector<uint8_t>& ping)
+{
+    OculusSimplePingResult metadata;
+    std::memcpy(&metadata, ping.data(), sizeof(metadata));
+    return metadata;
+}
+
+unsigned int sample(const std::vector<uint8_t>& ping, unsigned int r, unsigned int b)
+{
+    oculus::PingLayout layout(metadata_of(ping), ping);
+    const uint8_t* row = layout.row(r);
+    if(layout.is_16bit())
+        return row[2*b] | (row[2*b + 1] << 8);
+    return row[b];
+}
+
+std::vector<uint8_t> filter(Filter& filter, const std::vector<uint8_t>& ping)
+{
+    std::vector<uint8_t> output;
+    EXPECT_TRUE(filter.filter(metadata_of(ping), ping, output));
+    return output;
+}
+
+// Checks every sample of output against reference(samples of the pings, newest
+// last, for this position).
+template <typename Reference>
+void expect_filtered(const std::vector<uint8_t>& output,
+                     const std::vector<std::vector<uint8_t>>& pings,
+                     Reference reference)
+{
+    oculus::PingLayout layout(metadata_of(output), output);
+    std::vector<unsigned int> values(pings.size());
+    for(unsigned int r = 0; r < layout.n_ranges; r++) {
+        for(unsigned int b = 0; b < layout.n_beams; b++) {
+            for(size_t k = 0; k < pings.size(); k++)
+                values[k] = sample(pings[k], r, b);
+            ASSERT_EQ(sample(output, r, b), reference(values)) << "range " << r << ", beam " << b;
+        }
+    }
+}
+
+TEST(TemporalFilter, Median)
+{
+    for(bool use16Bits : {false, true}) {
+        Filter::Options options;
+        options.mode   = Filter::Median;
+        options.frames = 5;
+        Filter medianFilter(options);
+
+        std::vector<std::vector<uint8_t>> pings;
+        for(uint32_t i = 0; i < 8; i++) {
+            pings.push_back(make_ping(use16Bits, false, i));
+            if(pings.size() > 5)
+                pings.erase(pings.begin());
+            auto output = filter(medianFilter, pings.back());
+            EXPECT_EQ(medianFilter.frame_count(), pings.size());
+            // Upper median for even counts.
+            expect_filtered(output, pings, [](std::vector<unsigned int> values) {
+                std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+                return values[values.size() / 2];
+            });
+        }
+        EXPECT_EQ(medianFilter.resets(), 1u);
+    }
+}
+
+TEST(TemporalFilter, Min)
+{
+    for(bool use16Bits : {false, true}) {
+        Filter::Options options;
+        options.mode   = Filter::Min;
+        options.frames = 3;
+        Filter minFilter(options);
+
+        std::vector<std::vector<uint8_t>> pings;
+        for(uint32_t i = 0; i < 6; i++) {
+            pings.push_back(make_ping(use16Bits, false, i));
+            if(pings.size() > 3)
+                pings.erase(pings.begin());
+            auto output = filter(minFilter, pings.back());
+            expect_filtered(output, pings, [](const std::vector<unsigned int>& values) {
+                return *std::min_element(values.begin(), values.end());
+            });
+        }
+    }
+}
+
+TEST(TemporalFilter, Ema)
+{
+    for(bool use16Bits : {false, true}) {
+        Filter::Options options;
+        options.mode  = Filter::Ema;
+        options.alpha = 0.25f;
+        Filter emaFilter(options);
+
+        const unsigned int nBeams = 250, nRanges = 100;
+        std::vector<float> average;
+        for(uint32_t i = 0; i < 6; i++) {
+            auto ping   = make_ping(use16Bits, false, i);
+            auto output = filter(emaFilter, ping);
+            average.resize(nBeams*nRanges);
+            for(unsigned int r = 0; r < nRanges; r++) {
+                for(unsigned int b = 0; b < nBeams; b++) {
+                    float& value = average[r*nBeams + b];
+                    float alpha = i == 0 ? 1.0f : 0.25f;
+                    value += alpha*(sample(ping, r, b) - value);
+                    // Rounding may differ between the vectorized and scalar paths.
+                    ASSERT_LE(std::abs(static_cast<int>(sample(output, r, b)) - std::lround(value)), 1)
+                        << "ping " << i << ", range " << r << ", beam " << b;
+                }
+            }
+        }
+    }
+}
+
+TEST(TemporalFilter, PortableAndAvx2KernelsAgree)
+{
+    for(auto mode : {Filter::Median, Filter::Min}) {
+        for(bool use16Bits : {false, true}) {
+            Filter::Options options;
+            options.mode = mode;
+            Filter portableFilter(options), avx2Filter(options);
+            for(uint32_t i = 0; i < 6; i++) {
+                auto ping = make_ping(use16Bits, true, i);
+                oculus::set_avx2_enabled(false);
+                auto portable = filter(portableFilter, ping);
+                oculus::set_avx2_enabled(true);
+                EXPECT_EQ(filter(avx2Filter, ping), portable)
+                    << "mode " << mode << ", 16 bits " << use16Bits << ", ping " << i;
+            }
+        }
+    }
+}
+
+TEST(TemporalFilter, KeepsNewestHeaderAndGains)
+{
+    Filter::Options options;
+    options.mode = Filter::Median;
+    Filter medianFilter(options);
+
+    filter(medianFilter, make_ping(true, true, 0));
+    auto ping   = make_ping(true, true, 1);
+    auto output = filter(medianFilter, ping);
+    ASSERT_EQ(output.size(), ping.size());
+
+    oculus::PingLayout layout(metadata_of(ping), ping);
+    const size_t imageOffset = metadata_of(ping).imageOffset;
+    EXPECT_EQ(std::memcmp(output.data(), ping.data(), imageOffset), 0);
+    for(unsigned int r = 0; r < layout.n_ranges; r++) {
+        const size_t gainOffset = imageOffset + r*layout.row_stride;
+        EXPECT_EQ(std::memcmp(output.data() + gainOffset, ping.data() + gainOffset,
+                              oculus::PingLayout::GainSize), 0) << "range " << r;
+    }
+}
+
+TEST(TemporalFilter, RestartsOnGeometryChangeAndInvalidate)
+{
+    Filter::Options options;
+    options.mode = Filter::Min;
+    Filter minFilter(options);
+
+    filter(minFilter, make_ping(false, false, 0));
+    filter(minFilter, make_ping(false, false, 1));
+    EXPECT_EQ(minFilter.frame_count(), 2u);
+    EXPECT_EQ(minFilter.resets(), 1u);
+
+    // New range : the output is the new ping only.
+    auto ping = make_ping(false, false, 2, 20.0);
+    EXPECT_EQ(filter(minFilter, ping), ping);
+    EXPECT_EQ(minFilter.frame_count(), 1u);
+    EXPECT_EQ(minFilter.resets(), 2u);
+
+    ping = make_ping(true, false, 3, 20.0);
+    EXPECT_EQ(filter(minFilter, ping), ping);
+    EXPECT_EQ(minFilter.resets(), 3u);
+
+    minFilter.invalidate();
+    ping = make_ping(true, false, 4, 20.0);
+    EXPECT_EQ(filter(minFilter, ping), ping);
+    EXPECT_EQ(minFilter.resets(), 4u);
+    filter(minFilter, make_ping(true, false, 5, 20.0));
+    EXPECT_EQ(minFilter.frame_count(), 2u);
+}
+
+TEST(TemporalFilter, RejectsMalformedPings)
+{
+    Filter filter;
+    auto ping = make_ping(false, true, 0);
+    auto metadata = metadata_of(ping);
+    ping.resize(ping.size() - 1);
+    std::vector<uint8_t> output;
+    EXPECT_FALSE(filter.filter(metadata, ping, output));
+    EXPECT_EQ(filter.frame_count(), 0u);
+}
+
+} //namespace